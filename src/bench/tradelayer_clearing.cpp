@@ -0,0 +1,81 @@
+// Copyright (c) 2015-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <tradelayer/clearing.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+using namespace mastercore;
+
+// Matches random trades between the given number of addresses, with the
+// statuses the contract DEx records for the positions of both sides.
+static void SimulateTrades(CClearingGraph& graph, size_t nTrades, size_t nAddresses)
+{
+    FastRandomContext rand(true);
+    std::vector<std::string> addresses;
+    for (size_t n = 0; n < nAddresses; ++n) {
+        addresses.push_back("QWNbvhNuhuBMrqm4nLe4sCw1Tz" + std::to_string(100000000 + n));
+    }
+    std::vector<int64_t> positions(nAddresses, 0);
+
+    while (graph.Size() < nTrades) {
+        const size_t maker = rand.randrange(nAddresses);
+        const size_t taker = rand.randrange(nAddresses);
+        if (maker == taker) continue;
+
+        const int64_t amount = 1 + rand.randrange(10);
+        const int64_t takerDelta = rand.randbool() ? amount : -amount;
+        const int64_t price = 100 * CLEARING_PRICE_SCALE + rand.randrange(CLEARING_PRICE_SCALE);
+
+        std::string statuses[2];
+        const size_t sides[2] = {maker, taker};
+        const int64_t deltas[2] = {-takerDelta, takerDelta};
+        for (int n = 0; n < 2; ++n) {
+            const int64_t before = positions[sides[n]];
+            const int64_t after = before + deltas[n];
+            const std::string dir = (before > 0) ? "Long" : "Short";
+            if (before == 0) {
+                statuses[n] = (after > 0) ? "OpenLongPosition" : "OpenShortPosition";
+            } else if ((before > 0) == (deltas[n] > 0)) {
+                statuses[n] = dir + "PosIncreased";
+            } else if (after == 0) {
+                statuses[n] = dir + "PosNetted";
+            } else if ((after > 0) == (before > 0)) {
+                statuses[n] = dir + "PosNettedPartly";
+            } else {
+                statuses[n] = (after > 0) ? "OpenLongPosByShortPosNetted" : "OpenShortPosByLongPosNetted";
+            }
+            positions[sides[n]] = after;
+        }
+
+        graph.AddTrade(addresses[maker], statuses[0], llabs(positions[maker]),
+                addresses[taker], statuses[1], llabs(positions[taker]), amount, price);
+    }
+}
+
+// Settles the trades of a period with the given number of matches.
+static void ClearingSettle(benchmark::State& state, size_t nTrades)
+{
+    CClearingGraph graph;
+    SimulateTrades(graph, nTrades, 1000);
+
+    CClearingResult result;
+    while (state.KeepRunning()) {
+        SettleFifo(graph, result);
+    }
+}
+
+static void ClearingSettle10000(benchmark::State& state) { ClearingSettle(state, 10000); }
+static void ClearingSettle100000(benchmark::State& state) { ClearingSettle(state, 100000); }
+static void ClearingSettle1000000(benchmark::State& state) { ClearingSettle(state, 1000000); }
+
+BENCHMARK(ClearingSettle10000, 150);
+BENCHMARK(ClearingSettle100000, 10);
+BENCHMARK(ClearingSettle1000000, 1);
@@ -0,0 +1,72 @@
+// Copyright (c) 2016-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <tradelayer/tradelayer.h>
+
+#include <primitives/block.h>
+#include <streams.h>
+#include <util/strencodings.h>
+#include <version.h>
+
+#include <assert.h>
+#include <string>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+using namespace mastercore;
+
+// Scans the 3808 transactions of the Litecoin block 878439 for Trade Layer
+// transactions. The block contains none of them, so all transactions must be
+// rejected, and this is the cost of rejecting non- Trade Layer transactions.
+
+static CBlock LoadBlock()
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    return block;
+}
+
+static void TLEncodingClassBlock(benchmark::State& state)
+{
+    const CBlock block = LoadBlock();
+
+    while (state.KeepRunning()) {
+        size_t nRejected = 0;
+        for (const auto& tx : block.vtx) {
+            if (GetEncodingClass(*tx, 0) == NO_MARKER) ++nRejected;
+        }
+        assert(nRejected == block.vtx.size());
+    }
+}
+
+// The former pre-filter, which hex-encoded each output script, for comparison.
+static void TLEncodingClassBlockHexScan(benchmark::State& state)
+{
+    const CBlock block = LoadBlock();
+
+    while (state.KeepRunning()) {
+        size_t nRejected = 0;
+        for (const auto& tx : block.vtx) {
+            bool examineClosely = false;
+            for (const auto& output : tx->vout) {
+                std::string strSPB = HexStr(output.scriptPubKey.begin(), output.scriptPubKey.end());
+                if (strSPB.find("7070") != std::string::npos) {
+                    examineClosely = true;
+                    break;
+                }
+            }
+            if (!examineClosely) ++nRejected;
+        }
+        assert(nRejected <= block.vtx.size());
+    }
+}
+
+BENCHMARK(TLEncodingClassBlock, 100);
+BENCHMARK(TLEncodingClassBlockHexScan, 100);
@@ -0,0 +1,72 @@
+// Copyright (c) 2015-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <tradelayer/mdex.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <string>
+
+using namespace mastercore;
+
+static const std::string ORDER_ADDRESS = "QWNbvhNuhuBMrqm4nLe4sCw1Tz5XbrVdDD";
+
+static CMPMetaDEx MakeMetaDExOrder(int64_t level, unsigned int idx)
+{
+    return CMPMetaDEx(ORDER_ADDRESS, 1, 3, 100000, 4, 100000 + level, uint256(), idx, 1);
+}
+
+static CMPContractDex MakeContractDexOrder(int64_t level, unsigned int idx)
+{
+    return CMPContractDex(ORDER_ADDRESS, 1, 5, 100, 0, 0, uint256(), idx, 0, 10000 + level, 1, 0);
+}
+
+// Inserts and removes a single order into a book of the given depth, each
+// resting order on its own price level.
+static void MetaDExInsert(benchmark::State& state, int64_t nDepth)
+{
+    metadex.clear();
+    metadex_index.Clear();
+    for (int64_t n = 0; n < nDepth; ++n) {
+        MetaDEx_INSERT(MakeMetaDExOrder(n, n));
+    }
+
+    const CMPMetaDEx order = MakeMetaDExOrder(nDepth / 2, nDepth + 1);
+    while (state.KeepRunning()) {
+        MetaDEx_INSERT(order);
+        MetaDEx_ERASE(order);
+    }
+
+    metadex.clear();
+    metadex_index.Clear();
+}
+
+static void ContractDexInsert(benchmark::State& state, int64_t nDepth)
+{
+    contractdex.clear();
+    contractdex_index.Clear();
+    for (int64_t n = 0; n < nDepth; ++n) {
+        ContractDex_INSERT(MakeContractDexOrder(n, n));
+    }
+
+    const CMPContractDex order = MakeContractDexOrder(nDepth / 2, nDepth + 1);
+    while (state.KeepRunning()) {
+        ContractDex_INSERT(order);
+        ContractDex_ERASE(order);
+    }
+
+    contractdex.clear();
+    contractdex_index.Clear();
+}
+
+static void MetaDExInsertDepth100(benchmark::State& state) { MetaDExInsert(state, 100); }
+static void MetaDExInsertDepth10000(benchmark::State& state) { MetaDExInsert(state, 10000); }
+static void ContractDexInsertDepth100(benchmark::State& state) { ContractDexInsert(state, 100); }
+static void ContractDexInsertDepth10000(benchmark::State& state) { ContractDexInsert(state, 10000); }
+
+BENCHMARK(MetaDExInsertDepth100, 200 * 1000);
+BENCHMARK(MetaDExInsertDepth10000, 200 * 1000);
+BENCHMARK(ContractDexInsertDepth100, 200 * 1000);
+BENCHMARK(ContractDexInsertDepth10000, 200 * 1000);
@@ -331,6 +331,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "tl_senddexaccept", 2, "arg2" },
     { "tl_senddexaccept", 4, "arg4" },
     { "tl_getmarketprice", 0, "arg0" },
+    { "tl_gettradejournal", 0, "arg0" },
+    { "tl_gettradejournal", 1, "arg1" },
     {"tl_getaverage_entry",1,"arg1" },
     { "tl_getcache", 0, "arg0" }, // NOTE: only to test persistence
     { "tl_get_channelreserve", 1, "arg1" },
@@ -0,0 +1,609 @@
+#include <tradelayer/clearing.h>
+
+#include <tradelayer/log.h>
+
+#include <util/strencodings.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace mastercore;
+
+namespace
+{
+//! Largest fixed-point price, which still converts exactly into a double
+const int64_t MAX_CLEARING_PRICE = int64_t(1) << 53;
+
+/** Lists of values by key, stored as compressed rows.
+ *
+ * The values are counted per key first, then pushed in the same order, so
+ * the values of each key keep the order they were pushed in.
+ */
+class CKeyedLists
+{
+private:
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> values;
+
+public:
+    explicit CKeyedLists(size_t nKeys) : offsets(nKeys + 1, 0) {}
+
+    void Count(uint32_t key) { ++offsets[key + 1]; }
+
+    void Allocate()
+    {
+        for (size_t n = 1; n < offsets.size(); ++n) offsets[n] += offsets[n - 1];
+        values.resize(offsets.back());
+    }
+
+    //! Must be called in the same order as Count(), moves the offsets one key ahead
+    void Push(uint32_t key, uint32_t value) { values[offsets[key]++] = value; }
+
+    //! Restores the offsets after all values were pushed
+    void Finish()
+    {
+        for (size_t n = offsets.size() - 1; n > 0; --n) offsets[n] = offsets[n - 1];
+        offsets[0] = 0;
+    }
+
+    const uint32_t* Begin(uint32_t key) const { return values.data() + offsets[key]; }
+    const uint32_t* End(uint32_t key) const { return values.data() + offsets[key + 1]; }
+    const uint32_t* Data() const { return values.data(); }
+    size_t Size() const { return values.size(); }
+};
+
+/** Returns the first position from the given one on, which wasn't skipped yet. */
+size_t FindUnskipped(std::vector<uint32_t>& next, size_t pos)
+{
+    while (next[pos] != pos) {
+        next[pos] = next[next[pos]];
+        pos = next[pos];
+    }
+    return pos;
+}
+
+/** The side of a trade an address is on, the taker side if it isn't the maker. */
+int GetSide(const CClearingTrade& trade, uint32_t address)
+{
+    return (trade.address[0] == address) ? 0 : 1;
+}
+
+/** Follows an opened or increased position through the later trades netting it.
+ *
+ * Netting trades without contracts left are skipped for good, as their lives
+ * only ever decrease.
+ */
+void ClearPosition(const CClearingGraph& graph, const CKeyedLists& netting, std::vector<uint32_t>& nextNetting, std::vector<int64_t>& nlives,
+        uint32_t row, int side, int idxLongShort, uint32_t path, std::vector<CClearingEdge>& edges)
+{
+    const std::vector<CClearingTrade>& trades = graph.GetTrades();
+    const CClearingTrade& opening = trades[row];
+    const uint32_t address = opening.address[side];
+    const int64_t opened = nlives[2 * row + side];
+    int64_t amountSum = 0;
+
+    const uint32_t key = 2 * address + idxLongShort;
+    const size_t end = netting.End(key) - netting.Data();
+    const size_t start = std::upper_bound(netting.Begin(key), netting.End(key), row) - netting.Data();
+    for (size_t pos = FindUnskipped(nextNetting, start); pos < end; pos = FindUnskipped(nextNetting, pos + 1)) {
+        const uint32_t nettingRow = netting.Data()[pos];
+        const CClearingTrade& trade = trades[nettingRow];
+        const int trk = GetSide(trade, address);
+        int64_t& live = nlives[2 * nettingRow + trk];
+        if (live == 0) {
+            nextNetting[pos] = pos + 1;
+            continue;
+        }
+
+        const int64_t nettedLives = live;
+        amountSum += nettedLives;
+        const int64_t d = opened - amountSum;
+
+        CClearingEdge edge;
+        edge.addressSrc = trade.address[1 - trk];
+        edge.addressTrk = trade.address[trk];
+        edge.statusSrc = trade.status[1 - trk];
+        edge.statusTrk = trade.status[trk];
+        edge.livesSrc = trade.lives[1 - trk];
+        edge.entryPrice = opening.price;
+        edge.exitPrice = trade.price;
+        edge.row = nettingRow;
+        edge.path = path;
+
+        if (d > 0) {
+            live = 0;
+            nextNetting[pos] = pos + 1;
+            edge.livesTrk = d;
+            edge.amount = nettedLives;
+            edges.push_back(edge);
+            continue;
+        }
+
+        edge.livesTrk = 0;
+        if (d < 0) {
+            live = -d;
+            edge.amount = nettedLives + d;
+        } else {
+            live = 0;
+            nextNetting[pos] = pos + 1;
+            edge.amount = nettedLives;
+        }
+        edges.push_back(edge);
+        break;
+    }
+}
+
+void PushLives(const CClearingGraph& graph, uint32_t address, uint32_t status, int64_t lives, const CClearingEdge& edge, CClearingResult& result)
+{
+    CClearingLives entry;
+    entry.address = address;
+    entry.status = status;
+    entry.lives = lives;
+    entry.entryPrice = edge.entryPrice;
+    entry.row = edge.row;
+    entry.path = edge.path;
+
+    if (graph.GetStatusFlags(status) & CLEARING_LONG) {
+        result.livesLongs.push_back(entry);
+    } else {
+        result.livesShorts.push_back(entry);
+    }
+}
+
+/** Adds the lives of every increase of a position since it was opened, latest first. */
+void PushIncreasedLives(const CClearingGraph& graph, uint32_t address, uint32_t lastRow, const uint32_t* begin, const uint32_t* end, CClearingResult& result)
+{
+    for (const uint32_t* it = end; it != begin; ) {
+        const CClearingEdge& edge = result.edges[*--it];
+        if (edge.row > lastRow) continue;
+
+        const bool fSrc = (edge.addressSrc == address);
+        const uint32_t status = fSrc ? edge.statusSrc : edge.statusTrk;
+        PushLives(graph, address, status, edge.amount, edge, result);
+        if (graph.GetStatusFlags(status) & CLEARING_OPEN) break;
+    }
+}
+
+/** Lists the addresses of the paths in the order they appear.
+ *
+ * Like the string based algorithm, an address is left out, if it's part of
+ * an address already listed.
+ */
+std::vector<uint32_t> ListAddresses(const CClearingGraph& graph, const std::vector<CClearingEdge>& edges)
+{
+    std::vector<uint32_t> listed;
+    std::vector<bool> seen(graph.CountAddresses(), false);
+    std::map<size_t, std::vector<uint32_t> > listedByLength;
+
+    for (const CClearingEdge& edge : edges) {
+        const uint32_t addresses[2] = {edge.addressSrc, edge.addressTrk};
+        for (uint32_t address : addresses) {
+            if (seen[address]) continue;
+            seen[address] = true;
+
+            // only longer addresses can contain a different one
+            const std::string& str = graph.GetAddress(address);
+            bool fContained = false;
+            for (auto it = listedByLength.upper_bound(str.size()); it != listedByLength.end() && !fContained; ++it) {
+                for (uint32_t other : it->second) {
+                    if (graph.GetAddress(other).find(str) != std::string::npos) {
+                        fContained = true;
+                        break;
+                    }
+                }
+            }
+            if (fContained) continue;
+
+            listed.push_back(address);
+            listedByLength[str.size()].push_back(address);
+        }
+    }
+
+    return listed;
+}
+
+/** Sums the lives of a path, weighted with their prices, by the direction of the positions. */
+void GetGammas(const CClearingGraph& graph, const CClearingEdge* begin, const CClearingEdge* end, double& gammaP, double& gammaQ)
+{
+    const std::vector<CClearingTrade>& trades = graph.GetTrades();
+    int64_t sumAlphaBetaI = 0;
+    int64_t sumAlphaI = 0;
+    int64_t sumAlphaBetaJ = 0;
+    int64_t sumAlphaJ = 0;
+
+    for (const CClearingEdge* edge = begin; edge != end; ++edge) {
+        const CClearingTrade& trade = trades[edge->row];
+        if (edge->livesSrc != 0) {
+            const uint32_t status = trade.status[GetSide(trade, edge->addressSrc)];
+            if (graph.GetStatusFlags(status) & CLEARING_LONG) {
+                sumAlphaBetaI += edge->livesSrc * ClearingPriceToDouble(edge->exitPrice);
+                sumAlphaI += edge->livesSrc;
+            } else {
+                sumAlphaBetaJ += edge->livesSrc * ClearingPriceToDouble(edge->exitPrice);
+                sumAlphaJ += edge->livesSrc;
+            }
+        }
+        if (edge->livesTrk != 0) {
+            const uint32_t status = trade.status[GetSide(trade, edge->addressTrk)];
+            if (graph.GetStatusFlags(status) & CLEARING_LONG) {
+                sumAlphaBetaI += edge->livesTrk * ClearingPriceToDouble(edge->entryPrice);
+                sumAlphaI += edge->livesTrk;
+            } else {
+                sumAlphaBetaJ += edge->livesTrk * ClearingPriceToDouble(edge->entryPrice);
+                sumAlphaJ += edge->livesTrk;
+            }
+        }
+    }
+
+    // the PNL of the tracked addresses doesn't enter yet, the string based
+    // algorithm collects no addresses to compute it for
+    const double pnlTotal = 0;
+    gammaP = pnlTotal - sumAlphaBetaI + sumAlphaBetaJ;
+    gammaQ = sumAlphaJ - sumAlphaI;
+}
+
+void ComputeGhostEdges(CClearingResult& result)
+{
+    std::vector<int64_t> livesShorts;
+    livesShorts.reserve(result.livesShorts.size());
+    for (const CClearingLives& entry : result.livesShorts) livesShorts.push_back(entry.lives);
+
+    size_t indexStart = 0;
+    for (const CClearingLives& entryLong : result.livesLongs) {
+        int64_t amountLongs = entryLong.lives;
+
+        for (size_t j = indexStart; j < livesShorts.size(); ++j) {
+            const CClearingLives& entryShort = result.livesShorts[j];
+            const int64_t amountShorts = livesShorts[j];
+
+            CClearingGhost ghost;
+            ghost.addressLong = entryLong.address;
+            ghost.addressShort = entryShort.address;
+            ghost.statusLong = entryLong.status;
+            ghost.statusShort = entryShort.status;
+            ghost.entryPriceLong = entryLong.entryPrice;
+            ghost.entryPriceShort = entryShort.entryPrice;
+
+            if (amountLongs > amountShorts) {
+                amountLongs -= amountShorts;
+                ghost.amount = amountLongs;
+                result.ghosts.push_back(ghost);
+                continue;
+            }
+
+            if (amountLongs < amountShorts) {
+                indexStart = j;
+                livesShorts[j] = amountShorts - amountLongs;
+            } else {
+                indexStart = j + 1;
+            }
+            ghost.amount = amountLongs;
+            result.ghosts.push_back(ghost);
+            break;
+        }
+    }
+}
+} // anonymous namespace
+
+bool mastercore::ParseClearingPrice(const std::string& str, int64_t& price)
+{
+    size_t pos = 0;
+    bool fNegative = false;
+    if (pos < str.size() && str[pos] == '-') {
+        fNegative = true;
+        ++pos;
+    }
+
+    int64_t units = 0;
+    const size_t posUnits = pos;
+    for (; pos < str.size() && str[pos] >= '0' && str[pos] <= '9'; ++pos) {
+        units = units * 10 + (str[pos] - '0');
+        if (units > MAX_CLEARING_PRICE / CLEARING_PRICE_SCALE) return false;
+    }
+    if (pos == posUnits) return false;
+
+    int64_t fraction = 0;
+    if (pos < str.size() && str[pos] == '.') {
+        int64_t scale = CLEARING_PRICE_SCALE;
+        for (++pos; pos < str.size() && str[pos] >= '0' && str[pos] <= '9'; ++pos) {
+            if (scale == 1) return false;
+            scale /= 10;
+            fraction += (str[pos] - '0') * scale;
+        }
+    }
+    if (pos != str.size()) return false;
+
+    const int64_t value = units * CLEARING_PRICE_SCALE + fraction;
+    if (value > MAX_CLEARING_PRICE) return false;
+
+    price = fNegative ? -value : value;
+    return true;
+}
+
+double mastercore::ClearingPriceToDouble(int64_t price)
+{
+    return static_cast<double>(price) / CLEARING_PRICE_SCALE;
+}
+
+bool mastercore::ClearingPriceFromDouble(double value, int64_t& price)
+{
+    const double scaled = std::round(value * CLEARING_PRICE_SCALE);
+    if (!std::isfinite(scaled) || std::fabs(scaled) > static_cast<double>(MAX_CLEARING_PRICE)) return false;
+
+    price = static_cast<int64_t>(scaled);
+    return true;
+}
+
+uint32_t CClearingStrings::Intern(const std::string& str)
+{
+    auto it = ids.find(str);
+    if (it != ids.end()) return it->second;
+
+    const uint32_t id = strings.size();
+    strings.push_back(str);
+    ids.emplace(str, id);
+    return id;
+}
+
+void CClearingStrings::Clear()
+{
+    strings.clear();
+    ids.clear();
+}
+
+size_t CClearingStrings::DynamicMemoryUsage() const
+{
+    // each string is held twice, once as key of a hash node
+    size_t usage = strings.capacity() * sizeof(std::string) + ids.bucket_count() * sizeof(void*);
+    usage += ids.size() * (sizeof(void*) + sizeof(std::pair<const std::string, uint32_t>));
+    for (const std::string& str : strings) {
+        if (str.capacity() >= sizeof(std::string)) usage += 2 * (str.capacity() + 1);
+    }
+    return usage;
+}
+
+uint32_t CClearingGraph::InternStatus(const std::string& status)
+{
+    const uint32_t id = statuses.Intern(status);
+    if (id < statusFlags.size()) return id;
+
+    uint8_t flags = 0;
+    if (status.find("Long") != std::string::npos) flags |= CLEARING_LONG;
+    if (status.find("Open") != std::string::npos) flags |= CLEARING_OPEN;
+    if (status.find("Increased") != std::string::npos) flags |= CLEARING_INCREASED;
+    if (status.find("NettedPartly") != std::string::npos) flags |= CLEARING_NETTED_PARTLY;
+    if (status == "OpenLongPosition" || status == "LongPosIncreased") flags |= CLEARING_OPEN_INCR_LONG;
+    if (status == "OpenShortPosition" || status == "ShortPosIncreased") flags |= CLEARING_OPEN_INCR_SHORT;
+    if (status == "LongPosNetted" || status == "LongPosNettedPartly") flags |= CLEARING_NETTED_LONG;
+    if (status == "ShortPosNetted" || status == "ShortPosNettedPartly") flags |= CLEARING_NETTED_SHORT;
+    statusFlags.push_back(flags);
+
+    return id;
+}
+
+void CClearingGraph::AddTrade(const std::string& addressSrc, const std::string& statusSrc, int64_t livesSrc,
+        const std::string& addressTrk, const std::string& statusTrk, int64_t livesTrk, int64_t amount, int64_t price)
+{
+    CClearingTrade trade;
+    trade.address[0] = addresses.Intern(addressSrc);
+    trade.address[1] = addresses.Intern(addressTrk);
+    trade.status[0] = InternStatus(statusSrc);
+    trade.status[1] = InternStatus(statusTrk);
+    trade.lives[0] = livesSrc;
+    trade.lives[1] = livesTrk;
+    trade.amount = amount;
+    trade.price = price;
+    trades.push_back(trade);
+}
+
+bool CClearingGraph::AddTrade(const std::map<std::string, std::string>& edge)
+{
+    static const char* const fields[] = {"addrs_src", "status_src", "lives_src", "addrs_trk", "status_trk", "lives_trk", "amount_trd", "matched_price"};
+    const std::string* values[8];
+    for (size_t n = 0; n < 8; ++n) {
+        auto it = edge.find(fields[n]);
+        if (it == edge.end()) return false;
+        values[n] = &it->second;
+    }
+
+    int64_t livesSrc = 0;
+    int64_t livesTrk = 0;
+    int64_t amount = 0;
+    int64_t price = 0;
+    if (!ParseInt64(*values[2], &livesSrc) || !ParseInt64(*values[5], &livesTrk) || !ParseInt64(*values[6], &amount)) {
+        return false;
+    }
+    if (!ParseClearingPrice(*values[7], price)) return false;
+
+    AddTrade(*values[0], *values[1], livesSrc, *values[3], *values[4], livesTrk, amount, price);
+    return true;
+}
+
+void CClearingGraph::Clear()
+{
+    addresses.Clear();
+    statuses.Clear();
+    statusFlags.clear();
+    trades.clear();
+}
+
+size_t CClearingGraph::DynamicMemoryUsage() const
+{
+    return addresses.DynamicMemoryUsage() + statuses.DynamicMemoryUsage() + statusFlags.capacity() + trades.capacity() * sizeof(CClearingTrade);
+}
+
+void CClearingResult::Clear()
+{
+    edges.clear();
+    pathStarts.clear();
+    livesLongs.clear();
+    livesShorts.clear();
+    ghosts.clear();
+    exitPrice = 0;
+}
+
+void mastercore::SettleFifo(const CClearingGraph& graph, CClearingResult& result)
+{
+    const std::vector<CClearingTrade>& trades = graph.GetTrades();
+    const size_t nAddresses = graph.CountAddresses();
+    result.Clear();
+
+    /** First Part: Paths of the positions opened or increased */
+
+    // contracts of each side not yet netted against an earlier position
+    std::vector<int64_t> nlives(2 * trades.size());
+    for (size_t row = 0; row < trades.size(); ++row) {
+        nlives[2 * row] = nlives[2 * row + 1] = trades[row].amount;
+    }
+
+    // trades netting a long (0) or short (1) position, by address and direction
+    CKeyedLists netting(2 * nAddresses);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t row = 0; row < trades.size(); ++row) {
+            const CClearingTrade& trade = trades[row];
+            for (int side = 0; side < 2; ++side) {
+                const uint32_t address = trade.address[side];
+                if (side == 1 && address == trade.address[0]) continue;
+
+                const uint8_t flags = graph.GetStatusFlags(trade.status[GetSide(trade, address)]);
+                const int idxLongShort = (flags & CLEARING_NETTED_LONG) ? 0 : ((flags & CLEARING_NETTED_SHORT) ? 1 : -1);
+                if (idxLongShort < 0) continue;
+
+                if (pass == 0) {
+                    netting.Count(2 * address + idxLongShort);
+                } else {
+                    netting.Push(2 * address + idxLongShort, row);
+                }
+            }
+        }
+        if (pass == 0) netting.Allocate();
+    }
+    netting.Finish();
+
+    std::vector<uint32_t> nextNetting(netting.Size() + 1);
+    for (size_t pos = 0; pos < nextNetting.size(); ++pos) nextNetting[pos] = pos;
+
+    uint32_t path = 0;
+    result.pathStarts.push_back(0);
+    for (size_t row = 0; row < trades.size(); ++row) {
+        const CClearingTrade& trade = trades[row];
+        const int trkLong = (graph.GetStatusFlags(trade.status[0]) & CLEARING_OPEN_INCR_LONG) ? 0 : 1;
+        const int trkShort = (graph.GetStatusFlags(trade.status[0]) & CLEARING_OPEN_INCR_SHORT) ? 0 : 1;
+        const bool fLong = graph.GetStatusFlags(trade.status[trkLong]) & CLEARING_OPEN_INCR_LONG;
+        const bool fShort = graph.GetStatusFlags(trade.status[trkShort]) & CLEARING_OPEN_INCR_SHORT;
+        if (!fLong && !fShort) continue;
+
+        ++path;
+
+        // the trade itself starts the path, if both sides opened or increased their position
+        if (fLong && fShort) {
+            CClearingEdge source;
+            source.addressSrc = trade.address[1 - trkLong];
+            source.addressTrk = trade.address[trkLong];
+            source.statusSrc = trade.status[1 - trkLong];
+            source.statusTrk = trade.status[trkLong];
+            source.livesSrc = trade.lives[1 - trkLong];
+            source.livesTrk = trade.lives[trkLong];
+            source.amount = trade.amount;
+            source.entryPrice = trade.price;
+            source.exitPrice = trade.price;
+            source.row = row;
+            source.path = path;
+            result.edges.push_back(source);
+        }
+
+        if (fLong) ClearPosition(graph, netting, nextNetting, nlives, row, trkLong, 0, path, result.edges);
+        if (fShort) ClearPosition(graph, netting, nextNetting, nlives, row, trkShort, 1, path, result.edges);
+
+        result.pathStarts.push_back(result.edges.size());
+    }
+
+    if (msc_debug_settlement_algorithm_fifo) {
+        PrintToLog("%s(): %d trades, %d paths, %d edges\n", __func__, trades.size(), result.CountPaths(), result.edges.size());
+    }
+
+    /** Second Part: Lives Vectors and Ghost Edges */
+
+    // edges of each address, in the order of the paths
+    CKeyedLists events(nAddresses);
+    for (const CClearingEdge& edge : result.edges) {
+        events.Count(edge.addressSrc);
+        if (edge.addressTrk != edge.addressSrc) events.Count(edge.addressTrk);
+    }
+    events.Allocate();
+    for (size_t n = 0; n < result.edges.size(); ++n) {
+        const CClearingEdge& edge = result.edges[n];
+        events.Push(edge.addressSrc, n);
+        if (edge.addressTrk != edge.addressSrc) events.Push(edge.addressTrk, n);
+    }
+    events.Finish();
+
+    // the last open, increase or partial netting of an address determines its lives
+    for (uint32_t address : ListAddresses(graph, result.edges)) {
+        const uint32_t* begin = events.Begin(address);
+        const uint32_t* end = events.End(address);
+
+        for (const uint32_t* it = end; it != begin; ) {
+            const CClearingEdge& edge = result.edges[*--it];
+            const bool fSrc = (edge.addressSrc == address);
+            const uint32_t status = fSrc ? edge.statusSrc : edge.statusTrk;
+            const uint8_t flags = graph.GetStatusFlags(status);
+
+            if (flags & CLEARING_OPEN) {
+                PushLives(graph, address, status, fSrc ? edge.livesSrc : edge.livesTrk, edge, result);
+                break;
+            } else if (flags & CLEARING_INCREASED) {
+                PushIncreasedLives(graph, address, edge.row, begin, end, result);
+                break;
+            } else if (flags & CLEARING_NETTED_PARTLY) {
+                PushLives(graph, address, status, fSrc ? edge.livesSrc : edge.livesTrk, edge, result);
+                break;
+            }
+        }
+    }
+
+    // a path without lives keeps the gammas of the path before
+    double gammaP = 0;
+    double gammaQ = 0;
+    double sumGammaP = 0;
+    double sumGammaQ = 0;
+    for (size_t n = 0; n < result.CountPaths(); ++n) {
+        const CClearingEdge* begin = result.edges.data() + result.pathStarts[n];
+        const CClearingEdge* end = result.edges.data() + result.pathStarts[n + 1];
+
+        int64_t sumLives = 0;
+        for (const CClearingEdge* edge = begin; edge != end; ++edge) sumLives += edge->livesSrc + edge->livesTrk;
+
+        if (sumLives != 0) {
+            GetGammas(graph, begin, end, gammaP, gammaQ);
+        } else if (msc_debug_settlement_algorithm_fifo) {
+            PrintToLog("%s(): path #%d does not have lives contracts\n", __func__, n + 1);
+        }
+        sumGammaP += gammaP;
+        sumGammaQ += gammaQ;
+    }
+    result.exitPrice = sumGammaP / sumGammaQ;
+
+    int64_t nLivesLongs = 0;
+    int64_t nLivesShorts = 0;
+    for (const CClearingLives& entry : result.livesLongs) nLivesLongs += entry.lives;
+    for (const CClearingLives& entry : result.livesShorts) nLivesShorts += entry.lives;
+    if (nLivesLongs != nLivesShorts) {
+        PrintToLog("%s(): WARNING: lives of longs (%d) and shorts (%d) differ\n", __func__, nLivesLongs, nLivesShorts);
+    }
+
+    ComputeGhostEdges(result);
+
+    if (msc_debug_settlement_algorithm_fifo) {
+        PrintToLog("%s(): %d long lives, %d short lives, %d ghost edges, exit price: %f\n", __func__,
+                result.livesLongs.size(), result.livesShorts.size(), result.ghosts.size(), result.exitPrice);
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef TRADELAYER_CLEARING_H
+#define TRADELAYER_CLEARING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mastercore
+{
+//! Scale of the fixed-point settlement prices, which keep the six decimals of the recorded trades
+const int64_t CLEARING_PRICE_SCALE = 1000000;
+
+/** Parses a recorded price, as formatted by std::to_string, into a fixed-point price. */
+bool ParseClearingPrice(const std::string& str, int64_t& price);
+
+/** Returns the value the settlement computes with for a fixed-point price. */
+double ClearingPriceToDouble(int64_t price);
+
+/** Rounds a settlement price to a fixed-point price, fails if it's not finite or out of range. */
+bool ClearingPriceFromDouble(double value, int64_t& price);
+
+/** Properties of a position status, as the settlement tests them. */
+enum ClearingStatusFlags
+{
+    CLEARING_LONG             = 1 << 0, //!< Contains "Long", otherwise the position is short
+    CLEARING_OPEN             = 1 << 1, //!< Contains "Open"
+    CLEARING_INCREASED        = 1 << 2, //!< Contains "Increased"
+    CLEARING_NETTED_PARTLY    = 1 << 3, //!< Contains "NettedPartly"
+    CLEARING_OPEN_INCR_LONG   = 1 << 4, //!< OpenLongPosition or LongPosIncreased
+    CLEARING_OPEN_INCR_SHORT  = 1 << 5, //!< OpenShortPosition or ShortPosIncreased
+    CLEARING_NETTED_LONG      = 1 << 6, //!< LongPosNetted or LongPosNettedPartly
+    CLEARING_NETTED_SHORT     = 1 << 7, //!< ShortPosNetted or ShortPosNettedPartly
+};
+
+/** Strings of a settlement graph, identified by the order they were first seen. */
+class CClearingStrings
+{
+private:
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> ids;
+
+public:
+    /** Returns the identifier of a string, adding it if it's new. */
+    uint32_t Intern(const std::string& str);
+
+    const std::string& Get(uint32_t id) const { return strings[id]; }
+    size_t Size() const { return strings.size(); }
+    void Clear();
+
+    /** Estimates the memory allocated for the strings. */
+    size_t DynamicMemoryUsage() const;
+};
+
+/** A matched trade of the settlement period, one row of the recorded edges.
+ *
+ * Side 0 is the source (maker) and side 1 the tracked (taker) address.
+ */
+struct CClearingTrade
+{
+    uint32_t address[2];
+    uint32_t status[2];
+    int64_t lives[2];
+    int64_t amount;
+    int64_t price;
+};
+
+/** An edge of a settlement path, from a position's source to a netting trade. */
+struct CClearingEdge
+{
+    uint32_t addressSrc;
+    uint32_t addressTrk;
+    uint32_t statusSrc;
+    uint32_t statusTrk;
+    int64_t livesSrc;
+    int64_t livesTrk;
+    int64_t amount;
+    int64_t entryPrice;
+    int64_t exitPrice;
+    //! Trade the edge was built from
+    uint32_t row;
+    //! Path of the edge, starting with 1
+    uint32_t path;
+};
+
+/** Contracts still alive for an address at the end of the settlement period. */
+struct CClearingLives
+{
+    uint32_t address;
+    uint32_t status;
+    int64_t lives;
+    int64_t entryPrice;
+    uint32_t row;
+    uint32_t path;
+};
+
+/** A ghost edge, closing live long and short contracts at the settlement price. */
+struct CClearingGhost
+{
+    uint32_t addressLong;
+    uint32_t addressShort;
+    uint32_t statusLong;
+    uint32_t statusShort;
+    int64_t entryPriceLong;
+    int64_t entryPriceShort;
+    int64_t amount;
+};
+
+/** The trades of a settlement period, with interned addresses and statuses. */
+class CClearingGraph
+{
+private:
+    CClearingStrings addresses;
+    CClearingStrings statuses;
+    std::vector<uint8_t> statusFlags;
+    std::vector<CClearingTrade> trades;
+
+    uint32_t InternStatus(const std::string& status);
+
+public:
+    /** Adds a trade. */
+    void AddTrade(const std::string& addressSrc, const std::string& statusSrc, int64_t livesSrc,
+            const std::string& addressTrk, const std::string& statusTrk, int64_t livesTrk, int64_t amount, int64_t price);
+    /** Adds a trade built as edge by buildingEdge(), fails if a field is missing or malformed. */
+    bool AddTrade(const std::map<std::string, std::string>& edge);
+
+    const std::vector<CClearingTrade>& GetTrades() const { return trades; }
+    const std::string& GetAddress(uint32_t id) const { return addresses.Get(id); }
+    const std::string& GetStatus(uint32_t id) const { return statuses.Get(id); }
+    uint8_t GetStatusFlags(uint32_t id) const { return statusFlags[id]; }
+    size_t CountAddresses() const { return addresses.Size(); }
+    size_t CountStatuses() const { return statuses.Size(); }
+    size_t Size() const { return trades.size(); }
+    void Clear();
+
+    /** Estimates the memory allocated for the trades and their strings. */
+    size_t DynamicMemoryUsage() const;
+};
+
+/** Outcome of the settlement of a graph. */
+struct CClearingResult
+{
+    //! Edges of all paths, path n spans the edges from pathStarts[n-1] to pathStarts[n]
+    std::vector<CClearingEdge> edges;
+    std::vector<size_t> pathStarts;
+    std::vector<CClearingLives> livesLongs;
+    std::vector<CClearingLives> livesShorts;
+    std::vector<CClearingGhost> ghosts;
+    double exitPrice;
+
+    CClearingResult() : exitPrice(0) {}
+
+    size_t CountPaths() const { return pathStarts.empty() ? 0 : pathStarts.size() - 1; }
+    void Clear();
+};
+
+/** Runs the FIFO settlement over the trades of a graph.
+ *
+ * This produces the same paths, lives, ghost edges and settlement price as
+ * settlement_algorithm_fifo() does for the recorded edges, but works on the
+ * interned identifiers and indexes the trades of each address, instead of
+ * scanning the whole trade matrix for every position.
+ */
+void SettleFifo(const CClearingGraph& graph, CClearingResult& result);
+
+} // namespace mastercore
+
+#endif // TRADELAYER_CLEARING_H
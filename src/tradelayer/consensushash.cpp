@@ -20,13 +20,89 @@
 #include <uint256.h>
 
 #include <algorithm>
+#include <map>
+#include <set>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace mastercore
 {
 
+/**
+ * Cache of the balance stage of the consensus hash.
+ *
+ * Holds the consensus strings of all non-empty balance records, sorted by address
+ * and property identifier, which is the order in which they are hashed. The cache
+ * is built on the first hash and afterwards only the records reported as changed
+ * via NotifyConsensusBalanceChanged() are regenerated.
+ *
+ * Guarded by cs_tally.
+ */
+static std::map<std::string, std::map<uint32_t, std::string> > balanceStrings;
+//! Balance records changed since the cache was last updated
+static std::set<std::pair<std::string, uint32_t> > changedBalances;
+//! Whether the balance cache reflects the tally map (except for changed records)
+static bool fBalanceCacheValid = false;
+
+/**
+ * Consensus strings of a DEx stage, sorted the way they are hashed.
+ *
+ * Entries are stored by the key of the offer or accept, so a changed entry can
+ * replace its previous string.
+ */
+template <typename SortKey>
+class CConsensusStrings
+{
+public:
+    typedef std::multiset<std::pair<SortKey, std::string> > Entries;
+
+private:
+    std::map<std::string, typename Entries::iterator> byKey;
+    Entries entries;
+
+public:
+    void Set(const std::string& key, const SortKey& sortKey, const std::string& dataStr)
+    {
+        Erase(key);
+        byKey[key] = entries.insert(std::make_pair(sortKey, dataStr));
+    }
+
+    void Erase(const std::string& key)
+    {
+        typename std::map<std::string, typename Entries::iterator>::iterator it = byKey.find(key);
+        if (it == byKey.end()) return;
+
+        entries.erase(it->second);
+        byKey.erase(it);
+    }
+
+    void Clear()
+    {
+        byKey.clear();
+        entries.clear();
+    }
+
+    const Entries& Get() const { return entries; }
+};
+
+/**
+ * Cache of the DEx stages of the consensus hash.
+ *
+ * Like the balance cache, it is built on the first hash and afterwards only the
+ * offers and accepts reported as changed are regenerated.
+ *
+ * Guarded by cs_tally.
+ */
+static CConsensusStrings<arith_uint256> offerStrings;
+static CConsensusStrings<std::string> acceptStrings;
+//! Offers and accepts changed since the cache was last updated
+static std::set<std::string> changedOffers;
+static std::set<std::string> changedAccepts;
+//! Whether the DEx cache reflects the offers and accepts (except for changed ones)
+static bool fDExCacheValid = false;
+
 
 bool ShouldConsensusHashBlock(int block)
 {
@@ -75,6 +151,99 @@ std::string GenerateConsensusString(const CMPTally& tallyObj, const std::string&
 		     remaining, unvested);
 }
 
+void NotifyConsensusBalanceChanged(const std::string& address, uint32_t propertyId)
+{
+    LOCK(cs_tally);
+
+    // nothing to track, until the cache was built
+    if (!fBalanceCacheValid) return;
+
+    changedBalances.insert(std::make_pair(address, propertyId));
+}
+
+void NotifyConsensusOfferChanged(const std::string& combo)
+{
+    LOCK(cs_tally);
+
+    if (!fDExCacheValid) return;
+
+    changedOffers.insert(combo);
+}
+
+void NotifyConsensusAcceptChanged(const std::string& combo)
+{
+    LOCK(cs_tally);
+
+    if (!fDExCacheValid) return;
+
+    changedAccepts.insert(combo);
+}
+
+void InvalidateConsensusHashCache()
+{
+    LOCK(cs_tally);
+
+    balanceStrings.clear();
+    changedBalances.clear();
+    fBalanceCacheValid = false;
+
+    offerStrings.Clear();
+    acceptStrings.Clear();
+    changedOffers.clear();
+    changedAccepts.clear();
+    fDExCacheValid = false;
+}
+
+// Brings the cached balance consensus strings in line with the tally map
+static void UpdateBalanceCache()
+{
+    AssertLockHeld(cs_tally);
+
+    if (!fBalanceCacheValid) {
+        balanceStrings.clear();
+        for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it)
+        {
+            const std::string& address = it->first;
+            const CMPTally& tally = it->second;
+            for (const CMPTally::BalanceRecord& record : tally)
+            {
+                const uint32_t propertyId = record.propertyId;
+                std::string dataStr = GenerateConsensusString(tally, address, propertyId);
+                if (dataStr.empty()) continue; // skip empty balances
+                balanceStrings[address][propertyId] = dataStr;
+            }
+        }
+        changedBalances.clear();
+        fBalanceCacheValid = true;
+        return;
+    }
+
+    for (std::set<std::pair<std::string, uint32_t> >::const_iterator it = changedBalances.begin(); it != changedBalances.end(); ++it)
+    {
+        const std::string& address = it->first;
+        const uint32_t propertyId = it->second;
+
+        std::string dataStr;
+        std::unordered_map<std::string, CMPTally>::const_iterator tit = mp_tally_map.find(address);
+        if (tit != mp_tally_map.end()) {
+            dataStr = GenerateConsensusString(tit->second, address, propertyId);
+        }
+
+        if (!dataStr.empty()) {
+            balanceStrings[address][propertyId] = dataStr;
+            continue;
+        }
+
+        // the record is empty now, so it no longer contributes to the hash
+        std::map<std::string, std::map<uint32_t, std::string> >::iterator ait = balanceStrings.find(address);
+        if (ait == balanceStrings.end()) continue;
+        ait->second.erase(propertyId);
+        if (ait->second.empty()) balanceStrings.erase(ait);
+    }
+
+    changedBalances.clear();
+}
+
 // Generates a consensus string for hashing based on a DEx sell offer object
 std::string GenerateConsensusString(const CMPOffer& offerObj, const std::string& address)
 {
@@ -91,6 +260,66 @@ std::string GenerateConsensusString(const CMPAccept& acceptObj, const std::strin
              acceptObj.getAcceptBlock());
 }
 
+// Regenerates the consensus string of a DEx sell offer, or drops it, if the offer is gone
+static void UpdateOfferString(const std::string& combo)
+{
+    OfferMap::const_iterator it = my_offers.find(combo);
+    if (it == my_offers.end()) {
+        offerStrings.Erase(combo);
+        return;
+    }
+
+    const CMPOffer& selloffer = it->second;
+    std::string seller = combo.substr(0, combo.size() - 2);
+    offerStrings.Set(combo, UintToArith256(selloffer.getHash()), GenerateConsensusString(selloffer, seller));
+}
+
+// Regenerates the consensus string of a DEx accept, or drops it, if the accept is gone
+static void UpdateAcceptString(const std::string& combo)
+{
+    AcceptMap::const_iterator it = my_accepts.find(combo);
+    if (it == my_accepts.end()) {
+        acceptStrings.Erase(combo);
+        return;
+    }
+
+    const CMPAccept& accept = it->second;
+    std::string buyer = combo.substr((combo.find("+") + 1), (combo.size()-(combo.find("+") + 1)));
+    std::string sortKey = strprintf("%s-%s", accept.getHash().GetHex(), buyer);
+    acceptStrings.Set(combo, sortKey, GenerateConsensusString(accept, buyer));
+}
+
+// Brings the cached DEx consensus strings in line with the offers and accepts
+static void UpdateDExCache()
+{
+    AssertLockHeld(cs_tally);
+
+    if (!fDExCacheValid) {
+        offerStrings.Clear();
+        acceptStrings.Clear();
+        for (OfferMap::const_iterator it = my_offers.begin(); it != my_offers.end(); ++it) {
+            UpdateOfferString(it->first);
+        }
+        for (AcceptMap::const_iterator it = my_accepts.begin(); it != my_accepts.end(); ++it) {
+            UpdateAcceptString(it->first);
+        }
+        changedOffers.clear();
+        changedAccepts.clear();
+        fDExCacheValid = true;
+        return;
+    }
+
+    for (std::set<std::string>::const_iterator it = changedOffers.begin(); it != changedOffers.end(); ++it) {
+        UpdateOfferString(*it);
+    }
+    for (std::set<std::string>::const_iterator it = changedAccepts.begin(); it != changedAccepts.end(); ++it) {
+        UpdateAcceptString(*it);
+    }
+
+    changedOffers.clear();
+    changedAccepts.clear();
+}
+
 // Generates a consensus string for hashing based on a property issuer
 std::string GenerateConsensusString(const uint32_t propertyId, const std::string& address)
 {
@@ -222,136 +451,74 @@ uint256 GetConsensusHash()
 
     // Balances - loop through the tally map, updating the sha context with the data from each balance and tally type
     // Placeholders:  "address|propertyid|balance|selloffer_reserve|accept_reserve|metadex_reserve"
-    // Sort alphabetically first
-    std::map<std::string, CMPTally> tallyMapSorted;
-    for (std::unordered_map<string, CMPTally>::iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit)
-    {
-        tallyMapSorted.insert(std::make_pair(uoit->first,uoit->second));
-    }
+    // Sorted alphabetically by address, and by property identifier, as maintained by the balance cache
+    UpdateBalanceCache();
 
-    for (std::map<string, CMPTally>::iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it)
+    for (std::map<std::string, std::map<uint32_t, std::string> >::const_iterator my_it = balanceStrings.begin(); my_it != balanceStrings.end(); ++my_it)
     {
-        const std::string& address = my_it->first;
-        CMPTally& tally = my_it->second;
-        tally.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = (tally.next())))
+        const std::map<uint32_t, std::string>& records = my_it->second;
+        for (std::map<uint32_t, std::string>::const_iterator it = records.begin(); it != records.end(); ++it)
         {
-            std::string dataStr = GenerateConsensusString(tally, address, propertyId);
-            if (dataStr.empty()) continue; // skip empty balances
+            const std::string& dataStr = it->second;
             if (msc_debug_consensus_hash) PrintToLog("Adding balance data to consensus hash: %s\n", dataStr);
             hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
         }
     }
 
-    // DEx sell offers - loop through the DEx and add each sell offer to the consensus hash (ordered by txid)
+    // DEx sell offers - add each sell offer to the consensus hash (ordered by txid, as maintained by the DEx cache)
     // Placeholders: "txid|address|propertyid|offeramount|btcdesired|minfee|timelimit"
-    std::vector<std::pair<arith_uint256, std::string> > vecDExOffers;
-    for (OfferMap::iterator it = my_offers.begin(); it != my_offers.end(); ++it)
-    {
-        const CMPOffer& selloffer = it->second;
-        const std::string& sellCombo = it->first;
-        std::string seller = sellCombo.substr(0, sellCombo.size() - 2);
-        std::string dataStr = GenerateConsensusString(selloffer, seller);
-        vecDExOffers.push_back(std::make_pair(arith_uint256(selloffer.getHash().ToString()), dataStr));
-    }
+    UpdateDExCache();
 
-    std::sort (vecDExOffers.begin(), vecDExOffers.end());
-    for (std::vector<std::pair<arith_uint256, std::string> >::iterator it = vecDExOffers.begin(); it != vecDExOffers.end(); ++it)
+    for (CConsensusStrings<arith_uint256>::Entries::const_iterator it = offerStrings.Get().begin(); it != offerStrings.Get().end(); ++it)
     {
         const std::string& dataStr = it->second;
         if (msc_debug_consensus_hash) PrintToLog("Adding DEx offer data to consensus hash: %s\n", dataStr);
         hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
 
-    // DEx accepts - loop through the accepts map and add each accept to the consensus hash (ordered by matchedtxid then buyer)
+    // DEx accepts - add each accept to the consensus hash (ordered by matchedtxid then buyer)
     // Placeholders: "matchedselloffertxid|buyer|acceptamount|acceptamountremaining|acceptblock"
-    std::vector<std::pair<std::string, std::string> > vecAccepts;
-    for (AcceptMap::const_iterator it = my_accepts.begin(); it != my_accepts.end(); ++it)
-    {
-        const CMPAccept& accept = it->second;
-        const std::string& acceptCombo = it->first;
-        std::string buyer = acceptCombo.substr((acceptCombo.find("+") + 1), (acceptCombo.size()-(acceptCombo.find("+") + 1)));
-        std::string dataStr = GenerateConsensusString(accept, buyer);
-        std::string sortKey = strprintf("%s-%s", accept.getHash().GetHex(), buyer);
-        vecAccepts.push_back(std::make_pair(sortKey, dataStr));
-    }
-
-    std::sort (vecAccepts.begin(), vecAccepts.end());
-    for (std::vector<std::pair<std::string, std::string> >::iterator it = vecAccepts.begin(); it != vecAccepts.end(); ++it)
+    for (CConsensusStrings<std::string>::Entries::const_iterator it = acceptStrings.Get().begin(); it != acceptStrings.Get().end(); ++it)
     {
         const std::string& dataStr = it->second;
         if (msc_debug_consensus_hash) PrintToLog("Adding DEx accept to consensus hash: %s\n", dataStr);
-         hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
+        hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
 
-    // MetaDEx trades - loop through the MetaDEx maps and add each open trade to the consensus hash (ordered by txid)
+    // MetaDEx trades - add each open trade to the consensus hash (ordered by txid, as maintained by the order index)
     // Placeholders: "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining"
-    std::vector<std::pair<arith_uint256, std::string> > vecMetaDExTrades;
-    for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it)
-    {
-        const md_PricesMap& prices = my_it->second;
-        for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            const md_Set& indexes = it->second;
-            for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
-            {
-	              const CMPMetaDEx& obj = *it;
-	              std::string dataStr = obj.GenerateConsensusString();
-	              vecMetaDExTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
-            }
-        }
-    }
-
-    std::sort (vecMetaDExTrades.begin(), vecMetaDExTrades.end());
-    for (std::vector<std::pair<arith_uint256, std::string> >::iterator it = vecMetaDExTrades.begin(); it != vecMetaDExTrades.end(); ++it)
+    const COrderIndex<md_Position>::ConsensusStrings& metaDExStrings = metadex_index.GetConsensusStrings();
+    for (COrderIndex<md_Position>::ConsensusStrings::const_iterator it = metaDExStrings.begin(); it != metaDExStrings.end(); ++it)
     {
         const std::string& dataStr = it->second;
         if (msc_debug_consensus_hash) PrintToLog("Adding MetaDEx trade data to consensus hash: %s\n", dataStr);
-         hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
+        hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
 
-    // ContractDex trades - loop through the ContractDex maps and add each open trade to the consensus hash (ordered by txid)
+    // ContractDex trades - add each open trade to the consensus hash (ordered by txid, as maintained by the order index)
     // Placeholders: "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining|effectivePrice|tradignAction"
-    std::vector<std::pair<arith_uint256, std::string> > vecContractDexTrades;
-    for (cd_PropertiesMap::const_iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
-    {
-        const cd_PricesMap& prices = my_it->second;
-        for (cd_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            const cd_Set& indexes = it->second;
-            for (cd_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
-            {
-	              const CMPContractDex& obj = *it;
-	              std::string dataStr = obj.GenerateConsensusString();          /*-------the txid-------|---consensus string---*/
-	              vecContractDexTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
-            }
-        }
-    }
-
-    std::sort (vecContractDexTrades.begin(), vecContractDexTrades.end());
-    for (std::vector<std::pair<arith_uint256, std::string> >::iterator it = vecContractDexTrades.begin(); it != vecContractDexTrades.end(); ++it)
+    const COrderIndex<cd_Position>::ConsensusStrings& contractDexStrings = contractdex_index.GetConsensusStrings();
+    for (COrderIndex<cd_Position>::ConsensusStrings::const_iterator it = contractDexStrings.begin(); it != contractDexStrings.end(); ++it)
     {
         const std::string& dataStr = it->second;
         if (msc_debug_consensus_hash) PrintToLog("Adding ContractDex trade data to consensus hash: %s\n", dataStr);
-       hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
+        hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
 
     // Properties - loop through each property and store the issuer (to capture state changes via change issuer transactions)
-    // Note: we are loading every SP from the DB to check the issuer, if using consensus_hash_every_block debug option this
-    //       will slow things down dramatically.  Not an issue to do it once every 10,000 blocks for checkpoint verification.
+    // Note: entries are served from the SP cache, so only properties changed since the last hash are loaded from the DB.
     // Placeholders: "propertyid|issueraddress"
     uint32_t startPropertyId = 1;
     for (uint32_t propertyId = startPropertyId; propertyId < _my_sps->peekNextSPID(); propertyId++)
     {
-        CMPSPInfo::Entry sp;
-        if (!_my_sps->getSP(propertyId, sp))
+        std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
+        if (!sp)
         {
 	          PrintToLog("Error loading property ID %d for consensus hashing, hash should not be trusted!\n");
 	          continue;
         }
 
-        std::string dataStr = GenerateConsensusString(propertyId, sp.issuer);
+        std::string dataStr = GenerateConsensusString(propertyId, sp->issuer);
         if (msc_debug_consensus_hash) PrintToLog("Adding property to consensus hash: %s\n", dataStr);
         hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
@@ -470,14 +637,14 @@ uint256 GetMetaDExHash(const uint32_t propertyId)
 
     std::vector<std::pair<arith_uint256, std::string> > vecMetaDExTrades;
     for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        if (propertyId == 0 || propertyId == my_it->first) {
+        if (propertyId == 0 || propertyId == my_it->first.first) {
             const md_PricesMap& prices = my_it->second;
             for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
                 const md_Set& indexes = it->second;
                 for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
                     const CMPMetaDEx& obj = *it;
                     const std::string dataStr = obj.GenerateConsensusString();
-                    vecMetaDExTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
+                    vecMetaDExTrades.push_back(std::make_pair(UintToArith256(obj.getHash()), dataStr));
                 }
             }
         }
@@ -502,26 +669,16 @@ uint256 GetBalancesHash(const uint32_t hashPropertyId)
 
     LOCK(cs_tally);
 
-    std::map<std::string, CMPTally> tallyMapSorted;
-    for (std::unordered_map<string, CMPTally>::iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit)
-    {
-        tallyMapSorted.insert(std::make_pair(uoit->first,uoit->second));
-    }
+    UpdateBalanceCache();
 
-    for (std::map<string, CMPTally>::iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it)
+    for (std::map<std::string, std::map<uint32_t, std::string> >::const_iterator my_it = balanceStrings.begin(); my_it != balanceStrings.end(); ++my_it)
     {
-        const std::string& address = my_it->first;
-        CMPTally& tally = my_it->second;
-        tally.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = (tally.next())))
-        {
-            if (propertyId != hashPropertyId) continue;
-            std::string dataStr = GenerateConsensusString(tally, address, propertyId);
-            if (dataStr.empty()) continue;
-            if (msc_debug_consensus_hash) PrintToLog("Adding data to balances hash: %s\n", dataStr);
-            hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
-        }
+        const std::map<uint32_t, std::string>& records = my_it->second;
+        std::map<uint32_t, std::string>::const_iterator it = records.find(hashPropertyId);
+        if (it == records.end()) continue;
+        const std::string& dataStr = it->second;
+        if (msc_debug_consensus_hash) PrintToLog("Adding data to balances hash: %s\n", dataStr);
+        hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
 
     uint256 balancesHash;
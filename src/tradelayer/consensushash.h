@@ -3,12 +3,28 @@
 
 #include <uint256.h>
 
+#include <stdint.h>
+#include <string>
+#include <vector>
+
 namespace mastercore
 {
 
 /** Obtains a hash of all balances to use for consensus verification and checkpointing. */
 uint256 GetConsensusHash();
 
+/** Marks the balance record of an address as changed for the next consensus hash. */
+void NotifyConsensusBalanceChanged(const std::string& address, uint32_t propertyId);
+
+/** Marks a DEx sell offer, by its key in the offer map, as changed for the next consensus hash. */
+void NotifyConsensusOfferChanged(const std::string& combo);
+
+/** Marks a DEx accept, by its key in the accept map, as changed for the next consensus hash. */
+void NotifyConsensusAcceptChanged(const std::string& combo);
+
+/** Discards all cached consensus hash data, e.g. after the tally map was cleared. */
+void InvalidateConsensusHashCache();
+
 std::string kycGenerateConsensusString(const std::vector<std::string>& vstr);
 std::string attGenerateConsensusString(const std::vector<std::string>& vstr);
 
@@ -0,0 +1,319 @@
+#ifndef TRADELAYER_DBRECORDS_H
+#define TRADELAYER_DBRECORDS_H
+
+#include <clientversion.h>
+#include <serialize.h>
+#include <streams.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+#include <exception>
+#include <string>
+
+/** Binary records of the transaction and trade databases.
+ *
+ * Each record is stored under a key, which starts with the record type byte,
+ * followed by the serialized key fields (see MakeRecordKey). The value is the
+ * serialized record, which starts with its version, so fields can be added
+ * later on without touching the existing entries.
+ *
+ * Text records, as written by the remaining record* methods, always start
+ * with a printable character, so the types below never collide with them.
+ */
+namespace mastercore
+{
+//! Record types of CMPTxList
+enum TxRecordType : unsigned char
+{
+    //! txid -> CMPTxRecord
+    TXDB_TX = 0x10,
+    //! txid, payment number -> CMPPaymentRecord
+    TXDB_PAYMENT = 0x11,
+};
+
+//! Record types of CMPTradeList
+enum TradeRecordType : unsigned char
+{
+    //! txid -> CMPMetaDExTradeRecord
+    TRADEDB_METADEX_TRADE = 0x10,
+    //! txid1, txid2 -> CMPMetaDExMatchRecord
+    TRADEDB_METADEX_MATCH = 0x11,
+    //! txid1, txid2 -> CMPContractMatchRecord
+    TRADEDB_CONTRACT_MATCH = 0x12,
+};
+
+//! Current version of the records
+const int DB_RECORD_VERSION = 1;
+
+/** Wrapper to serialize signed integers as zigzag encoded varints. */
+template <typename I>
+class CSignedVarInt
+{
+protected:
+    I& n;
+
+public:
+    explicit CSignedVarInt(I& nIn) : n(nIn) { }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        const int64_t v = n;
+        WriteVarInt<Stream, uint64_t>(s, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        const uint64_t v = ReadVarInt<Stream, uint64_t>(s);
+        n = static_cast<I>(static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1));
+    }
+};
+
+template <typename I>
+CSignedVarInt<I> WrapSignedVarInt(I& n) { return CSignedVarInt<I>(n); }
+
+#define SVARINT(obj) REF(WrapSignedVarInt(REF(obj)))
+
+/** A transaction, as recorded in CMPTxList.
+ *
+ * DEx payments share this record, with the number of payments as value.
+ */
+struct CMPTxRecord
+{
+    int nVersion;
+    bool fValid;
+    //! Error code of the interpretation, if invalid
+    int nReason;
+    int nBlock;
+    uint32_t nType;
+    uint64_t nValue;
+
+    CMPTxRecord() : nVersion(DB_RECORD_VERSION), fValid(false), nReason(0), nBlock(0), nType(0), nValue(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nVersion));
+        READWRITE(fValid);
+        READWRITE(SVARINT(nReason));
+        READWRITE(VARINT(nBlock));
+        READWRITE(VARINT(nType));
+        READWRITE(VARINT(nValue));
+    }
+};
+
+/** A single DEx payment of a transaction. */
+struct CMPPaymentRecord
+{
+    int nVersion;
+    int nBlock;
+    uint32_t nVout;
+    std::string buyer;
+    std::string seller;
+    uint32_t propertyId;
+    uint64_t nValue;
+    uint64_t nAmountPaid;
+
+    CMPPaymentRecord() : nVersion(DB_RECORD_VERSION), nBlock(0), nVout(0), propertyId(0), nValue(0), nAmountPaid(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nVersion));
+        READWRITE(VARINT(nBlock));
+        READWRITE(VARINT(nVout));
+        READWRITE(buyer);
+        READWRITE(seller);
+        READWRITE(VARINT(propertyId));
+        READWRITE(VARINT(nValue));
+        READWRITE(VARINT(nAmountPaid));
+    }
+};
+
+/** A new MetaDEx order. */
+struct CMPMetaDExTradeRecord
+{
+    int nVersion;
+    std::string address;
+    uint32_t propertyIdForSale;
+    uint32_t propertyIdDesired;
+    int nBlock;
+    int nBlockIndex;
+    int64_t nReserve;
+
+    CMPMetaDExTradeRecord() : nVersion(DB_RECORD_VERSION), propertyIdForSale(0), propertyIdDesired(0), nBlock(0), nBlockIndex(0), nReserve(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nVersion));
+        READWRITE(address);
+        READWRITE(VARINT(propertyIdForSale));
+        READWRITE(VARINT(propertyIdDesired));
+        READWRITE(VARINT(nBlock));
+        READWRITE(VARINT(nBlockIndex));
+        READWRITE(SVARINT(nReserve));
+    }
+};
+
+/** A match of two MetaDEx orders. */
+struct CMPMetaDExMatchRecord
+{
+    int nVersion;
+    std::string address1;
+    std::string address2;
+    uint32_t prop1;
+    uint32_t prop2;
+    uint64_t amount1;
+    uint64_t amount2;
+    int nBlock;
+    int64_t nFee;
+
+    CMPMetaDExMatchRecord() : nVersion(DB_RECORD_VERSION), prop1(0), prop2(0), amount1(0), amount2(0), nBlock(0), nFee(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nVersion));
+        READWRITE(address1);
+        READWRITE(address2);
+        READWRITE(VARINT(prop1));
+        READWRITE(VARINT(prop2));
+        READWRITE(VARINT(amount1));
+        READWRITE(VARINT(amount2));
+        READWRITE(VARINT(nBlock));
+        READWRITE(SVARINT(nFee));
+    }
+};
+
+/** A match of two contract orders, maker first. */
+struct CMPContractMatchRecord
+{
+    int nVersion;
+    std::string addressMaker;
+    std::string addressTaker;
+    uint64_t effectivePrice;
+    uint64_t amountMaker;
+    uint64_t amountTaker;
+    int nBlockMaker;
+    int nBlockTaker;
+    std::string statusMaker;
+    std::string statusTaker;
+    int64_t livesMaker;
+    int64_t livesTaker;
+    uint32_t contractId;
+    uint256 txidMaker;
+    uint256 txidTaker;
+    //! Number of contracts traded
+    int64_t amountTraded;
+    uint64_t amountOld;
+    uint64_t amountNew;
+
+    CMPContractMatchRecord() : nVersion(DB_RECORD_VERSION), effectivePrice(0), amountMaker(0), amountTaker(0), nBlockMaker(0), nBlockTaker(0),
+        livesMaker(0), livesTaker(0), contractId(0), amountTraded(0), amountOld(0), amountNew(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nVersion));
+        READWRITE(addressMaker);
+        READWRITE(addressTaker);
+        READWRITE(VARINT(effectivePrice));
+        READWRITE(VARINT(amountMaker));
+        READWRITE(VARINT(amountTaker));
+        READWRITE(VARINT(nBlockMaker));
+        READWRITE(VARINT(nBlockTaker));
+        READWRITE(statusMaker);
+        READWRITE(statusTaker);
+        READWRITE(SVARINT(livesMaker));
+        READWRITE(SVARINT(livesTaker));
+        READWRITE(VARINT(contractId));
+        READWRITE(txidMaker);
+        READWRITE(txidTaker);
+        READWRITE(SVARINT(amountTraded));
+        READWRITE(VARINT(amountOld));
+        READWRITE(VARINT(amountNew));
+    }
+};
+
+/** Returns the key of a record: the type byte, followed by the serialized key fields. */
+template <typename K>
+std::string MakeRecordKey(unsigned char type, const K& key)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << type << key;
+    return ssKey.str();
+}
+
+template <typename K1, typename K2>
+std::string MakeRecordKey(unsigned char type, const K1& key1, const K2& key2)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << type << key1 << key2;
+    return ssKey.str();
+}
+
+/** Returns the key fields of a record key of the given type, or false, if the key is of another type. */
+template <typename K>
+bool ParseRecordKey(const std::string& strKey, unsigned char type, K& key)
+{
+    if (strKey.empty() || static_cast<unsigned char>(strKey[0]) != type) return false;
+    try {
+        CDataStream ssKey(strKey.data() + 1, strKey.data() + strKey.size(), SER_DISK, CLIENT_VERSION);
+        ssKey >> key;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+template <typename K1, typename K2>
+bool ParseRecordKey(const std::string& strKey, unsigned char type, K1& key1, K2& key2)
+{
+    if (strKey.empty() || static_cast<unsigned char>(strKey[0]) != type) return false;
+    try {
+        CDataStream ssKey(strKey.data() + 1, strKey.data() + strKey.size(), SER_DISK, CLIENT_VERSION);
+        ssKey >> key1 >> key2;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/** Serializes a record into a database value. */
+template <typename R>
+std::string EncodeRecord(const R& record)
+{
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssValue << record;
+    return ssValue.str();
+}
+
+/** Deserializes a database value, returns false, if it is no record of a known version. */
+template <typename R>
+bool DecodeRecord(const std::string& strValue, R& record)
+{
+    try {
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> record;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return record.nVersion <= DB_RECORD_VERSION;
+}
+
+/** Returns true, if the key belongs to a binary record or an index entry, rather than a text record. */
+inline bool IsBinaryRecordKey(const std::string& strKey)
+{
+    return !strKey.empty() && static_cast<unsigned char>(strKey[0]) < 0x20;
+}
+}
+
+#endif // TRADELAYER_DBRECORDS_H
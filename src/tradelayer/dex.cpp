@@ -6,6 +6,7 @@
 
 #include <tradelayer/dex.h>
 
+#include <tradelayer/consensushash.h>
 #include <tradelayer/convert.h>
 #include <tradelayer/errors.h>
 #include <tradelayer/externfns.h>
@@ -32,8 +33,8 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 
-std::map<int, std::map<uint32_t,int64_t>> mastercore::MapLTCVolume;
-std::map<int, std::map<uint32_t,int64_t>> mastercore::MapTokenVolume;
+mastercore::CMPVolumeHistory mastercore::MapLTCVolume;
+mastercore::CMPVolumeHistory mastercore::MapTokenVolume;
 std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>> mastercore::tokenvwap;
 
 
@@ -165,6 +166,8 @@ int DEx_offerCreate(const std::string& addressSeller, uint32_t propertyId, int64
         assert(update_tally_map(addressSeller, propertyId, amountOffered, SELLOFFER_RESERVE));
         CMPOffer sellOffer(block, amountOffered, propertyId, amountDesired, minAcceptFee, paymentWindow, txid,0, 2);
         my_offers.insert(std::make_pair(key, sellOffer));
+        NotifyConsensusOfferChanged(key);
+        NotifyStateSectionChanged(FILETYPE_OFFERS);
 
         rc = 0;
     }
@@ -248,6 +251,8 @@ int DEx_BuyOfferCreate(const std::string& addressMaker, uint32_t propertyId, int
     {
         CMPOffer sellOffer(block, amountOffered, propertyId, price, minAcceptFee, paymentWindow, txid, 0, 1);
         my_offers.insert(std::make_pair(key, sellOffer));
+        NotifyConsensusOfferChanged(key);
+        NotifyStateSectionChanged(FILETYPE_OFFERS);
         rc = 0;
     } else {
         if (msc_debug_dex) PrintToLog("You can't buy tokens, you need more position value\n");
@@ -282,6 +287,8 @@ int DEx_offerDestroy(const std::string& addressSeller, uint32_t propertyId)
     const std::string key = STR_SELLOFFER_ADDR_PROP_COMBO(addressSeller, propertyId);
     OfferMap::iterator it = my_offers.find(key);
     if (it != my_offers.end()) my_offers.erase(it);
+    NotifyConsensusOfferChanged(key);
+    NotifyStateSectionChanged(FILETYPE_OFFERS);
 
     if (msc_debug_dex) PrintToLog("%s(%s|%s)\n", __func__, addressSeller, key);
 
@@ -382,6 +389,8 @@ int DEx_acceptCreate(const std::string& addressTaker, const std::string& address
 
         CMPAccept acceptOffer(amountAccepted, block, offer.getBlockTimeLimit(), offer.getProperty(), offer.getOfferAmountOriginal(), offer.getLTCDesiredOriginal(), offer.getHash());
         my_accepts.insert(std::make_pair(keyAcceptOrder, acceptOffer));
+        NotifyConsensusAcceptChanged(keyAcceptOrder);
+        NotifyStateSectionChanged(FILETYPE_ACCEPTS);
 
         return 0;
     }
@@ -403,6 +412,8 @@ int DEx_acceptCreate(const std::string& addressTaker, const std::string& address
 
         CMPAccept acceptOffer(amountReserved, block, offer.getBlockTimeLimit(), offer.getProperty(), offer.getOfferAmountOriginal(), offer.getLTCDesiredOriginal(), offer.getHash());
         my_accepts.insert(std::make_pair(keyAcceptOrder, acceptOffer));
+        NotifyConsensusAcceptChanged(keyAcceptOrder);
+        NotifyStateSectionChanged(FILETYPE_ACCEPTS);
 
         rc = 0;
     }
@@ -457,6 +468,8 @@ int DEx_acceptDestroy(const std::string& addressBuyer, const std::string& addres
         if (my_accepts.end() != it) {
             my_accepts.erase(it);
         }
+        NotifyConsensusAcceptChanged(key);
+        NotifyStateSectionChanged(FILETYPE_ACCEPTS);
     }
 
     return 0;
@@ -498,6 +511,7 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
     uint32_t propertyId;
 
     CMPAccept* p_accept = nullptr;
+    std::string keyAccept;
 
     // logic here: we look only into main properties if there's some match
     for (propertyId = 1; propertyId < _my_sps->peekNextSPID(); propertyId++)
@@ -512,6 +526,7 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
         if (p_accept)
         {
             if (msc_debug_dex) PrintToLog("Found seller market maker!\n");
+            keyAccept = STR_ACCEPT_ADDR_PROP_ADDR_COMBO(addressSeller, addressBuyer, propertyId);
             break;
         }
 
@@ -523,6 +538,7 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
             if (p_accept)
             {
                 if (msc_debug_dex) PrintToLog("Found buyer market maker!\n");
+                keyAccept = STR_ACCEPT_ADDR_PROP_ADDR_COMBO(addressBuyer, addressSeller, propertyId);
                 break;
             }
 
@@ -562,7 +578,8 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
 
     // adding LTC volume added by this property
     PrintToLog("%s(): block: %d, propertyId: %d. amountPaid (LTC): %d\n",__func__, block, propertyId, amountPaid);
-    MapLTCVolume[block][propertyId] += amountPaid;
+    MapLTCVolume.Add(block, propertyId, amountPaid);
+    NotifyStateSectionChanged(FILE_TYPE_LTC_VOLUME);
 
     const arith_uint256 amountDesired256  = ConvertTo256(amountDesired);
     const arith_uint256 amountOffered256 = ConvertTo256(amountOffered);
@@ -572,12 +589,15 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
 
     // adding last price
     lastPrice[propertyId] = unitPrice;
+    NotifyStateSectionChanged(FILE_TYPE_TOKEN_LTC_PRICE);
 
     // adding numerator of vwap
     tokenvwap[propertyId][block].push_back(std::make_pair(unitPrice, amountPurchased));
+    NotifyStateSectionChanged(FILE_TYPE_TOKEN_VWAP);
 
     // saving DEx token volume
-    MapTokenVolume[block][propertyId] += amountPurchased;
+    MapTokenVolume.Add(block, propertyId, amountPurchased);
+    NotifyStateSectionChanged(FILETYPE_DEX_VOLUME);
 
 
     // adding Last token/ ltc price
@@ -627,7 +647,11 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
     }
 
     // reduce the amount of units still desired by the buyer and if 0 destroy the Accept order
-    if (p_accept->reduceAcceptAmountRemaining_andIsZero(amountPurchased))
+    const bool fAcceptFilled = p_accept->reduceAcceptAmountRemaining_andIsZero(amountPurchased);
+    NotifyConsensusAcceptChanged(keyAccept);
+    NotifyStateSectionChanged(FILETYPE_ACCEPTS);
+
+    if (fAcceptFilled)
     {
         if(msc_debug_dex) PrintToLog("p_accept->reduceAcceptAmountRemaining_andIsZero true\n");
 
@@ -676,6 +700,8 @@ unsigned int eraseExpiredAccepts(int blockNow)
 
             DEx_acceptDestroy(addressBuyer, addressSeller, propertyId);
 
+            NotifyConsensusAcceptChanged(it->first);
+            NotifyStateSectionChanged(FILETYPE_ACCEPTS);
             my_accepts.erase(it++);
 
             ++how_many_erased;
@@ -4,6 +4,7 @@
 #include <tradelayer/log.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/tx.h>
+#include <tradelayer/volume.h>
 
 #include <amount.h>
 #include <hash.h>
@@ -235,9 +236,9 @@ typedef std::map<std::string, CMPOffer> OfferMap;
 typedef std::map<std::string, CMPAccept> AcceptMap;
 
 /** Map of LTC Volume in DEx**/
-extern std::map<int, std::map<uint32_t,int64_t>> MapLTCVolume;
+extern CMPVolumeHistory MapLTCVolume;
 /** Map of Token Volume in DEx**/
-extern std::map<int, std::map<uint32_t,int64_t>> MapTokenVolume;
+extern CMPVolumeHistory MapTokenVolume;
 
 //! Global map for token numerator VWAP (LTC) NOTE: it needs persistence
 extern std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>> tokenvwap;
@@ -0,0 +1,124 @@
+#include <tradelayer/identity.h>
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace mastercore;
+
+void CMPIdentityRegistry::Insert(Records& records, std::map<std::string, std::map<std::string, const Record*>>& byAddress, const std::string& key, const Record& record)
+{
+    Records::iterator it = records.insert(std::make_pair(key, record)).first;
+    byAddress[record.address][key] = &it->second;
+}
+
+bool CMPIdentityRegistry::Erase(Records& records, std::map<std::string, std::map<std::string, const Record*>>& byAddress, const std::string& key)
+{
+    Records::iterator it = records.find(key);
+    if (it == records.end()) return false;
+
+    std::map<std::string, std::map<std::string, const Record*>>::iterator itAddress = byAddress.find(it->second.address);
+    if (itAddress != byAddress.end()) {
+        itAddress->second.erase(key);
+        if (itAddress->second.empty()) byAddress.erase(itAddress);
+    }
+    records.erase(it);
+
+    return true;
+}
+
+const CMPIdentityRegistry::Record* CMPIdentityRegistry::GetLast(const std::map<std::string, std::map<std::string, const Record*>>& byAddress, const std::string& address)
+{
+    std::map<std::string, std::map<std::string, const Record*>>::const_iterator it = byAddress.find(address);
+    if (it == byAddress.end() || it->second.empty()) return nullptr;
+
+    return it->second.rbegin()->second;
+}
+
+void CMPIdentityRegistry::AddRegistration(const std::string& key, const std::string& address, int kyc_id, int block)
+{
+    Remove(key);
+
+    Record record;
+    record.address = address;
+    record.kyc_id = kyc_id;
+    record.block = block;
+    Insert(registrations, registrationsByAddress, key, record);
+}
+
+void CMPIdentityRegistry::AddAttestation(const std::string& key, const std::string& attester, const std::string& address, int kyc_id, int block)
+{
+    Remove(key);
+
+    Record record;
+    record.address = address;
+    record.attester = attester;
+    record.kyc_id = kyc_id;
+    record.block = block;
+    Insert(attestations, attestationsByAddress, key, record);
+}
+
+bool CMPIdentityRegistry::Remove(const std::string& key)
+{
+    bool fRegistration = Erase(registrations, registrationsByAddress, key);
+    bool fAttestation = Erase(attestations, attestationsByAddress, key);
+
+    return fRegistration || fAttestation;
+}
+
+bool CMPIdentityRegistry::GetRegistration(const std::string& address, int& kyc_id) const
+{
+    const Record* record = GetLast(registrationsByAddress, address);
+    if (!record) return false;
+
+    kyc_id = record->kyc_id;
+    return true;
+}
+
+bool CMPIdentityRegistry::GetAttestation(const std::string& address, int& kyc_id) const
+{
+    const Record* record = GetLast(attestationsByAddress, address);
+    if (!record) return false;
+
+    kyc_id = record->kyc_id;
+    return true;
+}
+
+bool CMPIdentityRegistry::FindAttestation(const std::string& attester, const std::string& address, std::string& key) const
+{
+    std::map<std::string, std::map<std::string, const Record*>>::const_iterator it = attestationsByAddress.find(address);
+    if (it == attestationsByAddress.end()) return false;
+
+    for (std::map<std::string, const Record*>::const_reverse_iterator itKey = it->second.rbegin(); itKey != it->second.rend(); ++itKey) {
+        if (itKey->second->attester == attester) {
+            key = itKey->first;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<std::string> CMPIdentityRegistry::GetKeysAbove(int block) const
+{
+    std::vector<std::string> keys;
+    for (Records::const_iterator it = registrations.begin(); it != registrations.end(); ++it) {
+        if (it->second.block > block) keys.push_back(it->first);
+    }
+    for (Records::const_iterator it = attestations.begin(); it != attestations.end(); ++it) {
+        if (it->second.block > block) keys.push_back(it->first);
+    }
+
+    return keys;
+}
+
+void CMPIdentityRegistry::Clear()
+{
+    registrations.clear();
+    attestations.clear();
+    registrationsByAddress.clear();
+    attestationsByAddress.clear();
+}
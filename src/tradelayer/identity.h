@@ -0,0 +1,70 @@
+#ifndef TRADELAYER_IDENTITY_H
+#define TRADELAYER_IDENTITY_H
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mastercore
+{
+/** In-memory view of the identity registrations and attestations of the trade database.
+ *
+ * Each record is kept under the database key it is stored with, so lookups
+ * resolve to the same record as a backwards scan over the database: the one
+ * with the greatest key.
+ */
+class CMPIdentityRegistry
+{
+public:
+    struct Record
+    {
+        //! Registered or attested address
+        std::string address;
+        //! Attesting address, empty for registrations
+        std::string attester;
+        int kyc_id;
+        int block;
+    };
+
+private:
+    typedef std::map<std::string, Record> Records;
+
+    //! Records by database key
+    Records registrations;
+    Records attestations;
+    //! Database keys of the records by address, in database order
+    std::map<std::string, std::map<std::string, const Record*>> registrationsByAddress;
+    std::map<std::string, std::map<std::string, const Record*>> attestationsByAddress;
+
+    static void Insert(Records& records, std::map<std::string, std::map<std::string, const Record*>>& byAddress, const std::string& key, const Record& record);
+    static bool Erase(Records& records, std::map<std::string, std::map<std::string, const Record*>>& byAddress, const std::string& key);
+    static const Record* GetLast(const std::map<std::string, std::map<std::string, const Record*>>& byAddress, const std::string& address);
+
+public:
+    /** Adds the registration of an address, replacing any record with the same key. */
+    void AddRegistration(const std::string& key, const std::string& address, int kyc_id, int block);
+    /** Adds the attestation of an address, replacing any record with the same key. */
+    void AddAttestation(const std::string& key, const std::string& attester, const std::string& address, int kyc_id, int block);
+    /** Removes the record with the given key, if any. */
+    bool Remove(const std::string& key);
+
+    /** Retrieves the KYC identifier of the latest registration of an address. */
+    bool GetRegistration(const std::string& address, int& kyc_id) const;
+    /** Retrieves the KYC identifier of the latest attestation of an address. */
+    bool GetAttestation(const std::string& address, int& kyc_id) const;
+    /** Finds the key of the latest attestation of an address by the attester. */
+    bool FindAttestation(const std::string& attester, const std::string& address, std::string& key) const;
+
+    /** Returns the keys of all records of blocks after the given one. */
+    std::vector<std::string> GetKeysAbove(int block) const;
+
+    size_t CountRegistrations() const { return registrations.size(); }
+    size_t CountAttestations() const { return attestations.size(); }
+    void Clear();
+};
+
+} // namespace mastercore
+
+#endif // TRADELAYER_IDENTITY_H
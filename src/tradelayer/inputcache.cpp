@@ -0,0 +1,259 @@
+/**
+ * @file inputcache.cpp
+ *
+ * Resolves and caches the previous outputs of transactions, which are needed
+ * to identify the sender and the fee of Trade Layer transactions.
+ */
+
+#include <tradelayer/inputcache.h>
+
+#include <tradelayer/log.h>
+#include <tradelayer/tradelayer.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <sync.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <uint256.h>
+#include <validation.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace mastercore;
+
+CInputCache mastercore::inputCache(DEFAULT_INPUT_CACHE_SIZE);
+
+CInputCache::CInputCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn)
+{
+}
+
+bool CInputCache::Get(const COutPoint& outpoint, CTxOut& txOutRet)
+{
+    std::unordered_map<COutPoint, Entries::iterator, SaltedOutpointHasher>::iterator it = index.find(outpoint);
+    if (it == index.end()) {
+        ++stats.nMisses;
+        return false;
+    }
+
+    // move to the front, as most recently used
+    entries.splice(entries.begin(), entries, it->second);
+    txOutRet = it->second->second;
+    ++stats.nHits;
+
+    return true;
+}
+
+void CInputCache::Add(const COutPoint& outpoint, const CTxOut& txOut)
+{
+    std::unordered_map<COutPoint, Entries::iterator, SaltedOutpointHasher>::iterator it = index.find(outpoint);
+    if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+
+    entries.push_front(std::make_pair(outpoint, txOut));
+    index.insert(std::make_pair(outpoint, entries.begin()));
+    Trim();
+}
+
+void CInputCache::Trim()
+{
+    while (index.size() > nMaxEntries && !entries.empty()) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+        ++stats.nEvictions;
+    }
+}
+
+void CInputCache::RecordReads(uint64_t nTxs, uint64_t nFiles)
+{
+    stats.nTxReads += nTxs;
+    stats.nFileReads += nFiles;
+}
+
+void CInputCache::SetMaxEntries(size_t nMaxEntriesIn)
+{
+    nMaxEntries = nMaxEntriesIn;
+    Trim();
+}
+
+void CInputCache::Clear()
+{
+    entries.clear();
+    index.clear();
+}
+
+CInputCacheStats CInputCache::GetStats() const
+{
+    CInputCacheStats ret = stats;
+    ret.nEntries = index.size();
+    return ret;
+}
+
+/**
+ * Caches all outputs of a fetched transaction, given later transactions
+ * often spend its other outputs, and fills the inputs spending it.
+ */
+static bool AddPrevOutputs(const CTransaction& txPrev, const CTransaction& tx, const std::vector<size_t>& vInputs, std::vector<CTxOut>& vPrevOutsRet)
+{
+    for (unsigned int n = 0; n < txPrev.vout.size(); ++n) {
+        inputCache.Add(COutPoint(txPrev.GetHash(), n), txPrev.vout[n]);
+    }
+
+    for (size_t nInput : vInputs) {
+        const COutPoint& prevout = tx.vin[nInput].prevout;
+        if (prevout.n >= txPrev.vout.size()) {
+            PrintToLog("%s(): ERROR: output %s does not exist\n", __func__, prevout.ToString());
+            return false;
+        }
+        vPrevOutsRet[nInput] = txPrev.vout[prevout.n];
+    }
+
+    return true;
+}
+
+/**
+ * Resolves the previous outputs of all inputs of a transaction.
+ *
+ * Outputs are taken from the input cache, or the coins spent by the block,
+ * if available. The transactions of the remaining outputs are located via
+ * the transaction index and read in batches, opening each block file only
+ * once. Without transaction index, they are fetched one by one.
+ *
+ * Note: cs_main and cs_tx_cache must be held.
+ *
+ * @param tx[in]             The transaction
+ * @param removedCoins[in]   The coins spent by the block of the transaction (optional)
+ * @param vPrevOutsRet[out]  The previous outputs, in the order of the inputs
+ * @return True, if all previous outputs were found
+ */
+bool mastercore::ResolveInputs(const CTransaction& tx, const std::shared_ptr<std::map<COutPoint, Coin> >& removedCoins, std::vector<CTxOut>& vPrevOutsRet)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_tx_cache);
+
+    vPrevOutsRet.assign(tx.vin.size(), CTxOut());
+
+    // inputs still to fetch, by transaction
+    std::map<uint256, std::vector<size_t> > mapMissing;
+
+    for (size_t nInput = 0; nInput < tx.vin.size(); ++nInput) {
+        const COutPoint& prevout = tx.vin[nInput].prevout;
+        if (inputCache.Get(prevout, vPrevOutsRet[nInput])) {
+            continue;
+        }
+
+        if (removedCoins) {
+            std::map<COutPoint, Coin>::const_iterator it = removedCoins->find(prevout);
+            if (it != removedCoins->end()) {
+                vPrevOutsRet[nInput] = it->second.out;
+                inputCache.Add(prevout, it->second.out);
+                continue;
+            }
+        }
+
+        mapMissing[prevout.hash].push_back(nInput);
+    }
+
+    if (mapMissing.empty()) return true;
+
+    // locations of the transactions by block file
+    std::map<int, std::vector<std::pair<CDiskTxPos, uint256> > > mapFiles;
+    uint64_t nTxReads = 0;
+    uint64_t nFileReads = 0;
+    bool fSuccess = true;
+
+    for (std::map<uint256, std::vector<size_t> >::const_iterator it = mapMissing.begin(); fSuccess && it != mapMissing.end(); ++it) {
+        const uint256& txid = it->first;
+
+        CDiskTxPos postx;
+        CTransactionRef txPrev = mempool.get(txid);
+        if (!txPrev && fTxIndex && pblocktree->ReadTxIndex(txid, postx)) {
+            mapFiles[postx.nFile].push_back(std::make_pair(postx, txid));
+            continue;
+        }
+
+        if (!txPrev) {
+            uint256 hashBlock;
+            if (!GetTransaction(txid, txPrev, Params().GetConsensus(), hashBlock, true)) {
+                if (msc_debug_fill_tx_input_cache) PrintToLog("%s(): transaction %s not found\n", __func__, txid.GetHex());
+                fSuccess = false;
+                break;
+            }
+            ++nTxReads;
+        }
+
+        fSuccess = AddPrevOutputs(*txPrev, tx, it->second, vPrevOutsRet);
+    }
+
+    for (std::map<int, std::vector<std::pair<CDiskTxPos, uint256> > >::iterator it = mapFiles.begin(); fSuccess && it != mapFiles.end(); ++it) {
+        std::vector<std::pair<CDiskTxPos, uint256> >& vTxs = it->second;
+
+        // read the file front to back
+        std::sort(vTxs.begin(), vTxs.end(), [](const std::pair<CDiskTxPos, uint256>& a, const std::pair<CDiskTxPos, uint256>& b) {
+            if (a.first.nPos != b.first.nPos) return a.first.nPos < b.first.nPos;
+            return a.first.nTxOffset < b.first.nTxOffset;
+        });
+
+        CAutoFile file(OpenBlockFile(vTxs.front().first, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            PrintToLog("%s(): ERROR: failed to open block file %d\n", __func__, it->first);
+            fSuccess = false;
+            break;
+        }
+        ++nFileReads;
+
+        for (const std::pair<CDiskTxPos, uint256>& entry : vTxs) {
+            CTransactionRef txPrev;
+            try {
+                CBlockHeader header;
+                if (fseek(file.Get(), entry.first.nPos, SEEK_SET)) {
+                    throw std::runtime_error("seek failed");
+                }
+                file >> header;
+                if (fseek(file.Get(), entry.first.nTxOffset, SEEK_CUR)) {
+                    throw std::runtime_error("seek failed");
+                }
+                file >> txPrev;
+            } catch (const std::exception& e) {
+                PrintToLog("%s(): ERROR: failed to read transaction %s: %s\n", __func__, entry.second.GetHex(), e.what());
+                fSuccess = false;
+                break;
+            }
+            ++nTxReads;
+
+            if (txPrev->GetHash() != entry.second) {
+                PrintToLog("%s(): ERROR: txid mismatch for %s\n", __func__, entry.second.GetHex());
+                fSuccess = false;
+                break;
+            }
+
+            if (!AddPrevOutputs(*txPrev, tx, mapMissing[entry.second], vPrevOutsRet)) {
+                fSuccess = false;
+                break;
+            }
+        }
+    }
+
+    inputCache.RecordReads(nTxReads, nFileReads);
+
+    if (msc_debug_fill_tx_input_cache) {
+        PrintToLog("%s(): %s: %d transactions fetched from %d block files\n", __func__, tx.GetHash().GetHex(), nTxReads, nFileReads);
+    }
+
+    return fSuccess;
+}
@@ -0,0 +1,84 @@
+#ifndef TRADELAYER_INPUTCACHE_H
+#define TRADELAYER_INPUTCACHE_H
+
+#include <coins.h>
+#include <primitives/transaction.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mastercore
+{
+//! Previous outputs kept in the input cache, if not set via -tltxcache
+const size_t DEFAULT_INPUT_CACHE_SIZE = 500000;
+
+/** Usage statistics of the input cache. */
+struct CInputCacheStats
+{
+    //! Previous outputs served from the cache
+    uint64_t nHits;
+    //! Previous outputs, which had to be fetched
+    uint64_t nMisses;
+    //! Least recently used outputs dropped to make room
+    uint64_t nEvictions;
+    //! Transactions read from the block files
+    uint64_t nTxReads;
+    //! Block files opened to read transactions
+    uint64_t nFileReads;
+    //! Outputs currently cached
+    size_t nEntries;
+
+    CInputCacheStats() : nHits(0), nMisses(0), nEvictions(0), nTxReads(0), nFileReads(0), nEntries(0) {}
+};
+
+/** Least recently used cache of previous outputs, used to identify senders.
+ *
+ * Once the cache is full, only the least recently used outputs are dropped,
+ * rather than the whole cache.
+ */
+class CInputCache
+{
+private:
+    typedef std::list<std::pair<COutPoint, CTxOut> > Entries;
+
+    //! Outputs, most recently used first
+    Entries entries;
+    std::unordered_map<COutPoint, Entries::iterator, SaltedOutpointHasher> index;
+    size_t nMaxEntries;
+    CInputCacheStats stats;
+
+    void Trim();
+
+public:
+    explicit CInputCache(size_t nMaxEntriesIn);
+
+    /** Returns a cached output and marks it as recently used. */
+    bool Get(const COutPoint& outpoint, CTxOut& txOutRet);
+
+    /** Adds an output, and drops the least recently used ones, if the cache is full. */
+    void Add(const COutPoint& outpoint, const CTxOut& txOut);
+
+    /** Counts transactions and files read to fetch outputs. */
+    void RecordReads(uint64_t nTxs, uint64_t nFiles);
+
+    void SetMaxEntries(size_t nMaxEntriesIn);
+    void Clear();
+
+    CInputCacheStats GetStats() const;
+};
+
+//! Previous outputs of parsed transactions, guarded by cs_tx_cache
+extern CInputCache inputCache;
+
+/** Resolves the previous outputs of all inputs of a transaction. */
+bool ResolveInputs(const CTransaction& tx, const std::shared_ptr<std::map<COutPoint, Coin> >& removedCoins, std::vector<CTxOut>& vPrevOutsRet);
+}
+
+#endif // TRADELAYER_INPUTCACHE_H
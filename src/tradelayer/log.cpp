@@ -5,10 +5,18 @@
 #include <util/time.h>
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
-#include <stdio.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 // Default log files
@@ -17,6 +25,13 @@ const std::string LOG_FILENAME    = "tradelayer.log";
 // Options
 static const long LOG_BUFFERSIZE  =  8000000; //  8 MB
 static const long LOG_SHRINKSIZE  = 50000000; // 50 MB
+static const size_t LOG_FILEBUFFER = 65536;   // 64 KB
+
+//! Messages queued for the log writer, if not set via -tllogqueue
+static const int64_t DEFAULT_LOG_QUEUE_SIZE = 16384;
+static const int64_t MAX_LOG_QUEUE_SIZE = 1048576;
+//! Milliseconds between flushes of the log writer
+static const int LOG_FLUSH_INTERVAL = 100;
 
 // Debug flags
 bool msc_debug_parser_data                      = 0;
@@ -32,6 +47,7 @@ bool msc_debug_tokens                           = 0;
 bool msc_debug_spec                             = 0;
 bool msc_debug_exo                              = 0;
 bool msc_debug_tally                            = 0;
+bool msc_debug_tally_totals                     = 0;
 bool msc_debug_sp                               = 0;
 bool msc_debug_txdb                             = 1;
 bool msc_debug_persistence                      = 0;
@@ -128,12 +144,114 @@ bool msc_debug_try_add_second                   = 0;
  * the mutex).
  */
 static std::once_flag debugLogInitFlag;
+
+/** A message waiting to be written, with the time it was logged. */
+struct LogEntry
+{
+    //! Position in the queue, which indicates, whether the slot is free or filled
+    std::atomic<size_t> nSequence;
+    int64_t nTime;
+    std::string str;
+};
+
+/**
+ * Bounded queue of log messages, which many threads can add to without
+ * locking, while the log writer takes them out.
+ *
+ * Each slot carries a sequence number: a producer claims the slot at the
+ * enqueue position, if the sequence equals the position, and publishes the
+ * message by advancing the sequence. The consumer frees the slot by setting
+ * the sequence one lap ahead.
+ */
+class LogQueue
+{
+private:
+    std::unique_ptr<LogEntry[]> entries;
+    const size_t nMask;
+    std::atomic<size_t> nEnqueuePos;
+    std::atomic<size_t> nDequeuePos;
+
+public:
+    //! The size must be a power of two
+    explicit LogQueue(size_t nSize) : entries(new LogEntry[nSize]), nMask(nSize - 1), nEnqueuePos(0), nDequeuePos(0)
+    {
+        assert(nSize > 1 && (nSize & nMask) == 0);
+        for (size_t i = 0; i < nSize; ++i) {
+            entries[i].nSequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /** Adds a message, unless the queue is full. */
+    bool TryPush(int64_t nTime, std::string& str)
+    {
+        LogEntry* entry;
+        size_t nPos = nEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            entry = &entries[nPos & nMask];
+            const size_t nSequence = entry->nSequence.load(std::memory_order_acquire);
+            const intptr_t nDiff = (intptr_t) nSequence - (intptr_t) nPos;
+            if (nDiff == 0) {
+                if (nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed)) break;
+            } else if (nDiff < 0) {
+                return false;
+            } else {
+                nPos = nEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        entry->nTime = nTime;
+        entry->str.swap(str);
+        entry->nSequence.store(nPos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /** Takes out the oldest message. Only one thread may do so at a time. */
+    bool TryPop(int64_t& nTimeRet, std::string& strRet)
+    {
+        const size_t nPos = nDequeuePos.load(std::memory_order_relaxed);
+        LogEntry& entry = entries[nPos & nMask];
+        const size_t nSequence = entry.nSequence.load(std::memory_order_acquire);
+        if ((intptr_t) nSequence - (intptr_t) (nPos + 1) < 0) return false;
+
+        nTimeRet = entry.nTime;
+        strRet.swap(entry.str);
+        entry.str.clear();
+        entry.nSequence.store(nPos + nMask + 1, std::memory_order_release);
+        nDequeuePos.store(nPos + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /** Returns the approximate number of queued messages. */
+    size_t Size() const
+    {
+        return nEnqueuePos.load(std::memory_order_relaxed) - nDequeuePos.load(std::memory_order_relaxed);
+    }
+
+    size_t Capacity() const
+    {
+        return nMask + 1;
+    }
+};
+
 /**
  * We use std::call_once() to make sure these are initialized
  * in a thread-safe manner the first time called:
  */
 static FILE* fileout = nullptr;
+//! Guards the file, and taking messages out of the queue
 static std::mutex* mutexDebugLog = nullptr;
+static LogQueue* logQueue = nullptr;
+static std::mutex* mutexLogWriter = nullptr;
+static std::condition_variable* cvLogWriter = nullptr;
+static std::thread* logWriterThread = nullptr;
+//! Whether messages are queued for the log writer, or written right away
+static std::atomic<bool> fLogWriterRunning(false);
+static bool fLogWriterStop = false;
+//! Whether messages are dropped, rather than waiting, once the queue is full
+static bool fLogDropWhenFull = false;
+static std::atomic<uint64_t> nLogDropped(0);
 
 /** Flag to indicate, whether the Trade Layer log file should be reopened. */
 extern std::atomic<bool> fReopentradelayerLog;
@@ -160,7 +278,96 @@ static fs::path GetLogPath()
 }
 
 /**
- * Opens debug log file.
+ * @return The given time in the format: 2009-01-03 18:15:05
+ */
+ static std::string GetTimestamp(int64_t nTime)
+ {
+     return FormatISO8601DateTime(nTime);
+ }
+
+/**
+ * Writes a message to the log file.
+ *
+ * Note: mutexDebugLog must be held.
+ *
+ * @return The total number of characters written
+ */
+static int WriteToLogFile(int64_t nTime, const std::string& str)
+{
+    static bool fStartedNewLine = true;
+    int ret = 0; // Number of characters written
+
+    // Reopen the log file, if requested
+    if (fReopenTradeLayerLog)
+    {
+        fReopenTradeLayerLog = false;
+        fs::path pathDebug = GetLogPath();
+        if (freopen(pathDebug.string().c_str(), "a", fileout) != nullptr)
+            setvbuf(fileout, nullptr, _IOFBF, LOG_FILEBUFFER);
+    }
+
+    // Printing log timestamps can be useful for profiling
+    if (fLogTimestamps && fStartedNewLine) {
+        ret += fprintf(fileout, "%s ", GetTimestamp(nTime).c_str());
+    }
+
+    fStartedNewLine = (!str.empty() && str[str.size()-1] == '\n') ? true : false;
+
+    ret += fwrite(str.data(), 1, str.size(), fileout);
+
+    return ret;
+}
+
+/**
+ * Writes all queued messages to the log file.
+ *
+ * Note: mutexDebugLog must be held.
+ */
+static void DrainLogQueue()
+{
+    int64_t nTime;
+    std::string str;
+    while (logQueue->TryPop(nTime, str)) {
+        WriteToLogFile(nTime, str);
+    }
+
+    const uint64_t nDropped = nLogDropped.exchange(0);
+    if (nDropped > 0) {
+        WriteToLogFile(GetTime(), strprintf("%d log messages dropped, because the log queue was full\n", nDropped));
+    }
+
+    fflush(fileout);
+}
+
+/**
+ * Writes the queued messages in batches, until stopped.
+ */
+static void LogWriterLoop()
+{
+    while (true) {
+        bool fStop;
+        {
+            std::unique_lock<std::mutex> lock(*mutexLogWriter);
+            cvLogWriter->wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL), [] { return fLogWriterStop || logQueue->Size() >= logQueue->Capacity() / 2; });
+            fStop = fLogWriterStop;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(*mutexDebugLog);
+            DrainLogQueue();
+        }
+
+        if (fStop) break;
+    }
+}
+
+/**
+ * Opens debug log file, and starts the log writer.
+ *
+ * The size of the queue of the log writer can be set via "-tllogqueue", and
+ * with "-tllogqueue=0" messages are written right away. Once the queue is
+ * full, callers wait for the writer, unless "-tllogdrop" is set, in which
+ * case the messages are dropped and counted.
  */
 static void DebugLogInit()
 {
@@ -171,25 +378,53 @@ static void DebugLogInit()
     fileout = fopen(pathDebug.string().c_str(), "a");
 
     if (fileout) {
-        setbuf(fileout, nullptr); // Unbuffered
+        setvbuf(fileout, nullptr, _IOFBF, LOG_FILEBUFFER);
     } else {
         PrintToConsole("Failed to open debug log file: %s\n", pathDebug.string());
     }
 
     mutexDebugLog = new std::mutex();
+
+    const int64_t nQueueSize = std::min<int64_t>(gArgs.GetArg("-tllogqueue", DEFAULT_LOG_QUEUE_SIZE), MAX_LOG_QUEUE_SIZE);
+    if (fileout == nullptr || nQueueSize <= 0) return;
+
+    // round up to a power of two
+    size_t nCapacity = 2;
+    while ((int64_t) nCapacity < nQueueSize) nCapacity <<= 1;
+
+    fLogDropWhenFull = gArgs.GetBoolArg("-tllogdrop", false);
+    logQueue = new LogQueue(nCapacity);
+    mutexLogWriter = new std::mutex();
+    cvLogWriter = new std::condition_variable();
+    logWriterThread = new std::thread(&TraceThread<std::function<void()>>, "tllogwriter", std::function<void()>(LogWriterLoop));
+    fLogWriterRunning = true;
 }
 
 /**
- * @return The current timestamp in the format: 2009-01-03 18:15:05
+ * Writes the queued messages and stops the log writer.
+ *
+ * Later messages are written right away.
  */
- static std::string GetTimestamp()
- {
-     return FormatISO8601DateTime(GetTime());
- }
+void StopLogWriter()
+{
+    if (logWriterThread == nullptr) return;
+
+    fLogWriterRunning = false;
+    {
+        std::lock_guard<std::mutex> lock(*mutexLogWriter);
+        fLogWriterStop = true;
+    }
+    cvLogWriter->notify_one();
+
+    if (logWriterThread->joinable()) logWriterThread->join();
+}
 
 /**
  * Prints to log file.
  *
+ * The message is queued for the log writer, which adds the timestamp and
+ * writes it, so the caller doesn't wait for the disk.
+ *
  * The configuration options "-logtimestamps" can be used to indicate, whether
  * the message to log should be prepended with a timestamp.
  *
@@ -197,7 +432,7 @@ static void DebugLogInit()
  * output, usually the console, instead of a log file.
  *
  * @param str[in]  The message to log
- * @return The total number of characters written
+ * @return The total number of characters logged
  */
 int LogFilePrint(const std::string& str)
 {
@@ -207,7 +442,6 @@ int LogFilePrint(const std::string& str)
         ret = ConsolePrint(str);
 
     } else {
-        static bool fStartedNewLine = true;
         std::call_once(debugLogInitFlag, &DebugLogInit);
 
         if (fileout == nullptr)
@@ -215,26 +449,41 @@ int LogFilePrint(const std::string& str)
             return ret;
         }
 
-        std::lock_guard<std::mutex> lock(*mutexDebugLog);
+        const int64_t nTime = GetTime();
+
+        if (fLogWriterRunning) {
+            std::string msg(str);
+            bool fQueued;
+            while (!(fQueued = logQueue->TryPush(nTime, msg))) {
+                if (fLogDropWhenFull) {
+                    ++nLogDropped;
+                    return ret;
+                }
+                // wait for the writer to make room
+                cvLogWriter->notify_one();
+                std::this_thread::yield();
+                if (!fLogWriterRunning) break;
+            }
 
-        // Reopen the log file, if requested
-        if (fReopenTradeLayerLog)
-        {
-            fReopenTradeLayerLog = false;
-            fs::path pathDebug = GetLogPath();
-            if (freopen(pathDebug.string().c_str(), "a", fileout) != nullptr)
-                setbuf(fileout, nullptr); // Unbuffered
+            if (fQueued) {
+                if (logQueue->Size() >= logQueue->Capacity() / 2) cvLogWriter->notify_one();
 
-         }
+                // the writer might have been stopped meanwhile, so it's written here
+                if (!fLogWriterRunning) {
+                    std::lock_guard<std::mutex> lock(*mutexDebugLog);
+                    DrainLogQueue();
+                }
+                return str.size();
+            }
+        }
 
-         // Printing log timestamps can be useful for profiling
-         if (fLogTimestamps && fStartedNewLine) {
-           ret += fprintf(fileout, "%s ", GetTimestamp().c_str());
-         }
+        std::lock_guard<std::mutex> lock(*mutexDebugLog);
 
-         fStartedNewLine = (!str.empty() && str[str.size()-1] == '\n') ? true : false;
+        // messages queued, while the writer was stopped, go first
+        if (logQueue != nullptr) DrainLogQueue();
 
-         ret += fwrite(str.data(), 1, str.size(), fileout);
+        ret = WriteToLogFile(nTime, str);
+        fflush(fileout);
     }
 
     return ret;
@@ -257,7 +506,7 @@ int ConsolePrint(const std::string& str)
     static bool fStartedNewLine = true;
 
     if (fLogTimestamps && fStartedNewLine) {
-        ret = fprintf(stdout, "%s %s", GetTimestamp().c_str(), str.c_str());
+        ret = fprintf(stdout, "%s %s", GetTimestamp(GetTime()).c_str(), str.c_str());
     } else {
         ret = fwrite(str.data(), 1, str.size(), stdout);
     }
@@ -298,6 +547,7 @@ void InitDebugLogLevels()
           if (*it == "spec") msc_debug_spec = true;
           if (*it == "exo") msc_debug_exo = true;
           if (*it == "tally") msc_debug_tally = true;
+          if (*it == "tally_totals") msc_debug_tally_totals = true;
           if (*it == "sp") msc_debug_sp = true;
           if (*it == "txdb") msc_debug_txdb = true;
           if (*it == "persistence") msc_debug_persistence = true;
@@ -326,6 +576,7 @@ void InitDebugLogLevels()
               msc_debug_spec = allDebugState;
               msc_debug_exo = allDebugState;
               msc_debug_tally = allDebugState;
+              msc_debug_tally_totals = allDebugState;
               msc_debug_sp = allDebugState;
               msc_debug_txdb = allDebugState;
               msc_debug_persistence = allDebugState;
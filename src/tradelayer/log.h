@@ -9,6 +9,9 @@
 /** Prints to the log file. */
 int LogFilePrint(const std::string& str);
 
+/** Writes the queued messages and stops the log writer. */
+void StopLogWriter();
+
 /** Prints to the console. */
 int ConsolePrint(const std::string& str);
 
@@ -32,6 +35,7 @@ extern bool msc_debug_tokens;
 extern bool msc_debug_spec;
 extern bool msc_debug_exo;
 extern bool msc_debug_tally;
+extern bool msc_debug_tally_totals;
 extern bool msc_debug_sp;
 extern bool msc_debug_txdb;
 extern bool msc_debug_persistence;
@@ -43,23 +43,23 @@ using namespace mastercore;
 //! Global map for price and order data
 md_PropertiesMap mastercore::metadex;
 //! Global map for  tokens volume
-std::map<int, std::map<uint32_t,int64_t>> mastercore::metavolume;
+CMPVolumeHistory mastercore::metavolume;
 //! Global map for last contract price
 std::map<uint32_t,int64_t> mastercore::cdexlastprice;
 
 extern MatrixTLS *pt_ndatabase;
 
 
-md_PricesMap* mastercore::get_Prices(uint32_t prop)
+md_PricesMap* mastercore::get_Prices(uint32_t prop, uint32_t desprop)
 {
-    md_PropertiesMap::iterator it = metadex.find(prop);
+    md_PropertiesMap::iterator it = metadex.find(md_PairKey(prop, desprop));
 
     if (it != metadex.end()) return &(it->second);
 
     return static_cast<md_PricesMap*>(nullptr);
 }
 
-md_Set* mastercore::get_Indexes(md_PricesMap* p, rational_t price)
+md_Set* mastercore::get_Indexes(md_PricesMap* p, const CMPPrice& price)
 {
     md_PricesMap::iterator it = p->find(price);
 
@@ -69,6 +69,16 @@ md_Set* mastercore::get_Indexes(md_PricesMap* p, rational_t price)
 
 }
 
+std::pair<md_PropertiesMap::iterator, md_PropertiesMap::iterator> mastercore::get_PairsRange(uint32_t prop)
+{
+    md_PropertiesMap::iterator first = metadex.lower_bound(md_PairKey(prop, 0));
+    md_PropertiesMap::iterator last = first;
+
+    while (last != metadex.end() && last->first.first == prop) ++last;
+
+    return std::make_pair(first, last);
+}
+
 cd_PropertiesMap mastercore::contractdex;
 
 cd_PricesMap *mastercore::get_PricesCd(uint32_t prop)
@@ -89,6 +99,83 @@ cd_Set *mastercore::get_IndexesCd(cd_PricesMap *p, uint64_t price)
     return static_cast<cd_Set*>(nullptr);
 }
 
+COrderIndex<md_Position> mastercore::metadex_index;
+COrderIndex<cd_Position> mastercore::contractdex_index;
+
+static md_Position MetaDExPosition(const CMPMetaDEx& obj)
+{
+    return md_Position(md_PairKey(obj.getProperty(), obj.getDesProperty()), obj.unitPrice(), obj.getBlock(), obj.getIdx());
+}
+
+static cd_Position ContractDexPosition(const CMPContractDex& obj)
+{
+    return cd_Position(obj.getProperty(), obj.getEffectivePrice(), obj.getBlock(), obj.getIdx());
+}
+
+//! Inserts an order into a price level and into the indexes, and records it for the next state delta
+static bool InsertOrder(md_Set& indexes, const CMPMetaDEx& obj)
+{
+    if (!indexes.insert(obj).second) return false;
+
+    metadex_index.Add(obj.getHash(), obj.getAddr(), obj.getProperty(), MetaDExPosition(obj), obj.GenerateConsensusString());
+    NotifyStateOrderInserted(obj);
+    return true;
+}
+
+static bool InsertOrder(cd_Set& indexes, const CMPContractDex& obj)
+{
+    if (!indexes.insert(obj).second) return false;
+
+    contractdex_index.Add(obj.getHash(), obj.getAddr(), obj.getProperty(), ContractDexPosition(obj), obj.GenerateConsensusString());
+    NotifyStateOrderInserted(obj);
+    return true;
+}
+
+//! Removes an order from a price level and from the indexes, and records it for the next state delta; returns the next order
+static md_Set::iterator EraseOrder(md_Set& indexes, md_Set::iterator it)
+{
+    metadex_index.Remove(it->getHash(), it->getAddr(), it->getProperty(), MetaDExPosition(*it), it->GenerateConsensusString());
+    NotifyStateOrderErased(*it);
+    return indexes.erase(it);
+}
+
+static cd_Set::iterator EraseOrder(cd_Set& indexes, cd_Set::iterator it)
+{
+    contractdex_index.Remove(it->getHash(), it->getAddr(), it->getProperty(), ContractDexPosition(*it), it->GenerateConsensusString());
+    NotifyStateOrderErased(*it);
+    return indexes.erase(it);
+}
+
+//! Returns the price level of the order at the position, or nullptr, if there is no such order
+static md_Set* FindOrder(const md_Position& position, md_Set::iterator& it)
+{
+    md_PricesMap* const prices = get_Prices(position.book.first, position.book.second);
+    if (!prices) return nullptr;
+
+    md_Set* const indexes = get_Indexes(prices, position.price);
+    if (!indexes) return nullptr;
+
+    // orders are identified by block and position in block within the price level
+    it = indexes->find(CMPMetaDEx(std::string(), position.block, 0, 0, 0, 0, uint256(), position.idx, 0));
+    if (it == indexes->end()) return nullptr;
+
+    return indexes;
+}
+
+static cd_Set* FindOrder(const cd_Position& position, cd_Set::iterator& it)
+{
+    cd_PricesMap* const prices = get_PricesCd(position.book);
+    if (!prices) return nullptr;
+
+    cd_Set* const indexes = get_IndexesCd(prices, position.price);
+    if (!indexes) return nullptr;
+
+    it = indexes->find(CMPContractDex(std::string(), position.block, 0, 0, 0, 0, uint256(), position.idx, 0, 0, 0, 0));
+    if (it == indexes->end()) return nullptr;
+
+    return indexes;
+}
+
 void mastercore::LoopBiDirectional(cd_PricesMap* const ppriceMap, uint8_t trdAction, MatchReturnType &NewReturn, CMPContractDex* const pnew, const uint32_t propertyForSale)
 {
   cd_PricesMap::iterator it_fwdPrices;
@@ -1085,10 +1172,10 @@ void mastercore::x_TradeBidirectional(typename cd_PricesMap::iterator &it_fwdPri
           // t_tradelistdb->recordForUPNL(pnew->getHash(),pnew->getAddr(),property_traded,pold->getEffectivePrice());
 
           // if(msc_debug_x_trade_bidirectional) PrintToLog("++ erased old: %s\n", offerIt->ToString());
-          pofferSet->erase(offerIt++);
+          offerIt = EraseOrder(*pofferSet, offerIt);
 
           if (0 < remaining)
-	            pofferSet->insert(contract_replacement);
+	            InsertOrder(*pofferSet, contract_replacement);
       }
 }
 
@@ -1139,6 +1226,7 @@ bool mastercore::ContractDex_Fees(const CMPContractDex* maker, const CMPContract
         {
             //0.5 basis point to feecache
             cachefees_oracles[sp.collateral_currency] += cacheFee;
+            NotifyStateSectionChanged(FILETYPE_CACHEFEES_ORACLES);
 
         }else {
             // Create the metadex object with specific params
@@ -1172,6 +1260,7 @@ bool mastercore::ContractDex_Fees(const CMPContractDex* maker, const CMPContract
 
           // 0.5 basis point to feecache
           cachefees[sp.collateral_currency] += cacheFee;
+          NotifyStateSectionChanged(FILETYPE_CACHEFEES);
 
           if (msc_debug_contractdex_fees) PrintToLog("%s: natives takerFee: %d, natives makerFee: %d, cacheFee: %d\n",__func__, takerFee, makerFee, cacheFee);
 
@@ -1220,6 +1309,7 @@ bool mastercore::ContractDex_ADD_LTCVolume(int64_t nCouldBuy, uint32_t contractI
     arith_uint256 globalVolume = (ConvertTo256(nCouldBuy) * ConvertTo256(sp.notional_size) * ConvertTo256(tokenPrice)) / (ConvertTo256(COIN) * ConvertTo256(COIN));
 
     globalVolumeALL_LTC += ConvertTo64(globalVolume);
+    NotifyStateSectionChanged(FILETYPE_GLOBAL_VARS);
 
     if (msc_debug_add_contract_ltc_vol) PrintToLog("%s(): volume added: %d \n",__func__, ConvertTo64(globalVolume));
 
@@ -1256,6 +1346,7 @@ bool mastercore::MetaDEx_Fees(const CMPMetaDEx *pnew,const CMPMetaDEx *pold, int
          assert(update_tally_map(pnew->getAddr(), pnew->getDesProperty(), -takerFee, BALANCE));
          assert(update_tally_map(pold->getAddr(), pold->getProperty(), makerFee, BALANCE));
          cachefees[pnew->getProperty()] += cacheFee;
+         NotifyStateSectionChanged(FILETYPE_CACHEFEES);
          return true;
     }
 
@@ -1271,38 +1362,25 @@ bool mastercore::MetaDEx_Fees(const CMPMetaDEx *pnew,const CMPMetaDEx *pold, int
      int rc = METADEX_ERROR -40;
      bool bValid = false;
 
-     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-         // uint32_t prop = my_it->first;
-
-         // if(msc_debug_contract_cancel) PrintToLog(" ## property: %d\n", prop);
-         md_PricesMap &prices = my_it->second;
-
-         for (md_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt)
-         {
-             // uint64_t price = it->first;
-             md_Set &indexes = itt->second;
-
-             for (md_Set::iterator it = indexes.begin(); it != indexes.end();)
-             {
-
-                 if (it->getAddr() != sender_addr ||  it->getAmountForSale() == 0 || (it->getHash()).ToString() != hash) {
-                     ++it;
-                     continue;
-                 }
-
-                 // move from reserve to main
-                 assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
-                 assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+     md_Set::iterator it;
+     md_Set* indexes = nullptr;
 
+     // only the canonical form of the hash refers to an order
+     const uint256 orderTxid = uint256S(hash);
+     const md_Position* position = (orderTxid.ToString() == hash) ? metadex_index.Find(orderTxid) : nullptr;
+     if (position) indexes = FindOrder(*position, it);
 
-                 bValid = true;
-                 if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
-                 p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
-                 indexes.erase(it++);
-                 return 0;
-             }
-
-         }
+     if (indexes && it->getAddr() == sender_addr && it->getAmountForSale() != 0)
+     {
+         // move from reserve to main
+         assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
+         assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+
+         bValid = true;
+         if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
+         p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
+         EraseOrder(*indexes, it);
+         return 0;
      }
 
      if (!bValid && msc_debug_contract_cancel)
@@ -1360,6 +1438,11 @@ std::string xToString(const rational_t& value)
     return strprintf("%s / %s", xToString(value.numerator()), xToString(value.denominator()));
 }
 
+std::string xToString(const CMPPrice& value)
+{
+  return xToString(value.ToRational());
+}
+
 std::string xToString(const uint64_t &price)
 {
   return strprintf("%s", boost::lexical_cast<std::string>(price));
@@ -1405,7 +1488,8 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
     if (msc_debug_metadex1) PrintToLog("%s(%s: prop=%d, desprop=%d, desprice= %s);newo: %s\n",
         __FUNCTION__, pnew->getAddr(), propertyForSale, propertyDesired, xToString(pnew->inversePrice()), pnew->ToString());
 
-    md_PricesMap* const ppriceMap = get_Prices(propertyDesired);
+    // The offers selling the desired property in exchange for the property for sale
+    md_PricesMap* const ppriceMap = get_Prices(propertyDesired, propertyForSale);
 
     // Nothing for the desired property exists in the market !!
     if (!ppriceMap) {
@@ -1413,18 +1497,16 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
         return NewReturn;
     }
 
-    // Within the desired property map (given one property) iterate over the items looking at prices
-    for (md_PricesMap::iterator priceIt = ppriceMap->begin(); priceIt != ppriceMap->end(); ++priceIt)
-    { // check all prices
-        const rational_t sellersPrice = priceIt->first;
+    // The desired price check is satisfied, if the buyer's inverse price is larger than or equal
+    // to that of the seller, so only the price levels up to the buyer's inverse price are visited
+    const md_PricesMap::iterator priceEnd = ppriceMap->upper_bound(pnew->inversePrice());
+
+    for (md_PricesMap::iterator priceIt = ppriceMap->begin(); priceIt != priceEnd;)
+    { // check all crossing prices
+        const CMPPrice& sellersPrice = priceIt->first;
         if (msc_debug_metadex2) PrintToLog("comparing prices: desprice %s needs to be GREATER THAN OR EQUAL TO %s\n",
           xToString(pnew->inversePrice()), xToString(sellersPrice));
 
-        // Is the desired price check satisfied? The buyer's inverse price must be larger than that of the seller.
-        if (pnew->inversePrice() < sellersPrice) {
-          continue;
-        }
-
         md_Set* const pofferSet = &(priceIt->second);
 
         // at good (single) price level and property iterate over offers looking at all parameters to find the match
@@ -1438,12 +1520,6 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
   	        if (msc_debug_metadex1) PrintToLog("Looking at existing: %s (its prop= %d, its des prop= %d) = %s\n",
   	            xToString(sellersPrice), pold->getProperty(), pold->getDesProperty(), pold->ToString());
 
-    	      // does the desired property match?
-    	      if (pold->getDesProperty() != propertyForSale) {
-    	          ++offerIt;
-    	          continue;
-    	      }
-
     	      if (msc_debug_metadex1) PrintToLog("MATCH FOUND, Trade: %s = %s\n", xToString(sellersPrice), pold->ToString());
 
     	      // match found, execute trade now!
@@ -1501,7 +1577,7 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
           	// If the resulting adjusted unit price is higher than Alice' price, the
           	// orders shall not execute, and no representable fill is made
-          	const rational_t xEffectivePrice(nWouldPay, nCouldBuy);
+          	const CMPPrice xEffectivePrice(nWouldPay, nCouldBuy);
 
           	if (xEffectivePrice > pnew->inversePrice())
           	{
@@ -1634,8 +1710,9 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
             /***********************************************************************************************/
             // Adding token volume into Map
-            metavolume[pnew->getBlock()][pnew->getProperty()] = seller_amountGot;
-            metavolume[pnew->getBlock()][pnew->getDesProperty()] = buyer_amountGot;
+            metavolume.Set(pnew->getBlock(), pnew->getProperty(), seller_amountGot);
+            metavolume.Set(pnew->getBlock(), pnew->getDesProperty(), buyer_amountGot);
+            NotifyStateSectionChanged(FILETYPE_MDEX_VOLUME);
 
           	/***********************************************************************************************/
             // Adding volume in termos of LTC
@@ -1682,13 +1759,13 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
           	if (msc_debug_metadex3) PrintToLog("++ erased old: %s\n", offerIt->ToString());
           	// erase the old seller element
-          	pofferSet->erase(offerIt++);
+          	offerIt = EraseOrder(*pofferSet, offerIt);
 
           	// insert the updated one in place of the old
           	if (0 < seller_replacement.getAmountRemaining())
           	  {
           	    PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
-          	    pofferSet->insert(seller_replacement);
+          	    InsertOrder(*pofferSet, seller_replacement);
           	  }
 
           	if (bBuyerSatisfied)
@@ -1697,9 +1774,19 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
           	    break;
           	}
         } // specific price, check all properties
+
+        // Drop the price level, once all offers are filled
+        if (pofferSet->empty()) {
+            priceIt = ppriceMap->erase(priceIt);
+        } else {
+            ++priceIt;
+        }
+
         if (bBuyerSatisfied) break;
     } // check all prices
 
+    if (ppriceMap->empty()) metadex.erase(md_PairKey(propertyDesired, propertyForSale));
+
     if(msc_debug_metadex3) PrintToLog("%s()=%d:%s\n", __FUNCTION__, NewReturn, getTradeReturnType(NewReturn));
 
     return NewReturn;
@@ -1782,10 +1869,10 @@ std::string CMPMetaDEx::displayUnitPrice() const
 {
      rational_t tmpDisplayPrice;
      if (getDesProperty() == TL_PROPERTY_ALL || getDesProperty() == TL_PROPERTY_TALL) {
-         tmpDisplayPrice = unitPrice();
+         tmpDisplayPrice = unitPrice().ToRational();
          if (isPropertyDivisible(getProperty())) tmpDisplayPrice = tmpDisplayPrice * COIN;
      } else {
-         tmpDisplayPrice = inversePrice();
+         tmpDisplayPrice = inversePrice().ToRational();
          if (isPropertyDivisible(getDesProperty())) tmpDisplayPrice = tmpDisplayPrice * COIN;
      }
 
@@ -1802,7 +1889,7 @@ std::string CMPMetaDEx::displayUnitPrice() const
 
 std::string CMPMetaDEx::displayFullUnitPrice() const
 {
-    rational_t tempUnitPrice = unitPrice();
+    rational_t tempUnitPrice = unitPrice().ToRational();
 
     /* Matching types require no action (divisible/divisible or indivisible/indivisible)
        Non-matching types require adjustment for display purposes
@@ -1828,18 +1915,37 @@ std::string CMPContractDex::displayFullContractPrice() const
     return priceForsaleStr;
 }
 
-rational_t CMPMetaDEx::unitPrice() const
+CMPPrice::CMPPrice(int64_t numerator, int64_t denominator)
 {
-    rational_t effectivePrice;
-    if (amount_forsale) effectivePrice = rational_t(amount_desired, amount_forsale);
-    return effectivePrice;
+    assert(denominator != 0);
+
+    negative = (numerator < 0) != (denominator < 0);
+    // the magnitudes are taken as unsigned values, which also covers the minimum of int64_t
+    num = (numerator < 0) ? 0 - static_cast<uint64_t>(numerator) : static_cast<uint64_t>(numerator);
+    den = (denominator < 0) ? 0 - static_cast<uint64_t>(denominator) : static_cast<uint64_t>(denominator);
+
+    uint64_t a = num, b = den;
+    while (b != 0) {
+        const uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    num /= a;
+    den /= a;
+
+    if (num == 0) negative = false;
+}
+
+rational_t CMPPrice::ToRational() const
+{
+    const boost::multiprecision::checked_int128_t n(num);
+    return rational_t(negative ? -n : n, boost::multiprecision::checked_int128_t(den));
 }
 
-rational_t CMPMetaDEx::inversePrice() const
+void CMPMetaDEx::updatePrices()
 {
-    rational_t inversePrice;
-    if (amount_desired) inversePrice = rational_t(amount_forsale, amount_desired);
-    return inversePrice;
+    unit_price = amount_forsale ? CMPPrice(amount_desired, amount_forsale) : CMPPrice();
+    inverse_price = amount_desired ? CMPPrice(amount_forsale, amount_desired) : CMPPrice();
 }
 
 
@@ -1867,6 +1973,7 @@ void CMPMetaDEx::setAmountRemaining(int64_t amount, const std::string& label)
 void CMPMetaDEx::setAmountForsale(int64_t amount, const std::string& label)
 {
     amount_forsale = amount;
+    updatePrices();
     // PrintToLog("update remaining amount still up for sale (%ld %s):%s\n", amount, label, ToString());
 }
 
@@ -1959,23 +2066,6 @@ std::string CMPContractDex::GenerateConsensusString() const
 
 
 
-void saveDataGraphs(std::fstream &file, std::string lineOutSixth1, std::string lineOutSixth2, std::string lineOutSixth3, bool savedata_bool)
-{
-    std::string lineSixth1 = lineOutSixth1;
-    std::string lineSixth2 = lineOutSixth2;
-    std::string lineSixth3 = lineOutSixth3;
-
-    if (savedata_bool)
-    {
-          file << lineSixth1 << "\n";
-          file << lineSixth2 << std::endl;
-    } else {
-        file << lineSixth1 << "\n";
-        file << lineSixth2 << "\n";
-        file << lineSixth3 << std::endl;
-    }
-}
-
 void saveDataGraphs(std::fstream &file, std::string lineOut)
 {
     std::string line = lineOut;
@@ -1997,78 +2087,96 @@ bool ContractDex_compare::operator()(const CMPContractDex &lhs, const CMPContrac
 
 bool mastercore::MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx)
 {
-    // Create an empty price map (to use in case price map for this property does not already exist)
-    md_PricesMap temp_prices;
-    // Attempt to obtain the price map for the property
-    md_PricesMap *p_prices = get_Prices(objMetaDEx.getProperty());
+    // Obtain the set of metadex objects at this price, the price level and the
+    // price map of the property are created in place, if they don't exist yet
+    md_Set& indexes = metadex[md_PairKey(objMetaDEx.getProperty(), objMetaDEx.getDesProperty())][objMetaDEx.unitPrice()];
 
-    // Create an empty set of metadex objects (to use in case no set currently exists at this price)
-    md_Set temp_indexes;
-    md_Set *p_indexes = nullptr;
+    // Attempt to insert the metadex object into the set; if an object with the
+    // same position already exists, the price level wasn't empty before
+    return InsertOrder(indexes, objMetaDEx);
+}
 
-    // Prepare for return code
-    std::pair <md_Set::iterator, bool> ret;
+bool mastercore::MetaDEx_ERASE(const CMPMetaDEx& objMetaDEx)
+{
+    const md_PairKey pair(objMetaDEx.getProperty(), objMetaDEx.getDesProperty());
 
-    // Attempt to obtain a set of metadex objects for this price from the price map
-    if (p_prices) p_indexes = get_Indexes(p_prices, objMetaDEx.unitPrice());
-    // See if the set was populated, if not no set exists at this price level, use the empty set that we created earlier
-    if (!p_indexes) p_indexes = &temp_indexes;
+    md_PricesMap* p_prices = get_Prices(pair.first, pair.second);
+    if (!p_prices) return false;
 
-    // Attempt to insert the metadex object into the set
-    ret = p_indexes->insert(objMetaDEx);
-    if (false == ret.second) return false;
+    md_PricesMap::iterator it_prices = p_prices->find(objMetaDEx.unitPrice());
+    if (it_prices == p_prices->end()) return false;
 
-    // If a prices map did not exist for this property, set p_prices to the temp empty price map
-    if (!p_prices) p_prices = &temp_prices;
+    md_Set& indexes = it_prices->second;
+    md_Set::iterator it = indexes.find(objMetaDEx);
+    if (it == indexes.end()) return false;
 
-    // Update the prices map with the new set at this price
-    (*p_prices)[objMetaDEx.unitPrice()] = *p_indexes;
+    // The object might be part of the set, so it's not used after this point
+    EraseOrder(indexes, it);
 
-    // Set the metadex map for the property to the updated (or new if it didn't exist) price map
-    metadex[objMetaDEx.getProperty()] = *p_prices;
+    // Drop the price level and the price map, once they are empty
+    if (indexes.empty()) p_prices->erase(it_prices);
+    if (p_prices->empty()) metadex.erase(pair);
 
     return true;
 }
 
 bool mastercore::ContractDex_INSERT(const CMPContractDex &objContractDex)
 {
-    // Create an empty price map (to use in case price map for this property does not already exist)
-    cd_PricesMap temp_prices;
+    // Obtain the set of contractdex objects at this price, the price level and
+    // the price map of the property are created in place, if they don't exist yet
+    cd_Set& indexes = contractdex[objContractDex.getProperty()][objContractDex.getEffectivePrice()];
 
-    // Attempt to obtain the price map for the property
-    cd_PricesMap *cd_prices = get_PricesCd(objContractDex.getProperty());
+    // Attempt to insert the contractdex object into the set
+    return InsertOrder(indexes, objContractDex);
+}
 
-    // Create an empty set of contractdex objects (to use in case no set currently exists at this price)
-    cd_Set temp_indexes;
-    cd_Set *p_indexes = nullptr;
+bool mastercore::ContractDex_ERASE(const CMPContractDex &objContractDex)
+{
+    const uint32_t prop = objContractDex.getProperty();
 
-    // Prepare for return code
-    std::pair <cd_Set::iterator, bool> ret;
+    cd_PricesMap* cd_prices = get_PricesCd(prop);
+    if (!cd_prices) return false;
 
-    // Attempt to obtain a set of contractdex objects for this price from the price map
-    if (cd_prices) p_indexes = get_IndexesCd(cd_prices, objContractDex.getEffectivePrice());
+    cd_PricesMap::iterator it_prices = cd_prices->find(objContractDex.getEffectivePrice());
+    if (it_prices == cd_prices->end()) return false;
 
-    // See if the set was populated, if not no set exists at this price level, use the empty set that we created earlier
-    if (!p_indexes) p_indexes = &temp_indexes;
+    cd_Set& indexes = it_prices->second;
+    cd_Set::iterator it = indexes.find(objContractDex);
+    if (it == indexes.end()) return false;
 
-      // Attempt to insert the contractdex object into the set
-    ret = p_indexes->insert(objContractDex);
+    // The object might be part of the set, so it's not used after this point
+    EraseOrder(indexes, it);
 
-    if (false == ret.second) return false;
+    // Drop the price level and the price map, once they are empty
+    if (indexes.empty()) cd_prices->erase(it_prices);
+    if (cd_prices->empty()) contractdex.erase(prop);
 
-    // If a prices map did not exist for this property, set p_prices to the temp empty price map
-    if (!cd_prices) cd_prices = &temp_prices;
+    return true;
+}
 
-    // Update the prices map with the new Set at this price
-    (*cd_prices)[objContractDex.getEffectivePrice()] = *p_indexes;
+// pretty much directly linked to the ADD TX21 command off the wire
+const CMPMetaDEx* mastercore::MetaDEx_RetrieveTrade(const uint256& txid)
+{
+    const md_Position* position = metadex_index.Find(txid);
+    if (!position) return nullptr;
 
-    // Set the contractdex map for the property to the updated (or new if it didn't exist) price map
-    contractdex[objContractDex.getProperty()] = *cd_prices;
+    md_Set::iterator it;
+    if (!FindOrder(*position, it)) return nullptr;
 
-    return true;
+    return &(*it);
+}
+
+const CMPContractDex* mastercore::ContractDex_RetrieveTrade(const uint256& txid)
+{
+    const cd_Position* position = contractdex_index.Find(txid);
+    if (!position) return nullptr;
+
+    cd_Set::iterator it;
+    if (!FindOrder(*position, it)) return nullptr;
+
+    return &(*it);
 }
 
-// pretty much directly linked to the ADD TX21 command off the wire
 int mastercore::MetaDEx_ADD(const std::string& sender_addr, uint32_t prop, int64_t amount, int block, uint32_t property_desired, int64_t amount_desired, const uint256& txid, unsigned int idx)
 {
     int rc = 0;
@@ -2077,7 +2185,7 @@ int mastercore::MetaDEx_ADD(const std::string& sender_addr, uint32_t prop, int64
     if (msc_debug_metadex_add) PrintToLog("%s(); buyer obj: %s\n", __FUNCTION__, new_mdex.ToString());
 
     // Ensure this is not a badly priced trade (for example due to zero amounts)
-    if (0 == new_mdex.unitPrice()) return METADEX_ERROR -66;
+    if (new_mdex.unitPrice().isZero()) return METADEX_ERROR -66;
 
     // Match against existing trades, remainder of the order will be put into the order book
     // if (msc_debug_metadex_add) MetaDEx_debug_print();
@@ -2172,64 +2280,52 @@ int mastercore::ContractDex_CANCEL_EVERYTHING(const uint256& txid, unsigned int
     int rc = METADEX_ERROR -40;
     bool bValid = false;
 
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
-    {
-        unsigned int prop = my_it->first;
-
-        if (msc_debug_contract_cancel_every) PrintToLog(" ## property: %u\n", prop);
-        cd_PricesMap &prices = my_it->second;
+    // the orders of the sender for the contract, in the order of the book
+    const COrderIndex<cd_Position>::Positions positions = contractdex_index.Get(sender_addr, contractId);
 
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            uint64_t price = it->first;
-            cd_Set &indexes = it->second;
-
-            if (msc_debug_contract_cancel_every) PrintToLog("  # Price Level: %s\n", xToString(price));
-
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();)
-            {
-	              if (msc_debug_contract_cancel_every) PrintToLog("%s= %s\n", xToString(price), it->ToString());
+    for (const cd_Position& position : positions)
+    {
+        cd_Set::iterator it;
+        cd_Set* const indexes = FindOrder(position, it);
+        if (!indexes) continue;
 
-	              if (it->getAddr() != sender_addr || it->getProperty() != contractId || it->getAmountForSale() == 0)
-                {
-	                  ++it;
-	                  continue;
-	              }
+        if (msc_debug_contract_cancel_every) PrintToLog("%s= %s\n", xToString(position.price), it->ToString());
 
-	              rc = 0;
-	              if (msc_debug_contract_cancel_every) PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
+        if (it->getAmountForSale() == 0) continue;
 
-	              CMPSPInfo::Entry sp;
-	              assert(_my_sps->getSP(it->getProperty(), sp));
+        rc = 0;
+        if (msc_debug_contract_cancel_every) PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
 
-	              uint32_t collateralCurrency = sp.collateral_currency;
+        CMPSPInfo::Entry sp;
+        assert(_my_sps->getSP(it->getProperty(), sp));
 
-	              string addr = it->getAddr();
-                int64_t redeemed = it->getAmountReserved();
-	              int64_t amountForSale = it->getAmountForSale();
-                int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
+        uint32_t collateralCurrency = sp.collateral_currency;
 
-                if (msc_debug_contract_cancel_every)
-                {
-    	              PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
-    	              PrintToLog("amountForSale: %d\n",amountForSale);
-    	              PrintToLog("Address: %d\n",addr);
-    	              PrintToLog("--------------------------------------------\n");
-                }
+        string addr = it->getAddr();
+        int64_t redeemed = it->getAmountReserved();
+        int64_t amountForSale = it->getAmountForSale();
+        int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
 
-	              // move from reserve to balance the collateral
-	              if (balance > redeemed && balance > 0 && redeemed > 0)
-			          {
-	                  assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
-	                  assert(update_tally_map(addr, collateralCurrency, -redeemed, CONTRACTDEX_RESERVE));
-			          }
+        if (msc_debug_contract_cancel_every)
+        {
+            PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
+            PrintToLog("amountForSale: %d\n",amountForSale);
+            PrintToLog("Address: %d\n",addr);
+            PrintToLog("--------------------------------------------\n");
+        }
 
-	              bValid = true;
-	              // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-	              indexes.erase(it++);
-            }
+        // move from reserve to balance the collateral
+        if (balance > redeemed && balance > 0 && redeemed > 0)
+        {
+            assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
+            assert(update_tally_map(addr, collateralCurrency, -redeemed, CONTRACTDEX_RESERVE));
         }
+
+        bValid = true;
+        // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+        EraseOrder(*indexes, it);
     }
+
     if (!bValid && msc_debug_contract_cancel_every)
       PrintToLog("You don't have active orders\n");
 
@@ -2240,97 +2336,62 @@ int mastercore::ContractDex_CANCEL_FOR_BLOCK(const uint256& txid,  int block,uns
 {
     int rc = METADEX_ERROR -40;
     bool bValid = false;
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
-    {
-        cd_PricesMap &prices = my_it->second;
 
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            // uint64_t price = it->first;
-            cd_Set &indexes = it->second;
+    // the orders of the sender for all contracts, in the order of the books
+    const COrderIndex<cd_Position>::Positions positions = contractdex_index.GetAll(sender_addr);
 
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();)
-            {
-	              string addr = it->getAddr();
- 	              if (addr != sender_addr || it->getBlock()!= block || it->getIdx()!= idx)
-                {
-	                  ++it;
-	                  continue;
-	              }
-
-	              CMPSPInfo::Entry sp;
-	              uint32_t contractId = it->getProperty();
-                int64_t redeemed = it->getAmountReserved();
-	              assert(_my_sps->getSP(contractId, sp));
-
-	              uint32_t collateralCurrency = sp.collateral_currency;
-	              int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
-	              int64_t amountForSale = it->getAmountForSale();
-                if(msc_debug_contract_cancel_forblock)
-                {
+    for (const cd_Position& position : positions)
+    {
+        if (position.block != block || position.idx != idx) continue;
 
-    	              PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
-    	              PrintToLog("amountForSale: %d\n", amountForSale);
-    	              PrintToLog("Address: %d\n", addr);
-                    PrintToLog("balance in collateral: %d\n", balance);
-                }
+        cd_Set::iterator it;
+        cd_Set* const indexes = FindOrder(position, it);
+        if (!indexes) continue;
+
+        string addr = it->getAddr();
+        CMPSPInfo::Entry sp;
+        uint32_t contractId = it->getProperty();
+        int64_t redeemed = it->getAmountReserved();
+        assert(_my_sps->getSP(contractId, sp));
+
+        uint32_t collateralCurrency = sp.collateral_currency;
+        int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
+        int64_t amountForSale = it->getAmountForSale();
+        if(msc_debug_contract_cancel_forblock)
+        {
+            PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
+            PrintToLog("amountForSale: %d\n", amountForSale);
+            PrintToLog("Address: %d\n", addr);
+            PrintToLog("balance in collateral: %d\n", balance);
+        }
 
-	              // std::string sgetback = FormatDivisibleMP(redeemed, false);
+        if(msc_debug_contract_cancel_forblock) PrintToLog("amount returned to balance: %d\n", redeemed);
 
-	              if(msc_debug_contract_cancel_forblock) PrintToLog("amount returned to balance: %d\n", redeemed);
+        // move from reserve to balance the collateral
+        if (balance > redeemed && balance > 0 && redeemed > 0)
+        {
+            assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
+            assert(update_tally_map(addr, collateralCurrency,  -redeemed, CONTRACTDEX_RESERVE));
+        }
 
-	              // move from reserve to balance the collateral
-	              if (balance > redeemed && balance > 0 && redeemed > 0)
-			          {
-			              assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
-	                  assert(update_tally_map(addr, collateralCurrency,  -redeemed, CONTRACTDEX_RESERVE));
-	              }
+        // record the cancellation
+        bValid = true;
+        // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+        EraseOrder(*indexes, it);
 
-	              // record the cancellation
-	              bValid = true;
-	              // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-	              indexes.erase(it++);
+        rc = 0;
+    }
 
-	              rc = 0;
-            }
-       }
-  }
-  if (!bValid && msc_debug_contract_cancel_forblock){
-    PrintToLog("Incorrect block or idx\n");
-  }
+    if (!bValid && msc_debug_contract_cancel_forblock){
+        PrintToLog("Incorrect block or idx\n");
+    }
 
-  return rc;
+    return rc;
 }
 
 bool mastercore::ContractDex_CHECK_ORDERS(const std::string& sender_addr, uint32_t contractId)
 {
-    bool bValid = false;
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
-    {
-        cd_PricesMap &prices = my_it->second;
-
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            // uint64_t price = it->first;
-            cd_Set &indexes = it->second;
-
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();)
-            {
-	              string addr = it->getAddr();
-                uint32_t contract = it->getProperty();
- 	              if (addr != sender_addr || contract != contractId)
-                {
-	                  ++it;
-	                  continue;
-	              }
-
-	              bValid = true;
-                break;
-            }
-        }
-    }
-
-    return bValid;
+    return contractdex_index.Has(sender_addr, contractId);
 }
 
 int mastercore::ContractDex_CANCEL_IN_ORDER(const std::string& sender_addr, uint32_t contractId)
@@ -2344,61 +2405,52 @@ int mastercore::ContractDex_CANCEL_IN_ORDER(const std::string& sender_addr, uint
 
     uint32_t collateralCurrency = sp.collateral_currency;
 
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
-        unsigned int prop = my_it->first;
-
-        if(msc_debug_contract_cancel_inorder) PrintToLog(" ## property: %u\n", prop);
-        cd_PricesMap &prices = my_it->second;
-
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            uint64_t price = it->first;
-            cd_Set &indexes = it->second;
-
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();) {
-
-                if(msc_debug_contract_cancel_inorder)
-                {
-                    PrintToLog("%s= %s\n", xToString(price), it->ToString());
-                    PrintToLog("address: %d\n",it->getAddr());
-                    PrintToLog("propertyid: %d\n",it->getProperty());
-                    PrintToLog("amount for sale: %d\n",it->getAmountForSale());
-                }
+    // the orders of the sender for the contract, in the order of the book
+    const COrderIndex<cd_Position>::Positions positions = contractdex_index.Get(sender_addr, contractId);
 
-                if (it->getAddr() != sender_addr || it->getProperty() != contractId || it->getAmountForSale() == 0) {
-                    ++it;
-                    continue;
-                }
+    for (const cd_Position& position : positions)
+    {
+        cd_Set::iterator it;
+        cd_Set* const indexes = FindOrder(position, it);
+        if (!indexes) continue;
 
-                string addr = it->getAddr();
-                int64_t redeemed = it->getAmountReserved();
-                int64_t amountForSale = it->getAmountForSale();
-                int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
+        if(msc_debug_contract_cancel_inorder)
+        {
+            PrintToLog("%s= %s\n", xToString(position.price), it->ToString());
+            PrintToLog("address: %d\n",it->getAddr());
+            PrintToLog("propertyid: %d\n",it->getProperty());
+            PrintToLog("amount for sale: %d\n",it->getAmountForSale());
+        }
 
-                if(msc_debug_contract_cancel_inorder)
-                {
-                    PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
-                    PrintToLog("amountForSale: %d\n",amountForSale);
-                    PrintToLog("Address: %d\n",addr);
-                }
+        if (it->getAmountForSale() == 0) continue;
 
-                if(msc_debug_contract_cancel_inorder) PrintToLog("redeemed: %d\n",redeemed);
+        string addr = it->getAddr();
+        int64_t redeemed = it->getAmountReserved();
+        int64_t amountForSale = it->getAmountForSale();
+        int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
 
-                // move from reserve to balance the collateral
-                if (balance > redeemed && balance > 0 && redeemed > 0) {
-                    assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
-                    assert(update_tally_map(addr, collateralCurrency, -redeemed, CONTRACTDEX_RESERVE));
-                // // record the cancellation
-                }
+        if(msc_debug_contract_cancel_inorder)
+        {
+            PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
+            PrintToLog("amountForSale: %d\n",amountForSale);
+            PrintToLog("Address: %d\n",addr);
+        }
 
-                bValid = true;
-                if(msc_debug_contract_cancel_inorder) PrintToLog("CANCEL IN ORDER: order found!\n");
-                // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-                indexes.erase(it++);
-                rc = 0;
-                return rc;
-            }
+        if(msc_debug_contract_cancel_inorder) PrintToLog("redeemed: %d\n",redeemed);
 
+        // move from reserve to balance the collateral
+        if (balance > redeemed && balance > 0 && redeemed > 0) {
+            assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
+            assert(update_tally_map(addr, collateralCurrency, -redeemed, CONTRACTDEX_RESERVE));
+        // // record the cancellation
         }
+
+        bValid = true;
+        if(msc_debug_contract_cancel_inorder) PrintToLog("CANCEL IN ORDER: order found!\n");
+        // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+        EraseOrder(*indexes, it);
+        rc = 0;
+        return rc;
     }
 
     if (!bValid && msc_debug_contract_cancel_inorder)
@@ -2505,7 +2557,12 @@ int64_t mastercore::getPairMarketPrice(const std::string& num, const std::string
 	      }
     }
 
-    return market_priceMap[numId][denId];
+    // the last traded price of the pair, without adding entries for pairs never traded
+    auto it = market_priceMap.find(numId);
+    if (it == market_priceMap.end()) return 0;
+
+    auto itt = it->second.find(denId);
+    return (itt != it->second.end()) ? itt->second : 0;
 }
 
 uint64_t mastercore::edgeOrderbook(uint32_t contractId, uint8_t tradingAction)
@@ -2534,9 +2591,12 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
 {
     bool bBuyerSatisfied = false;
 
-    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it)
+    // The offers selling ALLs in exchange for the offered property
+    md_PricesMap* const pprices = get_Prices(ALL, propertyOffered);
+
+    if (pprices)
     {
-        md_PricesMap &prices = my_it->second;
+        md_PricesMap &prices = *pprices;
 
         for (md_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt)
         {
@@ -2544,13 +2604,6 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
 
             for (md_Set::iterator it = indexes.begin(); it != indexes.end();)
             {
-
-	              if (it->getProperty() != ALL || it->getDesProperty() != propertyOffered)
-                {
-	                  ++it;
-	                  continue;
-	              }
-
 	              if (msc_debug_search_all) PrintToLog("%s(): ALLS FOUND! %s\n", __func__, it->ToString());
 
                 if (msc_debug_search_all) PrintToLog("%s(): amount of ALL: %d, desproperty: %d; amount of desproperty: %d\n", __func__, it->getAmountForSale(), it->getDesProperty(), it->getAmountDesired());
@@ -2589,6 +2642,7 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
                 // taking ALLs from seller
                 assert(update_tally_map(it->getAddr(), it->getProperty(), -nCouldBuy, METADEX_RESERVE));
                 cachefees_oracles[ALL] = nCouldBuy;
+                NotifyStateSectionChanged(FILETYPE_CACHEFEES_ORACLES);
 
                 // giving the tokens from cache
                 assert(update_tally_map(it->getAddr(), it->getDesProperty(), nWouldPay, BALANCE));
@@ -2606,13 +2660,13 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
                 seller_replacement.setAmountRemaining(seller_amountLeft, "seller_replacement");
 
                 // erase the old seller element
-                indexes.erase(it++);
+                it = EraseOrder(indexes, it);
 
                 // insert the updated one in place of the old
                 if (0 < seller_replacement.getAmountRemaining())
                 {
                     if (msc_debug_search_all) PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
-                    indexes.insert(seller_replacement);
+                    InsertOrder(indexes, seller_replacement);
                 }
 
             }
@@ -2628,7 +2682,6 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
         if (amount == 0)
         {
             bBuyerSatisfied = true;
-            break;
         }
     }
 
@@ -2642,38 +2695,26 @@ int mastercore::MetaDEx_CANCEL_EVERYTHING(const uint256& txid, unsigned int bloc
 {
     int rc = METADEX_ERROR -40;
 
-    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        unsigned int prop = my_it->first;
-
-        if (msc_debug_metadex2) PrintToLog(" ## property: %u\n", prop);
-        md_PricesMap& prices = my_it->second;
-
-        for (md_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt) {
-            rational_t price = itt->first;
-            md_Set& indexes = itt->second;
-
-            if (msc_debug_metadex2) PrintToLog("  # Price Level: %s\n", xToString(price));
+    // the orders of the sender for all pairs, in the order of the books
+    const COrderIndex<md_Position>::Positions positions = metadex_index.GetAll(sender_addr);
 
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end();) {
-                PrintToLog("%s= %s\n", xToString(price), it->ToString());
+    for (const md_Position& position : positions) {
+        md_Set::iterator it;
+        md_Set* const indexes = FindOrder(position, it);
+        if (!indexes) continue;
 
-                if (it->getAddr() != sender_addr) {
-                    ++it;
-                    continue;
-                }
+        PrintToLog("%s= %s\n", xToString(position.price), it->ToString());
 
-                rc = 0;
-                // move from reserve to balance
-                assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
-                assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+        rc = 0;
+        // move from reserve to balance
+        assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
 
-                //record the cancellation
-                bool bValid = true;
-                p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
+        //record the cancellation
+        bool bValid = true;
+        p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
 
-                indexes.erase(it++);
-            }
-        }
+        EraseOrder(*indexes, it);
     }
 
     PrintToLog(" #### checkpoint\n");
@@ -2685,46 +2726,40 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 {
     int rc = METADEX_ERROR -20;
     CMPMetaDEx mdex(sender_addr, 0, prop, amount, property_desired, amount_desired, uint256(), 0, CMPTransaction::CANCEL_AT_PRICE);
-    md_PricesMap* prices = get_Prices(prop);
-    const CMPMetaDEx* p_mdex = nullptr;
+    md_PricesMap* prices = get_Prices(prop, property_desired);
 
     if (!prices) {
         PrintToLog("%s() NOTHING FOUND for %s\n", __func__, mdex.ToString());
         return rc -1;
     }
 
-    // within the desired property map (given one property) iterate over the items
-    for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        rational_t sellers_price = my_it->first;
+    // the orders of the sender for the property, in the order of the book
+    const COrderIndex<md_Position>::Positions positions = metadex_index.Get(sender_addr, prop);
 
-        if (mdex.unitPrice() != sellers_price) continue;
+    for (const md_Position& position : positions) {
+        if (position.book.second != property_desired || position.price != mdex.unitPrice()) continue;
 
-        md_Set* indexes = &(my_it->second);
+        md_Set::iterator it;
+        md_Set* const indexes = FindOrder(position, it);
+        if (!indexes) continue;
 
-        for (md_Set::iterator iitt = indexes->begin(); iitt != indexes->end();) {
-            p_mdex = &(*iitt);
+        const CMPMetaDEx* p_mdex = &(*it);
 
-            if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __func__, p_mdex->ToString());
+        if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __func__, p_mdex->ToString());
 
-            if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
-                ++iitt;
-                continue;
-            }
+        rc = 0;
 
-            rc = 0;
-
-            PrintToLog("%s(): REMOVING %s\n", __func__, p_mdex->ToString());
+        PrintToLog("%s(): REMOVING %s\n", __func__, p_mdex->ToString());
 
-            // move from reserve to main
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
+        // move from reserve to main
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
 
-            // record the cancellation
-            bool bValid = true;
-            p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+        // record the cancellation
+        bool bValid = true;
+        p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
 
-            indexes->erase(iitt++);
-        }
+        EraseOrder(*indexes, it);
     }
 
     return rc;
@@ -2733,41 +2768,39 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int block, const std::string& sender_addr, uint32_t prop, uint32_t property_desired)
 {
     int rc = METADEX_ERROR -30;
-    md_PricesMap* prices = get_Prices(prop);
-    const CMPMetaDEx* p_mdex = nullptr;
+    md_PricesMap* prices = get_Prices(prop, property_desired);
 
     if (!prices) {
         PrintToLog("%s() NOTHING FOUND\n", __FUNCTION__);
         return rc -1;
     }
 
-    // within the desired property map (given one property) iterate over the items
-    for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        md_Set* indexes = &(my_it->second);
+    // the orders of the sender for the property, in the order of the book
+    const COrderIndex<md_Position>::Positions positions = metadex_index.Get(sender_addr, prop);
 
-        for (md_Set::iterator iitt = indexes->begin(); iitt != indexes->end();) {
-            p_mdex = &(*iitt);
+    for (const md_Position& position : positions) {
+        if (position.book.second != property_desired) continue;
 
-            if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
+        md_Set::iterator it;
+        md_Set* const indexes = FindOrder(position, it);
+        if (!indexes) continue;
 
-            if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
-                ++iitt;
-                continue;
-            }
+        const CMPMetaDEx* p_mdex = &(*it);
 
-            rc = 0;
-            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
+        if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
 
-            // move from reserve to balance
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
+        rc = 0;
+        PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
 
-            // record the cancellation
-            bool bValid = true;
-            p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+        // move from reserve to balance
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
 
-            indexes->erase(iitt++);
-        }
+        // record the cancellation
+        bool bValid = true;
+        p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+
+        EraseOrder(*indexes, it);
     }
 
     return rc;
@@ -2781,70 +2814,60 @@ int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int bl
      int rc = METADEX_ERROR -40;
      bool bValid = false;
 
-     for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
-         uint32_t prop = my_it->first;
-
-         if(msc_debug_contract_cancel) PrintToLog(" ## property: %d\n", prop);
-         cd_PricesMap &prices = my_it->second;
-
-         for (cd_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt) {
-             // uint64_t price = it->first;
-             cd_Set &indexes = itt->second;
-
-             for (cd_Set::iterator it = indexes.begin(); it != indexes.end();) {
-
-                 if(msc_debug_contract_cancel)
-                 {
-                     std::string getstring = (it->getHash()).ToString();
-                     PrintToLog("getAddr: %s\n",it->getAddr());
-                     PrintToLog("address: %s\n",sender_addr);
-                     PrintToLog("propertyid: %d\n",it->getProperty());
-                     PrintToLog("amount for sale: %d\n",it->getAmountForSale());
-                     PrintToLog("hash: %s\n",hash);
-                     PrintToLog("getHash: %s\n",getstring);
-                 }
-
-                 if (it->getAddr() != sender_addr ||  it->getAmountForSale() == 0 || (it->getHash()).ToString() != hash) {
-                     ++it;
-                     continue;
-                 }
-
-                 string addr = it->getAddr();
-                 int64_t redeemed = it->getAmountReserved();
-                 int64_t amountForSale = it->getAmountForSale();
-                 uint32_t contractId = it->getProperty();
-
-                 CMPSPInfo::Entry sp;
-                 if(!_my_sps->getSP(contractId, sp))
-                     return rc;
-
-                 uint32_t collateralCurrency = sp.collateral_currency;
-
-                 if(msc_debug_contract_cancel)
-                 {
-
-                     PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
-                     PrintToLog("amountForSale: %d\n",amountForSale);
-                     PrintToLog("Address: %s\n",addr);
-                 }
-
-                 if(msc_debug_contract_cancel) PrintToLog("redeemed: %d\n",redeemed);
-
-                 // move from reserve to balance the collateral
-                 if (redeemed > 0) {
-                     assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
-                     assert(update_tally_map(addr, collateralCurrency, -redeemed, CONTRACTDEX_RESERVE));
-                 // // record the cancellation
-                 }
-
-                 bValid = true;
-                 if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
-                 // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-                 indexes.erase(it++);
-                 rc = 0;
+     cd_Set::iterator it;
+     cd_Set* indexes = nullptr;
+
+     // only the canonical form of the hash refers to an order
+     const uint256 txid = uint256S(hash);
+     const cd_Position* position = (txid.ToString() == hash) ? contractdex_index.Find(txid) : nullptr;
+     if (position) indexes = FindOrder(*position, it);
+
+     if (indexes)
+     {
+         if(msc_debug_contract_cancel)
+         {
+             PrintToLog("getAddr: %s\n",it->getAddr());
+             PrintToLog("address: %s\n",sender_addr);
+             PrintToLog("propertyid: %d\n",it->getProperty());
+             PrintToLog("amount for sale: %d\n",it->getAmountForSale());
+             PrintToLog("hash: %s\n",hash);
+         }
+
+         if (it->getAddr() == sender_addr && it->getAmountForSale() != 0)
+         {
+             string addr = it->getAddr();
+             int64_t redeemed = it->getAmountReserved();
+             int64_t amountForSale = it->getAmountForSale();
+             uint32_t contractId = it->getProperty();
+
+             CMPSPInfo::Entry sp;
+             if(!_my_sps->getSP(contractId, sp))
                  return rc;
+
+             uint32_t collateralCurrency = sp.collateral_currency;
+
+             if(msc_debug_contract_cancel)
+             {
+                 PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
+                 PrintToLog("amountForSale: %d\n",amountForSale);
+                 PrintToLog("Address: %s\n",addr);
              }
 
+             if(msc_debug_contract_cancel) PrintToLog("redeemed: %d\n",redeemed);
+
+             // move from reserve to balance the collateral
+             if (redeemed > 0) {
+                 assert(update_tally_map(addr, collateralCurrency, redeemed, BALANCE));
+                 assert(update_tally_map(addr, collateralCurrency, -redeemed, CONTRACTDEX_RESERVE));
+             // // record the cancellation
+             }
+
+             bValid = true;
+             if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
+             // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+             ContractDex_ERASE(*it);
+             rc = 0;
+             return rc;
          }
      }
 
@@ -2887,13 +2910,6 @@ bool mastercore::checkReserve(const std::string& address, int64_t amount, uint32
 
  }
 
-// auxiliar function
-void addLives(int64_t& totalLongs, int64_t& totalShorts, int32_t contractId, const CMPTally& tally){
-    int64_t position = tally.getMoney(contractId, CONTRACT_BALANCE);
-    (position > 0) ? totalLongs += position : totalShorts += position;
-
-}
-
  // counts the number of all contracts in every position
 int64_t mastercore::getTotalLives(uint32_t contractId)
 {
@@ -2907,8 +2923,10 @@ int64_t mastercore::getTotalLives(uint32_t contractId)
         return 0; // property ID does not exist or is not a contract
     }
 
-    // for each tally account, we sum just contracts (all shorts, or all longs)
-    for_each(mp_tally_map.begin(), mp_tally_map.end(), [&totalLongs, &totalShorts, contractId](const std::pair<std::string, CMPTally>& elem){ addLives(totalLongs, totalShorts, contractId, elem.second); });
+    // the running totals sum up contracts of all tally accounts (all shorts, or all longs)
+    const CMPTallyTotals totals = getTallyTotals(contractId);
+    totalLongs = totals.longs;
+    totalShorts = totals.shorts;
 
     if(msc_debug_get_total_lives) PrintToLog("%s(): totalLongs : %d, totalShorts : %d\n",__func__, totalLongs, totalShorts);
 
@@ -1,8 +1,10 @@
 #ifndef TRADELAYER_MDEX_H
 #define TRADELAYER_MDEX_H
 
+#include <tradelayer/orderindex.h>
 #include <tradelayer/tx.h>
 #include <tradelayer/tradelayer_matrices.h>
+#include <tradelayer/volume.h>
 #include <uint256.h>
 
 #include <fstream>
@@ -36,13 +38,81 @@ const int64_t globalNumPrice = 1;
 const int64_t globalDenPrice = 1;
 
 
+/** A MetaDEx price, as reduced fraction of two amounts.
+ *
+ * Prices are ordered exactly as the corresponding rational_t values, but a
+ * comparison only takes two native 64x64 bit multiplications, instead of
+ * checked 128 bit arithmetic.
+ */
+class CMPPrice
+{
+ private:
+  //! Magnitudes of the reduced fraction; the denominator is never zero
+  uint64_t num;
+  uint64_t den;
+  //! Zero is never negative
+  bool negative;
+
+  //! Compares num1 * den2 to num2 * den1
+  static int CompareProducts(uint64_t num1, uint64_t den2, uint64_t num2, uint64_t den1);
+
+ public:
+  CMPPrice() : num(0), den(1), negative(false) {}
+  CMPPrice(int64_t numerator, int64_t denominator);
+
+  bool isZero() const { return num == 0; }
+
+  rational_t ToRational() const;
+
+  friend bool operator==(const CMPPrice& a, const CMPPrice& b)
+  {
+      return a.num == b.num && a.den == b.den && a.negative == b.negative;
+  }
+
+  friend bool operator<(const CMPPrice& a, const CMPPrice& b)
+  {
+      if (a.negative != b.negative) return a.negative;
+      const int cmp = CompareProducts(a.num, b.den, b.num, a.den);
+      return a.negative ? cmp > 0 : cmp < 0;
+  }
+
+  friend bool operator!=(const CMPPrice& a, const CMPPrice& b) { return !(a == b); }
+  friend bool operator>(const CMPPrice& a, const CMPPrice& b) { return b < a; }
+  friend bool operator<=(const CMPPrice& a, const CMPPrice& b) { return !(b < a); }
+  friend bool operator>=(const CMPPrice& a, const CMPPrice& b) { return !(a < b); }
+};
+
+inline int CMPPrice::CompareProducts(uint64_t num1, uint64_t den2, uint64_t num2, uint64_t den1)
+{
+#ifdef __SIZEOF_INT128__
+  const unsigned __int128 lhs = static_cast<unsigned __int128>(num1) * den2;
+  const unsigned __int128 rhs = static_cast<unsigned __int128>(num2) * den1;
+  return (lhs < rhs) ? -1 : (rhs < lhs);
+#else
+  // schoolbook multiplication of 32 bit halves
+  uint64_t hi[2], lo[2];
+  const uint64_t a[2] = {num1, num2};
+  const uint64_t b[2] = {den2, den1};
+  for (int i = 0; i < 2; ++i) {
+      const uint64_t a0 = a[i] & 0xffffffff, a1 = a[i] >> 32;
+      const uint64_t b0 = b[i] & 0xffffffff, b1 = b[i] >> 32;
+      const uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+      const uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+      lo[i] = (mid << 32) | (p00 & 0xffffffff);
+      hi[i] = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+  }
+  if (hi[0] != hi[1]) return (hi[0] < hi[1]) ? -1 : 1;
+  return (lo[0] < lo[1]) ? -1 : (lo[1] < lo[0]);
+#endif
+}
+
 /** Converts price to string. */
 std::string xToString(const rational_t& value);
+std::string xToString(const CMPPrice& value);
 
 std::string xToString(const uint64_t &value);
 std::string xToString(const int64_t  &price);
 std::string xToString(const uint32_t &value);
-void saveDataGraphs(std::fstream &file, std::string lineOutSixth1, std::string lineOutSixth2, std::string lineOutSixth3, bool savedata_bool);
 void saveDataGraphs(std::fstream &file, std::string lineOut);
 ui128 multiply_uint64_t(uint64_t &m, uint64_t &n);
 ui128 multiply_int64_t(int64_t &m, int64_t &n);
@@ -79,6 +149,12 @@ class CMPMetaDEx
   uint8_t subaction;
   std::string addr;
 
+  //! Cached unit and inverse price, depending on the amounts for sale and desired
+  CMPPrice unit_price;
+  CMPPrice inverse_price;
+
+  void updatePrices();
+
  public:
   uint256 getHash() const { return txid; }
   uint32_t getProperty() const { return property; }
@@ -109,22 +185,22 @@ class CMPMetaDEx
  CMPMetaDEx(const std::string& addr, int b, uint32_t c, int64_t nValue, uint32_t cd, int64_t ad,
 	    const uint256& tx, uint32_t i, uint8_t suba)
    : block(b), txid(tx), idx(i), property(c), amount_forsale(nValue), desired_property(cd), amount_desired(ad),
-    amount_remaining(nValue), subaction(suba), addr(addr) {}
+    amount_remaining(nValue), subaction(suba), addr(addr) { updatePrices(); }
 
  CMPMetaDEx(const std::string& addr, int b, uint32_t c, int64_t nValue, uint32_t cd, int64_t ad,
 	    const uint256& tx, uint32_t i, uint8_t suba, int64_t ar)
    : block(b), txid(tx), idx(i), property(c), amount_forsale(nValue), desired_property(cd), amount_desired(ad),
-    amount_remaining(ar), subaction(suba), addr(addr) {}
+    amount_remaining(ar), subaction(suba), addr(addr) { updatePrices(); }
 
  CMPMetaDEx(const CMPTransaction& tx)
    : block(tx.block), txid(tx.txid), idx(tx.tx_idx), property(tx.property), amount_forsale(tx.nValue),
     desired_property(tx.desired_property), amount_desired(tx.desired_value), amount_remaining(tx.nValue),
-    subaction(tx.subaction), addr(tx.sender) {}
+    subaction(tx.subaction), addr(tx.sender) { updatePrices(); }
 
   std::string ToString() const;
 
-  rational_t unitPrice() const;
-  rational_t inversePrice() const;
+  const CMPPrice& unitPrice() const { return unit_price; }
+  const CMPPrice& inversePrice() const { return inverse_price; }
 
   /** Used for display of unit prices to 8 decimal places at UI layer. */
   std::string displayUnitPrice() const;
@@ -200,14 +276,16 @@ namespace mastercore
   //! Set of objects sorted by block+idx
   typedef std::set<CMPMetaDEx, MetaDEx_compare> md_Set;
   //! Map of prices; there is a set of sorted objects for each price
-  typedef std::map<rational_t, md_Set> md_PricesMap;
-  //! Map of properties; there is a map of prices for exchange each property
-  typedef std::map<uint32_t, md_PricesMap> md_PropertiesMap;
+  typedef std::map<CMPPrice, md_Set> md_PricesMap;
+  //! Pair of properties: property for sale, property desired
+  typedef std::pair<uint32_t, uint32_t> md_PairKey;
+  //! Map of property pairs; there is a map of prices for each pair of properties exchanged
+  typedef std::map<md_PairKey, md_PricesMap> md_PropertiesMap;
 
   /**  Global map for cumulative volume by pair of properties
    *   Block, property -> put the amount of property traded.
    */
-  extern std::map<int, std::map<uint32_t,int64_t>> metavolume;
+  extern CMPVolumeHistory metavolume;
 
 
   //! Global map for last contract price
@@ -216,9 +294,17 @@ namespace mastercore
   //! Global map for price and order data
   extern md_PropertiesMap metadex;
 
-  // TODO: explore a property-pair, instead of a single priceoperty as map's key........
-  md_PricesMap* get_Prices(uint32_t prop);
-  md_Set* get_Indexes(md_PricesMap* p, rational_t price);
+  md_PricesMap* get_Prices(uint32_t prop, uint32_t desprop);
+  md_Set* get_Indexes(md_PricesMap* p, const CMPPrice& price);
+
+  /** Returns the range of all pairs with the given property for sale. */
+  std::pair<md_PropertiesMap::iterator, md_PropertiesMap::iterator> get_PairsRange(uint32_t prop);
+
+  //! Position of a MetaDEx order: pair, unit price, block and index
+  typedef COrderPosition<md_PairKey, CMPPrice> md_Position;
+
+  //! Indexes of the live MetaDEx orders, by txid, and by address and property for sale
+  extern COrderIndex<md_Position> metadex_index;
 
   uint64_t edgeOrderbook(uint32_t contractId, uint8_t tradingAction);
 
@@ -235,13 +321,22 @@ namespace mastercore
 
   extern cd_PropertiesMap contractdex;
 
+  //! Position of a contract order: contract, effective price, block and index
+  typedef COrderPosition<uint32_t, uint64_t> cd_Position;
+
+  //! Indexes of the live contract orders, by txid, and by address and contract
+  extern COrderIndex<cd_Position> contractdex_index;
+
   cd_PricesMap *get_PricesCd(uint32_t prop);
   cd_Set *get_IndexesCd(cd_PricesMap *p, uint64_t price);
 
   void LoopBiDirectional(cd_PricesMap* const ppriceMap, uint8_t trdAction, MatchReturnType &NewReturn, CMPContractDex* const pnew, const uint32_t propertyForSale);
   void x_TradeBidirectional(typename cd_PricesMap::iterator &it_fwdPrices, typename cd_PricesMap::reverse_iterator &it_bwdPrices, uint8_t trdAction, CMPContractDex* const pnew, const uint64_t sellerPrice, const uint32_t propertyForSale, MatchReturnType &NewReturn);
   int ContractDex_ADD(const std::string& sender_addr, uint32_t prop, int64_t amount, int block, const uint256& txid, unsigned int idx, uint64_t effective_price, uint8_t trading_action, int64_t amountToReserve);
+  /** Inserts an order into the book, in place. */
   bool ContractDex_INSERT(const CMPContractDex &objContractDex);
+  /** Removes an order from the book, and drops its price level, once it is empty. */
+  bool ContractDex_ERASE(const CMPContractDex &objContractDex);
   void ContractDex_debug_print(bool bShowPriceLevel, bool bDisplay);
   const CMPContractDex *ContractDex_RetrieveTrade(const uint256& txid);
   bool ContractDex_isOpen(const uint256& txid, uint32_t propertyIdForSale);
@@ -273,7 +368,10 @@ namespace mastercore
   int MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block, const std::string& sender_addr, uint32_t prop, int64_t amount, uint32_t property_desired, int64_t amount_desired);
   int MetaDEx_SHUTDOWN();
   int MetaDEx_SHUTDOWN_ALLPAIR();
+  /** Inserts an order into the book, in place. */
   bool MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx);
+  /** Removes an order from the book, and drops its price level, once it is empty. */
+  bool MetaDEx_ERASE(const CMPMetaDEx& objMetaDEx);
   void MetaDEx_debug_print(bool bShowPriceLevel = false, bool bDisplay = false);
   bool MetaDEx_isOpen(const uint256& txid, uint32_t propertyIdForSale = 0);
   int MetaDEx_getStatus(const uint256& txid, uint32_t propertyIdForSale, int64_t amountForSale, int64_t totalSold = -1);
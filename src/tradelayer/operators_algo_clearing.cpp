@@ -217,11 +217,21 @@ void adding_newtwocols_trdamount(MatrixTLS &M_file, MatrixTLS &database)
 }
 
 void settlement_algorithm_fifo(MatrixTLS &M_file, int64_t interest, int64_t twap_price)
+{
+  std::vector<std::vector<std::map<std::string, std::string>>> path_main;
+  std::vector<std::map<std::string, std::string>> LivesLongs;
+  std::vector<std::map<std::string, std::string>> LivesShorts;
+  std::vector<std::map<std::string, std::string>> GhostEdgesArray;
+  double exit_price_desired = 0;
+
+  settlement_algorithm_fifo(M_file, interest, twap_price, path_main, LivesLongs, LivesShorts, GhostEdgesArray, exit_price_desired);
+}
+
+void settlement_algorithm_fifo(MatrixTLS &M_file, int64_t interest, int64_t twap_price, std::vector<std::vector<std::map<std::string, std::string>>> &path_main, std::vector<std::map<std::string, std::string>> &LivesLongs, std::vector<std::map<std::string, std::string>> &LivesShorts, std::vector<std::map<std::string, std::string>> &GhostEdgesArray, double &exit_price_desired)
 {
   VectorTLS &open_incr_long  = *pt_open_incr_long;
   VectorTLS &open_incr_short = *pt_open_incr_short;
 
-  std::vector<std::vector<std::map<std::string, std::string>>> path_main;
   std::vector<std::vector<std::map<std::string, std::string>>>::iterator it_path_main;
   std::vector<std::map<std::string, std::string>>::iterator it_path_maini;
   std::map<std::string, std::string> edge_source;
@@ -327,8 +337,6 @@ void settlement_algorithm_fifo(MatrixTLS &M_file, int64_t interest, int64_t twap
       PrintToLog("\nComputing Lives contracts in the Main Graph\n");
   }
 
-  std::vector<std::map<std::string, std::string>> LivesLongs;
-  std::vector<std::map<std::string, std::string>> LivesShorts;
   std::map<std::string, std::string> LivesLongsEle;
   std::map<std::string, std::string> LivesShortsEle;
 
@@ -424,7 +432,7 @@ void settlement_algorithm_fifo(MatrixTLS &M_file, int64_t interest, int64_t twap
   }
 
   if(msc_debug_settlement_algorithm_fifo) PrintToLog("\n*************************************************\n");
-  double exit_price_desired = 0;
+  exit_price_desired = 0;
   long int sum_oflives 	    = 0;
   double PNL_total 	    = 0;
   double gamma_p 	    = 0;
@@ -448,7 +456,6 @@ void settlement_algorithm_fifo(MatrixTLS &M_file, int64_t interest, int64_t twap
       PrintToLog("\nGhost Edges Vector:\n\n");
   }
 
-  std::vector<std::map<std::string, std::string>> GhostEdgesArray;
   GhostEdgesComputing(LivesLongs, LivesShorts, exit_price_desired, GhostEdgesArray);
 
   std::vector<std::map<std::string, std::string>>::iterator it_ghost;
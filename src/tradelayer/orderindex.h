@@ -0,0 +1,140 @@
+#ifndef TRADELAYER_ORDERINDEX_H
+#define TRADELAYER_ORDERINDEX_H
+
+#include <arith_uint256.h>
+#include <uint256.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+/** Position of a live order in a book, ordered the same way as the book.
+ *
+ * The position of an order doesn't change, when a partially filled order is
+ * replaced by its remainder, so the indexes only change, when orders are
+ * added or removed.
+ */
+template <typename BookKey, typename Price>
+struct COrderPosition
+{
+    BookKey book;
+    Price price;
+    int block;
+    unsigned int idx;
+
+    COrderPosition(const BookKey& bookIn, const Price& priceIn, int blockIn, unsigned int idxIn)
+      : book(bookIn), price(priceIn), block(blockIn), idx(idxIn) {}
+
+    bool operator<(const COrderPosition& other) const
+    {
+        if (book != other.book) return book < other.book;
+        if (price != other.price) return price < other.price;
+        if (block != other.block) return block < other.block;
+        return idx < other.idx;
+    }
+
+    bool operator==(const COrderPosition& other) const
+    {
+        return book == other.book && price == other.price && block == other.block && idx == other.idx;
+    }
+};
+
+/** Secondary indexes of the live orders of a book: by txid, and by address and property.
+ *
+ * The consensus strings of the orders are kept as well, sorted by txid and string,
+ * which is the order in which they are hashed.
+ */
+template <typename Position>
+class COrderIndex
+{
+public:
+    //! Positions of orders, in the order of the book
+    typedef std::set<Position> Positions;
+    //! Consensus strings of orders, by txid
+    typedef std::multiset<std::pair<arith_uint256, std::string> > ConsensusStrings;
+
+private:
+    typedef std::pair<std::string, uint32_t> AddressKey;
+
+    std::map<uint256, Position> byTxid;
+    std::map<AddressKey, Positions> byAddress;
+    ConsensusStrings consensusStrings;
+
+public:
+    void Add(const uint256& txid, const std::string& address, uint32_t propertyId, const Position& position, const std::string& consensusString)
+    {
+        std::pair<typename std::map<uint256, Position>::iterator, bool> ret = byTxid.insert(std::make_pair(txid, position));
+        if (!ret.second) ret.first->second = position;
+        byAddress[AddressKey(address, propertyId)].insert(position);
+        consensusStrings.insert(std::make_pair(UintToArith256(txid), consensusString));
+    }
+
+    void Remove(const uint256& txid, const std::string& address, uint32_t propertyId, const Position& position, const std::string& consensusString)
+    {
+        typename std::map<uint256, Position>::iterator it = byTxid.find(txid);
+        if (it != byTxid.end() && it->second == position) byTxid.erase(it);
+
+        typename ConsensusStrings::iterator itStr = consensusStrings.find(std::make_pair(UintToArith256(txid), consensusString));
+        if (itStr != consensusStrings.end()) consensusStrings.erase(itStr);
+
+        typename std::map<AddressKey, Positions>::iterator itAddr = byAddress.find(AddressKey(address, propertyId));
+        if (itAddr == byAddress.end()) return;
+
+        itAddr->second.erase(position);
+        if (itAddr->second.empty()) byAddress.erase(itAddr);
+    }
+
+    /** Returns the position of an order, or nullptr, if there is no such order. */
+    const Position* Find(const uint256& txid) const
+    {
+        typename std::map<uint256, Position>::const_iterator it = byTxid.find(txid);
+        if (it == byTxid.end()) return nullptr;
+
+        return &(it->second);
+    }
+
+    /** Returns the positions of the orders of an address for one property. */
+    Positions Get(const std::string& address, uint32_t propertyId) const
+    {
+        typename std::map<AddressKey, Positions>::const_iterator it = byAddress.find(AddressKey(address, propertyId));
+        if (it == byAddress.end()) return Positions();
+
+        return it->second;
+    }
+
+    /** Returns the positions of the orders of an address for all properties. */
+    Positions GetAll(const std::string& address) const
+    {
+        Positions positions;
+        typename std::map<AddressKey, Positions>::const_iterator it = byAddress.lower_bound(AddressKey(address, 0));
+        for (; it != byAddress.end() && it->first.first == address; ++it) {
+            positions.insert(it->second.begin(), it->second.end());
+        }
+
+        return positions;
+    }
+
+    /** Returns true, if the address has orders for the property. */
+    bool Has(const std::string& address, uint32_t propertyId) const
+    {
+        return byAddress.count(AddressKey(address, propertyId)) > 0;
+    }
+
+    /** Returns the consensus strings of all orders, sorted by txid. */
+    const ConsensusStrings& GetConsensusStrings() const { return consensusStrings; }
+
+    size_t Size() const { return byTxid.size(); }
+
+    void Clear()
+    {
+        byTxid.clear();
+        byAddress.clear();
+        consensusStrings.clear();
+    }
+};
+
+#endif // TRADELAYER_ORDERINDEX_H
@@ -6,17 +6,409 @@
 
 #include <tradelayer/persistence.h>
 
+#include <tradelayer/clearing.h>
+#include <tradelayer/consensushash.h>
+#include <tradelayer/dbrecords.h>
+#include <tradelayer/dex.h>
 #include <tradelayer/log.h>
+#include <tradelayer/mdex.h>
+#include <tradelayer/sp.h>
+#include <tradelayer/tally.h>
+#include <tradelayer/tradeedges.h>
+#include <tradelayer/tradelayer.h>
+#include <tradelayer/tx.h>
 
+#include <chain.h>
+#include <clientversion.h>
+#include <hash.h>
+#include <serialize.h>
 #include <util/system.h>
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 // XXX
 #include <boost/filesystem/path.hpp>
 
+namespace {
+/** Iterator over the text records of a database, skipping binary records. */
+class CTextRecordIterator : public leveldb::Iterator
+{
+private:
+    leveldb::Iterator* base;
+
+    void SkipForward()
+    {
+        while (base->Valid() && mastercore::IsBinaryRecordKey(base->key().ToString())) base->Next();
+    }
+
+    void SkipBackward()
+    {
+        while (base->Valid() && mastercore::IsBinaryRecordKey(base->key().ToString())) base->Prev();
+    }
+
+public:
+    explicit CTextRecordIterator(leveldb::Iterator* baseIn) : base(baseIn) {}
+    ~CTextRecordIterator() { delete base; }
+
+    bool Valid() const override { return base->Valid(); }
+    void SeekToFirst() override { base->SeekToFirst(); SkipForward(); }
+    void SeekToLast() override { base->SeekToLast(); SkipBackward(); }
+    void Seek(const leveldb::Slice& target) override { base->Seek(target); SkipForward(); }
+    void Next() override { base->Next(); SkipForward(); }
+    void Prev() override { base->Prev(); SkipBackward(); }
+    leveldb::Slice key() const override { return base->key(); }
+    leveldb::Slice value() const override { return base->value(); }
+    leveldb::Status status() const override { return base->status(); }
+};
+
+/** Iterator over a database, as seen with the writes of an open batch applied.
+ *
+ * The database iterator and the batch are stepped side by side, like a merging
+ * iterator, and the database iterator is only sought when the direction changes.
+ */
+class CBatchOverlayIterator : public leveldb::Iterator
+{
+private:
+    enum Direction { FORWARD, BACKWARD };
+
+    leveldb::Iterator* base;
+    std::shared_ptr<const CDBBatchOverlay> overlay;
+    //! Guards the batch, which may still be written to
+    CCriticalSection& cs_overlay;
+    //! Generation of the last write visible to this iterator
+    const uint64_t nGeneration;
+    Direction direction;
+    //! Moving forward: the first write at or after the current key
+    CDBBatchOverlay::const_iterator itNext;
+    //! Moving backward: the last write at or before the current key
+    CDBBatchOverlay::const_reverse_iterator itPrev;
+    bool fValid;
+    std::string strKey;
+    std::string strValue;
+
+    // returns the last write made before this iterator was created, if any
+    const CDBPendingWrite* GetVisible(const std::vector<CDBPendingWrite>& writes) const
+    {
+        for (std::vector<CDBPendingWrite>::const_reverse_iterator it = writes.rbegin(); it != writes.rend(); ++it) {
+            if (it->nGeneration <= nGeneration) return &*it;
+        }
+        return nullptr;
+    }
+
+    // moves to the first visible entry at or after the positions of both sides
+    void ResolveForward()
+    {
+        while (true) {
+            const bool fBase = base->Valid();
+            const bool fOverlay = (itNext != overlay->end());
+            if (!fBase && !fOverlay) {
+                fValid = false;
+                return;
+            }
+            const int cmp = !fBase ? 1 : (!fOverlay ? -1 : base->key().compare(itNext->first));
+            if (cmp < 0) {
+                fValid = true;
+                strKey = base->key().ToString();
+                strValue = base->value().ToString();
+                return;
+            }
+            // the batch shadows the database, unless the key was written later
+            const CDBPendingWrite* write = GetVisible(itNext->second);
+            if (write != nullptr && write->fExists) {
+                fValid = true;
+                strKey = itNext->first;
+                strValue = write->value;
+                return;
+            }
+            if (write != nullptr && cmp == 0) base->Next();
+            ++itNext;
+        }
+    }
+
+    // moves to the last visible entry at or before the positions of both sides
+    void ResolveBackward()
+    {
+        while (true) {
+            const bool fBase = base->Valid();
+            const bool fOverlay = (itPrev != overlay->rend());
+            if (!fBase && !fOverlay) {
+                fValid = false;
+                return;
+            }
+            const int cmp = !fBase ? -1 : (!fOverlay ? 1 : base->key().compare(itPrev->first));
+            if (cmp > 0) {
+                fValid = true;
+                strKey = base->key().ToString();
+                strValue = base->value().ToString();
+                return;
+            }
+            const CDBPendingWrite* write = GetVisible(itPrev->second);
+            if (write != nullptr && write->fExists) {
+                fValid = true;
+                strKey = itPrev->first;
+                strValue = write->value;
+                return;
+            }
+            if (write != nullptr && cmp == 0) base->Prev();
+            ++itPrev;
+        }
+    }
+
+public:
+    CBatchOverlayIterator(leveldb::Iterator* baseIn, const std::shared_ptr<const CDBBatchOverlay>& overlayIn,
+            CCriticalSection& csIn, uint64_t nGenerationIn)
+        : base(baseIn), overlay(overlayIn), cs_overlay(csIn), nGeneration(nGenerationIn), direction(FORWARD),
+          itNext(overlayIn->end()), itPrev(overlayIn->rend()), fValid(false) {}
+    ~CBatchOverlayIterator() { delete base; }
+
+    bool Valid() const override { return fValid; }
+
+    void SeekToFirst() override
+    {
+        LOCK(cs_overlay);
+        direction = FORWARD;
+        base->SeekToFirst();
+        itNext = overlay->begin();
+        ResolveForward();
+    }
+
+    void SeekToLast() override
+    {
+        LOCK(cs_overlay);
+        direction = BACKWARD;
+        base->SeekToLast();
+        itPrev = overlay->rbegin();
+        ResolveBackward();
+    }
+
+    void Seek(const leveldb::Slice& target) override
+    {
+        LOCK(cs_overlay);
+        direction = FORWARD;
+        base->Seek(target);
+        itNext = overlay->lower_bound(target.ToString());
+        ResolveForward();
+    }
+
+    void Next() override
+    {
+        assert(fValid);
+        LOCK(cs_overlay);
+        if (direction != FORWARD) {
+            direction = FORWARD;
+            base->Seek(strKey);
+            itNext = overlay->lower_bound(strKey);
+        }
+        // both sides are at or after the current key
+        if (base->Valid() && base->key() == strKey) base->Next();
+        if (itNext != overlay->end() && itNext->first == strKey) ++itNext;
+        ResolveForward();
+    }
+
+    void Prev() override
+    {
+        assert(fValid);
+        LOCK(cs_overlay);
+        if (direction != BACKWARD) {
+            direction = BACKWARD;
+            base->Seek(strKey);
+            if (!base->Valid()) {
+                base->SeekToLast();
+            } else if (base->key() != strKey) {
+                base->Prev();
+            }
+            itPrev = CDBBatchOverlay::const_reverse_iterator(overlay->upper_bound(strKey));
+        }
+        // both sides are at or before the current key
+        if (base->Valid() && base->key() == strKey) base->Prev();
+        if (itPrev != overlay->rend() && itPrev->first == strKey) ++itPrev;
+        ResolveBackward();
+    }
+
+    leveldb::Slice key() const override { return strKey; }
+    leveldb::Slice value() const override { return strValue; }
+    leveldb::Status status() const override { return base->status(); }
+};
+
+/** Adds the writes of a LevelDB batch to the open batch of a database. */
+class CBatchCollector : public leveldb::WriteBatch::Handler
+{
+private:
+    std::function<void(const std::string&, bool, const std::string&)> fn;
+
+public:
+    explicit CBatchCollector(const std::function<void(const std::string&, bool, const std::string&)>& fnIn) : fn(fnIn) {}
+
+    void Put(const leveldb::Slice& key, const leveldb::Slice& value) override { fn(key.ToString(), true, value.ToString()); }
+    void Delete(const leveldb::Slice& key) override { fn(key.ToString(), false, std::string()); }
+};
+}
+
+leveldb::Iterator* CDBBase::NewIterator() const
+{
+    assert(pdb != nullptr);
+    LOCK(cs_batch);
+    if (!pending || pending->empty()) return pdb->NewIterator(iteroptions);
+
+    // later writes of the batch are added as new versions, instead of replacing the seen ones
+    nIteratorGeneration = nGeneration;
+    return new CBatchOverlayIterator(pdb->NewIterator(iteroptions), pending, cs_batch, nGeneration);
+}
+
+leveldb::Iterator* CDBBase::NewTextIterator() const
+{
+    return new CTextRecordIterator(NewIterator());
+}
+
+void CDBBase::AddPending(const std::string& key, bool fExists, const std::string& value)
+{
+    AssertLockHeld(cs_batch);
+    if (!pending) pending = std::make_shared<CDBBatchOverlay>();
+
+    std::vector<CDBPendingWrite>& writes = (*pending)[key];
+    const CDBPendingWrite write(++nGeneration, fExists, value);
+    if (pending.use_count() == 1) {
+        // no iterator is open, older versions can't be seen anymore
+        writes.assign(1, write);
+    } else if (!writes.empty() && writes.back().nGeneration > nIteratorGeneration) {
+        writes.back() = write;
+    } else {
+        // iterators keep the writes they were created with
+        writes.push_back(write);
+    }
+}
+
+leveldb::Status CDBBase::Get(const std::string& key, std::string* value) const
+{
+    assert(pdb != nullptr);
+    {
+        LOCK(cs_batch);
+        if (pending) {
+            CDBBatchOverlay::const_iterator it = pending->find(key);
+            if (it != pending->end()) {
+                const CDBPendingWrite& write = it->second.back();
+                if (!write.fExists) return leveldb::Status::NotFound(key);
+                *value = write.value;
+                return leveldb::Status::OK();
+            }
+        }
+    }
+    return pdb->Get(readoptions, key, value);
+}
+
+leveldb::Status CDBBase::Put(const std::string& key, const std::string& value)
+{
+    assert(pdb != nullptr);
+    LOCK(cs_batch);
+    if (!fBatch) return pdb->Put(writeoptions, key, value);
+
+    AddPending(key, true, value);
+    return leveldb::Status::OK();
+}
+
+leveldb::Status CDBBase::Delete(const std::string& key)
+{
+    assert(pdb != nullptr);
+    LOCK(cs_batch);
+    if (!fBatch) return pdb->Delete(writeoptions, key);
+
+    AddPending(key, false, std::string());
+    return leveldb::Status::OK();
+}
+
+leveldb::Status CDBBase::Write(leveldb::WriteBatch* batch)
+{
+    assert(pdb != nullptr);
+    LOCK(cs_batch);
+    if (!fBatch) return pdb->Write(writeoptions, batch);
+
+    CBatchCollector collector([this](const std::string& key, bool fExists, const std::string& value) {
+        AddPending(key, fExists, value);
+    });
+    return batch->Iterate(&collector);
+}
+
+/**
+ * Starts collecting writes in a batch.
+ */
+void CDBBase::BeginBatch()
+{
+    CommitBatch();
+
+    LOCK(cs_batch);
+    fBatch = true;
+}
+
+/**
+ * Writes the collected entries atomically, and closes the batch.
+ */
+leveldb::Status CDBBase::CommitBatch(bool fSync)
+{
+    LOCK(cs_batch);
+    fBatch = false;
+    if (!pending || pending->empty()) {
+        pending.reset();
+        return leveldb::Status::OK();
+    }
+    assert(pdb != nullptr);
+
+    leveldb::WriteBatch batch;
+    uint64_t nBytes = 0;
+    for (CDBBatchOverlay::const_iterator it = pending->begin(); it != pending->end(); ++it) {
+        const CDBPendingWrite& write = it->second.back();
+        if (write.fExists) {
+            batch.Put(it->first, write.value);
+        } else {
+            batch.Delete(it->first);
+        }
+        nBytes += it->first.size() + write.value.size();
+    }
+
+    const int64_t nTimeStart = GetTimeMicros();
+    leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch);
+    const int64_t nTime = GetTimeMicros() - nTimeStart;
+
+    const uint64_t nEntries = pending->size();
+    pending.reset();
+
+    ++batchStats.nCommits;
+    batchStats.nLastEntries = nEntries;
+    batchStats.nLastBytes = nBytes;
+    batchStats.nMaxEntries = std::max(batchStats.nMaxEntries, nEntries);
+    batchStats.nTotalEntries += nEntries;
+    batchStats.nLastCommitTime = nTime;
+    batchStats.nMaxCommitTime = std::max(batchStats.nMaxCommitTime, nTime);
+    batchStats.nTotalCommitTime += nTime;
+
+    if (!status.ok()) PrintToLog("%s(): failed to commit %d entries: %s\n", __func__, nEntries, status.ToString());
+    if (msc_debug_persistence)
+        PrintToLog("Committed %d entries [%d bytes, %.3f ms total]\n", nEntries, nBytes, 0.001 * nTime);
+
+    return status;
+}
+
+/**
+ * Returns the statistics of the committed batches.
+ */
+CDBBatchStats CDBBase::GetBatchStats() const
+{
+    LOCK(cs_batch);
+    return batchStats;
+}
+
 /**
  * Opens or creates a LevelDB based database.
  */
@@ -39,6 +431,11 @@ leveldb::Status CDBBase::Open(const fs::path& path, bool fWipe)
  */
 void CDBBase::Clear()
 {
+    {
+        LOCK(cs_batch);
+        pending.reset();
+    }
+
     int64_t nTimeStart = GetTimeMicros();
     unsigned int n = 0;
     leveldb::WriteBatch batch;
@@ -67,12 +464,1317 @@ void CDBBase::Clear()
 void CDBBase::Close()
 {
     if (pdb) {
+        CommitBatch();
         delete pdb;
         pdb = nullptr;
     }
 }
 
 
+/**
+ * Binary state snapshot format:
+ *
+ *  Header:
+ *      char[4]   "TLSS"
+ *      uint32_t  format version
+ *      uint256   block hash
+ *      int32_t   block height
+ *
+ *  Sections, one per FILETYPES entry and binary only section, in no particular order:
+ *      uint8_t   section type (FILETYPES or StateSections)
+ *      uint32_t  payload length
+ *      char[]    payload
+ *
+ *  Trailer:
+ *      uint256   double SHA256 of everything before
+ *
+ * Amounts are stored as zigzag encoded varints, identifiers and heights as
+ * plain varints, and strings and hashes as usual. Unknown sections are skipped
+ * on load, so new sections can be added without bumping the version.
+ *
+ * Delta snapshots use the magic "TLSD" and extend the header with the hash of
+ * the previously saved block, which is either a full snapshot or another delta.
+ * They only contain the sections which changed since then, and instead of the
+ * whole tally map, the balance section lists the changed entries:
+ *
+ *      compactsize  number of entries
+ *      string       address
+ *      varint       property id
+ *      varint[11]   all tally types, zigzag encoded
+ *
+ * The sections of the MetaDEx and ContractDEx books list the changed orders
+ * instead of the whole book:
+ *
+ *      compactsize  number of entries
+ *      uint8_t      1: the order is removed, 2: an order is added, 3: both
+ *      order        the removed order, as in a full snapshot, if any
+ *      order        the added order, as in a full snapshot, if any
+ */
+namespace mastercore
+{
+static const char STATE_SNAPSHOT_MAGIC[4] = {'T', 'L', 'S', 'S'};
+static const char STATE_DELTA_MAGIC[4] = {'T', 'L', 'S', 'D'};
+
+//! Deltas of older versions have whole books instead of the changed orders
+static const uint32_t MIN_STATE_DELTA_VERSION = 2;
+
+//! Flags of an order change record of a delta
+enum StateOrderChange
+{
+    STATE_ORDER_ERASED = 1,
+    STATE_ORDER_INSERTED = 2,
+};
+
+//! Saved blocks between two full snapshots, if not set via -tlfullsnapshotinterval
+static const int DEFAULT_FULL_SNAPSHOT_INTERVAL = 50;
+
+/** An order of a book, which was added, replaced or removed since the last saved block.
+ */
+template <typename Order>
+struct CStateOrderChange
+{
+    //! Whether the order was in the book as of the last saved block
+    bool fErased;
+    //! The order as of the last saved block
+    Order erased;
+    //! Whether the order is in the book now
+    bool fInserted;
+    //! The order as it is now
+    Order inserted;
+
+    CStateOrderChange() : fErased(false), fInserted(false) {}
+};
+
+//! Tracks what changed since the last saved block, guarded by cs_tally
+static struct
+{
+    //! Hash of the last saved block, null if the next snapshot must be a full one
+    uint256 prevBlockHash;
+    //! Height of the last saved block
+    int nPrevHeight;
+    //! Number of deltas written since the last full snapshot
+    int nDeltas;
+    //! Sections changed since the last saved block
+    bool dirtySections[NUM_STATE_SECTIONS];
+    //! Hashes of the section payloads as last written, only kept with -tldebug=persistence
+    uint256 sectionHashes[NUM_STATE_SECTIONS];
+    //! Tally entries changed since the last saved block
+    std::set<std::pair<std::string, uint32_t>> changedBalances;
+    //! Orders of the books changed since the last saved block, by position
+    std::map<md_Position, CStateOrderChange<CMPMetaDEx>> changedMetaDExOrders;
+    std::map<cd_Position, CStateOrderChange<CMPContractDex>> changedContractDexOrders;
+} deltaState;
+
+//! Bases of the known deltas, as block hash -> hash of the block the delta is based on
+static CCriticalSection cs_deltabases;
+static std::map<uint256, uint256> mapDeltaBases;
+
+//! Maps signed integers to unsigned ones, so small negative amounts stay short
+static inline uint64_t ZigZagEncode(int64_t n)
+{
+    return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+static inline int64_t ZigZagDecode(uint64_t n)
+{
+    return static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+}
+
+template <typename Stream>
+static void WriteAmount(Stream& s, int64_t n)
+{
+    WriteVarInt<Stream, uint64_t>(s, ZigZagEncode(n));
+}
+
+template <typename Stream>
+static int64_t ReadAmount(Stream& s)
+{
+    return ZigZagDecode(ReadVarInt<Stream, uint64_t>(s));
+}
+
+template <typename Stream>
+static void WriteNumber(Stream& s, uint64_t n)
+{
+    WriteVarInt<Stream, uint64_t>(s, n);
+}
+
+template <typename Stream>
+static uint64_t ReadNumber(Stream& s)
+{
+    return ReadVarInt<Stream, uint64_t>(s);
+}
+
+/** Returns true, if any of the balances of the record is not zero. */
+static bool HasBalance(const CMPTally::BalanceRecord& record)
+{
+    for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+        if (record.balance[ttype] != 0) return true;
+    }
+    return false;
+}
+
+/**
+ * Serializes the tally entries with balances.
+ *
+ * "address" -> [propertyid, 11 x tally type], empty entries are not written,
+ * same as with the text format.
+ *
+ * This runs under cs_tally for every full snapshot, so the records are read in
+ * place, instead of looking up each property and balance again.
+ */
+static void SerializeBalances(CDataStream& ss)
+{
+    uint64_t nAddresses = 0;
+    for (const auto& entry : mp_tally_map) {
+        for (const CMPTally::BalanceRecord& record : entry.second) {
+            if (HasBalance(record)) {
+                ++nAddresses;
+                break;
+            }
+        }
+    }
+
+    WriteCompactSize(ss, nAddresses);
+    for (const auto& entry : mp_tally_map)
+    {
+        uint64_t nProperties = 0;
+        for (const CMPTally::BalanceRecord& record : entry.second) {
+            if (HasBalance(record)) ++nProperties;
+        }
+        if (nProperties == 0) continue;
+
+        ss << entry.first;
+        WriteCompactSize(ss, nProperties);
+        for (const CMPTally::BalanceRecord& record : entry.second) {
+            if (!HasBalance(record)) continue;
+            WriteNumber(ss, record.propertyId);
+            for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+                WriteAmount(ss, record.balance[ttype]);
+            }
+        }
+    }
+}
+
+static void UnserializeBalances(CDataStream& ss)
+{
+    mp_tally_map.clear();
+    InvalidateConsensusHashCache();
+    InvalidateTallyTotals();
+
+    const uint64_t nAddresses = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nAddresses; ++i)
+    {
+        std::string address;
+        ss >> address;
+        const uint64_t nProperties = ReadCompactSize(ss);
+        for (uint64_t j = 0; j < nProperties; ++j) {
+            const uint32_t propertyId = ReadNumber(ss);
+            for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+                const int64_t amount = ReadAmount(ss);
+                if (amount) update_tally_map(address, propertyId, amount, static_cast<TallyType>(ttype));
+            }
+        }
+    }
+}
+
+static void SerializeContractDexOrder(CDataStream& ss, const CMPContractDex& obj)
+{
+    ss << obj.getAddr();
+    WriteNumber(ss, obj.getBlock());
+    WriteAmount(ss, obj.getAmountForSale());
+    WriteNumber(ss, obj.getProperty());
+    WriteAmount(ss, obj.getAmountDesired());
+    WriteNumber(ss, obj.getDesProperty());
+    ss << obj.getAction();
+    WriteNumber(ss, obj.getIdx());
+    ss << obj.getHash();
+    WriteAmount(ss, obj.getAmountRemaining());
+    WriteNumber(ss, obj.getEffectivePrice());
+    ss << obj.getTradingAction();
+    WriteAmount(ss, obj.getAmountReserved());
+}
+
+static CMPContractDex UnserializeContractDexOrder(CDataStream& ss)
+{
+    std::string addr;
+    uint8_t subaction, trading_action;
+    uint256 txid;
+    ss >> addr;
+    const int block = ReadNumber(ss);
+    const int64_t amount_forsale = ReadAmount(ss);
+    const uint32_t property = ReadNumber(ss);
+    const int64_t amount_desired = ReadAmount(ss);
+    const uint32_t desired_property = ReadNumber(ss);
+    ss >> subaction;
+    const unsigned int idx = ReadNumber(ss);
+    ss >> txid;
+    const int64_t amount_remaining = ReadAmount(ss);
+    const uint64_t effective_price = ReadNumber(ss);
+    ss >> trading_action;
+    const int64_t amount_reserved = ReadAmount(ss);
+
+    return CMPContractDex(addr, block, property, amount_forsale, desired_property,
+            amount_desired, txid, idx, subaction, amount_remaining, effective_price, trading_action, amount_reserved);
+}
+
+static void SerializeContractDex(CDataStream& ss)
+{
+    std::vector<const CMPContractDex*> orders;
+    for (cd_PropertiesMap::const_iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
+        for (cd_PricesMap::const_iterator it = my_it->second.begin(); it != my_it->second.end(); ++it) {
+            for (cd_Set::const_iterator oit = it->second.begin(); oit != it->second.end(); ++oit) {
+                orders.push_back(&(*oit));
+            }
+        }
+    }
+
+    WriteCompactSize(ss, orders.size());
+    for (const CMPContractDex* obj : orders) {
+        SerializeContractDexOrder(ss, *obj);
+    }
+}
+
+static bool UnserializeContractDex(CDataStream& ss)
+{
+    contractdex.clear();
+    contractdex_index.Clear();
+
+    const uint64_t nOrders = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nOrders; ++i) {
+        if (!ContractDex_INSERT(UnserializeContractDexOrder(ss))) return false;
+    }
+
+    return true;
+}
+
+static void SerializeMetaDexOrder(CDataStream& ss, const CMPMetaDEx& obj)
+{
+    ss << obj.getAddr();
+    WriteNumber(ss, obj.getBlock());
+    WriteAmount(ss, obj.getAmountForSale());
+    WriteNumber(ss, obj.getProperty());
+    WriteAmount(ss, obj.getAmountDesired());
+    WriteNumber(ss, obj.getDesProperty());
+    ss << obj.getAction();
+    WriteNumber(ss, obj.getIdx());
+    ss << obj.getHash();
+    WriteAmount(ss, obj.getAmountRemaining());
+}
+
+static CMPMetaDEx UnserializeMetaDexOrder(CDataStream& ss)
+{
+    std::string addr;
+    uint8_t subaction;
+    uint256 txid;
+    ss >> addr;
+    const int block = ReadNumber(ss);
+    const int64_t amount_forsale = ReadAmount(ss);
+    const uint32_t property = ReadNumber(ss);
+    const int64_t amount_desired = ReadAmount(ss);
+    const uint32_t desired_property = ReadNumber(ss);
+    ss >> subaction;
+    const unsigned int idx = ReadNumber(ss);
+    ss >> txid;
+    const int64_t amount_remaining = ReadAmount(ss);
+
+    return CMPMetaDEx(addr, block, property, amount_forsale, desired_property,
+            amount_desired, txid, idx, subaction, amount_remaining);
+}
+
+static void SerializeMetaDex(CDataStream& ss)
+{
+    std::vector<const CMPMetaDEx*> orders;
+    for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        for (md_PricesMap::const_iterator it = my_it->second.begin(); it != my_it->second.end(); ++it) {
+            for (md_Set::const_iterator oit = it->second.begin(); oit != it->second.end(); ++oit) {
+                orders.push_back(&(*oit));
+            }
+        }
+    }
+
+    WriteCompactSize(ss, orders.size());
+    for (const CMPMetaDEx* obj : orders) {
+        SerializeMetaDexOrder(ss, *obj);
+    }
+}
+
+static bool UnserializeMetaDex(CDataStream& ss)
+{
+    metadex.clear();
+    metadex_index.Clear();
+
+    const uint64_t nOrders = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nOrders; ++i) {
+        if (!MetaDEx_INSERT(UnserializeMetaDexOrder(ss))) return false;
+    }
+
+    return true;
+}
+
+// flags, removed order, added order for each changed order
+template <typename Order, typename Position>
+static void SerializeChangedOrders(CDataStream& ss, const std::map<Position, CStateOrderChange<Order>>& changes,
+        void (*serializeOrder)(CDataStream&, const Order&))
+{
+    std::vector<const CStateOrderChange<Order>*> records;
+    for (typename std::map<Position, CStateOrderChange<Order>>::const_iterator it = changes.begin(); it != changes.end(); ++it) {
+        // orders, which were added and removed again, are left out
+        if (it->second.fErased || it->second.fInserted) records.push_back(&it->second);
+    }
+
+    WriteCompactSize(ss, records.size());
+    for (const CStateOrderChange<Order>* change : records)
+    {
+        ss << static_cast<uint8_t>((change->fErased ? STATE_ORDER_ERASED : 0) | (change->fInserted ? STATE_ORDER_INSERTED : 0));
+        if (change->fErased) serializeOrder(ss, change->erased);
+        if (change->fInserted) serializeOrder(ss, change->inserted);
+    }
+}
+
+template <typename Order>
+static bool UnserializeChangedOrders(CDataStream& ss, Order (*unserializeOrder)(CDataStream&),
+        bool (*eraseOrder)(const Order&), bool (*insertOrder)(const Order&))
+{
+    const uint64_t nChanges = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nChanges; ++i)
+    {
+        uint8_t flags = 0;
+        ss >> flags;
+        if ((flags & STATE_ORDER_ERASED) && !eraseOrder(unserializeOrder(ss))) return false;
+        if ((flags & STATE_ORDER_INSERTED) && !insertOrder(unserializeOrder(ss))) return false;
+    }
+
+    return true;
+}
+
+// the map keys already combine the addresses and the property, so they are stored as is
+static void SerializeOffers(CDataStream& ss)
+{
+    WriteCompactSize(ss, my_offers.size());
+    for (OfferMap::const_iterator it = my_offers.begin(); it != my_offers.end(); ++it)
+    {
+        const CMPOffer& offer = it->second;
+        ss << it->first;
+        WriteNumber(ss, offer.getOfferBlock());
+        WriteAmount(ss, offer.getOfferAmountOriginal());
+        WriteNumber(ss, offer.getProperty());
+        WriteAmount(ss, offer.getLTCDesiredOriginal());
+        WriteAmount(ss, offer.getMinFee());
+        ss << offer.getBlockTimeLimit();
+        ss << offer.getHash();
+        ss << offer.getSubaction();
+        ss << offer.getOption();
+    }
+}
+
+static bool UnserializeOffers(CDataStream& ss)
+{
+    my_offers.clear();
+    InvalidateConsensusHashCache();
+
+    const uint64_t nOffers = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nOffers; ++i)
+    {
+        std::string combo;
+        uint8_t blocktimelimit, subaction, option;
+        uint256 txid;
+        ss >> combo;
+        const int offerBlock = ReadNumber(ss);
+        const int64_t amountOriginal = ReadAmount(ss);
+        const uint32_t prop = ReadNumber(ss);
+        const int64_t ltcDesired = ReadAmount(ss);
+        const int64_t minFee = ReadAmount(ss);
+        ss >> blocktimelimit;
+        ss >> txid;
+        ss >> subaction;
+        ss >> option;
+
+        CMPOffer newOffer(offerBlock, amountOriginal, prop, ltcDesired, minFee, blocktimelimit, txid, subaction, option);
+        if (!my_offers.insert(std::make_pair(combo, newOffer)).second) return false;
+    }
+
+    return true;
+}
+
+static void SerializeAccepts(CDataStream& ss)
+{
+    WriteCompactSize(ss, my_accepts.size());
+    for (AcceptMap::const_iterator it = my_accepts.begin(); it != my_accepts.end(); ++it)
+    {
+        const CMPAccept& accept = it->second;
+        ss << it->first;
+        WriteAmount(ss, accept.getAcceptAmount());
+        WriteAmount(ss, accept.getAcceptAmountRemaining());
+        WriteNumber(ss, accept.getAcceptBlock());
+        ss << accept.getBlockTimeLimit();
+        WriteNumber(ss, accept.getProperty());
+        WriteAmount(ss, accept.getOfferAmountOriginal());
+        WriteAmount(ss, accept.getLTCDesiredOriginal());
+        ss << accept.getHash();
+    }
+}
+
+static bool UnserializeAccepts(CDataStream& ss)
+{
+    my_accepts.clear();
+    InvalidateConsensusHashCache();
+
+    const uint64_t nAccepts = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nAccepts; ++i)
+    {
+        std::string combo;
+        uint8_t blocktimelimit;
+        uint256 txid;
+        ss >> combo;
+        const int64_t amountOriginal = ReadAmount(ss);
+        const int64_t amountRemaining = ReadAmount(ss);
+        const int nBlock = ReadNumber(ss);
+        ss >> blocktimelimit;
+        const uint32_t prop = ReadNumber(ss);
+        const int64_t offerOriginal = ReadAmount(ss);
+        const int64_t ltcDesired = ReadAmount(ss);
+        ss >> txid;
+
+        CMPAccept newAccept(amountOriginal, amountRemaining, nBlock, blocktimelimit, prop, offerOriginal, ltcDesired, txid);
+        if (!my_accepts.insert(std::make_pair(combo, newAccept)).second) return false;
+    }
+
+    return true;
+}
+
+// propertyid -> amount
+static void SerializeAmountMap(CDataStream& ss, const std::map<uint32_t, int64_t>& amounts)
+{
+    WriteCompactSize(ss, amounts.size());
+    for (std::map<uint32_t, int64_t>::const_iterator it = amounts.begin(); it != amounts.end(); ++it) {
+        WriteNumber(ss, it->first);
+        WriteAmount(ss, it->second);
+    }
+}
+
+static void UnserializeAmountMap(CDataStream& ss, std::map<uint32_t, int64_t>& amounts)
+{
+    amounts.clear();
+
+    const uint64_t nEntries = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nEntries; ++i) {
+        const uint32_t propertyId = ReadNumber(ss);
+        amounts[propertyId] = ReadAmount(ss);
+    }
+}
+
+// block -> propertyid -> amount
+static void SerializeVolumeMap(CDataStream& ss, const CMPVolumeHistory& history)
+{
+    const std::map<int, std::map<uint32_t, int64_t>> volumes = history.GetBlocks();
+
+    WriteCompactSize(ss, volumes.size());
+    for (std::map<int, std::map<uint32_t, int64_t>>::const_iterator it = volumes.begin(); it != volumes.end(); ++it) {
+        WriteNumber(ss, it->first);
+        SerializeAmountMap(ss, it->second);
+    }
+    // stored with an offset of one, as there may be no checkpoint
+    WriteNumber(ss, history.GetCheckpoint() + 1);
+}
+
+static void UnserializeVolumeMap(CDataStream& ss, CMPVolumeHistory& history)
+{
+    history.Clear();
+
+    const uint64_t nBlocks = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nBlocks; ++i) {
+        const int block = ReadNumber(ss);
+        std::map<uint32_t, int64_t> amounts;
+        UnserializeAmountMap(ss, amounts);
+        for (std::map<uint32_t, int64_t>::const_iterator it = amounts.begin(); it != amounts.end(); ++it) {
+            history.Add(block, it->first, it->second);
+        }
+    }
+    // snapshots written before the checkpoint was stored end here
+    if (!ss.empty()) history.Compact(static_cast<int>(ReadNumber(ss)) - 1);
+}
+
+static void SerializeWithdrawals(CDataStream& ss)
+{
+    std::map<std::string, std::vector<withdrawalAccepted>> withdrawals;
+    withdrawalSchedule.ForEach([&withdrawals] (const std::string& chnAddr, const withdrawalAccepted& w) { withdrawals[chnAddr].push_back(w); });
+
+    WriteCompactSize(ss, withdrawals.size());
+    for (std::map<std::string, std::vector<withdrawalAccepted>>::const_iterator it = withdrawals.begin(); it != withdrawals.end(); ++it)
+    {
+        ss << it->first;
+        WriteCompactSize(ss, it->second.size());
+        for (const withdrawalAccepted& w : it->second) {
+            ss << w.address;
+            WriteNumber(ss, w.deadline_block);
+            WriteNumber(ss, w.propertyId);
+            WriteNumber(ss, w.amount);
+            ss << w.txid;
+        }
+    }
+}
+
+static void UnserializeWithdrawals(CDataStream& ss)
+{
+    withdrawalSchedule.Clear();
+
+    const uint64_t nChannels = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nChannels; ++i)
+    {
+        std::string chnAddr;
+        ss >> chnAddr;
+        const uint64_t nWithdrawals = ReadCompactSize(ss);
+        for (uint64_t j = 0; j < nWithdrawals; ++j) {
+            withdrawalAccepted w;
+            ss >> w.address;
+            w.deadline_block = ReadNumber(ss);
+            w.propertyId = ReadNumber(ss);
+            w.amount = ReadNumber(ss);
+            ss >> w.txid;
+            withdrawalSchedule.Add(chnAddr, w);
+        }
+    }
+}
+
+static void SerializeChannels(CDataStream& ss)
+{
+    WriteCompactSize(ss, channels_Map.size());
+    for (std::map<std::string, Channel>::const_iterator it = channels_Map.begin(); it != channels_Map.end(); ++it)
+    {
+        const Channel& chn = it->second;
+        const std::map<std::string, std::map<uint32_t, int64_t>>& balances = chn.getBalanceMap();
+        ss << it->first;
+        ss << chn.getMultisig();
+        ss << chn.getFirst();
+        ss << chn.getSecond();
+        WriteNumber(ss, chn.getLastBlock());
+        WriteCompactSize(ss, balances.size());
+        for (std::map<std::string, std::map<uint32_t, int64_t>>::const_iterator bit = balances.begin(); bit != balances.end(); ++bit) {
+            ss << bit->first;
+            SerializeAmountMap(ss, bit->second);
+        }
+    }
+}
+
+static bool UnserializeChannels(CDataStream& ss)
+{
+    channels_Map.clear();
+
+    const uint64_t nChannels = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nChannels; ++i)
+    {
+        std::string chnAddr, multisig, first, second;
+        ss >> chnAddr;
+        ss >> multisig;
+        ss >> first;
+        ss >> second;
+        const int lastBlock = ReadNumber(ss);
+
+        Channel chn(multisig, first, second, lastBlock);
+        const uint64_t nAddresses = ReadCompactSize(ss);
+        for (uint64_t j = 0; j < nAddresses; ++j) {
+            std::string address;
+            std::map<uint32_t, int64_t> amounts;
+            ss >> address;
+            UnserializeAmountMap(ss, amounts);
+            for (std::map<uint32_t, int64_t>::const_iterator it = amounts.begin(); it != amounts.end(); ++it) {
+                chn.setBalance(address, it->first, it->second);
+            }
+        }
+
+        if (!channels_Map.insert(std::make_pair(chnAddr, chn)).second) return false;
+    }
+
+    return true;
+}
+
+// propertyid -> block -> [unit price, amount]
+static void SerializeTokenVWAP(CDataStream& ss)
+{
+    WriteCompactSize(ss, tokenvwap.size());
+    for (const auto& mp : tokenvwap)
+    {
+        WriteNumber(ss, mp.first);
+        WriteCompactSize(ss, mp.second.size());
+        for (const auto& blc : mp.second) {
+            WriteNumber(ss, blc.first);
+            WriteCompactSize(ss, blc.second.size());
+            for (const std::pair<int64_t, int64_t>& vwPair : blc.second) {
+                WriteAmount(ss, vwPair.first);
+                WriteAmount(ss, vwPair.second);
+            }
+        }
+    }
+}
+
+static void UnserializeTokenVWAP(CDataStream& ss)
+{
+    tokenvwap.clear();
+
+    const uint64_t nProperties = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nProperties; ++i)
+    {
+        const uint32_t propertyId = ReadNumber(ss);
+        const uint64_t nBlocks = ReadCompactSize(ss);
+        for (uint64_t j = 0; j < nBlocks; ++j) {
+            const int block = ReadNumber(ss);
+            std::vector<std::pair<int64_t, int64_t>>& vpairs = tokenvwap[propertyId][block];
+            const uint64_t nPairs = ReadCompactSize(ss);
+            for (uint64_t k = 0; k < nPairs; ++k) {
+                const int64_t unitPrice = ReadAmount(ss);
+                const int64_t amount = ReadAmount(ss);
+                vpairs.push_back(std::make_pair(unitPrice, amount));
+            }
+        }
+    }
+}
+
+// strings of the graph, then the trades referring to them
+static void SerializeClearingGraph(CDataStream& ss, const CClearingGraph& graph)
+{
+    WriteCompactSize(ss, graph.CountAddresses());
+    for (size_t i = 0; i < graph.CountAddresses(); ++i) ss << graph.GetAddress(i);
+    WriteCompactSize(ss, graph.CountStatuses());
+    for (size_t i = 0; i < graph.CountStatuses(); ++i) ss << graph.GetStatus(i);
+
+    WriteCompactSize(ss, graph.Size());
+    for (const CClearingTrade& trade : graph.GetTrades()) {
+        for (int side = 0; side < 2; ++side) {
+            WriteNumber(ss, trade.address[side]);
+            WriteNumber(ss, trade.status[side]);
+            WriteAmount(ss, trade.lives[side]);
+        }
+        WriteAmount(ss, trade.amount);
+        WriteAmount(ss, trade.price);
+    }
+}
+
+static bool UnserializeClearingGraph(CDataStream& ss, CClearingGraph& graph)
+{
+    std::vector<std::string> addresses(ReadCompactSize(ss));
+    for (std::string& address : addresses) ss >> address;
+    std::vector<std::string> statuses(ReadCompactSize(ss));
+    for (std::string& status : statuses) ss >> status;
+
+    const uint64_t nTrades = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nTrades; ++i) {
+        uint64_t address[2], status[2];
+        int64_t lives[2];
+        for (int side = 0; side < 2; ++side) {
+            address[side] = ReadNumber(ss);
+            status[side] = ReadNumber(ss);
+            lives[side] = ReadAmount(ss);
+            if (address[side] >= addresses.size() || status[side] >= statuses.size()) return false;
+        }
+        const int64_t amount = ReadAmount(ss);
+        const int64_t price = ReadAmount(ss);
+        graph.AddTrade(addresses[address[0]], statuses[status[0]], lives[0], addresses[address[1]], statuses[status[1]], lives[1], amount, price);
+    }
+
+    return true;
+}
+
+// carried positions, then the trades of each unsettled period
+static void SerializeTradeEdges(CDataStream& ss)
+{
+    SerializeClearingGraph(ss, tradeEdges.GetCarried());
+
+    const std::map<int, CClearingGraph>& segments = tradeEdges.GetSegments();
+    WriteCompactSize(ss, segments.size());
+    for (const auto& segment : segments) {
+        WriteNumber(ss, segment.first);
+        SerializeClearingGraph(ss, segment.second);
+    }
+}
+
+static bool UnserializeTradeEdges(CDataStream& ss)
+{
+    CClearingGraph carried;
+    if (!UnserializeClearingGraph(ss, carried)) return false;
+
+    std::map<int, CClearingGraph> segments;
+    const uint64_t nSegments = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nSegments; ++i) {
+        const int period = ReadNumber(ss);
+        if (!UnserializeClearingGraph(ss, segments[period])) return false;
+    }
+
+    tradeEdges.Load(carried, segments);
+    return true;
+}
+
+static void SerializeSectionPayload(CDataStream& ss, int what)
+{
+    switch (what) {
+        case FILETYPE_BALANCES: SerializeBalances(ss); break;
+        case FILETYPE_GLOBALS: WriteNumber(ss, _my_sps->peekNextSPID()); break;
+        case FILETYPE_CDEXORDERS: SerializeContractDex(ss); break;
+        case FILETYPE_MDEXORDERS: SerializeMetaDex(ss); break;
+        case FILETYPE_OFFERS: SerializeOffers(ss); break;
+        case FILETYPE_ACCEPTS: SerializeAccepts(ss); break;
+        case FILETYPE_CACHEFEES: SerializeAmountMap(ss, cachefees); break;
+        case FILETYPE_CACHEFEES_ORACLES: SerializeAmountMap(ss, cachefees_oracles); break;
+        case FILETYPE_WITHDRAWALS: SerializeWithdrawals(ss); break;
+        case FILETYPE_ACTIVE_CHANNELS: SerializeChannels(ss); break;
+        case FILETYPE_DEX_VOLUME: SerializeVolumeMap(ss, MapTokenVolume); break;
+        case FILETYPE_MDEX_VOLUME: SerializeVolumeMap(ss, metavolume); break;
+        case FILETYPE_GLOBAL_VARS: WriteAmount(ss, globalVolumeALL_LTC); break;
+        case FILE_TYPE_VESTING_ADDRESSES: ss << vestingAddresses; break;
+        case FILE_TYPE_LTC_VOLUME: SerializeVolumeMap(ss, MapLTCVolume); break;
+        case FILE_TYPE_TOKEN_LTC_PRICE: SerializeAmountMap(ss, lastPrice); break;
+        case FILE_TYPE_TOKEN_VWAP: SerializeTokenVWAP(ss); break;
+        case STATE_SECTION_TRADE_EDGES: SerializeTradeEdges(ss); break;
+    }
+}
+
+static void WriteSection(CDataStream& ssSnapshot, int what, const CDataStream& ss)
+{
+    ssSnapshot << static_cast<uint8_t>(what);
+    ssSnapshot << static_cast<uint32_t>(ss.size());
+    ssSnapshot.write(ss.data(), ss.size());
+}
+
+static uint256 HashSection(const CDataStream& ss)
+{
+    uint256 hash;
+    CHash256().Write((const unsigned char*) ss.data(), ss.size()).Finalize(hash.begin());
+    return hash;
+}
+
+static bool UnserializeSection(CDataStream& ss, int what)
+{
+    switch (what) {
+        case FILETYPE_BALANCES: UnserializeBalances(ss); break;
+        case FILETYPE_GLOBALS: _my_sps->init(ReadNumber(ss)); break;
+        case FILETYPE_CDEXORDERS: return UnserializeContractDex(ss);
+        case FILETYPE_MDEXORDERS: return UnserializeMetaDex(ss);
+        case FILETYPE_OFFERS: return UnserializeOffers(ss);
+        case FILETYPE_ACCEPTS: return UnserializeAccepts(ss);
+        case FILETYPE_CACHEFEES: UnserializeAmountMap(ss, cachefees); break;
+        case FILETYPE_CACHEFEES_ORACLES: UnserializeAmountMap(ss, cachefees_oracles); break;
+        case FILETYPE_WITHDRAWALS: UnserializeWithdrawals(ss); break;
+        case FILETYPE_ACTIVE_CHANNELS: return UnserializeChannels(ss);
+        case FILETYPE_DEX_VOLUME: UnserializeVolumeMap(ss, MapTokenVolume); break;
+        case FILETYPE_MDEX_VOLUME: UnserializeVolumeMap(ss, metavolume); break;
+        case FILETYPE_GLOBAL_VARS: globalVolumeALL_LTC = ReadAmount(ss); break;
+        case FILE_TYPE_VESTING_ADDRESSES: vestingAddresses.clear(); ss >> vestingAddresses; break;
+        case FILE_TYPE_LTC_VOLUME: UnserializeVolumeMap(ss, MapLTCVolume); break;
+        case FILE_TYPE_TOKEN_LTC_PRICE: UnserializeAmountMap(ss, lastPrice); break;
+        case FILE_TYPE_TOKEN_VWAP: UnserializeTokenVWAP(ss); break;
+        case STATE_SECTION_TRADE_EDGES: return UnserializeTradeEdges(ss);
+        default:
+            if (msc_debug_persistence) PrintToLog("%s(): skipping unknown section %d\n", __func__, what);
+            break;
+    }
+
+    return true;
+}
+
+// "address", propertyid, 11 x tally type for each changed entry
+static void SerializeChangedBalances(CDataStream& ss)
+{
+    WriteCompactSize(ss, deltaState.changedBalances.size());
+    for (const std::pair<std::string, uint32_t>& entry : deltaState.changedBalances)
+    {
+        std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.find(entry.first);
+        ss << entry.first;
+        WriteNumber(ss, entry.second);
+        for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+            WriteAmount(ss, (it == mp_tally_map.end()) ? 0 : it->second.getMoney(entry.second, static_cast<TallyType>(ttype)));
+        }
+    }
+}
+
+static void UnserializeChangedBalances(CDataStream& ss)
+{
+    const uint64_t nEntries = ReadCompactSize(ss);
+    for (uint64_t i = 0; i < nEntries; ++i)
+    {
+        std::string address;
+        ss >> address;
+        const uint32_t propertyId = ReadNumber(ss);
+        for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+            const int64_t amount = ReadAmount(ss);
+            const int64_t diff = amount - getMPbalance(address, propertyId, static_cast<TallyType>(ttype));
+            if (diff) update_tally_map(address, propertyId, diff, static_cast<TallyType>(ttype));
+        }
+    }
+}
+
+static void WriteHeader(CDataStream& ssSnapshot, const char* magic, const CBlockIndex* pBlockIndex)
+{
+    ssSnapshot.write(magic, 4);
+    ssSnapshot << STATE_SNAPSHOT_VERSION;
+    ssSnapshot << pBlockIndex->GetBlockHash();
+    ssSnapshot << static_cast<int32_t>(pBlockIndex->nHeight);
+}
+
+void NotifyStateBalanceChanged(const std::string& address, uint32_t propertyId)
+{
+    AssertLockHeld(cs_tally);
+
+    // nothing to track, while there is no saved block to refer to
+    if (deltaState.prevBlockHash.IsNull()) return;
+
+    deltaState.changedBalances.insert(std::make_pair(address, propertyId));
+}
+
+void NotifyStateSectionChanged(int what)
+{
+    assert(what > FILETYPE_BALANCES && what < NUM_STATE_SECTIONS);
+
+    deltaState.dirtySections[what] = true;
+}
+
+template <typename Order, typename Position>
+static void RecordOrderErased(std::map<Position, CStateOrderChange<Order>>& changes, const Position& position, const Order& obj)
+{
+    // nothing to track, while there is no saved block to refer to
+    if (deltaState.prevBlockHash.IsNull()) return;
+
+    // an order without record was in the book as of the last saved block
+    std::pair<typename std::map<Position, CStateOrderChange<Order>>::iterator, bool> ret = changes.insert(std::make_pair(position, CStateOrderChange<Order>()));
+    CStateOrderChange<Order>& change = ret.first->second;
+    if (ret.second) {
+        change.fErased = true;
+        change.erased = obj;
+    }
+    change.fInserted = false;
+}
+
+template <typename Order, typename Position>
+static void RecordOrderInserted(std::map<Position, CStateOrderChange<Order>>& changes, const Position& position, const Order& obj)
+{
+    if (deltaState.prevBlockHash.IsNull()) return;
+
+    CStateOrderChange<Order>& change = changes[position];
+    change.fInserted = true;
+    change.inserted = obj;
+}
+
+void NotifyStateOrderInserted(const CMPMetaDEx& obj)
+{
+    const md_Position position(md_PairKey(obj.getProperty(), obj.getDesProperty()), obj.unitPrice(), obj.getBlock(), obj.getIdx());
+    RecordOrderInserted(deltaState.changedMetaDExOrders, position, obj);
+}
+
+void NotifyStateOrderErased(const CMPMetaDEx& obj)
+{
+    const md_Position position(md_PairKey(obj.getProperty(), obj.getDesProperty()), obj.unitPrice(), obj.getBlock(), obj.getIdx());
+    RecordOrderErased(deltaState.changedMetaDExOrders, position, obj);
+}
+
+void NotifyStateOrderInserted(const CMPContractDex& obj)
+{
+    const cd_Position position(obj.getProperty(), obj.getEffectivePrice(), obj.getBlock(), obj.getIdx());
+    RecordOrderInserted(deltaState.changedContractDexOrders, position, obj);
+}
+
+void NotifyStateOrderErased(const CMPContractDex& obj)
+{
+    const cd_Position position(obj.getProperty(), obj.getEffectivePrice(), obj.getBlock(), obj.getIdx());
+    RecordOrderErased(deltaState.changedContractDexOrders, position, obj);
+}
+
+//! Forgets the changes, once the state of a block was serialized
+static void ClearStateChanges()
+{
+    std::fill(deltaState.dirtySections, deltaState.dirtySections + NUM_STATE_SECTIONS, false);
+    deltaState.changedBalances.clear();
+    deltaState.changedMetaDExOrders.clear();
+    deltaState.changedContractDexOrders.clear();
+}
+
+void ResetStateDelta()
+{
+    AssertLockHeld(cs_tally);
+
+    deltaState.prevBlockHash.SetNull();
+    deltaState.nPrevHeight = 0;
+    deltaState.nDeltas = 0;
+    ClearStateChanges();
+}
+
+void SerializeStateSnapshot(CDataStream& ssSnapshot, const CBlockIndex* pBlockIndex)
+{
+    AssertLockHeld(cs_tally);
+
+    WriteHeader(ssSnapshot, STATE_SNAPSHOT_MAGIC, pBlockIndex);
+
+    for (int i = 0; i < NUM_STATE_SECTIONS; ++i) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        SerializeSectionPayload(ss, i);
+        WriteSection(ssSnapshot, i, ss);
+        if (msc_debug_persistence) deltaState.sectionHashes[i] = HashSection(ss);
+    }
+
+    deltaState.prevBlockHash = pBlockIndex->GetBlockHash();
+    deltaState.nPrevHeight = pBlockIndex->nHeight;
+    deltaState.nDeltas = 0;
+    ClearStateChanges();
+
+    LOCK(cs_deltabases);
+    mapDeltaBases.erase(pBlockIndex->GetBlockHash());
+}
+
+bool SerializeStateDelta(CDataStream& ssSnapshot, const CBlockIndex* pBlockIndex)
+{
+    AssertLockHeld(cs_tally);
+
+    // a delta only works on top of a saved ancestor
+    if (deltaState.prevBlockHash.IsNull() || deltaState.nPrevHeight >= pBlockIndex->nHeight) {
+        return false;
+    }
+    const CBlockIndex* pPrevIndex = pBlockIndex->GetAncestor(deltaState.nPrevHeight);
+    if (pPrevIndex == nullptr || pPrevIndex->GetBlockHash() != deltaState.prevBlockHash) {
+        return false;
+    }
+
+    // periodically write a full snapshot, to limit the number of deltas to replay
+    const int nInterval = gArgs.GetArg("-tlfullsnapshotinterval", DEFAULT_FULL_SNAPSHOT_INTERVAL);
+    if (deltaState.nDeltas + 1 >= nInterval) {
+        return false;
+    }
+
+    WriteHeader(ssSnapshot, STATE_DELTA_MAGIC, pBlockIndex);
+    ssSnapshot << deltaState.prevBlockHash;
+
+    CDataStream ssBalances(SER_DISK, CLIENT_VERSION);
+    SerializeChangedBalances(ssBalances);
+    WriteSection(ssSnapshot, FILETYPE_BALANCES, ssBalances);
+
+    if (!deltaState.changedContractDexOrders.empty()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        SerializeChangedOrders(ss, deltaState.changedContractDexOrders, SerializeContractDexOrder);
+        WriteSection(ssSnapshot, FILETYPE_CDEXORDERS, ss);
+    }
+    if (!deltaState.changedMetaDExOrders.empty()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        SerializeChangedOrders(ss, deltaState.changedMetaDExOrders, SerializeMetaDexOrder);
+        WriteSection(ssSnapshot, FILETYPE_MDEXORDERS, ss);
+    }
+
+    // everything else is only written, if it was marked as changed
+    for (int i = FILETYPE_BALANCES + 1; i < NUM_STATE_SECTIONS; ++i)
+    {
+        if (i == FILETYPE_CDEXORDERS || i == FILETYPE_MDEXORDERS) continue;
+        if (!deltaState.dirtySections[i] && !msc_debug_persistence) continue;
+
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        SerializeSectionPayload(ss, i);
+        bool fChanged = deltaState.dirtySections[i];
+        if (msc_debug_persistence) {
+            // catches changes, which were made without notification
+            const uint256 hash = HashSection(ss);
+            if (!fChanged && hash != deltaState.sectionHashes[i]) {
+                PrintToLog("%s(): ERROR: section %d changed without notification\n", __func__, i);
+                fChanged = true;
+            }
+            deltaState.sectionHashes[i] = hash;
+        }
+        if (fChanged) WriteSection(ssSnapshot, i, ss);
+    }
+
+    if (msc_debug_persistence) {
+        PrintToLog("%s(): block %d, %d changed balances, %d changed orders since block %d\n", __func__,
+                pBlockIndex->nHeight, deltaState.changedBalances.size(),
+                deltaState.changedMetaDExOrders.size() + deltaState.changedContractDexOrders.size(), deltaState.nPrevHeight);
+    }
+
+    {
+        LOCK(cs_deltabases);
+        mapDeltaBases[pBlockIndex->GetBlockHash()] = deltaState.prevBlockHash;
+    }
+
+    deltaState.prevBlockHash = pBlockIndex->GetBlockHash();
+    deltaState.nPrevHeight = pBlockIndex->nHeight;
+    ++deltaState.nDeltas;
+    ClearStateChanges();
+
+    return true;
+}
+
+bool WriteStateSnapshot(const fs::path& path, const CDataStream& ssSnapshot)
+{
+    uint256 hash;
+    CHash256().Write((const unsigned char*) ssSnapshot.data(), ssSnapshot.size()).Finalize(hash.begin());
+
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+
+    FILE* file = fsbridge::fopen(pathTmp, "wb");
+    if (file == nullptr) {
+        PrintToLog("%s(): ERROR: failed to open %s\n", __func__, pathTmp.string());
+        return false;
+    }
+
+    bool fSuccess = (fwrite(ssSnapshot.data(), 1, ssSnapshot.size(), file) == ssSnapshot.size());
+    fSuccess &= (fwrite(hash.begin(), 1, hash.size(), file) == hash.size());
+    if (fSuccess) FileCommit(file);
+    fclose(file);
+
+    if (!fSuccess || !RenameOver(pathTmp, path)) {
+        PrintToLog("%s(): ERROR: failed to write %s\n", __func__, path.string());
+        fs::remove(pathTmp);
+        return false;
+    }
+
+    return true;
+}
+
+fs::path GetStateSnapshotPath(const fs::path& dir, const uint256& blockHash, bool fDelta)
+{
+    return dir / strprintf("%s-%s.dat", fDelta ? "delta" : "snapshot", blockHash.ToString());
+}
+
+/**
+ * Reads a snapshot or delta file and verifies its trailing hash.
+ *
+ * On success vch holds the content without the trailer.
+ */
+static bool ReadStateFile(const fs::path& path, std::vector<char>& vch)
+{
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (file == nullptr) {
+        if (msc_debug_persistence) PrintToLog("%s(%s): file not found\n", __func__, path.string());
+        return false;
+    }
+
+    // read the whole file at once
+    vch.clear();
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long nSize = ftell(file);
+        if (nSize > 0 && fseek(file, 0, SEEK_SET) == 0) {
+            vch.resize(nSize);
+            if (fread(vch.data(), 1, vch.size(), file) != vch.size()) vch.clear();
+        }
+    }
+    fclose(file);
+
+    const size_t nHeaderSize = sizeof(STATE_SNAPSHOT_MAGIC) + sizeof(uint32_t) + 32 + sizeof(int32_t);
+    if (vch.size() < nHeaderSize + 32) {
+        PrintToLog("%s(%s): ERROR: file is truncated\n", __func__, path.string());
+        return false;
+    }
+
+    // verify the trailing hash before anything is touched
+    const size_t nContentSize = vch.size() - 32;
+    uint256 hash;
+    CHash256().Write((const unsigned char*) vch.data(), nContentSize).Finalize(hash.begin());
+    if (memcmp(hash.begin(), vch.data() + nContentSize, 32) != 0) {
+        PrintToLog("File %s loaded, but failed hash validation!\n", path.string());
+        return false;
+    }
+    vch.resize(nContentSize);
+
+    return true;
+}
+
+/**
+ * Reads and checks the header of a snapshot or delta.
+ */
+static bool ReadHeader(CDataStream& ss, const char* magic, const fs::path& path, const uint256& blockHash, int nHeight)
+{
+    char fileMagic[4];
+    uint32_t nVersion = 0;
+    uint256 fileBlockHash;
+    int32_t nFileHeight = 0;
+    ss.read(fileMagic, sizeof(fileMagic));
+    ss >> nVersion;
+    ss >> fileBlockHash;
+    ss >> nFileHeight;
+
+    const bool fDelta = (memcmp(magic, STATE_DELTA_MAGIC, sizeof(fileMagic)) == 0);
+    if (memcmp(fileMagic, magic, sizeof(fileMagic)) != 0 || nVersion > STATE_SNAPSHOT_VERSION ||
+            (fDelta && nVersion < MIN_STATE_DELTA_VERSION)) {
+        PrintToLog("%s(%s): ERROR: unsupported format (version %d)\n", __func__, path.string(), nVersion);
+        return false;
+    }
+    if (fileBlockHash != blockHash || nFileHeight != nHeight) {
+        PrintToLog("%s(%s): ERROR: snapshot of block %s does not match\n", __func__, path.string(), fileBlockHash.GetHex());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Restores the sections of a snapshot or delta, after the header was read.
+ */
+static bool ReadSections(CDataStream& ss, const fs::path& path, bool fDelta)
+{
+    while (!ss.empty())
+    {
+        uint8_t what = 0;
+        uint32_t nLength = 0;
+        ss >> what;
+        ss >> nLength;
+        if (nLength > ss.size()) {
+            throw std::ios_base::failure("section exceeds snapshot");
+        }
+
+        CDataStream ssSection(ss.data(), ss.data() + nLength, SER_DISK, CLIENT_VERSION);
+        ss.ignore(nLength);
+
+        bool fSuccess = true;
+        if (fDelta && what == FILETYPE_BALANCES) {
+            UnserializeChangedBalances(ssSection);
+        } else if (fDelta && what == FILETYPE_CDEXORDERS) {
+            fSuccess = UnserializeChangedOrders(ssSection, UnserializeContractDexOrder, ContractDex_ERASE, ContractDex_INSERT);
+        } else if (fDelta && what == FILETYPE_MDEXORDERS) {
+            fSuccess = UnserializeChangedOrders(ssSection, UnserializeMetaDexOrder, MetaDEx_ERASE, MetaDEx_INSERT);
+        } else {
+            fSuccess = UnserializeSection(ssSection, what);
+        }
+        if (!fSuccess) {
+            PrintToLog("%s(%s): ERROR: failed to restore section %d\n", __func__, path.string(), what);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int LoadStateSnapshot(const fs::path& path, const CBlockIndex* pBlockIndex)
+{
+    AssertLockHeld(cs_tally);
+
+    std::vector<char> vch;
+    if (!ReadStateFile(path, vch)) return -1;
+
+    try {
+        CDataStream ss(vch.data(), vch.data() + vch.size(), SER_DISK, CLIENT_VERSION);
+        if (!ReadHeader(ss, STATE_SNAPSHOT_MAGIC, path, pBlockIndex->GetBlockHash(), pBlockIndex->nHeight)) return -1;
+        if (!ReadSections(ss, path, false)) return -1;
+    } catch (const std::exception& e) {
+        PrintToLog("%s(%s): ERROR: %s\n", __func__, path.string(), e.what());
+        return -1;
+    }
+
+    if (msc_debug_persistence) PrintToLog("%s(%s): loaded %d bytes\n", __func__, path.string(), vch.size());
+
+    return 0;
+}
+
+/**
+ * Returns the block the delta of the given block was based on, or a null hash.
+ */
+static uint256 ReadDeltaBase(const fs::path& path, const CBlockIndex* pBlockIndex, std::vector<char>& vch)
+{
+    uint256 prevBlockHash;
+    if (!ReadStateFile(path, vch)) return prevBlockHash;
+
+    try {
+        CDataStream ss(vch.data(), vch.data() + vch.size(), SER_DISK, CLIENT_VERSION);
+        if (ReadHeader(ss, STATE_DELTA_MAGIC, path, pBlockIndex->GetBlockHash(), pBlockIndex->nHeight)) {
+            ss >> prevBlockHash;
+        }
+    } catch (const std::exception& e) {
+        PrintToLog("%s(%s): ERROR: %s\n", __func__, path.string(), e.what());
+        prevBlockHash.SetNull();
+    }
+
+    return prevBlockHash;
+}
+
+int LoadStateDeltas(const fs::path& dir, const CBlockIndex* pBlockIndex)
+{
+    AssertLockHeld(cs_tally);
+
+    // walk back from the given block to the full snapshot the deltas are based on
+    std::vector<std::pair<const CBlockIndex*, std::vector<char>>> deltas;
+    const CBlockIndex* pCurIndex = pBlockIndex;
+    while (!fs::exists(GetStateSnapshotPath(dir, pCurIndex->GetBlockHash(), false)))
+    {
+        std::vector<char> vch;
+        const uint256 prevBlockHash = ReadDeltaBase(GetStateSnapshotPath(dir, pCurIndex->GetBlockHash(), true), pCurIndex, vch);
+        if (prevBlockHash.IsNull()) return -1;
+
+        deltas.push_back(std::make_pair(pCurIndex, std::move(vch)));
+        {
+            LOCK(cs_deltabases);
+            mapDeltaBases[pCurIndex->GetBlockHash()] = prevBlockHash;
+        }
+
+        // the base must be an ancestor of this block
+        const CBlockIndex* pPrevIndex = pCurIndex->pprev;
+        while (pPrevIndex != nullptr && pPrevIndex->GetBlockHash() != prevBlockHash) {
+            pPrevIndex = pPrevIndex->pprev;
+        }
+        if (pPrevIndex == nullptr) {
+            PrintToLog("%s(): ERROR: base %s of block %d is not an ancestor\n", __func__, prevBlockHash.GetHex(), pCurIndex->nHeight);
+            return -1;
+        }
+        pCurIndex = pPrevIndex;
+    }
+
+    if (LoadStateSnapshot(GetStateSnapshotPath(dir, pCurIndex->GetBlockHash(), false), pCurIndex) < 0) {
+        return -1;
+    }
+
+    // replay the deltas, oldest first
+    for (std::vector<std::pair<const CBlockIndex*, std::vector<char>>>::reverse_iterator it = deltas.rbegin(); it != deltas.rend(); ++it)
+    {
+        const fs::path path = GetStateSnapshotPath(dir, it->first->GetBlockHash(), true);
+        try {
+            CDataStream ss(it->second.data(), it->second.data() + it->second.size(), SER_DISK, CLIENT_VERSION);
+            uint256 prevBlockHash;
+            if (!ReadHeader(ss, STATE_DELTA_MAGIC, path, it->first->GetBlockHash(), it->first->nHeight)) return -1;
+            ss >> prevBlockHash;
+            if (!ReadSections(ss, path, true)) return -1;
+        } catch (const std::exception& e) {
+            PrintToLog("%s(%s): ERROR: %s\n", __func__, path.string(), e.what());
+            return -1;
+        }
+    }
+
+    if (msc_debug_persistence) PrintToLog("%s(): replayed %d deltas on top of block %d\n", __func__, deltas.size(), pCurIndex->nHeight);
+
+    return 0;
+}
+
+void GetStateDeltaBases(const fs::path& dir, const CBlockIndex* pBlockIndex, std::set<uint256>& bases)
+{
+    const CBlockIndex* pCurIndex = pBlockIndex;
+    while (pCurIndex != nullptr)
+    {
+        const uint256 blockHash = pCurIndex->GetBlockHash();
+        uint256 prevBlockHash;
+        {
+            LOCK(cs_deltabases);
+            std::map<uint256, uint256>::const_iterator it = mapDeltaBases.find(blockHash);
+            if (it != mapDeltaBases.end()) prevBlockHash = it->second;
+        }
+
+        // only the deltas of an earlier run are read from disk, and only once
+        if (prevBlockHash.IsNull()) {
+            if (fs::exists(GetStateSnapshotPath(dir, blockHash, false))) return;
+
+            std::vector<char> vch;
+            prevBlockHash = ReadDeltaBase(GetStateSnapshotPath(dir, blockHash, true), pCurIndex, vch);
+            if (prevBlockHash.IsNull()) return;
+
+            LOCK(cs_deltabases);
+            mapDeltaBases[blockHash] = prevBlockHash;
+        }
+
+        if (!bases.insert(prevBlockHash).second) return;
+
+        do {
+            pCurIndex = pCurIndex->pprev;
+        } while (pCurIndex != nullptr && pCurIndex->GetBlockHash() != prevBlockHash);
+    }
+}
+
+void ForgetStateDeltaBase(const uint256& blockHash)
+{
+    LOCK(cs_deltabases);
+    mapDeltaBases.erase(blockHash);
+}
+
+} // namespace mastercore
+
+
 /**
 @todo  Move initialization and deinitialization of databases into this file (?)
 @todo  Move file based storage into this file
@@ -3,9 +3,67 @@
 
 #include <leveldb/db.h>
 #include <fs.h>
+#include <streams.h>
+#include <sync.h>
+#include <uint256.h>
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+class CMPContractDex;
+class CMPMetaDEx;
+
+/** A pending write of a batch.
+ */
+struct CDBPendingWrite
+{
+    //! Write generation, iterators only see the writes made before they were created
+    uint64_t nGeneration;
+    //! Whether the entry exists; deletions have it set to false
+    bool fExists;
+    //! The written value
+    std::string value;
+
+    CDBPendingWrite(uint64_t nGenerationIn, bool fExistsIn, const std::string& valueIn)
+        : nGeneration(nGenerationIn), fExists(fExistsIn), value(valueIn) {}
+};
+
+//! Pending writes of a batch, as key -> writes in generation order
+typedef std::map<std::string, std::vector<CDBPendingWrite>> CDBBatchOverlay;
+
+/** Statistics of the write batches committed to a database.
+ */
+struct CDBBatchStats
+{
+    //! Number of committed batches
+    uint64_t nCommits;
+    //! Number of entries of the last batch
+    uint64_t nLastEntries;
+    //! Size of keys and values of the last batch, in bytes
+    uint64_t nLastBytes;
+    //! Number of entries of the largest batch
+    uint64_t nMaxEntries;
+    //! Number of entries of all batches
+    uint64_t nTotalEntries;
+    //! Commit latency of the last batch, in microseconds
+    int64_t nLastCommitTime;
+    //! Highest commit latency, in microseconds
+    int64_t nMaxCommitTime;
+    //! Commit latency of all batches, in microseconds
+    int64_t nTotalCommitTime;
+
+    CDBBatchStats() : nCommits(0), nLastEntries(0), nLastBytes(0), nMaxEntries(0), nTotalEntries(0),
+        nLastCommitTime(0), nMaxCommitTime(0), nTotalCommitTime(0) {}
+};
 
 /** Base class for LevelDB based storage.
  */
@@ -15,6 +73,27 @@ private:
     //! Options used when iterating over values of the database
     leveldb::ReadOptions iteroptions;
 
+    //! Guards the pending batch
+    mutable CCriticalSection cs_batch;
+
+    //! Whether writes are collected in a batch, instead of being written directly
+    bool fBatch;
+
+    //! Writes of the current batch, shared with the iterators created while it is open
+    std::shared_ptr<CDBBatchOverlay> pending;
+
+    //! Generation of the last write of the current batch
+    uint64_t nGeneration;
+
+    //! Generation of the last write seen by a new iterator, later writes don't replace it
+    mutable uint64_t nIteratorGeneration;
+
+    //! Statistics of the committed batches
+    CDBBatchStats batchStats;
+
+    //! Adds a write to the current batch
+    void AddPending(const std::string& key, bool fExists, const std::string& value);
+
 protected:
     //! Database options used
     leveldb::Options options;
@@ -37,7 +116,7 @@ protected:
     //! Number of entries written
     unsigned int nWritten;
 
-    CDBBase() : pdb(nullptr), nRead(0), nWritten(0)
+    CDBBase() : fBatch(false), nGeneration(0), nIteratorGeneration(0), pdb(nullptr), nRead(0), nWritten(0)
     {
         options.paranoid_checks = true;
         options.create_if_missing = true;
@@ -58,15 +137,43 @@ protected:
      * Creates and returns a new LevelDB iterator.
      *
      * It is expected that the database is not closed. The iterator is owned by the
-     * caller, and the object has to be deleted explicitly.
+     * caller, and the object has to be deleted explicitly. Writes of an open batch,
+     * which were made before the iterator was created, are visible to it.
      *
      * @return A new LevelDB iterator
      */
-    leveldb::Iterator* NewIterator() const
-    {
-        assert(pdb != nullptr);
-        return pdb->NewIterator(iteroptions);
-    }
+    leveldb::Iterator* NewIterator() const;
+
+    /**
+     * Creates and returns a new LevelDB iterator, which only visits text records.
+     *
+     * Binary records and index entries, whose keys start with a control byte,
+     * are skipped. The iterator is owned by the caller, and the object has to
+     * be deleted explicitly.
+     *
+     * @return A new LevelDB iterator
+     */
+    leveldb::Iterator* NewTextIterator() const;
+
+    /**
+     * Reads an entry, including the writes of an open batch.
+     */
+    leveldb::Status Get(const std::string& key, std::string* value) const;
+
+    /**
+     * Writes an entry, or adds it to the open batch.
+     */
+    leveldb::Status Put(const std::string& key, const std::string& value);
+
+    /**
+     * Deletes an entry, or adds the deletion to the open batch.
+     */
+    leveldb::Status Delete(const std::string& key);
+
+    /**
+     * Applies a set of writes atomically, or adds them to the open batch.
+     */
+    leveldb::Status Write(leveldb::WriteBatch* batch);
 
     /**
      * Opens or creates a LevelDB based database.
@@ -81,16 +188,131 @@ protected:
     leveldb::Status Open(const fs::path& path, bool fWipe = false);
 
     /**
-     * Deinitializes and closes the database.
+     * Deinitializes and closes the database, an open batch is committed first.
      */
     void Close();
 
 public:
     /**
      * Deletes all entries of the database, and resets the counters.
+     *
+     * Writes of an open batch are discarded.
      */
     void Clear();
+
+    /**
+     * Starts collecting writes in a batch, usually for the duration of a block.
+     *
+     * A batch, which is still open, is committed first.
+     */
+    void BeginBatch();
+
+    /**
+     * Writes the collected entries atomically, and closes the batch.
+     *
+     * @param fSync  Whether to sync the write to disk
+     * @return A Status object, indicating success or failure
+     */
+    leveldb::Status CommitBatch(bool fSync = false);
+
+    /**
+     * Returns the statistics of the committed batches.
+     */
+    CDBBatchStats GetBatchStats() const;
 };
 
+namespace mastercore
+{
+//! Version of the binary state snapshot format
+const uint32_t STATE_SNAPSHOT_VERSION = 2;
+
+/**
+ * Serializes the complete state as of the given block into a binary snapshot image.
+ *
+ * Must be called while holding cs_tally.
+ */
+void SerializeStateSnapshot(CDataStream& ssSnapshot, const CBlockIndex* pBlockIndex);
+
+/**
+ * Serializes the changes since the last saved block into a delta image.
+ *
+ * Only the changed tally entries, the changed orders of the books and the
+ * sections marked as changed since the last saved block are included.
+ *
+ * Must be called while holding cs_tally.
+ *
+ * @return False, if a full snapshot must be written instead
+ */
+bool SerializeStateDelta(CDataStream& ssSnapshot, const CBlockIndex* pBlockIndex);
+
+/**
+ * Records a changed tally entry for the next delta.
+ */
+void NotifyStateBalanceChanged(const std::string& address, uint32_t propertyId);
+
+/**
+ * Marks a section of the state as changed, so the next delta includes it.
+ *
+ * @param what  The FILETYPES entry of the section, other than the balances and the books
+ */
+void NotifyStateSectionChanged(int what);
+
+/**
+ * Records an order added to or removed from a book for the next delta.
+ */
+void NotifyStateOrderInserted(const CMPMetaDEx& obj);
+void NotifyStateOrderErased(const CMPMetaDEx& obj);
+void NotifyStateOrderInserted(const CMPContractDex& obj);
+void NotifyStateOrderErased(const CMPContractDex& obj);
+
+/**
+ * Forgets the last saved block, so the next snapshot is a full one.
+ */
+void ResetStateDelta();
+
+/**
+ * Writes a snapshot image to disk, followed by the double SHA256 of the content.
+ *
+ * The file is written under a temporary name first, and moved into place once
+ * it was committed to disk.
+ */
+bool WriteStateSnapshot(const fs::path& path, const CDataStream& ssSnapshot);
+
+/**
+ * Returns the path of the full or delta snapshot of the given block.
+ */
+fs::path GetStateSnapshotPath(const fs::path& dir, const uint256& blockHash, bool fDelta);
+
+/**
+ * Loads the state from a binary snapshot file.
+ *
+ * The whole file is read at once, and the state is only touched after the hash
+ * and the header were verified to match the given block.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int LoadStateSnapshot(const fs::path& path, const CBlockIndex* pBlockIndex);
+
+/**
+ * Loads the state of the given block by replaying its chain of deltas on top
+ * of the full snapshot they are based on.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int LoadStateDeltas(const fs::path& dir, const CBlockIndex* pBlockIndex);
+
+/**
+ * Collects the saved blocks the delta of the given block depends on.
+ */
+void GetStateDeltaBases(const fs::path& dir, const CBlockIndex* pBlockIndex, std::set<uint256>& bases);
+
+/**
+ * Forgets the base of the delta of the given block, once its files are removed.
+ *
+ * The bases of the deltas written or loaded are kept in memory, so the files
+ * don't have to be read, whenever the state files are pruned.
+ */
+void ForgetStateDeltaBase(const uint256& blockHash);
+}
 
 #endif // TRADELAYER_PERSISTENCE_H
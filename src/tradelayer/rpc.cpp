@@ -13,6 +13,7 @@
 #include <tradelayer/errors.h>
 #include <tradelayer/externfns.h>
 #include <tradelayer/fetchwallettx.h>
+#include <tradelayer/inputcache.h>
 #include <tradelayer/log.h>
 #include <tradelayer/mdex.h>
 #include <tradelayer/notifications.h>
@@ -24,6 +25,8 @@
 #include <tradelayer/rules.h>
 #include <tradelayer/sp.h>
 #include <tradelayer/tally.h>
+#include <tradelayer/tradeedges.h>
+#include <tradelayer/tradejournal.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/tx.h>
 #include <tradelayer/uint256_extensions.h>
@@ -446,8 +449,8 @@ UniValue mscrpc(const JSONRPCRequest& request)
             for (std::unordered_map<std::string, CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
                 PrintToLog("%34s => ", my_it->first);
                 (my_it->second).print(extra2);
-                (my_it->second).init();
-                while (0 != (id = (my_it->second).next())) {
+                for (const CMPTally::BalanceRecord& record : my_it->second) {
+                    id = record.propertyId;
                     PrintToLog("Id: %u=0x%X ", id, id);
                 }
                 PrintToLog("\n");
@@ -897,12 +900,10 @@ UniValue tl_getallbalancesforid(const JSONRPCRequest& request)
     LOCK(cs_tally);
 
     for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-        uint32_t id = 0;
         bool includeAddress = false;
         const std::string& address = it->first;
-        (it->second).init();
-        while (0 != (id = (it->second).next())) {
-            if (id == propertyId) {
+        for (const CMPTally::BalanceRecord& record : it->second) {
+            if (record.propertyId == propertyId) {
                 includeAddress = true;
                 break;
             }
@@ -960,10 +961,8 @@ UniValue tl_getallbalancesforaddress(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Address not found");
     }
 
-    addressTally->init();
-
-    uint32_t propertyId = 0;
-    while (0 != (propertyId = addressTally->next())) {
+    for (const CMPTally::BalanceRecord& record : *addressTally) {
+        const uint32_t propertyId = record.propertyId;
         UniValue balanceObj(UniValue::VOBJ);
         balanceObj.pushKV("propertyid", (uint64_t) propertyId);
         bool nonEmptyBalance = BalanceToJSON(address, propertyId, balanceObj, isPropertyDivisible(propertyId));
@@ -1693,6 +1692,280 @@ UniValue tl_getinfo(const JSONRPCRequest& request)
     return infoResponse;
 }
 
+UniValue tl_getcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp)
+        throw runtime_error(
+            "tl_getcacheinfo\n"
+
+            "\nReturns usage statistics of the in-memory caches.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"spinfo\" : {                 (object) decoded smart property entries\n"
+            "    \"hits\" : nnnnnnnn,         (number) lookups served from the cache\n"
+            "    \"misses\" : nnnnnnnn,       (number) lookups served from the database\n"
+            "    \"entries\" : nnnnnnnn       (number) entries currently cached\n"
+            "  },\n"
+            "  \"inputs\" : {                 (object) previous outputs used to identify senders\n"
+            "    \"hits\" : nnnnnnnn,         (number) outputs served from the cache\n"
+            "    \"misses\" : nnnnnnnn,       (number) outputs, which had to be fetched\n"
+            "    \"evictions\" : nnnnnnnn,    (number) least recently used outputs dropped from the cache\n"
+            "    \"txreads\" : nnnnnnnn,      (number) transactions read to fetch outputs\n"
+            "    \"filereads\" : nnnnnnnn,    (number) block files opened to read transactions\n"
+            "    \"entries\" : nnnnnnnn       (number) outputs currently cached\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("tl_getcacheinfo", "")
+            + HelpExampleRpc("tl_getcacheinfo", "")
+        );
+
+    UniValue response(UniValue::VOBJ);
+
+    uint64_t hits = 0, misses = 0;
+    size_t entries = 0;
+    _my_sps->getCacheStats(hits, misses, entries);
+
+    UniValue spInfo(UniValue::VOBJ);
+    spInfo.pushKV("hits", hits);
+    spInfo.pushKV("misses", misses);
+    spInfo.pushKV("entries", (uint64_t) entries);
+    response.pushKV("spinfo", spInfo);
+
+    CInputCacheStats inputStats;
+    {
+        LOCK(cs_tx_cache);
+        inputStats = inputCache.GetStats();
+    }
+
+    UniValue inputInfo(UniValue::VOBJ);
+    inputInfo.pushKV("hits", inputStats.nHits);
+    inputInfo.pushKV("misses", inputStats.nMisses);
+    inputInfo.pushKV("evictions", inputStats.nEvictions);
+    inputInfo.pushKV("txreads", inputStats.nTxReads);
+    inputInfo.pushKV("filereads", inputStats.nFileReads);
+    inputInfo.pushKV("entries", (uint64_t) inputStats.nEntries);
+    response.pushKV("inputs", inputInfo);
+
+    return response;
+}
+
+static UniValue DBBatchStatsToJSON(const CDBBatchStats& stats)
+{
+    UniValue statsObj(UniValue::VOBJ);
+    statsObj.pushKV("commits", stats.nCommits);
+    statsObj.pushKV("lastentries", stats.nLastEntries);
+    statsObj.pushKV("lastbytes", stats.nLastBytes);
+    statsObj.pushKV("maxentries", stats.nMaxEntries);
+    statsObj.pushKV("totalentries", stats.nTotalEntries);
+    statsObj.pushKV("lastcommitms", 0.001 * stats.nLastCommitTime);
+    statsObj.pushKV("maxcommitms", 0.001 * stats.nMaxCommitTime);
+    statsObj.pushKV("totalcommitms", 0.001 * stats.nTotalCommitTime);
+    return statsObj;
+}
+
+UniValue tl_getdbinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp)
+        throw runtime_error(
+            "tl_getdbinfo\n"
+
+            "\nReturns statistics of the per-block write batches of the databases.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txlist\" : {                 (object) transaction database\n"
+            "    \"commits\" : nnnnnnnn,      (number) batches committed\n"
+            "    \"lastentries\" : nnnnnnnn,  (number) entries of the last batch\n"
+            "    \"lastbytes\" : nnnnnnnn,    (number) size of the last batch in bytes\n"
+            "    \"maxentries\" : nnnnnnnn,   (number) entries of the largest batch\n"
+            "    \"totalentries\" : nnnnnnnn, (number) entries of all batches\n"
+            "    \"lastcommitms\" : n.nnn,    (number) commit latency of the last batch in milliseconds\n"
+            "    \"maxcommitms\" : n.nnn,     (number) highest commit latency in milliseconds\n"
+            "    \"totalcommitms\" : n.nnn    (number) commit latency of all batches in milliseconds\n"
+            "  },\n"
+            "  \"tradelist\" : { ... },       (object) trade database\n"
+            "  \"transactions\" : { ... }     (object) master transaction database\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("tl_getdbinfo", "")
+            + HelpExampleRpc("tl_getdbinfo", "")
+        );
+
+    UniValue response(UniValue::VOBJ);
+
+    LOCK(cs_tally);
+    if (p_txlistdb) response.pushKV("txlist", DBBatchStatsToJSON(p_txlistdb->GetBatchStats()));
+    if (t_tradelistdb) response.pushKV("tradelist", DBBatchStatsToJSON(t_tradelistdb->GetBatchStats()));
+    if (p_TradeTXDB) response.pushKV("transactions", DBBatchStatsToJSON(p_TradeTXDB->GetBatchStats()));
+
+    return response;
+}
+
+UniValue tl_getwithdrawalinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp)
+        throw runtime_error(
+            "tl_getwithdrawalinfo\n"
+
+            "\nReturns statistics of the pending withdrawals of channels.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"pending\" : nnnnnnnn,        (number) withdrawals waiting for their deadline\n"
+            "  \"deadlines\" : nnnnnnnn,      (number) distinct deadline blocks of the pending withdrawals\n"
+            "  \"scheduled\" : nnnnnnnn,      (number) withdrawals scheduled since the state was loaded\n"
+            "  \"matured\" : nnnnnnnn,        (number) withdrawals, which reached their deadline\n"
+            "  \"lastmatured\" : nnnnnnnn     (number) withdrawals, which reached their deadline in the last block\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("tl_getwithdrawalinfo", "")
+            + HelpExampleRpc("tl_getwithdrawalinfo", "")
+        );
+
+    CWithdrawalStats stats;
+    {
+        LOCK(cs_tally);
+        stats = withdrawalSchedule.GetStats();
+    }
+
+    UniValue response(UniValue::VOBJ);
+    response.pushKV("pending", (uint64_t) stats.nPending);
+    response.pushKV("deadlines", (uint64_t) stats.nDeadlines);
+    response.pushKV("scheduled", stats.nScheduled);
+    response.pushKV("matured", stats.nMatured);
+    response.pushKV("lastmatured", stats.nLastMatured);
+
+    return response;
+}
+
+UniValue tl_gettradeedgeinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp)
+        throw runtime_error(
+            "tl_gettradeedgeinfo\n"
+
+            "\nReturns statistics of the matched contract trades kept for the settlement.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"trades\" : nnnnnnnn,         (number) trades kept, including the carried ones\n"
+            "  \"carried\" : nnnnnnnn,        (number) trades carrying the open positions of the settled periods\n"
+            "  \"periods\" : nnnnnnnn,        (number) settlement periods with trades, which weren't settled yet\n"
+            "  \"memoryusage\" : nnnnnnnn,    (number) estimated memory used by the trades, in bytes\n"
+            "  \"recorded\" : nnnnnnnn,       (number) trades recorded since the state was loaded\n"
+            "  \"rejected\" : nnnnnnnn,       (number) recorded trades, which were dropped as malformed\n"
+            "  \"settlements\" : nnnnnnnn,    (number) settlements run\n"
+            "  \"settled\" : nnnnnnnn,       (number) trades settled and compacted away\n"
+            "  \"droppedlives\" : nnnnnnnn    (number) live contracts without counterparty, which couldn't be carried\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("tl_gettradeedgeinfo", "")
+            + HelpExampleRpc("tl_gettradeedgeinfo", "")
+        );
+
+    CTradeEdgeStats stats;
+    {
+        LOCK(cs_tally);
+        stats = tradeEdges.GetStats();
+    }
+
+    UniValue response(UniValue::VOBJ);
+    response.pushKV("trades", (uint64_t) stats.nTrades);
+    response.pushKV("carried", (uint64_t) stats.nCarried);
+    response.pushKV("periods", (uint64_t) stats.nSegments);
+    response.pushKV("memoryusage", (uint64_t) stats.nMemoryUsage);
+    response.pushKV("recorded", stats.nRecorded);
+    response.pushKV("rejected", stats.nRejected);
+    response.pushKV("settlements", stats.nSettlements);
+    response.pushKV("settled", stats.nSettled);
+    response.pushKV("droppedlives", stats.nDroppedLives);
+
+    return response;
+}
+
+UniValue tl_gettradejournal(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "tl_gettradejournal startblock ( endblock )\n"
+
+            "\nReturns the matched contract trades of a range of blocks, as journaled on disk once the blocks were processed.\n"
+
+            "\nArguments:\n"
+            "1. startblock           (number, required) first block of the range\n"
+            "2. endblock             (number, optional) last block of the range (default: startblock)\n"
+
+            "\nResult:\n"
+            "[                                   (array of JSON objects)\n"
+            "  {\n"
+            "    \"block\" : nnnnnn,                   (number) the block the trade was matched in\n"
+            "    \"contractid\" : nnnnnn,              (number) the identifier of the contract\n"
+            "    \"makertxid\" : \"hash\",              (string) the hash of the maker transaction\n"
+            "    \"takertxid\" : \"hash\",              (string) the hash of the taker transaction\n"
+            "    \"makeraddress\" : \"address\",        (string) the address of the maker\n"
+            "    \"takeraddress\" : \"address\",        (string) the address of the taker\n"
+            "    \"makerstatus\" : \"status\",          (string) the position change of the maker\n"
+            "    \"takerstatus\" : \"status\",          (string) the position change of the taker\n"
+            "    \"makerlives\" : nnnnnn,              (number) the contracts of the maker left open\n"
+            "    \"takerlives\" : nnnnnn,              (number) the contracts of the taker left open\n"
+            "    \"amount\" : nnnnnn,                  (number) the number of contracts traded\n"
+            "    \"unitprice\" : \"n.nnnnnnnn\"         (string) the price of a contract\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("tl_gettradejournal", "100000 100100")
+            + HelpExampleRpc("tl_gettradejournal", "100000, 100100")
+        );
+
+    int nStartBlock = request.params[0].get_int();
+    if (nStartBlock < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative start block");
+    int nEndBlock = nStartBlock;
+    if (request.params.size() > 1) nEndBlock = request.params[1].get_int();
+    if (nEndBlock < nStartBlock) throw JSONRPCError(RPC_INVALID_PARAMETER, "End block must not be lower than start block");
+
+    fs::path journalPath;
+    {
+        LOCK(cs_tally);
+        if (!tradeJournal.IsOpen()) throw JSONRPCError(RPC_MISC_ERROR, "Trade journal is disabled (use -tltradejournal)");
+        journalPath = tradeJournal.GetPath();
+    }
+
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+    if (!ReadTradeJournal(journalPath, nStartBlock, nEndBlock, blocks)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to read the trade journal");
+    }
+
+    UniValue response(UniValue::VARR);
+    for (const auto& block : blocks) {
+        for (const CTradeJournalEntry& entry : block.second) {
+            UniValue tradeObj(UniValue::VOBJ);
+            tradeObj.pushKV("block", block.first);
+            tradeObj.pushKV("contractid", (uint64_t) entry.contractId);
+            tradeObj.pushKV("makertxid", entry.txidMaker.GetHex());
+            tradeObj.pushKV("takertxid", entry.txidTaker.GetHex());
+            tradeObj.pushKV("makeraddress", entry.addressMaker);
+            tradeObj.pushKV("takeraddress", entry.addressTaker);
+            tradeObj.pushKV("makerstatus", entry.statusMaker);
+            tradeObj.pushKV("takerstatus", entry.statusTaker);
+            tradeObj.pushKV("makerlives", entry.livesMaker);
+            tradeObj.pushKV("takerlives", entry.livesTaker);
+            tradeObj.pushKV("amount", entry.amount);
+            tradeObj.pushKV("unitprice", FormatDivisibleMP(entry.effectivePrice));
+            response.push_back(tradeObj);
+        }
+    }
+
+    return response;
+}
+
 UniValue tl_getactivations(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -2033,16 +2306,13 @@ UniValue tl_getorderbook(const JSONRPCRequest& request)
     std::vector<CMPMetaDEx> vecMetaDexObjects;
     {
         LOCK(cs_tally);
-        for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        std::pair<md_PropertiesMap::iterator, md_PropertiesMap::iterator> pairs = get_PairsRange(propertyIdForSale);
+        for (md_PropertiesMap::const_iterator my_it = pairs.first; my_it != pairs.second; ++my_it) {
+            if (filterDesired && my_it->first.second != propertyIdDesired) continue;
             const md_PricesMap& prices = my_it->second;
             for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
                 const md_Set& indexes = it->second;
-                for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                    const CMPMetaDEx& obj = *it;
-                    if (obj.getProperty() != propertyIdForSale) continue;
-                    if (!filterDesired || obj.getDesProperty() == propertyIdDesired)
-                        vecMetaDexObjects.push_back(obj);
-                }
+                vecMetaDexObjects.insert(vecMetaDexObjects.end(), indexes.begin(), indexes.end());
             }
         }
     }
@@ -2896,6 +3166,7 @@ UniValue tl_get_ltcvolume(const JSONRPCRequest& request)
             "{\n"
             "  \"supply\" : \"n.nnnnnnnn\",   (number) the LTC volume traded \n"
             "  \"blockheight\" : \"n.\",      (number) last block\n"
+            "  \"compacted\" : true|false,    (boolean) whether the first block is in the compacted history, so the volume includes older blocks\n"
             "}\n"
 
             "\nExamples:\n"
@@ -2920,6 +3191,7 @@ UniValue tl_get_ltcvolume(const JSONRPCRequest& request)
 
     balanceObj.pushKV("volume", FormatDivisibleMP(amount));
     balanceObj.pushKV("blockheigh", FormatIndivisibleMP(GetHeight()));
+    balanceObj.pushKV("compacted", MapLTCVolume.IsCompacted(fblock));
 
     return balanceObj;
 }
@@ -2941,6 +3213,7 @@ UniValue tl_getmdexvolume(const JSONRPCRequest& request)
             "{\n"
             "  \"volume\" : \"n.nnnnnnnn\",   (number) the available volume (of property) traded\n"
             "  \"blockheight\" : \"n.\",      (number) last block\n"
+            "  \"compacted\" : true|false,    (boolean) whether the first block is in the compacted history, so the volume includes older blocks\n"
             "}\n"
 
             "\nExamples:\n"
@@ -2965,6 +3238,7 @@ UniValue tl_getmdexvolume(const JSONRPCRequest& request)
 
     balanceObj.pushKV("volume", FormatDivisibleMP(amount));
     balanceObj.pushKV("blockheigh", FormatIndivisibleMP(GetHeight()));
+    balanceObj.pushKV("compacted", metavolume.IsCompacted(fblock));
 
     return balanceObj;
 }
@@ -3661,6 +3935,11 @@ static const CRPCCommand commands[] =
   //  ------------------------------------ ------------------------------- ------------------------------ ----------
   { "trade layer (data retrieval)", "tl_getinfo",                              &tl_getinfo,                           {} },
   { "trade layer (data retrieval)", "tl_getactivations",                       &tl_getactivations,                    {} },
+  { "trade layer (data retrieval)", "tl_getcacheinfo",                         &tl_getcacheinfo,                      {} },
+  { "trade layer (data retrieval)", "tl_getdbinfo",                            &tl_getdbinfo,                         {} },
+  { "trade layer (data retrieval)", "tl_getwithdrawalinfo",                    &tl_getwithdrawalinfo,                 {} },
+  { "trade layer (data retrieval)", "tl_gettradeedgeinfo",                     &tl_gettradeedgeinfo,                  {} },
+  { "trade layer (data retrieval)", "tl_gettradejournal",                      &tl_gettradejournal,                   {} },
   { "trade layer (data retrieval)", "tl_getallbalancesforid",                  &tl_getallbalancesforid,               {} },
   { "trade layer (data retrieval)", "tl_getbalance",                           &tl_getbalance,                        {} },
   { "trade layer (data retrieval)", "tl_gettransaction",                       &tl_gettransaction,                    {} },
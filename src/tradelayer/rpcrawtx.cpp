@@ -25,7 +25,6 @@
 extern CCriticalSection cs_main;
 
 using mastercore::cs_tx_cache;
-using mastercore::view;
 
 
 UniValue tl_decodetransaction(const JSONRPCRequest& request)
@@ -343,17 +343,14 @@ void RequireShort(std::string& fromAddress, uint32_t contractId, uint64_t amount
 
 void RequireContractTxId(std::string& txid)
 {
-    std::string result;
+    mastercore::CMPTxRecord record;
     uint256 tx;
     tx.SetHex(txid);
-    if (!p_txlistdb->getTX(tx, result)) {
+    if (!p_txlistdb->getTX(tx, record)) {
           throw JSONRPCError(RPC_INVALID_PARAMETER, "TxId doesn't exist\n");
     }
 
-    std::vector<std::string> vstr;
-    boost::split(vstr, result, boost::is_any_of(":"), token_compress_on);
-    unsigned int type = atoi(vstr[2]);
-    if (type != 29) {
+    if (record.nType != 29) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "TxId isn't a future contract trade\n");
     }
 
@@ -11,6 +11,10 @@
 #include <util/strencodings.h>
 #include <validation.h>
 
+#include <string.h>
+
+#include <algorithm>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -78,6 +82,105 @@ bool GetScriptPushes(const CScript& script, std::vector<std::string>& vstrRet, b
     return true;
 }
 
+/**
+ * Checks, whether a byte sequence is part of a range, without copying the data.
+ *
+ * The first byte is located with memchr, which is vectorized by the C library,
+ * so most scripts are rejected without comparing them bytewise.
+ */
+static bool ContainsBytes(const unsigned char* pbegin, const unsigned char* pend, const unsigned char* pbytes, size_t nSize)
+{
+    if (nSize == 0) return true;
+
+    while (static_cast<size_t>(pend - pbegin) >= nSize) {
+        const void* pfound = memchr(pbegin, pbytes[0], (pend - pbegin) - nSize + 1);
+        if (pfound == nullptr) return false;
+
+        pbegin = static_cast<const unsigned char*>(pfound);
+        if (memcmp(pbegin, pbytes, nSize) == 0) return true;
+        ++pbegin;
+    }
+
+    return false;
+}
+
+/**
+ * Checks, whether a script is a data-carrying output, whose first push starts with the marker.
+ *
+ * This is equivalent to identifying the output as TX_NULL_DATA and comparing
+ * the first element of GetScriptPushes with the marker, but works directly on
+ * the script bytes and doesn't allocate any memory.
+ *
+ * @param script[in]     The script
+ * @param vchMarker[in]  The marker bytes
+ * @return True if the first pushed data starts with the marker
+ */
+bool HasDataMarker(const CScript& script, const std::vector<unsigned char>& vchMarker)
+{
+    // Provably prunable, data-carrying outputs only
+    if (script.size() < 2 || script[0] != OP_RETURN) {
+        return false;
+    }
+
+    const unsigned char* pbegin = script.data();
+    const unsigned char* pend = pbegin + script.size();
+    if (!ContainsBytes(pbegin + 1, pend, vchMarker.data(), vchMarker.size())) {
+        return false;
+    }
+
+    CScript::const_iterator pc = script.begin() + 1;
+    if (!script.IsPushOnly(pc)) {
+        return false;
+    }
+
+    while (pc < script.end()) {
+        CScript::const_iterator pcOp = pc;
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode)) {
+            return false;
+        }
+        if (opcode > OP_PUSHDATA4) {
+            continue;
+        }
+
+        // Skip the opcode and the size of the pushed data
+        size_t nHeader = 1;
+        if (opcode == OP_PUSHDATA1) nHeader = 2;
+        else if (opcode == OP_PUSHDATA2) nHeader = 3;
+        else if (opcode == OP_PUSHDATA4) nHeader = 5;
+
+        const size_t nDataBegin = (pcOp - script.begin()) + nHeader;
+        const size_t nDataSize = (pc - script.begin()) - nDataBegin;
+        if (nDataSize < vchMarker.size()) {
+            return false;
+        }
+
+        return std::equal(vchMarker.begin(), vchMarker.end(), pbegin + nDataBegin);
+    }
+
+    return false;
+}
+
+/** Returns the script templates of SafeSolver. */
+static std::multimap<txnouttype, CScript> GetSolverTemplates()
+{
+    std::multimap<txnouttype, CScript> mTemplates;
+
+    // Standard tx, sender provides pubkey, receiver adds signature
+    mTemplates.insert(std::make_pair(TX_PUBKEY, CScript() << OP_PUBKEY << OP_CHECKSIG));
+
+    // Bitcoin address tx, sender provides hash of pubkey, receiver provides signature and pubkey
+    mTemplates.insert(std::make_pair(TX_PUBKEYHASH, CScript() << OP_DUP << OP_HASH160 << OP_PUBKEYHASH << OP_EQUALVERIFY << OP_CHECKSIG));
+
+    // Sender provides N pubkeys, receivers provides M signatures
+    mTemplates.insert(std::make_pair(TX_MULTISIG, CScript() << OP_SMALLINTEGER << OP_PUBKEYS << OP_SMALLINTEGER << OP_CHECKMULTISIG));
+
+    // Empty, provably prunable, data-carrying output
+    mTemplates.insert(std::make_pair(TX_NULL_DATA, CScript() << OP_RETURN));
+
+    return mTemplates;
+}
+
 /**
  * Returns public keys or hashes from scriptPubKey, for standard transaction types.
  *
@@ -91,22 +194,8 @@ bool GetScriptPushes(const CScript& script, std::vector<std::string>& vstrRet, b
  */
 bool SafeSolver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet)
 {
-    // Templates
-     static std::multimap<txnouttype, CScript> mTemplates;
-     if (mTemplates.empty())
-     {
-         // Standard tx, sender provides pubkey, receiver adds signature
-         mTemplates.insert(std::make_pair(TX_PUBKEY, CScript() << OP_PUBKEY << OP_CHECKSIG));
-
-         // Bitcoin address tx, sender provides hash of pubkey, receiver provides signature and pubkey
-         mTemplates.insert(std::make_pair(TX_PUBKEYHASH, CScript() << OP_DUP << OP_HASH160 << OP_PUBKEYHASH << OP_EQUALVERIFY << OP_CHECKSIG));
-
-         // Sender provides N pubkeys, receivers provides M signatures
-         mTemplates.insert(std::make_pair(TX_MULTISIG, CScript() << OP_SMALLINTEGER << OP_PUBKEYS << OP_SMALLINTEGER << OP_CHECKMULTISIG));
-
-         // Empty, provably prunable, data-carrying output
-         mTemplates.insert(std::make_pair(TX_NULL_DATA, CScript() << OP_RETURN));
-     }
+    // Templates, initialized once, as the scan pre-parses transactions on several threads
+    static const std::multimap<txnouttype, CScript> mTemplates = GetSolverTemplates();
 
      vSolutionsRet.clear();
 
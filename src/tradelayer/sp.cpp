@@ -22,6 +22,7 @@
 #include <leveldb/write_batch.h>
 
 #include <stdint.h>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <utility>
@@ -36,7 +37,7 @@ typedef boost::multiprecision::uint128_t ui128;
 
 CMPSPInfo::Entry::Entry()
   : prop_type(0), prev_prop_id(0), num_tokens(0),
-    fixed(false), manual(false) {}
+    fixed(false), manual(false), expirated(false) {}
 
 bool CMPSPInfo::Entry::isDivisible() const
 {
@@ -124,6 +125,7 @@ void CMPSPInfo::Entry::print() const
 }
 
 CMPSPInfo::CMPSPInfo(const fs::path& path, bool fWipe)
+  : nCacheHits(0), nCacheMisses(0)
 {
   leveldb::Status status = Open(path, fWipe);
   PrintToLog("Loading smart property database: %s\n", status.ToString());
@@ -159,6 +161,8 @@ void CMPSPInfo::Clear()
 {
   // wipe database via parent class
   CDBBase::Clear();
+  // drop all decoded entries
+  clearCache();
   // reset "next property identifiers"
   init();
 }
@@ -210,6 +214,9 @@ bool CMPSPInfo::updateSP(uint32_t propertyId, const Entry& info)
   batch.Put(slSpKey, slSpValue);
   leveldb::Status status = pdb->Write(syncoptions, &batch);
 
+  // the cached entry is stale either way
+  invalidateCache(propertyId);
+
   if (!status.ok()) {
     PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, status.ToString());
     return false;
@@ -222,6 +229,7 @@ bool CMPSPInfo::updateSP(uint32_t propertyId, const Entry& info)
 uint32_t CMPSPInfo::putSP(const Entry& info)
 {
     uint32_t propertyId = next_spid++;
+    NotifyStateSectionChanged(FILETYPE_GLOBALS);
 
     // DB key for property entry
     CDataStream ssSpKey(SER_DISK, CLIENT_VERSION);
@@ -262,6 +270,8 @@ uint32_t CMPSPInfo::putSP(const Entry& info)
 
     leveldb::Status status = pdb->Write(syncoptions, &batch);
 
+    invalidateCache(propertyId);
+
     if (!status.ok()) {
         PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, status.ToString());
     }
@@ -271,15 +281,42 @@ uint32_t CMPSPInfo::putSP(const Entry& info)
 
 bool CMPSPInfo::getSP(uint32_t propertyId, Entry& info) const
 {
-    // special cases for ALL and sLTC
+    std::shared_ptr<const Entry> handle = getSPHandle(propertyId);
+    if (!handle) {
+        return false;
+    }
+
+    info = *handle;
+    return true;
+}
+
+/**
+ * Returns a shared, immutable handle to the decoded entry of a property.
+ *
+ * Entries are decoded from the database only once and served from the cache
+ * until they are invalidated by updateSP(), putSP(), popBlock() or Clear().
+ *
+ * @return The entry, or an empty handle, if the property doesn't exist
+ */
+std::shared_ptr<const CMPSPInfo::Entry> CMPSPInfo::getSPHandle(uint32_t propertyId) const
+{
+    // special cases for ALL and sLTC: non-owning handles to the implied entries
     if (ALL == propertyId) {
-        info = implied_all;
-        return true;
-    } else if (sLTC == propertyId){
-        info = implied_tall;
-        return true;
+        return std::shared_ptr<const Entry>(std::shared_ptr<const Entry>(), &implied_all);
+    } else if (sLTC == propertyId) {
+        return std::shared_ptr<const Entry>(std::shared_ptr<const Entry>(), &implied_tall);
     }
 
+    LOCK(cs_cache);
+
+    std::map<uint32_t, std::shared_ptr<const Entry>>::const_iterator it = cache.find(propertyId);
+    if (it != cache.end()) {
+        ++nCacheHits;
+        return it->second;
+    }
+
+    ++nCacheMisses;
+
     // DB key for property entry
     CDataStream ssSpKey(SER_DISK, CLIENT_VERSION);
     ssSpKey << std::make_pair('s', propertyId);
@@ -292,18 +329,93 @@ bool CMPSPInfo::getSP(uint32_t propertyId, Entry& info) const
         if (!status.IsNotFound()) {
             PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, status.ToString());
         }
-        return false;
+        return nullptr;
     }
 
+    std::shared_ptr<Entry> info = std::make_shared<Entry>();
     try {
         CDataStream ssSpValue(strSpValue.data(), strSpValue.data() + strSpValue.size(), SER_DISK, CLIENT_VERSION);
-        ssSpValue >> info;
+        ssSpValue >> *info;
     } catch (const std::exception& e) {
         PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, e.what());
-        return false;
+        return nullptr;
     }
 
-    return true;
+    cache[propertyId] = info;
+    return info;
+}
+
+/**
+ * Checks whether a KYC identifier is accepted by a property.
+ *
+ * The identifiers of an entry are expanded into a bitset on first use, which is
+ * dropped together with the cached entry. Identifiers beyond the bitset are rare
+ * and kept in a sorted list.
+ *
+ * @return True, if the property exists and lists the identifier
+ */
+bool CMPSPInfo::hasKYC(uint32_t propertyId, int64_t kyc_id) const
+{
+    static const int64_t MAX_KYC_BITS = 1 << 16;
+
+    std::shared_ptr<const KYCSet> kycSet;
+    {
+        LOCK(cs_cache);
+        std::map<uint32_t, std::shared_ptr<const KYCSet>>::const_iterator it = kycCache.find(propertyId);
+        if (it != kycCache.end()) kycSet = it->second;
+    }
+
+    if (!kycSet) {
+        std::shared_ptr<const Entry> handle = getSPHandle(propertyId);
+        if (!handle) {
+            return false; // property ID does not exist
+        }
+
+        std::shared_ptr<KYCSet> newSet = std::make_shared<KYCSet>();
+        for (int64_t k : handle->kyc) {
+            if (0 <= k && k < MAX_KYC_BITS) {
+                if (newSet->bits.size() <= (size_t) k) newSet->bits.resize(k + 1, false);
+                newSet->bits[k] = true;
+            } else {
+                newSet->large.push_back(k);
+            }
+        }
+        std::sort(newSet->large.begin(), newSet->large.end());
+
+        LOCK(cs_cache);
+        // only keep the set while the entry it was built from is cached
+        std::map<uint32_t, std::shared_ptr<const Entry>>::const_iterator it = cache.find(propertyId);
+        if (it != cache.end() && it->second == handle) kycCache[propertyId] = newSet;
+        kycSet = newSet;
+    }
+
+    if (0 <= kyc_id && kyc_id < MAX_KYC_BITS) {
+        return (size_t) kyc_id < kycSet->bits.size() && kycSet->bits[kyc_id];
+    }
+
+    return std::binary_search(kycSet->large.begin(), kycSet->large.end(), kyc_id);
+}
+
+void CMPSPInfo::invalidateCache(uint32_t propertyId)
+{
+    LOCK(cs_cache);
+    cache.erase(propertyId);
+    kycCache.erase(propertyId);
+}
+
+void CMPSPInfo::clearCache()
+{
+    LOCK(cs_cache);
+    cache.clear();
+    kycCache.clear();
+}
+
+void CMPSPInfo::getCacheStats(uint64_t& hits, uint64_t& misses, size_t& entries) const
+{
+    LOCK(cs_cache);
+    hits = nCacheHits;
+    misses = nCacheMisses;
+    entries = cache.size();
 }
 
 bool CMPSPInfo::hasSP(uint32_t propertyId) const
@@ -425,6 +537,9 @@ int64_t CMPSPInfo::popBlock(const uint256& block_hash)
 
     leveldb::Status status = pdb->Write(syncoptions, &commitBatch);
 
+    // rolled back entries are restored from the database on the next access
+    clearCache();
+
     if (!status.ok()) {
         PrintToLog("%s(): ERROR: %s\n", __func__, status.ToString());
         return -4;
@@ -551,45 +666,44 @@ bool mastercore::IsPropertyIdValid(uint32_t propertyId)
 
 bool mastercore::isPropertyDivisible(uint32_t propertyId)
 {
-  // TODO: is a lock here needed
-  CMPSPInfo::Entry sp;
+  std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
 
-  if (_my_sps->getSP(propertyId, sp)) return sp.isDivisible();
+  if (sp) return sp->isDivisible();
 
   return true;
 }
 
 bool mastercore::isPropertyContract(uint32_t propertyId)
 {
-  CMPSPInfo::Entry sp;
+  std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
 
-  if (_my_sps->getSP(propertyId, sp)) return sp.isContract();
+  if (sp) return sp->isContract();
 
   return true;
 }
 
 bool mastercore::isPropertySwap(uint32_t propertyId)
 {
-  CMPSPInfo::Entry sp;
+  std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
 
-  if (_my_sps->getSP(propertyId, sp)) return sp.isSwap();
+  if (sp) return sp->isSwap();
 
   return true;
 }
 
 bool mastercore::isPropertyPegged(uint32_t propertyId)
 {
-  CMPSPInfo::Entry sp;
+  std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
 
-  if (_my_sps->getSP(propertyId, sp)) return sp.isPegged();
+  if (sp) return sp->isPegged();
 
   return true;
 }
 
 std::string mastercore::getPropertyName(uint32_t propertyId)
 {
-    CMPSPInfo::Entry sp;
-    if (_my_sps->getSP(propertyId, sp)) return sp.name;
+    std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
+    if (sp) return sp->name;
     return "Property Name Not Found";
 }
 
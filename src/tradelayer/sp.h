@@ -10,12 +10,14 @@ class CHash256;
 class uint256;
 
 #include <serialize.h>
+#include <sync.h>
 
 #include <stdint.h>
 #include <stdio.h>
 
 #include <fstream>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -171,6 +173,28 @@ public:
     uint32_t next_spid;
     uint32_t next_test_spid;
 
+    /** Read-through cache of decoded entries, keyed by property identifier.
+     *
+     * Handles are shared and immutable: any write to an entry replaces the
+     * cached handle instead of modifying it, so outstanding handles remain
+     * valid snapshots of the entry at the time they were retrieved.
+     */
+    mutable CCriticalSection cs_cache;
+    mutable std::map<uint32_t, std::shared_ptr<const Entry>> cache;
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
+    /** Bitsets of the KYC identifiers accepted by a property, built from the cached entries. */
+    struct KYCSet
+    {
+        std::vector<bool> bits;
+        std::vector<int64_t> large;
+    };
+    mutable std::map<uint32_t, std::shared_ptr<const KYCSet>> kycCache;
+
+    void invalidateCache(uint32_t propertyId);
+    void clearCache();
+
  public:
     CMPSPInfo(const fs::path& path, bool fWipe);
     virtual ~CMPSPInfo();
@@ -184,8 +208,10 @@ public:
     bool updateSP(uint32_t propertyId, const Entry& info);
     uint32_t putSP(const Entry& info);
     bool getSP(uint32_t propertyId, Entry& info) const;
+    std::shared_ptr<const Entry> getSPHandle(uint32_t propertyId) const;
     bool hasSP(uint32_t propertyId) const;
     uint32_t findSPByTX(const uint256& txid) const;
+    bool hasKYC(uint32_t propertyId, int64_t kyc_id) const;
 
     int64_t popBlock(const uint256& block_hash);
 
@@ -194,6 +220,9 @@ public:
 
     void printAll() const;
 
+    /** Returns the hit and miss counters and the number of cached entries. */
+    void getCacheStats(uint64_t& hits, uint64_t& misses, size_t& entries) const;
+
 };
 
 
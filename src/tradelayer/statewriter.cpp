@@ -0,0 +1,131 @@
+#include <tradelayer/statewriter.h>
+
+#include <fs.h>
+#include <streams.h>
+#include <util/system.h>
+
+#include <stddef.h>
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using namespace mastercore;
+
+CMPStateWriter::CMPStateWriter(size_t nMaxQueueIn, const WriteFunction& writeIn)
+    : nMaxQueue(nMaxQueueIn), write(writeIn), fBusy(false), fStop(false), fFailed(false)
+{
+}
+
+CMPStateWriter::~CMPStateWriter()
+{
+    Stop();
+}
+
+bool CMPStateWriter::WriteJob(Job& job)
+{
+    if (!write(job.path, job.image)) return false;
+    if (job.onWritten) job.onWritten();
+    return true;
+}
+
+void CMPStateWriter::Loop()
+{
+    std::unique_lock<std::mutex> lock(cs_writer);
+    while (true)
+    {
+        cvWriter.wait(lock, [this] { return fStop || !queue.empty(); });
+
+        // the queue is drained, before stopping
+        if (queue.empty()) break;
+
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        fBusy = true;
+        lock.unlock();
+        cvWriter.notify_all();
+
+        const bool fWritten = WriteJob(job);
+
+        lock.lock();
+        if (fWritten) {
+            ++stats.nWritten;
+        } else {
+            ++stats.nFailed;
+            fFailed = true;
+        }
+        fBusy = false;
+        cvWriter.notify_all();
+    }
+}
+
+void CMPStateWriter::Start(const char* name)
+{
+    std::lock_guard<std::mutex> lock(cs_writer);
+    if (thread.joinable()) return;
+
+    fStop = false;
+    thread = std::thread(&TraceThread<std::function<void()>>, name, std::function<void()>(std::bind(&CMPStateWriter::Loop, this)));
+}
+
+void CMPStateWriter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_writer);
+        fStop = true;
+    }
+    cvWriter.notify_all();
+
+    if (thread.joinable()) thread.join();
+}
+
+bool CMPStateWriter::IsRunning()
+{
+    std::lock_guard<std::mutex> lock(cs_writer);
+    return thread.joinable();
+}
+
+bool CMPStateWriter::Write(const fs::path& path, CDataStream& image, const Callback& onWritten)
+{
+    std::unique_lock<std::mutex> lock(cs_writer);
+    if (!thread.joinable()) {
+        // no writer running, so do it right here
+        lock.unlock();
+        Job job{std::move(image), path, onWritten};
+        const bool fWritten = WriteJob(job);
+
+        lock.lock();
+        if (fWritten) {
+            ++stats.nWritten;
+        } else {
+            ++stats.nFailed;
+        }
+        return fWritten;
+    }
+
+    // wait for the writer, if it falls behind too far
+    if (queue.size() >= nMaxQueue) {
+        ++stats.nFullWaits;
+        cvWriter.wait(lock, [this] { return queue.size() < nMaxQueue; });
+    }
+    queue.push_back(Job{std::move(image), path, onWritten});
+    lock.unlock();
+    cvWriter.notify_all();
+
+    return true;
+}
+
+void CMPStateWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(cs_writer);
+    cvWriter.wait(lock, [this] { return queue.empty() && !fBusy; });
+}
+
+CStateWriterStats CMPStateWriter::GetStats()
+{
+    std::lock_guard<std::mutex> lock(cs_writer);
+    CStateWriterStats result = stats;
+    result.nQueued = queue.size();
+    return result;
+}
@@ -0,0 +1,102 @@
+#ifndef TRADELAYER_STATEWRITER_H
+#define TRADELAYER_STATEWRITER_H
+
+#include <fs.h>
+#include <streams.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace mastercore
+{
+/** Usage statistics of the state writer. */
+struct CStateWriterStats
+{
+    //! Images waiting to be written
+    size_t nQueued;
+    //! Images written
+    uint64_t nWritten;
+    //! Images, which could not be written
+    uint64_t nFailed;
+    //! Saves, which waited for the writer, because the queue was full
+    uint64_t nFullWaits;
+
+    CStateWriterStats() : nQueued(0), nWritten(0), nFailed(0), nFullWaits(0) {}
+};
+
+/** Background writer for the state snapshots.
+ *
+ * The images are serialized into memory while holding the locks, and queued.
+ * Writing them, and what has to follow a written image, like pruning and
+ * moving the watermark, happens on the writer thread, which takes neither
+ * cs_main nor cs_tally. The queue is bounded, so a writer falling behind
+ * holds up the saves, instead of piling up images in memory.
+ */
+class CMPStateWriter
+{
+public:
+    //! Writes an image to disk
+    typedef std::function<bool(const fs::path&, const CDataStream&)> WriteFunction;
+    //! Called once an image was written
+    typedef std::function<void()> Callback;
+
+private:
+    struct Job
+    {
+        CDataStream image;
+        fs::path path;
+        Callback onWritten;
+    };
+
+    const size_t nMaxQueue;
+    const WriteFunction write;
+
+    std::mutex cs_writer;
+    std::condition_variable cvWriter;
+    std::deque<Job> queue;
+    std::thread thread;
+    bool fBusy;
+    bool fStop;
+    //! Set, if an image could not be written, so the next one is a full snapshot
+    std::atomic<bool> fFailed;
+    CStateWriterStats stats;
+
+    void Loop();
+    bool WriteJob(Job& job);
+
+public:
+    CMPStateWriter(size_t nMaxQueue, const WriteFunction& write);
+    ~CMPStateWriter();
+
+    /** Starts the writer thread with the given name. */
+    void Start(const char* name);
+    /** Writes the queued images, and stops the writer thread. */
+    void Stop();
+    bool IsRunning();
+
+    /** Queues an image, and waits first, if the queue is full.
+     *
+     * Without writer thread the image is written right here. Returns false,
+     * if it was written here and failed.
+     */
+    bool Write(const fs::path& path, CDataStream& image, const Callback& onWritten);
+
+    /** Waits until all queued images are written. */
+    void Flush();
+
+    /** Returns true, if an image could not be written since the last call. */
+    bool TakeFailed() { return fFailed.exchange(false); }
+
+    CStateWriterStats GetStats();
+};
+
+} // namespace mastercore
+
+#endif // TRADELAYER_STATEWRITER_H
@@ -4,44 +4,39 @@
 #include <tradelayer/tradelayer.h>
 
 #include <stdint.h>
-#include <map>
+#include <string.h>
 
-/**
- * Creates an empty tally.
- */
-CMPTally::CMPTally()
+#include <algorithm>
+
+namespace {
+bool RecordBeforeProperty(const CMPTally::BalanceRecord& record, uint32_t propertyId)
 {
-    my_it = mp_token.begin();
+    return record.propertyId < propertyId;
+}
 }
 
 /**
- * Resets the internal iterator.
- *
- * @return Identifier of the first tally element.
+ * Creates an empty tally.
  */
-uint32_t CMPTally::init()
+CMPTally::CMPTally()
 {
-    uint32_t propertyId = 0;
-    my_it = mp_token.begin();
-    if (my_it != mp_token.end()) {
-        propertyId = my_it->first;
-    }
-    return propertyId;
 }
 
 /**
- * Advances the internal iterator.
+ * Returns the balance record of the token.
  *
- * @return Identifier of the tally element before the update.
+ * @param propertyId  The identifier of the tally to lookup
+ * @return The balance record, or nullptr, if there is none
  */
-uint32_t CMPTally::next()
+const CMPTally::BalanceRecord* CMPTally::find(uint32_t propertyId) const
 {
-    uint32_t ret = 0;
-    if (my_it != mp_token.end()) {
-        ret = my_it->first;
-        ++my_it;
+    const_iterator it = std::lower_bound(mp_token.begin(), mp_token.end(), propertyId, RecordBeforeProperty);
+
+    if (it != mp_token.end() && it->propertyId == propertyId) {
+        return &(*it);
     }
-    return ret;
+
+    return nullptr;
 }
 
 /**
@@ -73,7 +68,17 @@ bool CMPTally::updateMoney(uint32_t propertyId, int64_t amount, TallyType ttype)
         return false;
     }
     bool fUpdated = false;
-    int64_t now64 = mp_token[propertyId].balance[ttype];
+
+    // an empty record is created, even if the update fails
+    TokenVector::iterator it = std::lower_bound(mp_token.begin(), mp_token.end(), propertyId, RecordBeforeProperty);
+    if (it == mp_token.end() || it->propertyId != propertyId) {
+        BalanceRecord record;
+        memset(&record, 0, sizeof(record));
+        record.propertyId = propertyId;
+        it = mp_token.insert(it, record);
+    }
+
+    int64_t now64 = it->balance[ttype];
 
     if (isOverflow(now64, amount)) {
         PrintToLog("%s(): ERROR: arithmetic overflow [%d + %d]\n", __func__, now64, amount);
@@ -86,7 +91,7 @@ bool CMPTally::updateMoney(uint32_t propertyId, int64_t amount, TallyType ttype)
     } else {
 
         now64 += amount;
-        mp_token[propertyId].balance[ttype] = now64;
+        it->balance[ttype] = now64;
 
         fUpdated = true;
     }
@@ -107,11 +112,10 @@ int64_t CMPTally::getMoney(uint32_t propertyId, TallyType ttype) const
         return 0;
     }
     int64_t money = 0;
-    TokenMap::const_iterator it = mp_token.find(propertyId);
+    const BalanceRecord* record = find(propertyId);
 
-    if (it != mp_token.end()) {
-        const BalanceRecord& record = it->second;
-        money = record.balance[ttype];
+    if (record != nullptr) {
+        money = record->balance[ttype];
     }
 
     return money;
@@ -128,20 +132,56 @@ int64_t CMPTally::getMoney(uint32_t propertyId, TallyType ttype) const
  */
 int64_t CMPTally::getMoneyAvailable(uint32_t propertyId) const
 {
-    TokenMap::const_iterator it = mp_token.find(propertyId);
+    const BalanceRecord* record = find(propertyId);
 
-    if (it != mp_token.end()) {
-        const BalanceRecord& record = it->second;
-        if (record.balance[PENDING] < 0) {
-            return record.balance[BALANCE] + record.balance[PENDING];
+    if (record != nullptr) {
+        if (record->balance[PENDING] < 0) {
+            return record->balance[BALANCE] + record->balance[PENDING];
         } else {
-            return record.balance[BALANCE];
+            return record->balance[BALANCE];
         }
     }
 
     return 0;
 }
 
+/**
+ * Returns the number of tokens, available or reserved.
+ *
+ * Pending balances and contract positions are not included.
+ *
+ * @param propertyId  The identifier of the tally to lookup
+ * @return The balance and reserves
+ */
+int64_t CMPTally::getMoneySupply(uint32_t propertyId) const
+{
+    const BalanceRecord* record = find(propertyId);
+
+    if (record != nullptr) {
+        return record->balance[BALANCE] + record->balance[SELLOFFER_RESERVE] + record->balance[ACCEPT_RESERVE] +
+               record->balance[METADEX_RESERVE] + record->balance[CONTRACTDEX_RESERVE];
+    }
+
+    return 0;
+}
+
+/**
+ * Compares the totals with other totals and returns true, if they are equal.
+ *
+ * @param rhs  The other totals
+ * @return True, if both are equal
+ */
+bool CMPTallyTotals::operator==(const CMPTallyTotals& rhs) const
+{
+    for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+        if (total[ttype] != rhs.total[ttype]) {
+            return false;
+        }
+    }
+
+    return longs == rhs.longs && shorts == rhs.shorts && owners == rhs.owners;
+}
+
 /**
  * Compares the tally with another tally and returns true, if they are equal.
  *
@@ -153,15 +193,15 @@ bool CMPTally::operator==(const CMPTally& rhs) const
     if (mp_token.size() != rhs.mp_token.size()) {
         return false;
     }
-    TokenMap::const_iterator pc1 = mp_token.begin();
-    TokenMap::const_iterator pc2 = rhs.mp_token.begin();
+    const_iterator pc1 = mp_token.begin();
+    const_iterator pc2 = rhs.mp_token.begin();
 
     for (unsigned int i = 0; i < mp_token.size(); ++i) {
-        if (pc1->first != pc2->first) {
+        if (pc1->propertyId != pc2->propertyId) {
             return false;
         }
-        const BalanceRecord& record1 = pc1->second;
-        const BalanceRecord& record2 = pc2->second;
+        const BalanceRecord& record1 = *pc1;
+        const BalanceRecord& record2 = *pc2;
 
         for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
             if (record1.balance[ttype] != record2.balance[ttype]) {
@@ -201,12 +241,11 @@ int64_t CMPTally::print(uint32_t propertyId, bool bDivisible) const
     int64_t balance = 0;
     int64_t pending = 0;
 
-    TokenMap::const_iterator it = mp_token.find(propertyId);
+    const BalanceRecord* record = find(propertyId);
 
-    if (it != mp_token.end()) {
-        const BalanceRecord& record = it->second;
-        balance = record.balance[BALANCE];
-        pending = record.balance[PENDING];
+    if (record != nullptr) {
+        balance = record->balance[BALANCE];
+        pending = record->balance[PENDING];
     }
 
     if (bDivisible) {
@@ -1,8 +1,10 @@
 #ifndef TRADELAYER_TALLY_H
 #define TRADELAYER_TALLY_H
 
+#include <prevector.h>
+
+#include <stddef.h>
 #include <stdint.h>
-#include <map>
 
 //! Balance record types
 enum TallyType {
@@ -22,31 +24,80 @@ enum TallyType {
 
 bool isOverflow(int64_t a, int64_t b);
 
+/** Totals of a single property over all tallies.
+ */
+struct CMPTallyTotals
+{
+    //! Sum of each tally type
+    int64_t total[TALLY_TYPE_COUNT];
+    //! Sum of long contract positions
+    int64_t longs;
+    //! Sum of short contract positions, which is negative
+    int64_t shorts;
+    //! Number of addresses holding tokens, available or reserved
+    int64_t owners;
+
+    CMPTallyTotals() : total(), longs(0), shorts(0), owners(0) {}
+
+    /** Returns the number of tokens, available or reserved. */
+    int64_t getSupply() const
+    {
+        return total[BALANCE] + total[SELLOFFER_RESERVE] + total[ACCEPT_RESERVE] + total[METADEX_RESERVE] + total[CONTRACTDEX_RESERVE];
+    }
+
+    bool operator==(const CMPTallyTotals& rhs) const;
+    bool operator!=(const CMPTallyTotals& rhs) const { return !operator==(rhs); }
+};
+
+/** Returns true, if the tally type counts towards the supply of a token. */
+inline bool isSupplyTallyType(TallyType ttype)
+{
+    return ttype == BALANCE || ttype == SELLOFFER_RESERVE || ttype == ACCEPT_RESERVE || ttype == METADEX_RESERVE || ttype == CONTRACTDEX_RESERVE;
+}
+
 /** Balance records of a single entity.
+ *
+ * The records are kept in a flat vector, ordered by property identifier,
+ * and the first one is stored inline, as most entities only hold a single
+ * token. The tally can be iterated without modifying it:
+ *
+ *     for (const CMPTally::BalanceRecord& record : tally) {
+ *         uint32_t propertyId = record.propertyId;
+ *         ...
+ *     }
  */
 class CMPTally
 {
-private:
-    typedef struct {
+public:
+    //! Balances of a single token
+    struct BalanceRecord
+    {
+        uint32_t propertyId;
         int64_t balance[TALLY_TYPE_COUNT];
-    } BalanceRecord;
+    };
+
+private:
+    //! Balance records for different tokens, ordered by property identifier
+    typedef prevector<1, BalanceRecord> TokenVector;
+    TokenVector mp_token;
 
-    //! Map of balance records
-    typedef std::map<uint32_t, BalanceRecord> TokenMap;
-    //! Balance records for different tokens
-    TokenMap mp_token;
-    //! Internal iterator pointing to a balance record
-    TokenMap::iterator my_it;
+    /** Returns the balance record of the token, or nullptr, if there is none. */
+    const BalanceRecord* find(uint32_t propertyId) const;
 
 public:
+    typedef TokenVector::const_iterator const_iterator;
+
     /** Creates an empty tally. */
     CMPTally();
 
-    /** Resets the internal iterator. */
-    uint32_t init();
+    /** Returns an iterator to the first balance record. */
+    const_iterator begin() const { return mp_token.begin(); }
+
+    /** Returns an iterator past the last balance record. */
+    const_iterator end() const { return mp_token.end(); }
 
-    /** Advances the internal iterator. */
-    uint32_t next();
+    /** Returns the number of balance records. */
+    size_t size() const { return mp_token.size(); }
 
     /** Updates the number of tokens for the given tally type. */
     bool updateMoney(uint32_t propertyId, int64_t amount, TallyType ttype);
@@ -57,6 +108,9 @@ public:
     /** Returns the number of available tokens. */
     int64_t getMoneyAvailable(uint32_t propertyId) const;
 
+    /** Returns the number of tokens, available or reserved. */
+    int64_t getMoneySupply(uint32_t propertyId) const;
+
     /** Compares the tally with another tally and returns true, if they are equal. */
     bool operator==(const CMPTally& rhs) const;
 
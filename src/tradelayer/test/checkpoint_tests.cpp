@@ -9,6 +9,7 @@
 #include <tradelayer/tradelayer.h>
 
 #include <arith_uint256.h>
+#include <crypto/sha256.h>
 #include <sync.h>
 #include <uint256.h>
 
@@ -28,6 +29,7 @@ extern std::string kycGenerateConsensusString(const std::vector<std::string>& vs
 extern std::string attGenerateConsensusString(const std::vector<std::string>& vstr);
 extern std::string feeGenerateConsensusString(const uint32_t& propertyId, const int64_t& cache);
 extern std::string GenerateConsensusString(const FeatureActivation& feat);
+extern uint256 GetBalancesHash(const uint32_t hashPropertyId);
 
 }
 
@@ -178,6 +180,47 @@ BOOST_AUTO_TEST_CASE(consensus_activations)
            GenerateConsensusString(feat));
 }
 
+BOOST_AUTO_TEST_CASE(consensus_balances_incremental)
+{
+    const std::string addressA = "1A4ZGPXyJ2rmBvG2u8Rte9KYqgatQJGyd2";
+    const std::string addressB = "3CwZ7FiQ4MqBenRdCkjjc41M5bnoKQGC2b";
+    const uint32_t propertyId = 5;
+
+    LOCK(cs_tally);
+    mp_tally_map.clear();
+    InvalidateConsensusHashCache();
+    InvalidateTallyTotals();
+
+    BOOST_CHECK(update_tally_map(addressB, propertyId, 300, BALANCE));
+    BOOST_CHECK(update_tally_map(addressA, propertyId, 100, BALANCE));
+    uint256 initialHash = GetBalancesHash(propertyId);
+
+    // records are hashed in address order
+    std::string strA = addressA + "|5|100|0|0|0|0|0|0|0|0|0";
+    std::string strB = addressB + "|5|300|0|0|0|0|0|0|0|0|0";
+    uint256 expectedHash;
+    CSHA256().Write((unsigned char*)strA.c_str(), strA.length()).Write((unsigned char*)strB.c_str(), strB.length()).Finalize(expectedHash.begin());
+    BOOST_CHECK_EQUAL(expectedHash, initialHash);
+
+    // changed and emptied records are picked up incrementally
+    BOOST_CHECK(update_tally_map(addressA, propertyId, 50, METADEX_RESERVE));
+    BOOST_CHECK(update_tally_map(addressB, propertyId, -300, BALANCE));
+    uint256 incrementalHash = GetBalancesHash(propertyId);
+    BOOST_CHECK(initialHash != incrementalHash);
+
+    strA = addressA + "|5|100|0|0|50|0|0|0|0|0|0";
+    CSHA256().Write((unsigned char*)strA.c_str(), strA.length()).Finalize(expectedHash.begin());
+    BOOST_CHECK_EQUAL(expectedHash, incrementalHash);
+
+    // a full rebuild yields the same hash
+    InvalidateConsensusHashCache();
+    BOOST_CHECK_EQUAL(incrementalHash, GetBalancesHash(propertyId));
+
+    mp_tally_map.clear();
+    InvalidateConsensusHashCache();
+    InvalidateTallyTotals();
+}
+
 BOOST_AUTO_TEST_CASE(get_checkpoints)
 {
     // There aren't yet consensus checkpoints for mainnet:
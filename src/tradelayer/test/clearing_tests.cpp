@@ -0,0 +1,266 @@
+#include <tradelayer/clearing.h>
+#include <tradelayer/operators_algo_clearing.h>
+#include <tradelayer/tradelayer.h>
+#include <tradelayer/tradelayer_matrices.h>
+
+#include <test/test_bitcoin.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+namespace
+{
+typedef std::map<std::string, std::string> Edge;
+
+/** Outcome of the string based settlement algorithm. */
+struct LegacyResult
+{
+    std::vector<std::vector<Edge> > paths;
+    std::vector<Edge> livesLongs;
+    std::vector<Edge> livesShorts;
+    std::vector<Edge> ghosts;
+    double exitPrice;
+};
+
+Edge MakeEdge(const std::string& addrsSrc, const std::string& statusSrc, int64_t livesSrc,
+        const std::string& addrsTrk, const std::string& statusTrk, int64_t livesTrk, int64_t amount, double price)
+{
+    Edge edge;
+    edge["addrs_src"] = addrsSrc;
+    edge["addrs_trk"] = addrsTrk;
+    edge["status_src"] = statusSrc;
+    edge["status_trk"] = statusTrk;
+    edge["lives_src"] = std::to_string(livesSrc);
+    edge["lives_trk"] = std::to_string(livesTrk);
+    edge["amount_trd"] = std::to_string(amount);
+    edge["matched_price"] = std::to_string(price);
+    edge["edge_row"] = "0";
+    edge["ghost_edge"] = "0";
+    return edge;
+}
+
+/** Runs settlement_algorithm_fifo() the way CallingSettlement() sets it up. */
+LegacyResult SettleLegacy(std::vector<Edge>& trades)
+{
+    LegacyResult result;
+    MatrixTLS ndatabase(trades.size(), n_cols);
+    MatrixTLS M_file(trades.size(), n_cols);
+    fillingMatrix(M_file, ndatabase, trades);
+    pt_ndatabase = &ndatabase;
+    n_rows = size(M_file, 0);
+
+    settlement_algorithm_fifo(M_file, 0, 0, result.paths, result.livesLongs, result.livesShorts, result.ghosts, result.exitPrice);
+    pt_ndatabase = nullptr;
+    return result;
+}
+
+std::string FormatPrice(int64_t price)
+{
+    return std::to_string(ClearingPriceToDouble(price));
+}
+
+void CheckLives(const CClearingGraph& graph, const std::vector<CClearingLives>& lives, std::vector<Edge>& expected)
+{
+    BOOST_REQUIRE_EQUAL(lives.size(), expected.size());
+    for (size_t n = 0; n < lives.size(); ++n) {
+        BOOST_CHECK_EQUAL(graph.GetAddress(lives[n].address), expected[n]["addrs"]);
+        BOOST_CHECK_EQUAL(graph.GetStatus(lives[n].status), expected[n]["status"]);
+        BOOST_CHECK_EQUAL(std::to_string(lives[n].lives), expected[n]["lives"]);
+        BOOST_CHECK_EQUAL(FormatPrice(lives[n].entryPrice), expected[n]["entry_price"]);
+        BOOST_CHECK_EQUAL(std::to_string(lives[n].row), expected[n]["edge_row"]);
+        BOOST_CHECK_EQUAL(std::to_string(lives[n].path), expected[n]["path_number"]);
+    }
+}
+
+/** Settles the trades with both algorithms and compares every part of the outcome. */
+void CheckSettlement(std::vector<Edge>& trades)
+{
+    CClearingGraph graph;
+    for (const Edge& trade : trades) BOOST_REQUIRE(graph.AddTrade(trade));
+
+    CClearingResult result;
+    SettleFifo(graph, result);
+    LegacyResult expected = SettleLegacy(trades);
+
+    BOOST_REQUIRE_EQUAL(result.CountPaths(), expected.paths.size());
+    for (size_t n = 0; n < expected.paths.size(); ++n) {
+        std::vector<Edge>& path = expected.paths[n];
+        BOOST_REQUIRE_EQUAL(result.pathStarts[n + 1] - result.pathStarts[n], path.size());
+
+        for (size_t k = 0; k < path.size(); ++k) {
+            const CClearingEdge& edge = result.edges[result.pathStarts[n] + k];
+            BOOST_CHECK_EQUAL(graph.GetAddress(edge.addressSrc), path[k]["addrs_src"]);
+            BOOST_CHECK_EQUAL(graph.GetAddress(edge.addressTrk), path[k]["addrs_trk"]);
+            BOOST_CHECK_EQUAL(graph.GetStatus(edge.statusSrc), path[k]["status_src"]);
+            BOOST_CHECK_EQUAL(graph.GetStatus(edge.statusTrk), path[k]["status_trk"]);
+            BOOST_CHECK_EQUAL(std::to_string(edge.livesSrc), path[k]["lives_src"]);
+            BOOST_CHECK_EQUAL(std::to_string(edge.livesTrk), path[k]["lives_trk"]);
+            BOOST_CHECK_EQUAL(std::to_string(edge.amount), path[k]["amount_trd_src"]);
+            BOOST_CHECK_EQUAL(FormatPrice(edge.entryPrice), path[k]["entry_price"]);
+            BOOST_CHECK_EQUAL(FormatPrice(edge.exitPrice), path[k]["exit_price"]);
+            BOOST_CHECK_EQUAL(std::to_string(edge.row), path[k]["edge_row"]);
+            BOOST_CHECK_EQUAL(std::to_string(edge.path), path[k]["path_number"]);
+        }
+    }
+
+    CheckLives(graph, result.livesLongs, expected.livesLongs);
+    CheckLives(graph, result.livesShorts, expected.livesShorts);
+
+    BOOST_CHECK_EQUAL(std::to_string(result.exitPrice), std::to_string(expected.exitPrice));
+
+    BOOST_REQUIRE_EQUAL(result.ghosts.size(), expected.ghosts.size());
+    for (size_t n = 0; n < result.ghosts.size(); ++n) {
+        const CClearingGhost& ghost = result.ghosts[n];
+        BOOST_CHECK_EQUAL(graph.GetAddress(ghost.addressLong), expected.ghosts[n]["addrs_src"]);
+        BOOST_CHECK_EQUAL(graph.GetAddress(ghost.addressShort), expected.ghosts[n]["addrs_trk"]);
+        BOOST_CHECK_EQUAL(graph.GetStatus(ghost.statusLong), expected.ghosts[n]["status_src"]);
+        BOOST_CHECK_EQUAL(graph.GetStatus(ghost.statusShort), expected.ghosts[n]["status_trk"]);
+        BOOST_CHECK_EQUAL(FormatPrice(ghost.entryPriceLong), expected.ghosts[n]["entry_price_src"]);
+        BOOST_CHECK_EQUAL(FormatPrice(ghost.entryPriceShort), expected.ghosts[n]["entry_price_trk"]);
+        BOOST_CHECK_EQUAL(std::to_string(ghost.amount), expected.ghosts[n]["amount_trd"]);
+    }
+}
+
+/** Matches random trades between a few addresses, with the statuses the contract DEx records. */
+std::vector<Edge> SimulateTrades(size_t nTrades, size_t nAddresses)
+{
+    std::vector<std::string> addresses;
+    for (size_t n = 0; n < nAddresses; ++n) addresses.push_back("QAddress" + std::to_string(n));
+    std::vector<int64_t> positions(nAddresses, 0);
+
+    std::vector<Edge> trades;
+    while (trades.size() < nTrades) {
+        const size_t maker = InsecureRandRange(nAddresses);
+        const size_t taker = InsecureRandRange(nAddresses);
+        if (maker == taker) continue;
+
+        // the taker buys from the maker, or the other way round
+        const int64_t amount = 1 + InsecureRandRange(10);
+        const int64_t takerDelta = InsecureRandBool() ? amount : -amount;
+        const double price = 100 + InsecureRandRange(100000) / 7000.0;
+
+        std::string statuses[2];
+        const size_t sides[2] = {maker, taker};
+        const int64_t deltas[2] = {-takerDelta, takerDelta};
+        for (int n = 0; n < 2; ++n) {
+            const int64_t before = positions[sides[n]];
+            const int64_t after = before + deltas[n];
+            const std::string dir = (before > 0) ? "Long" : "Short";
+            if (before == 0) {
+                statuses[n] = (after > 0) ? "OpenLongPosition" : "OpenShortPosition";
+            } else if ((before > 0) == (deltas[n] > 0)) {
+                statuses[n] = dir + "PosIncreased";
+            } else if (after == 0) {
+                statuses[n] = dir + "PosNetted";
+            } else if ((after > 0) == (before > 0)) {
+                statuses[n] = dir + "PosNettedPartly";
+            } else {
+                statuses[n] = (after > 0) ? "OpenLongPosByShortPosNetted" : "OpenShortPosByLongPosNetted";
+            }
+            positions[sides[n]] = after;
+        }
+
+        trades.push_back(MakeEdge(addresses[maker], statuses[0], std::abs(positions[maker]),
+                addresses[taker], statuses[1], std::abs(positions[taker]), amount, price));
+    }
+
+    return trades;
+}
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_clearing_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(clearing_prices)
+{
+    int64_t price = 0;
+    BOOST_CHECK(ParseClearingPrice("100.500000", price));
+    BOOST_CHECK_EQUAL(price, 100500000);
+    BOOST_CHECK(ParseClearingPrice("-0.000001", price));
+    BOOST_CHECK_EQUAL(price, -1);
+    BOOST_CHECK(ParseClearingPrice("42", price));
+    BOOST_CHECK_EQUAL(price, 42000000);
+    BOOST_CHECK_EQUAL(ClearingPriceToDouble(97125000), 97.125);
+    BOOST_CHECK_EQUAL(FormatPrice(123456789), std::to_string(123.456789));
+
+    BOOST_CHECK(!ParseClearingPrice("", price));
+    BOOST_CHECK(!ParseClearingPrice(".5", price));
+    BOOST_CHECK(!ParseClearingPrice("1.0000001", price));
+    BOOST_CHECK(!ParseClearingPrice("1e5", price));
+    BOOST_CHECK(!ParseClearingPrice("nan", price));
+    BOOST_CHECK(!ParseClearingPrice("99999999999.000000", price));
+
+    // fields are required
+    Edge edge = MakeEdge("QSrc", "OpenLongPosition", 1, "QTrk", "OpenShortPosition", 1, 1, 1.0);
+    CClearingGraph graph;
+    BOOST_CHECK(graph.AddTrade(edge));
+    edge.erase("matched_price");
+    BOOST_CHECK(!graph.AddTrade(edge));
+    BOOST_CHECK_EQUAL(graph.Size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(clearing_recorded)
+{
+    const std::string A = "QWNbvhNuhuBMrqm4nLe4sCw1Tz5XbrVdDD";
+    const std::string B = "QZ1cVm9NUkHuYwkDNf1bN7wfpkmgxoRsY3";
+    const std::string C = "QeNFWYYNqgwTbShwzEA1fPkyD4ogwkp5aM";
+    const std::string D = "QVFpuGdxG1fmQ7JGb8HqUHjdc1wzeZVhTA";
+
+    std::vector<Edge> trades;
+    trades.push_back(MakeEdge(A, "OpenShortPosition", 10, B, "OpenLongPosition", 10, 10, 100.5));
+    trades.push_back(MakeEdge(C, "OpenShortPosition", 5, B, "LongPosIncreased", 15, 5, 101.0));
+    trades.push_back(MakeEdge(B, "LongPosNettedPartly", 7, D, "OpenLongPosition", 8, 8, 102.25));
+    trades.push_back(MakeEdge(A, "ShortPosIncreased", 14, D, "LongPosIncreased", 12, 4, 99.75));
+    trades.push_back(MakeEdge(D, "LongPosNetted", 0, A, "ShortPosNettedPartly", 2, 12, 98.0));
+    trades.push_back(MakeEdge(B, "LongPosNetted", 0, C, "OpenLongPosByShortPosNetted", 2, 7, 97.5));
+    trades.push_back(MakeEdge(C, "LongPosNetted", 0, A, "ShortPosNetted", 0, 2, 96.125));
+    trades.push_back(MakeEdge(B, "OpenShortPosition", 3, D, "OpenLongPosition", 3, 3, 100.0));
+
+    CheckSettlement(trades);
+
+    CClearingGraph graph;
+    for (const Edge& trade : trades) BOOST_REQUIRE(graph.AddTrade(trade));
+    CClearingResult result;
+    SettleFifo(graph, result);
+
+    BOOST_CHECK_EQUAL(graph.CountAddresses(), 4U);
+    BOOST_CHECK_EQUAL(result.CountPaths(), 5U);
+    BOOST_CHECK_EQUAL(result.edges.size(), 12U);
+    BOOST_CHECK_EQUAL(std::to_string(result.exitPrice), "101.812500");
+
+    // the last open or partial netting of each address is still alive
+    BOOST_REQUIRE_EQUAL(result.livesLongs.size(), 2U);
+    BOOST_REQUIRE_EQUAL(result.livesShorts.size(), 2U);
+    BOOST_CHECK_EQUAL(graph.GetAddress(result.livesLongs[0].address), D);
+    BOOST_CHECK_EQUAL(result.livesLongs[0].lives, 3);
+    BOOST_CHECK_EQUAL(graph.GetAddress(result.livesLongs[1].address), C);
+    BOOST_CHECK_EQUAL(result.livesLongs[1].lives, 2);
+    BOOST_CHECK_EQUAL(graph.GetAddress(result.livesShorts[0].address), A);
+    BOOST_CHECK_EQUAL(result.livesShorts[0].lives, 2);
+    BOOST_CHECK_EQUAL(graph.GetAddress(result.livesShorts[1].address), B);
+    BOOST_CHECK_EQUAL(result.livesShorts[1].lives, 3);
+
+    BOOST_REQUIRE_EQUAL(result.ghosts.size(), 3U);
+    BOOST_CHECK_EQUAL(result.ghosts[0].amount, 1);
+    BOOST_CHECK_EQUAL(result.ghosts[1].amount, 1);
+    BOOST_CHECK_EQUAL(result.ghosts[2].amount, 2);
+}
+
+BOOST_AUTO_TEST_CASE(clearing_simulated)
+{
+    SeedInsecureRand(true);
+    for (int n = 0; n < 20; ++n) {
+        std::vector<Edge> trades = SimulateTrades(20 + InsecureRandRange(200), 2 + InsecureRandRange(8));
+        CheckSettlement(trades);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
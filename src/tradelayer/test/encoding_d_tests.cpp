@@ -7,6 +7,7 @@
 #include <util/strencodings.h>
 
 #include <stdint.h>
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -94,5 +95,60 @@ BOOST_AUTO_TEST_CASE(class_d_with_empty_payload)
     nMaxDatacarrierBytes = nMaxDatacarrierBytesOriginal;
 }
 
+BOOST_AUTO_TEST_CASE(class_d_marker_detection)
+{
+    std::vector<unsigned char> vchMarker = ParseHex("7070");
+    std::vector<unsigned char> vchPayload = ParseHex("70700000000100000002");
+    std::vector<unsigned char> vchLongPayload(100, 0x70);
+
+    // First push starts with the marker
+    BOOST_CHECK(HasDataMarker(CScript() << OP_RETURN << vchPayload, vchMarker));
+    BOOST_CHECK(HasDataMarker(CScript() << OP_RETURN << vchMarker, vchMarker));
+    BOOST_CHECK(HasDataMarker(CScript() << OP_RETURN << vchLongPayload, vchMarker));
+    BOOST_CHECK(HasDataMarker(CScript() << OP_RETURN << OP_1 << vchPayload, vchMarker));
+    BOOST_CHECK(HasDataMarker(CScript() << OP_RETURN << vchPayload << ParseHex("01"), vchMarker));
+
+    // Marker in other places
+    BOOST_CHECK(!HasDataMarker(CScript() << vchPayload, vchMarker));
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_RETURN << ParseHex("01") << vchPayload, vchMarker));
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_RETURN << ParseHex("70"), vchMarker));
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_RETURN << ParseHex("00007070"), vchMarker));
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_DUP << OP_HASH160 << ParseHex("7070707070707070707070707070707070707070") << OP_EQUALVERIFY << OP_CHECKSIG, vchMarker));
+
+    // No data-carrying output
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_RETURN, vchMarker));
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_RETURN << vchPayload << OP_CHECKSIG, vchMarker));
+    BOOST_CHECK(!HasDataMarker(CScript() << OP_RETURN << OP_RETURN << vchPayload, vchMarker));
+
+    // Truncated push
+    std::vector<unsigned char> vchTruncated = ParseHex("6a057070");
+    BOOST_CHECK(!HasDataMarker(CScript(vchTruncated.begin(), vchTruncated.end()), vchMarker));
+}
+
+BOOST_AUTO_TEST_CASE(class_d_marker_detection_random)
+{
+    std::vector<unsigned char> vchMarker = ParseHex("7070");
+
+    // Compare with the marker check based on the decoded pushes
+    for (int i = 0; i < 10000; ++i) {
+        std::vector<unsigned char> vchScript(1 + InsecureRandRange(12));
+        for (size_t n = 0; n < vchScript.size(); ++n) {
+            const unsigned char values[] = {OP_RETURN, OP_1, OP_PUSHDATA1, OP_PUSHDATA2, OP_CHECKSIG, 0x00, 0x01, 0x02, 0x03, 0x70};
+            vchScript[n] = values[InsecureRandRange(sizeof(values))];
+        }
+        if (InsecureRandBool()) vchScript[0] = OP_RETURN;
+        CScript script(vchScript.begin(), vchScript.end());
+
+        bool fExpected = false;
+        txnouttype outType;
+        std::vector<std::string> vstrPushes;
+        if (GetOutputType(script, outType) && outType == TX_NULL_DATA && GetScriptPushes(script, vstrPushes) && !vstrPushes.empty()) {
+            std::vector<unsigned char> vchPushed = ParseHex(vstrPushes.front());
+            fExpected = vchPushed.size() >= vchMarker.size() && std::equal(vchMarker.begin(), vchMarker.end(), vchPushed.begin());
+        }
+
+        BOOST_CHECK_EQUAL(HasDataMarker(script, vchMarker), fExpected);
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,158 @@
+#include <tradelayer/identity.h>
+#include <tradelayer/tradelayer.h>
+
+#include <test/test_bitcoin.h>
+#include <fs.h>
+#include <uint256.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_identity_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(identity_registry)
+{
+    CMPIdentityRegistry registry;
+    int kyc_id = -1;
+    std::string key;
+
+    BOOST_CHECK(!registry.GetRegistration("alice", kyc_id));
+    BOOST_CHECK(!registry.GetAttestation("alice", kyc_id));
+
+    registry.AddRegistration("100+aa", "alice", 1, 100);
+    registry.AddRegistration("100+bb", "bob", 2, 100);
+    registry.AddRegistration("99+cc", "alice", 3, 99);
+    BOOST_CHECK_EQUAL(registry.CountRegistrations(), 3U);
+
+    // the record with the greatest key wins, as in a backwards scan of the database
+    BOOST_CHECK(registry.GetRegistration("alice", kyc_id));
+    BOOST_CHECK_EQUAL(kyc_id, 3);
+    BOOST_CHECK(registry.GetRegistration("bob", kyc_id));
+    BOOST_CHECK_EQUAL(kyc_id, 2);
+
+    registry.AddAttestation("101+dd", "bob", "carol", 0, 101);
+    registry.AddAttestation("102+ee", "alice", "carol", 5, 102);
+    BOOST_CHECK(registry.GetAttestation("carol", kyc_id));
+    BOOST_CHECK_EQUAL(kyc_id, 5);
+    BOOST_CHECK(!registry.GetRegistration("carol", kyc_id));
+
+    BOOST_CHECK(registry.FindAttestation("bob", "carol", key));
+    BOOST_CHECK_EQUAL(key, "101+dd");
+    BOOST_CHECK(!registry.FindAttestation("carol", "bob", key));
+
+    // replacing a record moves it to the new address
+    registry.AddAttestation("102+ee", "alice", "dave", 6, 102);
+    BOOST_CHECK(registry.GetAttestation("carol", kyc_id));
+    BOOST_CHECK_EQUAL(kyc_id, 0);
+    BOOST_CHECK(registry.GetAttestation("dave", kyc_id));
+    BOOST_CHECK_EQUAL(kyc_id, 6);
+    BOOST_CHECK_EQUAL(registry.CountAttestations(), 2U);
+
+    const std::vector<std::string> keys = registry.GetKeysAbove(100);
+    BOOST_CHECK_EQUAL(keys.size(), 2U);
+
+    BOOST_CHECK(registry.Remove("99+cc"));
+    BOOST_CHECK(!registry.Remove("99+cc"));
+    BOOST_CHECK(registry.GetRegistration("alice", kyc_id));
+    BOOST_CHECK_EQUAL(kyc_id, 1);
+
+    registry.Clear();
+    BOOST_CHECK(!registry.GetRegistration("bob", kyc_id));
+    BOOST_CHECK_EQUAL(registry.CountAttestations(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(identity_tradelist)
+{
+    const fs::path path = GetDataDir() / "tl_identity_test";
+    const uint256 txidA = uint256S("1111111111111111111111111111111111111111111111111111111111111111");
+    const uint256 txidB = uint256S("2222222222222222222222222222222222222222222222222222222222222222");
+    const uint256 txidC = uint256S("3333333333333333333333333333333333333333333333333333333333333333");
+    int kyc_id = -1;
+
+    {
+        CMPTradeList tradelist(path, true);
+        tradelist.recordNewIdRegister(txidA, "alice", "Alice", "alice.org", 100, 1);
+        tradelist.recordNewIdRegister(txidB, "bob", "Bob", "bob.org", 101, 1);
+        tradelist.recordNewAttestation(txidC, "alice", "carol", 102, 1, 0);
+
+        BOOST_CHECK(tradelist.checkKYCRegister("alice", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 1);
+        BOOST_CHECK(tradelist.checkKYCRegister("bob", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 2);
+        BOOST_CHECK(tradelist.checkAttestationReg("carol", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 0);
+        BOOST_CHECK_EQUAL(tradelist.getNextId(), 3);
+    }
+
+    // the registry is rebuilt from the database
+    {
+        CMPTradeList tradelist(path, false);
+        BOOST_CHECK(tradelist.checkKYCRegister("bob", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 2);
+        BOOST_CHECK(tradelist.checkAttestationReg("carol", kyc_id));
+
+        BOOST_CHECK(!tradelist.deleteAttestationReg("bob", "carol"));
+        BOOST_CHECK(tradelist.deleteAttestationReg("alice", "carol"));
+        BOOST_CHECK(!tradelist.checkAttestationReg("carol", kyc_id));
+
+        // registrations of orphaned blocks are removed
+        BOOST_CHECK_EQUAL(tradelist.rollBackIdentities(100), 1);
+        BOOST_CHECK(!tradelist.checkKYCRegister("bob", kyc_id));
+        BOOST_CHECK_EQUAL(tradelist.getNextId(), 2);
+    }
+
+    {
+        CMPTradeList tradelist(path, false);
+        BOOST_CHECK(tradelist.checkKYCRegister("alice", kyc_id));
+        BOOST_CHECK(!tradelist.checkKYCRegister("bob", kyc_id));
+        BOOST_CHECK(!tradelist.checkAttestationReg("carol", kyc_id));
+
+        tradelist.Clear();
+        BOOST_CHECK(!tradelist.checkKYCRegister("alice", kyc_id));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(identity_rescan)
+{
+    const fs::path path = GetDataDir() / "tl_identity_rescan_test";
+    const uint256 txidA = uint256S("1111111111111111111111111111111111111111111111111111111111111111");
+    const uint256 txidB = uint256S("2222222222222222222222222222222222222222222222222222222222222222");
+    const uint256 txidC = uint256S("3333333333333333333333333333333333333333333333333333333333333333");
+    int kyc_id = -1;
+
+    {
+        CMPTradeList tradelist(path, true);
+        tradelist.recordNewIdRegister(txidA, "alice", "Alice", "alice.org", 100, 1);
+        tradelist.recordNewIdRegister(txidB, "bob", "Bob", "bob.org", 101, 1);
+        tradelist.recordNewIdRegister(txidC, "carol", "Carol", "carol.org", 102, 1);
+    }
+
+    // a restart scans blocks 101 and later again, which register the same identities
+    {
+        CMPTradeList tradelist(path, false);
+        BOOST_CHECK_EQUAL(tradelist.rollBackIdentities(100), 2);
+        tradelist.recordNewIdRegister(txidB, "bob", "Bob", "bob.org", 101, 1);
+        tradelist.recordNewIdRegister(txidC, "carol", "Carol", "carol.org", 102, 1);
+
+        BOOST_CHECK(tradelist.checkKYCRegister("alice", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 1);
+        BOOST_CHECK(tradelist.checkKYCRegister("bob", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 2);
+        BOOST_CHECK(tradelist.checkKYCRegister("carol", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 3);
+        BOOST_CHECK_EQUAL(tradelist.getNextId(), 4);
+    }
+
+    {
+        CMPTradeList tradelist(path, false);
+        BOOST_CHECK(tradelist.checkKYCRegister("carol", kyc_id));
+        BOOST_CHECK_EQUAL(kyc_id, 3);
+        tradelist.Clear();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+#include <tradelayer/inputcache.h>
+
+#include <primitives/transaction.h>
+#include <test/test_bitcoin.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_inputcache_tests, BasicTestingSetup)
+
+static COutPoint MakeOutPoint(uint32_t n)
+{
+    return COutPoint(uint256S("0x1234"), n);
+}
+
+static CTxOut MakeTxOut(int64_t nValue)
+{
+    return CTxOut(nValue, CScript());
+}
+
+BOOST_AUTO_TEST_CASE(input_cache_lru)
+{
+    CInputCache cache(3);
+    CTxOut txOut;
+
+    BOOST_CHECK(!cache.Get(MakeOutPoint(0), txOut));
+
+    cache.Add(MakeOutPoint(0), MakeTxOut(100));
+    cache.Add(MakeOutPoint(1), MakeTxOut(101));
+    cache.Add(MakeOutPoint(2), MakeTxOut(102));
+
+    // mark the first output as recently used
+    BOOST_CHECK(cache.Get(MakeOutPoint(0), txOut));
+    BOOST_CHECK_EQUAL(txOut.nValue, 100);
+
+    // only the least recently used output is dropped
+    cache.Add(MakeOutPoint(3), MakeTxOut(103));
+    BOOST_CHECK(!cache.Get(MakeOutPoint(1), txOut));
+    BOOST_CHECK(cache.Get(MakeOutPoint(0), txOut));
+    BOOST_CHECK(cache.Get(MakeOutPoint(2), txOut));
+    BOOST_CHECK(cache.Get(MakeOutPoint(3), txOut));
+    BOOST_CHECK_EQUAL(txOut.nValue, 103);
+
+    // adding a cached output again doesn't replace it
+    cache.Add(MakeOutPoint(3), MakeTxOut(200));
+    BOOST_CHECK(cache.Get(MakeOutPoint(3), txOut));
+    BOOST_CHECK_EQUAL(txOut.nValue, 103);
+
+    CInputCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 5U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 1U);
+    BOOST_CHECK_EQUAL(stats.nEntries, 3U);
+
+    // shrinking drops the least recently used outputs
+    cache.SetMaxEntries(1);
+    BOOST_CHECK(cache.Get(MakeOutPoint(3), txOut));
+    BOOST_CHECK(!cache.Get(MakeOutPoint(0), txOut));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEvictions, 3U);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    BOOST_CHECK(!cache.Get(MakeOutPoint(3), txOut));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,17 +4,19 @@
 #include <tradelayer/uint256_extensions.h>
 #include <test/test_bitcoin.h>
 #include <boost/test/unit_test.hpp>
+#include <iterator>
+#include <limits>
 #include <stdint.h>
 
 using namespace mastercore;
 
 BOOST_FIXTURE_TEST_SUITE(tradelayer_mdex_functions_tests, BasicTestingSetup)
 
-void literVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const std::map<int, std::map<uint32_t,int64_t>>& aMap)
+void literVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const CMPVolumeHistory& volumes)
 {
     // BOOST_TEST_MESSAGE("iter, fblock:" << fblock);
     // BOOST_TEST_MESSAGE("iter, sblock:" << sblock);
-    for(const auto &m : aMap)
+    for(const auto &m : volumes.GetBlocks())
     {
         const int& blk = m.first;
         // BOOST_TEST_MESSAGE("iter, block (after):" << blk);
@@ -104,7 +106,7 @@ int64_t lincreaseLTCVolume(uint32_t propertyId, uint32_t propertyDesired, int aB
         // BOOST_TEST_MESSAGE("total:" << total);
 
         // increment cumulative LTC volume by tokens traded * the 12-block VWAP
-        MapLTCVolume[aBlock][propertyDesired] += total;
+        MapLTCVolume.Add(aBlock, propertyDesired, total);
 
     }
 
@@ -126,17 +128,17 @@ BOOST_AUTO_TEST_CASE(getvwap_function)
     tokenvwap[propertyId][aBlock - 4].push_back(std::make_pair(2000 * COIN, 1900 * COIN));
 
     // adding some volume
-    MapLTCVolume[aBlock - 1][propertyId] += 2000 * COIN;
-    MapLTCVolume[aBlock - 2][propertyId] += 1000 * COIN;
-    MapLTCVolume[aBlock - 3][propertyId] += 3000 * COIN;
-    MapLTCVolume[aBlock - 4][propertyId] += 4000 * COIN;
+    MapLTCVolume.Add(aBlock - 1, propertyId, 2000 * COIN);
+    MapLTCVolume.Add(aBlock - 2, propertyId, 1000 * COIN);
+    MapLTCVolume.Add(aBlock - 3, propertyId, 3000 * COIN);
+    MapLTCVolume.Add(aBlock - 4, propertyId, 4000 * COIN);
 
     // checking vwap:   17000000 / 10000 = 1700
     BOOST_CHECK_EQUAL(1700 * COIN, lgetVWap(propertyId, aBlock, tokenvwap));
 
     // cleaning maps
     tokenvwap.clear();
-    MapLTCVolume.clear();
+    MapLTCVolume.Clear();
 }
 
 BOOST_AUTO_TEST_CASE(increase_ltc_volume_function)
@@ -155,8 +157,8 @@ BOOST_AUTO_TEST_CASE(increase_ltc_volume_function)
 
 
     // adding some volume
-    MapLTCVolume[aBlock - 10][propertyId] = 2000 * COIN;
-    MapLTCVolume[aBlock - 10][propertyDesired] = 2000 * COIN;
+    MapLTCVolume.Set(aBlock - 10, propertyId, 2000 * COIN);
+    MapLTCVolume.Set(aBlock - 10, propertyDesired, 2000 * COIN);
 
 
     // 12-vwap * amountdesired = 3000 * 2000 = 6000000
@@ -167,4 +169,181 @@ BOOST_AUTO_TEST_CASE(increase_ltc_volume_function)
 
 
 
+BOOST_AUTO_TEST_CASE(orderbook_pairs)
+{
+    metadex.clear();
+    metadex_index.Clear();
+
+    const std::string address = "1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH";
+
+    // property for sale, amount for sale, property desired, amount desired
+    CMPMetaDEx order1(address, 200, 1, 1000, 2, 2000, uint256S("11"), 1, 1);
+    CMPMetaDEx order2(address, 200, 1, 1000, 2, 3000, uint256S("12"), 2, 1);
+    CMPMetaDEx order3(address, 200, 1, 1000, 3, 2000, uint256S("13"), 3, 1);
+    CMPMetaDEx order4(address, 200, 2, 1000, 1, 2000, uint256S("14"), 4, 1);
+
+    BOOST_CHECK(MetaDEx_INSERT(order1));
+    BOOST_CHECK(MetaDEx_INSERT(order2));
+    BOOST_CHECK(MetaDEx_INSERT(order3));
+    BOOST_CHECK(MetaDEx_INSERT(order4));
+    BOOST_CHECK(!MetaDEx_INSERT(order1));
+
+    // one book per pair, with one level per price
+    BOOST_CHECK_EQUAL(3, metadex.size());
+    BOOST_CHECK_EQUAL(2, get_Prices(1, 2)->size());
+    BOOST_CHECK_EQUAL(1, get_Prices(1, 3)->size());
+    BOOST_CHECK(get_Prices(2, 3) == nullptr);
+
+    std::pair<md_PropertiesMap::iterator, md_PropertiesMap::iterator> pairs = get_PairsRange(1);
+    BOOST_CHECK_EQUAL(2, std::distance(pairs.first, pairs.second));
+    BOOST_CHECK(pairs.first->first == md_PairKey(1, 2));
+
+    // the best price comes first
+    BOOST_CHECK(get_Prices(1, 2)->begin()->first == order1.unitPrice());
+
+    // emptied levels and books are dropped
+    BOOST_CHECK(MetaDEx_ERASE(order1));
+    BOOST_CHECK(!MetaDEx_ERASE(order1));
+    BOOST_CHECK_EQUAL(1, get_Prices(1, 2)->size());
+    BOOST_CHECK(MetaDEx_ERASE(order3));
+    BOOST_CHECK(get_Prices(1, 3) == nullptr);
+
+    pairs = get_PairsRange(1);
+    BOOST_CHECK_EQUAL(1, std::distance(pairs.first, pairs.second));
+
+    metadex.clear();
+    metadex_index.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(orderbook_indexes)
+{
+    metadex.clear();
+    metadex_index.Clear();
+    contractdex.clear();
+    contractdex_index.Clear();
+
+    const std::string alice = "1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH";
+    const std::string bob = "1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXy";
+
+    CMPMetaDEx order1(alice, 200, 1, 1000, 2, 2000, uint256S("11"), 1, 1);
+    CMPMetaDEx order2(alice, 201, 1, 1000, 2, 3000, uint256S("12"), 1, 1);
+    CMPMetaDEx order3(alice, 201, 3, 1000, 2, 3000, uint256S("13"), 2, 1);
+    CMPMetaDEx order4(bob, 201, 1, 1000, 2, 2000, uint256S("14"), 3, 1);
+
+    BOOST_CHECK(MetaDEx_INSERT(order1));
+    BOOST_CHECK(MetaDEx_INSERT(order2));
+    BOOST_CHECK(MetaDEx_INSERT(order3));
+    BOOST_CHECK(MetaDEx_INSERT(order4));
+    BOOST_CHECK_EQUAL(4, metadex_index.Size());
+
+    const CMPMetaDEx* found = MetaDEx_RetrieveTrade(uint256S("12"));
+    BOOST_CHECK(found != nullptr && found->getHash() == order2.getHash());
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("15")) == nullptr);
+
+    // positions of an address are in the order of the book
+    BOOST_CHECK_EQUAL(2, metadex_index.Get(alice, 1).size());
+    BOOST_CHECK_EQUAL(3, metadex_index.GetAll(alice).size());
+    BOOST_CHECK(metadex_index.GetAll(alice).begin()->block == 200);
+    BOOST_CHECK_EQUAL(1, metadex_index.GetAll(bob).size());
+
+    // consensus strings are sorted by the numeric value of the txid
+    CMPMetaDEx order5(bob, 202, 1, 1000, 2, 2000, uint256S("0100"), 1, 1);
+    BOOST_CHECK(MetaDEx_INSERT(order5));
+    const COrderIndex<md_Position>::ConsensusStrings& strings = metadex_index.GetConsensusStrings();
+    BOOST_CHECK_EQUAL(5, strings.size());
+    BOOST_CHECK_EQUAL(strings.begin()->second, order1.GenerateConsensusString());
+    BOOST_CHECK_EQUAL(strings.rbegin()->second, order5.GenerateConsensusString());
+    BOOST_CHECK(MetaDEx_ERASE(order5));
+
+    BOOST_CHECK(MetaDEx_ERASE(order2));
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("12")) == nullptr);
+    BOOST_CHECK_EQUAL(1, metadex_index.Get(alice, 1).size());
+    BOOST_CHECK_EQUAL(3, metadex_index.Size());
+    BOOST_CHECK_EQUAL(3, strings.size());
+    BOOST_CHECK_EQUAL(std::next(strings.begin())->second, order3.GenerateConsensusString());
+
+    // contract orders: address, block, contract, amount, -, -, txid, index, subaction, remaining, price, action, reserved
+    CMPContractDex cdex1(alice, 200, 5, 10, 0, 0, uint256S("21"), 1, 1, 0, 100, 1, 0);
+    CMPContractDex cdex2(alice, 200, 6, 10, 0, 0, uint256S("22"), 2, 1, 0, 100, 2, 0);
+
+    BOOST_CHECK(!ContractDex_CHECK_ORDERS(alice, 5));
+    BOOST_CHECK(ContractDex_INSERT(cdex1));
+    BOOST_CHECK(ContractDex_INSERT(cdex2));
+    BOOST_CHECK(ContractDex_CHECK_ORDERS(alice, 5));
+    BOOST_CHECK(!ContractDex_CHECK_ORDERS(bob, 5));
+
+    const CMPContractDex* cfound = ContractDex_RetrieveTrade(uint256S("22"));
+    BOOST_CHECK(cfound != nullptr && cfound->getProperty() == 6);
+
+    BOOST_CHECK(ContractDex_ERASE(cdex1));
+    BOOST_CHECK(!ContractDex_CHECK_ORDERS(alice, 5));
+    BOOST_CHECK(ContractDex_RetrieveTrade(uint256S("21")) == nullptr);
+    BOOST_CHECK_EQUAL(1, contractdex_index.Size());
+    BOOST_CHECK_EQUAL(1, contractdex_index.GetConsensusStrings().size());
+    BOOST_CHECK_EQUAL(contractdex_index.GetConsensusStrings().begin()->second, cdex2.GenerateConsensusString());
+
+    metadex.clear();
+    metadex_index.Clear();
+    contractdex.clear();
+    contractdex_index.Clear();
+}
+
+//! Returns an amount of random bit length and sign, including the edge cases
+static int64_t RandomPriceAmount()
+{
+    static const int64_t edges[] = {0, 1, -1, 2, 3, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max() - 1};
+    if (InsecureRandRange(8) == 0) return edges[InsecureRandRange(sizeof(edges) / sizeof(edges[0]))];
+
+    const int64_t n = static_cast<int64_t>(InsecureRandBits(1 + InsecureRandRange(63)));
+    return InsecureRandBool() ? -n : n;
+}
+
+static CMPPrice RandomPrice(rational_t& rat)
+{
+    int64_t num = RandomPriceAmount();
+    int64_t den = RandomPriceAmount();
+    if (den == 0) den = 1;
+    // small factors make equal prices of different amounts likely
+    if (InsecureRandBool()) {
+        const int64_t factor = 1 + InsecureRandRange(4);
+        if (num / factor != 0 && den / factor != 0) {
+            num = (num / factor) * factor;
+            den = (den / factor) * factor;
+        }
+    }
+    rat = rational_t(num, den);
+    return CMPPrice(num, den);
+}
+
+BOOST_AUTO_TEST_CASE(price_ordering)
+{
+    for (int i = 0; i < 100000; ++i) {
+        rational_t rat1, rat2;
+        const CMPPrice price1 = RandomPrice(rat1);
+        const CMPPrice price2 = (i % 4 == 0) ? CMPPrice(price1) : RandomPrice(rat2);
+        if (i % 4 == 0) rat2 = rat1;
+
+        BOOST_CHECK(price1.ToRational() == rat1);
+        BOOST_CHECK_EQUAL(price1 < price2, rat1 < rat2);
+        BOOST_CHECK_EQUAL(price2 < price1, rat2 < rat1);
+        BOOST_CHECK_EQUAL(price1 == price2, rat1 == rat2);
+        BOOST_CHECK_EQUAL(price1 <= price2, rat1 <= rat2);
+        BOOST_CHECK_EQUAL(price1.isZero(), rat1 == 0);
+    }
+
+    // equal prices of different amounts share a level
+    BOOST_CHECK(CMPPrice(2000, 1000) == CMPPrice(2, 1));
+    BOOST_CHECK(CMPPrice(-4, -6) == CMPPrice(2, 3));
+    BOOST_CHECK(CMPPrice(0, 5) == CMPPrice());
+    BOOST_CHECK(CMPPrice(1, std::numeric_limits<int64_t>::max()) < CMPPrice(1, std::numeric_limits<int64_t>::max() - 1));
+    BOOST_CHECK(CMPPrice(std::numeric_limits<int64_t>::min(), 1) < CMPPrice(-std::numeric_limits<int64_t>::max(), 1));
+
+    // the cached prices of orders
+    CMPMetaDEx order("1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH", 200, 1, 3000, 2, 2000, uint256S("11"), 1, 1);
+    BOOST_CHECK(order.unitPrice().ToRational() == rational_t(2, 3));
+    BOOST_CHECK(order.inversePrice().ToRational() == rational_t(3, 2));
+    order.setAmountForsale(0);
+    BOOST_CHECK(order.unitPrice().isZero());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
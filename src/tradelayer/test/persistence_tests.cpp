@@ -1,10 +1,17 @@
 #include <test/test_bitcoin.h>
 #include <tradelayer/dex.h>
 #include <tradelayer/mdex.h>
+#include <tradelayer/persistence.h>
+#include <tradelayer/sp.h>
 #include <tradelayer/tally.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/tx.h>
 
+#include <chain.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <util/time.h>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
 #include <stdint.h>
@@ -75,10 +82,9 @@ static int write_msc_balances(std::string& lineOut)
     {
         lineOut = (*iter).first;
         lineOut.append("=");
-        CMPTally& curAddr = (*iter).second;
-        curAddr.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = curAddr.next())) {
+        const CMPTally& curAddr = (*iter).second;
+        for (const CMPTally::BalanceRecord& record : curAddr) {
+            const uint32_t propertyId = record.propertyId;
             const int64_t balance = (*iter).second.getMoney(propertyId, BALANCE);
             const int64_t sellReserved = (*iter).second.getMoney(propertyId, SELLOFFER_RESERVE);
             const int64_t acceptReserved = (*iter).second.getMoney(propertyId, ACCEPT_RESERVE);
@@ -204,15 +210,7 @@ static void savingLine(std::string& lineOut, const std::string& chnAddr, const w
 
 static int write_mp_withdrawals(std::string& lineOut)
 {
-    for (const auto w : withdrawal_Map)
-    {
-        // decompose the key
-        const std::string& chnAddr = w.first;
-        const vector<withdrawalAccepted>& whd = w.second;
-
-        for_each(whd.begin(), whd.end(), [&lineOut, &chnAddr] (const withdrawalAccepted&  w) { savingLine(lineOut, chnAddr, w);});
-
-    }
+    withdrawalSchedule.ForEach([&lineOut] (const std::string& chnAddr, const withdrawalAccepted& w) { savingLine(lineOut, chnAddr, w);});
 
     return 0;
 }
@@ -231,20 +229,7 @@ int input_withdrawals_string(const std::string& s)
     w.amount = boost::lexical_cast<int64_t>(vstr[4]);
     w.txid = uint256S(vstr[5]);
 
-    auto it = withdrawal_Map.find(chnAddr);
-
-    // channel found !
-    if(it != withdrawal_Map.end())
-    {
-        vector<withdrawalAccepted>& whAc = it->second;
-        whAc.push_back(w);
-        return 0;
-    }
-
-    // if there's no channel yet
-    vector<withdrawalAccepted> whAcc;
-    whAcc.push_back(w);
-    if(!withdrawal_Map.insert(std::make_pair(chnAddr,whAcc)).second) return -1;
+    withdrawalSchedule.Add(chnAddr, w);
 
     return 0;
 
@@ -608,10 +593,7 @@ BOOST_AUTO_TEST_CASE(withdrawals_persistence)
     w.amount = 600000;
     w.txid = uint256S("749eecf591d04339f63b4514130051a1cd552e3ab9671e857839807109899f35");
 
-    vector<withdrawalAccepted> whAcc;
-    whAcc.push_back(w);
-
-    withdrawal_Map.insert(std::make_pair(chnAddr, whAcc));
+    withdrawalSchedule.Add(chnAddr, w);
 
     std::string lineOut;
 
@@ -621,24 +603,23 @@ BOOST_AUTO_TEST_CASE(withdrawals_persistence)
     BOOST_CHECK_EQUAL("Qdj12J6FZgaY34ZNx12pVpTeF9NQdmpGzj,muY24px8kWVHUDc8NmBRjL6UWGbjz8wW5r,150000,3,600000,749eecf591d04339f63b4514130051a1cd552e3ab9671e857839807109899f35", lineOut);
 
     // writting on memory
+    withdrawalSchedule.Clear();
     input_withdrawals_string(lineOut);
 
     withdrawalAccepted w1;
-    auto it = withdrawal_Map.find("Qdj12J6FZgaY34ZNx12pVpTeF9NQdmpGzj");
-    if (it != withdrawal_Map.end()){
-        const auto &whd = it->second;
-        const std::string sAddress = "muY24px8kWVHUDc8NmBRjL6UWGbjz8wW5r";
-        auto itt = find_if(whd.begin(), whd.end(), [&sAddress] (const withdrawalAccepted& w) { return (w.address == sAddress);});
-        if (itt != whd.end()){
-            w1 = *itt;
-        }
-    }
+    const std::string sAddress = "muY24px8kWVHUDc8NmBRjL6UWGbjz8wW5r";
+    withdrawalSchedule.ForEach([&w1, &sAddress] (const std::string& chnAddr, const withdrawalAccepted& w) {
+        if (chnAddr == "Qdj12J6FZgaY34ZNx12pVpTeF9NQdmpGzj" && w.address == sAddress) w1 = w;
+    });
 
     BOOST_CHECK_EQUAL("muY24px8kWVHUDc8NmBRjL6UWGbjz8wW5r", w1.address);
     BOOST_CHECK_EQUAL(150000, w1.deadline_block);
     BOOST_CHECK_EQUAL(3, w1.propertyId);
     BOOST_CHECK_EQUAL(600000, w1.amount);
     BOOST_CHECK_EQUAL("749eecf591d04339f63b4514130051a1cd552e3ab9671e857839807109899f35", (w1.txid).ToString());
+    BOOST_CHECK_EQUAL(withdrawalSchedule.Size(), 1U);
+
+    withdrawalSchedule.Clear();
 }
 
 BOOST_AUTO_TEST_CASE(cdex_persistence)
@@ -734,7 +715,7 @@ BOOST_AUTO_TEST_CASE(mdex_persistence)
     input_mp_mdexorder_string(lineOut);
 
     CMPMetaDEx seller1;
-    md_PricesMap* prices = get_Prices(1);
+    md_PricesMap* prices = get_Prices(1, 2);
     for (auto my_it = prices->begin(); my_it != prices->end(); ++my_it)
     {
         md_Set* indexes = &(my_it->second);
@@ -799,4 +780,262 @@ BOOST_AUTO_TEST_CASE(tokenvwap_persistence)
 
 }
 
+BOOST_AUTO_TEST_CASE(snapshot_persistence)
+{
+    LOCK(cs_tally);
+
+    const fs::path pathTemp = fs::temp_directory_path() / strprintf("test_tlsnapshot_%lu", (unsigned long)GetTime());
+    fs::create_directories(pathTemp);
+
+    // the globals section needs the smart property database
+    CMPSPInfo spInfo(pathTemp / "spinfo", true);
+    CMPSPInfo* prevSPs = _my_sps;
+    _my_sps = &spInfo;
+
+    const std::string address = "QN4WpQJ5LbxhW2YUrDZ1usm7pmTEEZuYEu";
+    const uint32_t propertyId = 3;
+
+    mp_tally_map.clear();
+    update_tally_map(address, propertyId, 1000 * COIN, BALANCE);
+    update_tally_map(address, propertyId, -50, CONTRACT_BALANCE);
+    cachefees[propertyId] = 77;
+    vestingAddresses.push_back(address);
+    tradeEdges.AddTrade(1234, "QSeller", "OpenShortPosition", 5, address, "OpenLongPosition", 5, 5, -250);
+    metavolume.Add(1000, propertyId, 40);
+    metavolume.Add(1100, propertyId, 2);
+    metavolume.Compact(1050);
+
+    uint256 blockHash = uint256S("00000000000000000000000000000000000000000000000000000000000004d2");
+    CBlockIndex index;
+    index.phashBlock = &blockHash;
+    index.nHeight = 1234;
+
+    CDataStream ssSnapshot(SER_DISK, CLIENT_VERSION);
+    SerializeStateSnapshot(ssSnapshot, &index);
+
+    const fs::path path = pathTemp / "snapshot-test.dat";
+    BOOST_CHECK(WriteStateSnapshot(path, ssSnapshot));
+
+    mp_tally_map.clear();
+    cachefees.clear();
+    vestingAddresses.clear();
+    tradeEdges.Clear();
+    metavolume.Clear();
+
+    BOOST_CHECK_EQUAL(0, LoadStateSnapshot(path, &index));
+    BOOST_CHECK_EQUAL(1050, metavolume.GetCheckpoint());
+    BOOST_CHECK_EQUAL(42, metavolume.Sum(propertyId, 0, 1100));
+    BOOST_CHECK_EQUAL(1000 * COIN, getMPbalance(address, propertyId, BALANCE));
+    BOOST_CHECK_EQUAL(-50, getMPbalance(address, propertyId, CONTRACT_BALANCE));
+    BOOST_CHECK_EQUAL(77, cachefees[propertyId]);
+    BOOST_CHECK_EQUAL(1, vestingAddresses.size());
+    BOOST_CHECK_EQUAL(1U, tradeEdges.Size());
+    const std::map<int, CClearingGraph>& segments = tradeEdges.GetSegments();
+    BOOST_CHECK_EQUAL(1U, segments.size());
+    BOOST_CHECK_EQUAL(tradeEdges.GetPeriod(1234), segments.begin()->first);
+    const CClearingTrade& trade = segments.begin()->second.GetTrades()[0];
+    BOOST_CHECK_EQUAL(address, segments.begin()->second.GetAddress(trade.address[1]));
+    BOOST_CHECK_EQUAL(-250, trade.price);
+
+    // a snapshot of another block is rejected
+    uint256 otherHash = uint256S("00000000000000000000000000000000000000000000000000000000000004d3");
+    CBlockIndex otherIndex;
+    otherIndex.phashBlock = &otherHash;
+    otherIndex.nHeight = 1234;
+    BOOST_CHECK_EQUAL(-1, LoadStateSnapshot(path, &otherIndex));
+
+    // so is a corrupted one
+    FILE* file = fsbridge::fopen(path, "r+b");
+    BOOST_CHECK(file != nullptr);
+    fseek(file, 50, SEEK_SET);
+    fputc(0xff, file);
+    fclose(file);
+    BOOST_CHECK_EQUAL(-1, LoadStateSnapshot(path, &index));
+
+    ResetStateDelta();
+    _my_sps = prevSPs;
+    mp_tally_map.clear();
+    cachefees.clear();
+    vestingAddresses.clear();
+    tradeEdges.Clear();
+    metavolume.Clear();
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(delta_persistence)
+{
+    LOCK(cs_tally);
+
+    const fs::path pathTemp = fs::temp_directory_path() / strprintf("test_tldelta_%lu", (unsigned long)GetTime());
+    fs::create_directories(pathTemp);
+
+    CMPSPInfo spInfo(pathTemp / "spinfo", true);
+    CMPSPInfo* prevSPs = _my_sps;
+    _my_sps = &spInfo;
+
+    const std::string address1 = "QN4WpQJ5LbxhW2YUrDZ1usm7pmTEEZuYEu";
+    const std::string address2 = "QgKxFUBgR8y4xFy3s9ybpbDvYNKr4HTKPb";
+
+    uint256 hashes[3] = {uint256S("01"), uint256S("02"), uint256S("03")};
+    CBlockIndex blocks[3];
+    for (int i = 0; i < 3; ++i) {
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].nHeight = i;
+        blocks[i].pprev = (i > 0) ? &blocks[i-1] : nullptr;
+        blocks[i].BuildSkip();
+    }
+
+    mp_tally_map.clear();
+    ResetStateDelta();
+    update_tally_map(address1, 3, 1000, BALANCE);
+
+    // the first one is always a full snapshot
+    CDataStream ss0(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(!SerializeStateDelta(ss0, &blocks[0]));
+    SerializeStateSnapshot(ss0, &blocks[0]);
+    BOOST_CHECK(WriteStateSnapshot(GetStateSnapshotPath(pathTemp, hashes[0], false), ss0));
+
+    update_tally_map(address1, 3, -400, BALANCE);
+    CDataStream ss1(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(SerializeStateDelta(ss1, &blocks[1]));
+    BOOST_CHECK(WriteStateSnapshot(GetStateSnapshotPath(pathTemp, hashes[1], true), ss1));
+
+    update_tally_map(address2, 4, 25, BALANCE);
+    cachefees[4] = 5;
+    NotifyStateSectionChanged(FILETYPE_CACHEFEES);
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(SerializeStateDelta(ss2, &blocks[2]));
+    BOOST_CHECK(WriteStateSnapshot(GetStateSnapshotPath(pathTemp, hashes[2], true), ss2));
+
+    // a delta only holds the changes
+    BOOST_CHECK(ss2.size() < ss0.size());
+
+    mp_tally_map.clear();
+    cachefees.clear();
+
+    BOOST_CHECK_EQUAL(0, LoadStateDeltas(pathTemp, &blocks[2]));
+    BOOST_CHECK_EQUAL(600, getMPbalance(address1, 3, BALANCE));
+    BOOST_CHECK_EQUAL(25, getMPbalance(address2, 4, BALANCE));
+    BOOST_CHECK_EQUAL(5, cachefees[4]);
+
+    // both the delta and the full snapshot are needed for the last block
+    std::set<uint256> bases;
+    GetStateDeltaBases(pathTemp, &blocks[2], bases);
+    BOOST_CHECK_EQUAL(2, bases.size());
+
+    // without its base, the chain can't be loaded
+    fs::remove(GetStateSnapshotPath(pathTemp, hashes[1], true));
+    BOOST_CHECK_EQUAL(-1, LoadStateDeltas(pathTemp, &blocks[2]));
+
+    // the bases of the deltas written are still known, without reading the files
+    bases.clear();
+    GetStateDeltaBases(pathTemp, &blocks[2], bases);
+    BOOST_CHECK_EQUAL(2, bases.size());
+
+    // until the files are pruned
+    ForgetStateDeltaBase(hashes[1]);
+    bases.clear();
+    GetStateDeltaBases(pathTemp, &blocks[2], bases);
+    BOOST_CHECK_EQUAL(1, bases.size());
+    BOOST_CHECK(bases.count(hashes[1]));
+    ForgetStateDeltaBase(hashes[2]);
+
+    ResetStateDelta();
+    _my_sps = prevSPs;
+    mp_tally_map.clear();
+    cachefees.clear();
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(delta_orders_persistence)
+{
+    LOCK(cs_tally);
+
+    const fs::path pathTemp = fs::temp_directory_path() / strprintf("test_tldeltaorders_%lu", (unsigned long)GetTime());
+    fs::create_directories(pathTemp);
+
+    CMPSPInfo spInfo(pathTemp / "spinfo", true);
+    CMPSPInfo* prevSPs = _my_sps;
+    _my_sps = &spInfo;
+
+    const std::string address = "QN4WpQJ5LbxhW2YUrDZ1usm7pmTEEZuYEu";
+    const CMPMetaDEx orderA(address, 100, 1, 1000, 2, 2000, uint256S("0a"), 1, CMPTransaction::ADD);
+    const CMPMetaDEx orderB(address, 100, 1, 500, 2, 2000, uint256S("0b"), 2, CMPTransaction::ADD);
+    const CMPMetaDEx orderA2(address, 100, 1, 1000, 2, 2000, uint256S("0a"), 1, CMPTransaction::ADD, 600);
+    const CMPMetaDEx orderC(address, 101, 2, 300, 1, 100, uint256S("0c"), 1, CMPTransaction::ADD);
+    const CMPMetaDEx orderD(address, 102, 1, 10, 2, 10, uint256S("0d"), 1, CMPTransaction::ADD);
+    const CMPContractDex orderE(address, 101, 5, 10, 0, 0, uint256S("0e"), 2, 1, 10, 5000, 1, 0);
+
+    uint256 hashes[3] = {uint256S("01"), uint256S("02"), uint256S("03")};
+    CBlockIndex blocks[3];
+    for (int i = 0; i < 3; ++i) {
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].nHeight = i;
+        blocks[i].pprev = (i > 0) ? &blocks[i-1] : nullptr;
+        blocks[i].BuildSkip();
+    }
+
+    mp_tally_map.clear();
+    metadex.clear();
+    metadex_index.Clear();
+    contractdex.clear();
+    contractdex_index.Clear();
+    ResetStateDelta();
+
+    BOOST_CHECK(MetaDEx_INSERT(orderA));
+    BOOST_CHECK(MetaDEx_INSERT(orderB));
+    CDataStream ss0(SER_DISK, CLIENT_VERSION);
+    SerializeStateSnapshot(ss0, &blocks[0]);
+    BOOST_CHECK(WriteStateSnapshot(GetStateSnapshotPath(pathTemp, hashes[0], false), ss0));
+
+    // a partially filled order is replaced by its remainder
+    BOOST_CHECK(MetaDEx_ERASE(orderA));
+    BOOST_CHECK(MetaDEx_INSERT(orderA2));
+    BOOST_CHECK(MetaDEx_INSERT(orderC));
+    BOOST_CHECK(ContractDex_INSERT(orderE));
+    CDataStream ss1(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(SerializeStateDelta(ss1, &blocks[1]));
+    BOOST_CHECK(WriteStateSnapshot(GetStateSnapshotPath(pathTemp, hashes[1], true), ss1));
+
+    // an order added and removed within the same block leaves no record
+    BOOST_CHECK(MetaDEx_ERASE(orderB));
+    BOOST_CHECK(MetaDEx_INSERT(orderD));
+    BOOST_CHECK(MetaDEx_ERASE(orderD));
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(SerializeStateDelta(ss2, &blocks[2]));
+    BOOST_CHECK(WriteStateSnapshot(GetStateSnapshotPath(pathTemp, hashes[2], true), ss2));
+
+    // only the changed orders are written
+    BOOST_CHECK(ss2.size() < ss1.size());
+
+    metadex.clear();
+    metadex_index.Clear();
+    contractdex.clear();
+    contractdex_index.Clear();
+    ResetStateDelta();
+
+    BOOST_CHECK_EQUAL(0, LoadStateDeltas(pathTemp, &blocks[2]));
+    BOOST_CHECK_EQUAL(2U, metadex_index.Size());
+    BOOST_CHECK_EQUAL(1U, contractdex_index.Size());
+    const CMPMetaDEx* pOrderA = MetaDEx_RetrieveTrade(uint256S("0a"));
+    BOOST_CHECK(pOrderA != nullptr);
+    if (pOrderA) BOOST_CHECK_EQUAL(600, pOrderA->getAmountRemaining());
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("0b")) == nullptr);
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("0c")) != nullptr);
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("0d")) == nullptr);
+    const CMPContractDex* pOrderE = ContractDex_RetrieveTrade(uint256S("0e"));
+    BOOST_CHECK(pOrderE != nullptr);
+    if (pOrderE) BOOST_CHECK_EQUAL(5000U, pOrderE->getEffectivePrice());
+
+    ForgetStateDeltaBase(hashes[1]);
+    ForgetStateDeltaBase(hashes[2]);
+    ResetStateDelta();
+    _my_sps = prevSPs;
+    metadex.clear();
+    metadex_index.Clear();
+    contractdex.clear();
+    contractdex_index.Clear();
+    fs::remove_all(pathTemp);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
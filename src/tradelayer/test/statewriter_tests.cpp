@@ -0,0 +1,234 @@
+#include <tradelayer/persistence.h>
+#include <tradelayer/statewriter.h>
+
+#include <clientversion.h>
+#include <fs.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <tinyformat.h>
+#include <util/time.h>
+
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+namespace
+{
+/** Writes nothing, but records the images and holds the writer until opened. */
+class CTestImageSink
+{
+private:
+    std::mutex cs;
+    std::condition_variable cv;
+    bool fOpen;
+    bool fFail;
+
+public:
+    std::vector<std::string> written;
+    std::vector<std::string> committed;
+
+    CTestImageSink() : fOpen(true), fFail(false) {}
+
+    void Close() { std::lock_guard<std::mutex> lock(cs); fOpen = false; }
+    void Open() { { std::lock_guard<std::mutex> lock(cs); fOpen = true; } cv.notify_all(); }
+    void SetFail(bool fFailIn) { std::lock_guard<std::mutex> lock(cs); fFail = fFailIn; }
+
+    bool Write(const fs::path& path, const CDataStream& image)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cv.wait(lock, [this] { return fOpen; });
+        if (fFail) return false;
+        written.push_back(path.string());
+        return true;
+    }
+
+    CMPStateWriter::WriteFunction GetWriteFunction()
+    {
+        return [this](const fs::path& path, const CDataStream& image) { return Write(path, image); };
+    }
+
+    CMPStateWriter::Callback GetCallback(const std::string& name)
+    {
+        return [this, name] { committed.push_back(name); };
+    }
+};
+
+CDataStream MakeImage(int n)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << n;
+    return ss;
+}
+
+bool Queue(CMPStateWriter& writer, CTestImageSink& sink, int n)
+{
+    CDataStream image = MakeImage(n);
+    const std::string name = strprintf("%d", n);
+    return writer.Write(name, image, sink.GetCallback(name));
+}
+
+/** Waits until the condition holds, or gives up after a few seconds. */
+template <typename Predicate>
+bool WaitFor(Predicate predicate)
+{
+    for (int n = 0; n < 500; ++n) {
+        if (predicate()) return true;
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+    }
+    return predicate();
+}
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_statewriter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(statewriter_inline)
+{
+    CTestImageSink sink;
+    CMPStateWriter writer(2, sink.GetWriteFunction());
+    BOOST_CHECK(!writer.IsRunning());
+
+    // without writer thread the image is written right away
+    BOOST_CHECK(Queue(writer, sink, 1));
+    BOOST_CHECK_EQUAL(sink.written.size(), 1U);
+    BOOST_CHECK_EQUAL(sink.committed.size(), 1U);
+
+    // a failed write is reported to the caller, and nothing is committed
+    sink.SetFail(true);
+    BOOST_CHECK(!Queue(writer, sink, 2));
+    BOOST_CHECK_EQUAL(sink.committed.size(), 1U);
+    BOOST_CHECK(!writer.TakeFailed());
+
+    const CStateWriterStats stats = writer.GetStats();
+    BOOST_CHECK_EQUAL(stats.nWritten, 1U);
+    BOOST_CHECK_EQUAL(stats.nFailed, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(statewriter_bounded_queue)
+{
+    CTestImageSink sink;
+    CMPStateWriter writer(2, sink.GetWriteFunction());
+    writer.Start("tlstatewritertest");
+    BOOST_CHECK(writer.IsRunning());
+
+    // the writer holds the first image, the next two fill the queue
+    sink.Close();
+    BOOST_CHECK(Queue(writer, sink, 1));
+    BOOST_CHECK(WaitFor([&writer] { return writer.GetStats().nQueued == 0; }));
+    BOOST_CHECK(Queue(writer, sink, 2));
+    BOOST_CHECK(Queue(writer, sink, 3));
+    BOOST_CHECK_EQUAL(writer.GetStats().nQueued, 2U);
+
+    // the next save waits for the writer
+    bool fQueued = false;
+    std::thread saver([&] { Queue(writer, sink, 4); fQueued = true; });
+    BOOST_CHECK(WaitFor([&writer] { return writer.GetStats().nFullWaits == 1; }));
+    BOOST_CHECK_EQUAL(writer.GetStats().nQueued, 2U);
+
+    sink.Open();
+    saver.join();
+    BOOST_CHECK(fQueued);
+
+    // the images are written and committed in order
+    writer.Flush();
+    const CStateWriterStats stats = writer.GetStats();
+    BOOST_CHECK_EQUAL(stats.nQueued, 0U);
+    BOOST_CHECK_EQUAL(stats.nWritten, 4U);
+    BOOST_CHECK_EQUAL(stats.nFullWaits, 1U);
+    BOOST_CHECK_EQUAL(sink.committed.size(), 4U);
+    for (size_t n = 0; n < sink.committed.size(); ++n) {
+        BOOST_CHECK_EQUAL(sink.committed[n], strprintf("%d", n + 1));
+    }
+
+    writer.Stop();
+    BOOST_CHECK(!writer.IsRunning());
+}
+
+BOOST_AUTO_TEST_CASE(statewriter_failed_write)
+{
+    CTestImageSink sink;
+    CMPStateWriter writer(4, sink.GetWriteFunction());
+    writer.Start("tlstatewritertest");
+
+    // the save succeeds, the failure is picked up by the next one
+    sink.SetFail(true);
+    BOOST_CHECK(Queue(writer, sink, 1));
+    writer.Flush();
+    BOOST_CHECK(sink.committed.empty());
+    BOOST_CHECK(writer.TakeFailed());
+    BOOST_CHECK(!writer.TakeFailed());
+
+    sink.SetFail(false);
+    BOOST_CHECK(Queue(writer, sink, 2));
+    writer.Flush();
+    BOOST_CHECK(!writer.TakeFailed());
+    BOOST_CHECK_EQUAL(sink.committed.size(), 1U);
+
+    const CStateWriterStats stats = writer.GetStats();
+    BOOST_CHECK_EQUAL(stats.nWritten, 1U);
+    BOOST_CHECK_EQUAL(stats.nFailed, 1U);
+
+    writer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(statewriter_stop_drains)
+{
+    CTestImageSink sink;
+    CMPStateWriter writer(8, sink.GetWriteFunction());
+    writer.Start("tlstatewritertest");
+
+    sink.Close();
+    for (int n = 1; n <= 5; ++n) {
+        BOOST_CHECK(Queue(writer, sink, n));
+    }
+
+    // stopping waits for the queued images, instead of dropping them
+    std::thread stopper([&writer] { writer.Stop(); });
+    sink.Open();
+    stopper.join();
+
+    BOOST_CHECK(!writer.IsRunning());
+    BOOST_CHECK_EQUAL(sink.committed.size(), 5U);
+    BOOST_CHECK_EQUAL(writer.GetStats().nWritten, 5U);
+    BOOST_CHECK_EQUAL(writer.GetStats().nQueued, 0U);
+
+    // once stopped, the images are written right away again
+    BOOST_CHECK(Queue(writer, sink, 6));
+    BOOST_CHECK_EQUAL(sink.committed.size(), 6U);
+}
+
+BOOST_AUTO_TEST_CASE(statewriter_flush)
+{
+    const fs::path pathTemp = fs::temp_directory_path() / strprintf("test_tlstatewriter_%lu", (unsigned long)GetTime());
+    fs::create_directories(pathTemp);
+
+    // the state is only loaded after a flush, so the files of the queued images are complete
+    bool fCommitted = false;
+    CMPStateWriter writer(2, [](const fs::path& path, const CDataStream& image) {
+        UninterruptibleSleep(std::chrono::milliseconds{50});
+        return WriteStateSnapshot(path, image);
+    });
+    writer.Start("tlstatewritertest");
+
+    const fs::path path = pathTemp / "snapshot-test.dat";
+    CDataStream image = MakeImage(42);
+    BOOST_CHECK(writer.Write(path, image, [&fCommitted] { fCommitted = true; }));
+    writer.Flush();
+
+    BOOST_CHECK(fCommitted);
+    BOOST_CHECK(fs::exists(path));
+    BOOST_CHECK_EQUAL(writer.GetStats().nWritten, 1U);
+
+    writer.Stop();
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
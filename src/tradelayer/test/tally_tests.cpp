@@ -1,11 +1,24 @@
 #include <test/test_bitcoin.h>
 #include <tradelayer/tally.h>
+#include <tradelayer/tradelayer.h>
 
 #include <boost/test/unit_test.hpp>
 #include <stdint.h>
+#include <vector>
+
+using namespace mastercore;
 
 BOOST_FIXTURE_TEST_SUITE(tradelayer_tally_tests, BasicTestingSetup)
 
+static std::vector<uint32_t> GetProperties(const CMPTally& tally)
+{
+    std::vector<uint32_t> properties;
+    for (const CMPTally::BalanceRecord& record : tally) {
+        properties.push_back(record.propertyId);
+    }
+    return properties;
+}
+
 BOOST_AUTO_TEST_CASE(empty_tally)
 {
     CMPTally tally;
@@ -29,8 +42,8 @@ BOOST_AUTO_TEST_CASE(empty_tally)
     BOOST_CHECK(!tally.updateMoney(0, 1, static_cast<TallyType>(14)));
     BOOST_CHECK(!tally.updateMoney(0, 1, static_cast<TallyType>(15)));
 
-    BOOST_CHECK_EQUAL(0, tally.init());
-    BOOST_CHECK_EQUAL(0, tally.next());
+    BOOST_CHECK_EQUAL(0U, tally.size());
+    BOOST_CHECK(tally.begin() == tally.end());
 
     BOOST_CHECK_EQUAL(0, tally.getMoneyAvailable(0));
     BOOST_CHECK_EQUAL(0, tally.getMoneyAvailable(55));
@@ -119,19 +132,13 @@ BOOST_AUTO_TEST_CASE(filled_tally)
 
     BOOST_CHECK_EQUAL(tally.getMoneyAvailable(5), 0);
 
-    /**
-     * Note:
-     * The internal iterator must be replaced via init(),
-     * after inserting a new entry via updateMoney().
-     */
-    BOOST_CHECK_EQUAL(0, tally.init());
-    BOOST_CHECK_EQUAL(0, tally.next());
-    BOOST_CHECK_EQUAL(1, tally.next());
-    BOOST_CHECK_EQUAL(2, tally.next());
-    BOOST_CHECK_EQUAL(5, tally.next());
-    BOOST_CHECK_EQUAL(0, tally.init());
-    BOOST_CHECK_EQUAL(0, tally.next());
-    BOOST_CHECK_EQUAL(1, tally.next());
+    const std::vector<uint32_t> expected = {0, 1, 2, 5};
+    const std::vector<uint32_t> properties = GetProperties(tally);
+    BOOST_CHECK_EQUAL_COLLECTIONS(properties.begin(), properties.end(), expected.begin(), expected.end());
+
+    // iterating again yields the same order
+    const std::vector<uint32_t> propertiesAgain = GetProperties(tally);
+    BOOST_CHECK_EQUAL_COLLECTIONS(propertiesAgain.begin(), propertiesAgain.end(), expected.begin(), expected.end());
 }
 
 BOOST_AUTO_TEST_CASE(tally_entry_order)
@@ -168,20 +175,10 @@ BOOST_AUTO_TEST_CASE(tally_entry_order)
     BOOST_CHECK(tally.updateMoney(3, 7, REALIZED_LOSSES));
     BOOST_CHECK(tally.updateMoney(2, 1, REMAINING));
 
-    BOOST_CHECK_EQUAL(1, tally.init());
-    // Begin iterations:
-    BOOST_CHECK_EQUAL(1, tally.next());
-    BOOST_CHECK_EQUAL(2, tally.next());
-    BOOST_CHECK_EQUAL(3, tally.next());
-    BOOST_CHECK_EQUAL(4, tally.next());
-    BOOST_CHECK_EQUAL(5, tally.next());
-    BOOST_CHECK_EQUAL(6, tally.next());
-    BOOST_CHECK_EQUAL(7, tally.next());
-    BOOST_CHECK_EQUAL(8, tally.next());
-    BOOST_CHECK_EQUAL(9, tally.next());
-    BOOST_CHECK_EQUAL(70, tally.next());
-    // End of tally reached:
-    BOOST_CHECK_EQUAL(0, tally.next());
+    // records are ordered by property identifier
+    const std::vector<uint32_t> expected = {1, 2, 3, 4, 5, 6, 7, 8, 9, 70};
+    const std::vector<uint32_t> properties = GetProperties(tally);
+    BOOST_CHECK_EQUAL_COLLECTIONS(properties.begin(), properties.end(), expected.begin(), expected.end());
 
     BOOST_CHECK_EQUAL(tally.getMoneyAvailable(1), 2);
     BOOST_CHECK_EQUAL(tally.getMoneyAvailable(2), -2);
@@ -243,16 +240,11 @@ BOOST_AUTO_TEST_CASE(tally_equality)
     BOOST_CHECK(tally1.getMoneyAvailable(9) == tally2.getMoneyAvailable(9));
     BOOST_CHECK(tally1.getMoneyAvailable(0) == tally2.getMoneyAvailable(0));
 
-    BOOST_CHECK_EQUAL(0, tally1.init());
-    BOOST_CHECK_EQUAL(0, tally1.next());
-    BOOST_CHECK_EQUAL(1, tally1.next());
-    BOOST_CHECK_EQUAL(3, tally1.next());
-    BOOST_CHECK_EQUAL(4, tally1.next());
-    BOOST_CHECK_EQUAL(9, tally1.next());
-    BOOST_CHECK_EQUAL(0, tally2.init());
-    BOOST_CHECK_EQUAL(0, tally2.next());
-    BOOST_CHECK_EQUAL(1, tally2.next());
-    BOOST_CHECK_EQUAL(3, tally2.next());
+    const std::vector<uint32_t> expected = {0, 1, 3, 4, 9};
+    const std::vector<uint32_t> properties1 = GetProperties(tally1);
+    const std::vector<uint32_t> properties2 = GetProperties(tally2);
+    BOOST_CHECK_EQUAL_COLLECTIONS(properties1.begin(), properties1.end(), expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(properties2.begin(), properties2.end(), expected.begin(), expected.end());
 
     BOOST_CHECK(tally1 == tally2);
 
@@ -349,5 +341,53 @@ BOOST_AUTO_TEST_CASE(tally_overflow)
 
 }
 
+BOOST_AUTO_TEST_CASE(tally_totals)
+{
+    const std::string address1 = "QPh9K4wVBrbJVJnbLd7q2eKNpK8Cv2SEwP";
+    const std::string address2 = "QTfGsmEbHYsgsDL1ZmUnFHbXCHAjXXGSQf";
+
+    mp_tally_map.clear();
+    InvalidateTallyTotals();
+
+    BOOST_CHECK(update_tally_map(address1, 3, 1000, BALANCE));
+    // built from the tally map, and updated from now on
+    BOOST_CHECK_EQUAL(getTallyTotals(3).getSupply(), 1000);
+
+    BOOST_CHECK(update_tally_map(address1, 3, -400, BALANCE));
+    BOOST_CHECK(update_tally_map(address1, 3, 400, METADEX_RESERVE));
+    BOOST_CHECK(update_tally_map(address2, 3, 250, BALANCE));
+    BOOST_CHECK(update_tally_map(address1, 7, 5, CONTRACT_BALANCE));
+    BOOST_CHECK(update_tally_map(address2, 7, -5, CONTRACT_BALANCE));
+    BOOST_CHECK(update_tally_map(address2, 7, 8, CONTRACT_BALANCE));
+    BOOST_CHECK(update_tally_map(address1, 7, -8, CONTRACT_BALANCE));
+
+    CMPTallyTotals totals = getTallyTotals(3);
+    BOOST_CHECK_EQUAL(totals.total[BALANCE], 850);
+    BOOST_CHECK_EQUAL(totals.total[METADEX_RESERVE], 400);
+    BOOST_CHECK_EQUAL(totals.getSupply(), 1250);
+    BOOST_CHECK_EQUAL(totals.owners, 2);
+
+    // positions flipped sides
+    totals = getTallyTotals(7);
+    BOOST_CHECK_EQUAL(totals.longs, 3);
+    BOOST_CHECK_EQUAL(totals.shorts, -3);
+    BOOST_CHECK_EQUAL(totals.owners, 0);
+
+    BOOST_CHECK(update_tally_map(address2, 3, -250, BALANCE));
+    BOOST_CHECK_EQUAL(getTallyTotals(3).owners, 1);
+
+    // rejected updates don't change anything
+    BOOST_CHECK(!update_tally_map(address2, 3, -1, BALANCE));
+    BOOST_CHECK_EQUAL(getTallyTotals(3).getSupply(), 1000);
+
+    // a rebuild yields the same totals
+    const CMPTallyTotals running = getTallyTotals(3);
+    InvalidateTallyTotals();
+    BOOST_CHECK(getTallyTotals(3) == running);
+    BOOST_CHECK(getTallyTotals(7) == totals);
+
+    mp_tally_map.clear();
+    InvalidateTallyTotals();
+}
 
 BOOST_AUTO_TEST_SUITE_END()
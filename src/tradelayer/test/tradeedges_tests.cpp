@@ -0,0 +1,235 @@
+#include <tradelayer/clearing.h>
+#include <tradelayer/tradeedges.h>
+
+#include <test/test_bitcoin.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+namespace
+{
+const int64_t PRICE_100 = 100 * CLEARING_PRICE_SCALE;
+const int64_t PRICE_110 = 110 * CLEARING_PRICE_SCALE;
+
+/** Sums the lives of the carried trades by address and direction, the last trade of a position has them all. */
+std::map<std::string, int64_t> GetCarriedLives(const CClearingGraph& carried)
+{
+    std::map<std::string, int64_t> lives;
+    for (const CClearingTrade& trade : carried.GetTrades()) {
+        for (int side = 0; side < 2; ++side) {
+            const bool fLong = carried.GetStatusFlags(trade.status[side]) & CLEARING_LONG;
+            lives[(fLong ? "long " : "short ") + carried.GetAddress(trade.address[side])] = trade.lives[side];
+        }
+    }
+    return lives;
+}
+
+/** Records the trades of two settlement periods. */
+void AddTwoPeriods(CMPTradeEdgeStore& store)
+{
+    // A buys 5 from B, then sells 2 to C
+    store.AddTrade(3, "B", "OpenShortPosition", 5, "A", "OpenLongPosition", 5, 5, PRICE_100);
+    store.AddTrade(4, "A", "LongPosNettedPartly", 3, "C", "OpenLongPosition", 2, 2, PRICE_110);
+    // C sells 1 to D, A buys 3 more from E, B buys 7 from C
+    store.AddTrade(12, "C", "LongPosNettedPartly", 1, "D", "OpenLongPosition", 1, 1, PRICE_110);
+    store.AddTrade(15, "E", "OpenShortPosition", 3, "A", "LongPosIncreased", 6, 3, PRICE_100);
+    store.AddTrade(17, "C", "OpenShortPosByLongPosNetted", 6, "B", "OpenLongPosByShortPosNetted", 2, 7, PRICE_110);
+}
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_tradeedges_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(tradeedges_segments)
+{
+    CMPTradeEdgeStore store(10);
+    BOOST_CHECK(store.Empty());
+    BOOST_CHECK_EQUAL(store.GetPeriod(9), 0);
+    BOOST_CHECK_EQUAL(store.GetPeriod(10), 1);
+
+    store.AddTrade(3, "B", "OpenShortPosition", 5, "A", "OpenLongPosition", 5, 5, PRICE_100);
+    store.AddTrade(12, "D", "OpenShortPosition", 1, "E", "OpenLongPosition", 1, 1, PRICE_100);
+    store.AddTrade(27, "D", "ShortPosIncreased", 2, "E", "LongPosIncreased", 2, 1, PRICE_100);
+    BOOST_CHECK_EQUAL(store.Size(), 3U);
+    BOOST_CHECK_EQUAL(store.GetSegments().size(), 3U);
+
+    // edges as built by buildingEdge() are accepted, malformed ones dropped
+    std::map<std::string, std::string> edge;
+    edge["addrs_src"] = "B";
+    edge["addrs_trk"] = "C";
+    edge["status_src"] = "ShortPosIncreased";
+    edge["status_trk"] = "OpenLongPosition";
+    edge["lives_src"] = "7";
+    edge["lives_trk"] = "2";
+    edge["amount_trd"] = "2";
+    edge["matched_price"] = "110.000000";
+    BOOST_CHECK(store.AddTrade(28, edge));
+    edge["matched_price"] = "110.0x";
+    BOOST_CHECK(!store.AddTrade(35, edge));
+    BOOST_CHECK_EQUAL(store.Size(), 4U);
+    BOOST_CHECK_EQUAL(store.GetSegments().size(), 3U);
+
+    const CTradeEdgeStats stats = store.GetStats();
+    BOOST_CHECK_EQUAL(stats.nTrades, 4U);
+    BOOST_CHECK_EQUAL(stats.nCarried, 0U);
+    BOOST_CHECK_EQUAL(stats.nSegments, 3U);
+    BOOST_CHECK_EQUAL(stats.nRecorded, 4U);
+    BOOST_CHECK_EQUAL(stats.nRejected, 1U);
+    BOOST_CHECK(stats.nMemoryUsage > 0);
+
+    store.Clear();
+    BOOST_CHECK(store.Empty());
+    BOOST_CHECK(store.GetStats().nMemoryUsage < stats.nMemoryUsage);
+}
+
+BOOST_AUTO_TEST_CASE(tradeedges_settle)
+{
+    CMPTradeEdgeStore store(10);
+    CClearingGraph graph;
+    CClearingResult result;
+
+    // nothing recorded, or only trades of the current period
+    BOOST_CHECK(!store.Settle(10, graph, result));
+    store.AddTrade(10, "D", "OpenShortPosition", 1, "E", "OpenLongPosition", 1, 1, PRICE_100);
+    BOOST_CHECK(!store.Settle(10, graph, result));
+
+    // A buys 5 from B, then sells 2 to C
+    store.AddTrade(3, "B", "OpenShortPosition", 5, "A", "OpenLongPosition", 5, 5, PRICE_100);
+    store.AddTrade(4, "A", "LongPosNettedPartly", 3, "C", "OpenLongPosition", 2, 2, PRICE_110);
+    BOOST_CHECK_EQUAL(store.Size(), 3U);
+
+    BOOST_CHECK(store.Settle(10, graph, result));
+    BOOST_CHECK_EQUAL(graph.Size(), 2U);
+
+    // the positions left open are carried, the trade of the current period is kept
+    int64_t exitPrice = 0;
+    BOOST_CHECK(ClearingPriceFromDouble(result.exitPrice, exitPrice));
+    const CClearingGraph& carried = store.GetCarried();
+    BOOST_CHECK_EQUAL(store.Size(), carried.Size() + 1);
+    BOOST_CHECK_EQUAL(store.GetSegments().size(), 1U);
+    BOOST_CHECK_EQUAL(store.GetSegments().begin()->first, 1);
+    for (const CClearingTrade& trade : carried.GetTrades()) {
+        BOOST_CHECK_EQUAL(trade.price, exitPrice);
+    }
+
+    std::map<std::string, int64_t> lives = GetCarriedLives(carried);
+    BOOST_CHECK_EQUAL(lives.size(), 3U);
+    BOOST_CHECK_EQUAL(lives["long A"], 3);
+    BOOST_CHECK_EQUAL(lives["long C"], 2);
+    BOOST_CHECK_EQUAL(lives["short B"], 5);
+
+    // the next settlement starts from the carried positions
+    const size_t nCarried = carried.Size();
+    store.AddTrade(15, "D", "ShortPosIncreased", 3, "F", "OpenLongPosition", 2, 2, PRICE_110);
+    BOOST_CHECK(store.Settle(20, graph, result));
+    BOOST_CHECK_EQUAL(graph.Size(), nCarried + 2);
+    BOOST_CHECK_EQUAL(store.Size(), store.GetCarried().Size());
+
+    lives = GetCarriedLives(store.GetCarried());
+    BOOST_CHECK_EQUAL(lives.size(), 6U);
+    BOOST_CHECK_EQUAL(lives["long A"], 3);
+    BOOST_CHECK_EQUAL(lives["long C"], 2);
+    BOOST_CHECK_EQUAL(lives["long E"], 1);
+    BOOST_CHECK_EQUAL(lives["long F"], 2);
+    BOOST_CHECK_EQUAL(lives["short B"], 5);
+    BOOST_CHECK_EQUAL(lives["short D"], 3);
+
+    const CTradeEdgeStats stats = store.GetStats();
+    BOOST_CHECK_EQUAL(stats.nSettlements, 2U);
+    BOOST_CHECK_EQUAL(stats.nSettled, 4U);
+    BOOST_CHECK_EQUAL(stats.nSegments, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(tradeedges_carry_equivalence)
+{
+    CClearingGraph graph;
+    CClearingResult result;
+
+    // settled at once
+    CMPTradeEdgeStore storeFull(10);
+    AddTwoPeriods(storeFull);
+    BOOST_CHECK(storeFull.Settle(20, graph, result));
+    const std::map<std::string, int64_t> livesFull = GetCarriedLives(storeFull.GetCarried());
+
+    // settled per period, the second settlement starts from the carried positions
+    CMPTradeEdgeStore storeCarried(10);
+    AddTwoPeriods(storeCarried);
+    BOOST_CHECK(storeCarried.Settle(10, graph, result));
+    BOOST_CHECK(storeCarried.Settle(20, graph, result));
+    const std::map<std::string, int64_t> livesCarried = GetCarriedLives(storeCarried.GetCarried());
+
+    BOOST_CHECK(livesFull == livesCarried);
+    BOOST_CHECK_EQUAL(livesCarried.size(), 5U);
+    BOOST_CHECK_EQUAL(livesCarried.at("long A"), 6);
+    BOOST_CHECK_EQUAL(livesCarried.at("long B"), 2);
+    BOOST_CHECK_EQUAL(livesCarried.at("long D"), 1);
+    BOOST_CHECK_EQUAL(livesCarried.at("short C"), 6);
+    BOOST_CHECK_EQUAL(livesCarried.at("short E"), 3);
+    BOOST_CHECK_EQUAL(storeFull.GetStats().nDroppedLives, 0U);
+    BOOST_CHECK_EQUAL(storeCarried.GetStats().nDroppedLives, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(tradeedges_dropped_lives)
+{
+    CMPTradeEdgeStore store(10);
+    CClearingGraph graph;
+    CClearingResult result;
+
+    // the lives of both sides don't add up, the longs left over can't be carried
+    store.AddTrade(3, "B", "OpenShortPosition", 2, "A", "OpenLongPosition", 5, 2, PRICE_100);
+    BOOST_CHECK(store.Settle(10, graph, result));
+
+    const std::map<std::string, int64_t> lives = GetCarriedLives(store.GetCarried());
+    BOOST_CHECK_EQUAL(lives.at("long A"), 2);
+    BOOST_CHECK_EQUAL(lives.at("short B"), 2);
+    BOOST_CHECK_EQUAL(store.GetStats().nDroppedLives, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(tradeedges_compaction)
+{
+    CMPTradeEdgeStore store(10);
+    CClearingGraph graph;
+    CClearingResult result;
+
+    // two addresses trading back and forth, closing the carried position first
+    for (int period = 0; period < 20; ++period) {
+        if (period > 0) {
+            store.AddTrade(period * 10, "A", "LongPosNetted", 0, "B", "ShortPosNetted", 0, 1, PRICE_100);
+        }
+        for (int n = 0; n < 50; ++n) {
+            const int block = period * 10 + n % 10;
+            store.AddTrade(block, "B", "OpenShortPosition", 1, "A", "OpenLongPosition", 1, 1, PRICE_100 + n);
+            store.AddTrade(block, "A", "LongPosNetted", 0, "B", "ShortPosNetted", 0, 1, PRICE_100 + n);
+        }
+        store.AddTrade(period * 10 + 9, "B", "OpenShortPosition", 1, "A", "OpenLongPosition", 1, 1, PRICE_110);
+        BOOST_CHECK(store.Settle((period + 1) * 10, graph, result));
+        BOOST_CHECK_EQUAL(store.Size(), store.GetCarried().Size());
+        BOOST_CHECK_EQUAL(store.GetCarried().Size(), 1U);
+    }
+
+    BOOST_CHECK_EQUAL(store.GetStats().nSettled, 101U + 19U * 102U);
+}
+
+BOOST_AUTO_TEST_CASE(tradeedges_load)
+{
+    CMPTradeEdgeStore store(10);
+    CClearingGraph carried;
+    std::map<int, CClearingGraph> segments;
+    carried.AddTrade("B", "OpenShortPosition", 5, "A", "OpenLongPosition", 5, 5, PRICE_100);
+    segments[1].AddTrade("D", "OpenShortPosition", 1, "E", "OpenLongPosition", 1, 1, PRICE_100);
+    segments[2].AddTrade("D", "ShortPosIncreased", 2, "E", "LongPosIncreased", 2, 1, PRICE_110);
+
+    store.Load(carried, segments);
+    BOOST_CHECK_EQUAL(store.Size(), 3U);
+    BOOST_CHECK_EQUAL(store.GetCarried().Size(), 1U);
+    BOOST_CHECK_EQUAL(store.GetSegments().size(), 2U);
+    BOOST_CHECK_EQUAL(store.GetStats().nCarried, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
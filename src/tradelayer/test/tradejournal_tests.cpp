@@ -0,0 +1,249 @@
+#include <tradelayer/tradejournal.h>
+
+#include <fs.h>
+#include <test/test_bitcoin.h>
+#include <tinyformat.h>
+#include <uint256.h>
+#include <util/time.h>
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+namespace
+{
+CTradeJournalEntry MakeEntry(uint32_t contractId, int64_t amount, uint64_t price)
+{
+    CTradeJournalEntry entry;
+    entry.contractId = contractId;
+    entry.txidMaker = uint256S("01");
+    entry.txidTaker = uint256S("02");
+    entry.addressMaker = "QN4WpQJ5LbxhW2YUrDZ1usm7pmTEEZuYEu";
+    entry.addressTaker = "QgKxFUBgR8y4xFy3s9ybpbDvYNKr4HTKPb";
+    entry.statusMaker = "OpenShortPosition";
+    entry.statusTaker = "OpenLongPosition";
+    entry.livesMaker = -amount;
+    entry.livesTaker = amount;
+    entry.amount = amount;
+    entry.effectivePrice = price;
+    return entry;
+}
+
+fs::path MakeTempDir(const std::string& name)
+{
+    const fs::path pathTemp = fs::temp_directory_path() / strprintf("test_%s_%lu", name, (unsigned long)GetTime());
+    fs::remove_all(pathTemp);
+    return pathTemp;
+}
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_tradejournal_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(tradejournal_write_read)
+{
+    const fs::path pathTemp = MakeTempDir("tltradejournal");
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+
+    CMPTradeJournal journal;
+    BOOST_CHECK(!journal.IsOpen());
+    BOOST_CHECK(journal.Open(pathTemp, 100));
+    BOOST_CHECK(journal.IsOpen());
+
+    journal.Append(10, MakeEntry(5, 2, 100000000));
+    journal.Append(10, MakeEntry(5, 3, 110000000));
+    journal.Append(12, MakeEntry(6, 1, 50000000));
+
+    // the trades are on disk once committed
+    BOOST_CHECK(journal.Commit());
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 2U);
+
+    const std::vector<CTradeJournalEntry>& trades = blocks[10];
+    BOOST_CHECK_EQUAL(trades.size(), 2U);
+    BOOST_CHECK_EQUAL(trades[1].contractId, 5U);
+    BOOST_CHECK(trades[1].txidMaker == uint256S("01"));
+    BOOST_CHECK(trades[1].txidTaker == uint256S("02"));
+    BOOST_CHECK_EQUAL(trades[1].addressMaker, "QN4WpQJ5LbxhW2YUrDZ1usm7pmTEEZuYEu");
+    BOOST_CHECK_EQUAL(trades[1].statusTaker, "OpenLongPosition");
+    BOOST_CHECK_EQUAL(trades[1].livesMaker, -3);
+    BOOST_CHECK_EQUAL(trades[1].amount, 3);
+    BOOST_CHECK_EQUAL(trades[1].effectivePrice, 110000000U);
+    BOOST_CHECK_EQUAL(blocks[12].size(), 1U);
+
+    // the range filter
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 11, 12, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 1U);
+    BOOST_CHECK(blocks.count(12));
+
+    // reopening continues the latest file
+    journal.Close();
+    BOOST_CHECK(!journal.IsOpen());
+    BOOST_CHECK(journal.Open(pathTemp, 100));
+    journal.Append(13, MakeEntry(6, 4, 50000000));
+    journal.Close();
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 3U);
+
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(tradejournal_rotation)
+{
+    const fs::path pathTemp = MakeTempDir("tltradejournal_rotation");
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+
+    CMPTradeJournal journal;
+    BOOST_CHECK(journal.Open(pathTemp, 10));
+    for (int block = 5; block < 35; block += 5) {
+        journal.Append(block, MakeEntry(5, block, 100000000));
+        BOOST_CHECK(journal.Commit());
+    }
+    journal.Close();
+
+    BOOST_CHECK(fs::exists(GetTradeJournalFile(pathTemp, 0)));
+    BOOST_CHECK(fs::exists(GetTradeJournalFile(pathTemp, 10)));
+    BOOST_CHECK(fs::exists(GetTradeJournalFile(pathTemp, 20)));
+    BOOST_CHECK(fs::exists(GetTradeJournalFile(pathTemp, 30)));
+
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 6U);
+    BOOST_CHECK_EQUAL(blocks[25][0].amount, 25);
+
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(tradejournal_rollback)
+{
+    const fs::path pathTemp = MakeTempDir("tltradejournal_rollback");
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+
+    CMPTradeJournal journal;
+    BOOST_CHECK(journal.Open(pathTemp, 10));
+    for (int block = 5; block < 25; ++block) {
+        journal.Append(block, MakeEntry(5, 1, 100000000));
+    }
+    BOOST_CHECK(journal.Commit());
+
+    // blocks 8 and later are disconnected, block 8 is connected again
+    BOOST_CHECK(journal.Rollback(8));
+    journal.Append(8, MakeEntry(5, 7, 120000000));
+    BOOST_CHECK(journal.Commit());
+    journal.Close();
+
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 4U);
+    BOOST_CHECK_EQUAL(blocks.rbegin()->first, 8);
+    BOOST_CHECK_EQUAL(blocks[8].size(), 1U);
+    BOOST_CHECK_EQUAL(blocks[8][0].amount, 7);
+
+    // files are only rotated forward, the superseded files stay
+    BOOST_CHECK(fs::exists(GetTradeJournalFile(pathTemp, 20)));
+    BOOST_CHECK(blocks.count(5));
+
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(tradejournal_rollback_below_disconnect)
+{
+    const fs::path pathTemp = MakeTempDir("tltradejournal_rescan");
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+
+    CMPTradeJournal journal;
+    BOOST_CHECK(journal.Open(pathTemp, 10));
+    for (int block = 5; block < 25; ++block) {
+        journal.Append(block, MakeEntry(5, block, 100000000));
+    }
+    BOOST_CHECK(journal.Commit());
+
+    // block 20 is disconnected, but the state is restored at block 12, so 13 and later are scanned again
+    BOOST_CHECK(journal.Rollback(20));
+    BOOST_CHECK(journal.Rollback(13));
+    for (int block = 13; block < 21; ++block) {
+        journal.Append(block, MakeEntry(5, block, 100000000));
+    }
+    BOOST_CHECK(journal.Commit());
+    journal.Close();
+
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 16U);
+    BOOST_CHECK_EQUAL(blocks.rbegin()->first, 20);
+    for (const auto& item : blocks) {
+        BOOST_CHECK_EQUAL(item.second.size(), 1U);
+        BOOST_CHECK_EQUAL(item.second[0].amount, item.first);
+    }
+
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(tradejournal_split_block)
+{
+    const fs::path pathTemp = MakeTempDir("tltradejournal_split");
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+
+    CMPTradeJournal journal;
+    BOOST_CHECK(journal.Open(pathTemp, 10));
+    journal.Append(9, MakeEntry(5, 1, 100000000));
+    BOOST_CHECK(journal.Commit());
+
+    // the trades of a block written as two records are both kept
+    journal.Append(10, MakeEntry(5, 2, 100000000));
+    BOOST_CHECK(journal.Commit());
+    journal.Append(10, MakeEntry(5, 3, 100000000));
+    BOOST_CHECK(journal.Commit());
+
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 2U);
+    BOOST_CHECK_EQUAL(blocks[9].size(), 1U);
+    BOOST_CHECK_EQUAL(blocks[10].size(), 2U);
+    BOOST_CHECK_EQUAL(blocks[10][0].amount, 2);
+    BOOST_CHECK_EQUAL(blocks[10][1].amount, 3);
+
+    // buffered trades of a disconnected block are dropped with it
+    journal.Append(11, MakeEntry(5, 4, 100000000));
+    BOOST_CHECK(journal.Rollback(10));
+    journal.Close();
+
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 1U);
+    BOOST_CHECK(blocks.count(9));
+
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_CASE(tradejournal_torn_tail)
+{
+    const fs::path pathTemp = MakeTempDir("tltradejournal_torn");
+    std::map<int, std::vector<CTradeJournalEntry>> blocks;
+
+    CMPTradeJournal journal;
+    BOOST_CHECK(journal.Open(pathTemp, 100));
+    journal.Append(1, MakeEntry(5, 1, 100000000));
+    journal.Append(2, MakeEntry(5, 2, 100000000));
+    journal.Close();
+
+    // an interrupted write left half a record
+    const fs::path path = GetTradeJournalFile(pathTemp, 0);
+    const uintmax_t nSize = fs::file_size(path);
+    fs::resize_file(path, nSize - 10);
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 1U);
+
+    // the incomplete record is cut off before anything is appended
+    BOOST_CHECK(journal.Open(pathTemp, 100));
+    journal.Append(3, MakeEntry(5, 3, 100000000));
+    journal.Close();
+    BOOST_CHECK(ReadTradeJournal(pathTemp, 0, 1000, blocks));
+    BOOST_CHECK_EQUAL(blocks.size(), 2U);
+    BOOST_CHECK(blocks.count(1));
+    BOOST_CHECK(blocks.count(3));
+
+    fs::remove_all(pathTemp);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,255 @@
+#include <test/test_bitcoin.h>
+#include <tradelayer/dbrecords.h>
+#include <tradelayer/persistence.h>
+#include <tradelayer/tradelayer.h>
+
+#include <fs.h>
+#include <uint256.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <leveldb/iterator.h>
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+/** Exposes the batch interface of the database base class. */
+class CTestDB : public CDBBase
+{
+public:
+    CTestDB(const fs::path& path) { Open(path, true); }
+
+    using CDBBase::Delete;
+    using CDBBase::Get;
+    using CDBBase::NewIterator;
+    using CDBBase::Put;
+
+    std::string Read(const std::string& key)
+    {
+        std::string value;
+        return Get(key, &value).ok() ? value : "-";
+    }
+};
+
+std::vector<std::string> ReadForward(leveldb::Iterator* it)
+{
+    std::vector<std::string> entries;
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        entries.push_back(it->key().ToString() + "=" + it->value().ToString());
+    }
+    return entries;
+}
+
+std::vector<std::string> ReadBackward(leveldb::Iterator* it)
+{
+    std::vector<std::string> entries;
+    for (it->SeekToLast(); it->Valid(); it->Prev()) {
+        entries.insert(entries.begin(), it->key().ToString() + "=" + it->value().ToString());
+    }
+    return entries;
+}
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_tradelist_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(trades_for_address_index)
+{
+    const fs::path path = GetDataDir() / "tl_tradelist_test";
+    const std::string address = "QPh9K4wVBrbJVJnbLd7q2eKNpK8Cv2SEwP";
+    const std::string other = "QTfGsmEbHYsgsDL1ZmUnFHbXCHAjXXGSQf";
+    const uint256 txidA = uint256S("1111111111111111111111111111111111111111111111111111111111111111");
+    const uint256 txidB = uint256S("2222222222222222222222222222222222222222222222222222222222222222");
+    const uint256 txidC = uint256S("3333333333333333333333333333333333333333333333333333333333333333");
+
+    {
+        CMPTradeList tradelist(path, true);
+        tradelist.recordNewTrade(txidB, address, 3, 4, 200, 1);
+        tradelist.recordNewTrade(txidA, address, 4, 5, 100, 7);
+        tradelist.recordNewTrade(txidC, other, 3, 4, 150, 2);
+
+        // ordered by block, only trades of the address
+        std::vector<uint256> vTrades;
+        tradelist.getTradesForAddress(address, vTrades);
+        BOOST_CHECK_EQUAL(vTrades.size(), 2U);
+        BOOST_CHECK(vTrades[0] == txidA);
+        BOOST_CHECK(vTrades[1] == txidB);
+
+        // filtered by either side of the trade
+        vTrades.clear();
+        tradelist.getTradesForAddress(address, vTrades, 3);
+        BOOST_CHECK_EQUAL(vTrades.size(), 1U);
+        BOOST_CHECK(vTrades[0] == txidB);
+
+        vTrades.clear();
+        tradelist.getTradesForAddress(address, vTrades, 5);
+        BOOST_CHECK_EQUAL(vTrades.size(), 1U);
+        BOOST_CHECK(vTrades[0] == txidA);
+    }
+
+    // reopening keeps the index as it is
+    {
+        CMPTradeList tradelist(path, false);
+        std::vector<uint256> vTrades;
+        tradelist.getTradesForAddress(other, vTrades);
+        BOOST_CHECK_EQUAL(vTrades.size(), 1U);
+        BOOST_CHECK(vTrades[0] == txidC);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_batch)
+{
+    const fs::path path = GetDataDir() / "tl_tradelist_batch_test";
+    const std::string address = "QPh9K4wVBrbJVJnbLd7q2eKNpK8Cv2SEwP";
+    const std::string other = "QTfGsmEbHYsgsDL1ZmUnFHbXCHAjXXGSQf";
+    const uint256 txidA = uint256S("1111111111111111111111111111111111111111111111111111111111111111");
+    const uint256 txidB = uint256S("2222222222222222222222222222222222222222222222222222222222222222");
+    const uint256 txidC = uint256S("3333333333333333333333333333333333333333333333333333333333333333");
+
+    {
+        CMPTradeList tradelist(path, true);
+        tradelist.recordNewTrade(txidA, address, 3, 4, 100, 1);
+
+        tradelist.BeginBatch();
+        tradelist.recordNewTrade(txidB, address, 3, 4, 101, 1);
+        tradelist.recordMatchedTrade(txidC, txidA, other, address, 4, 3, 50, 60, 101, 0);
+
+        // pending records are merged with the committed ones
+        std::vector<uint256> vTrades;
+        tradelist.getTradesForAddress(address, vTrades);
+        BOOST_CHECK_EQUAL(vTrades.size(), 2U);
+        BOOST_CHECK(vTrades[0] == txidA);
+        BOOST_CHECK(vTrades[1] == txidB);
+
+        BOOST_CHECK(tradelist.CommitBatch().ok());
+        const CDBBatchStats stats = tradelist.GetBatchStats();
+        BOOST_CHECK_EQUAL(stats.nCommits, 1U);
+        // two records, and their index entries
+        BOOST_CHECK(stats.nLastEntries > 2U);
+        BOOST_CHECK_EQUAL(stats.nTotalEntries, stats.nLastEntries);
+
+        // an empty batch is not counted
+        tradelist.BeginBatch();
+        BOOST_CHECK(tradelist.CommitBatch().ok());
+        BOOST_CHECK_EQUAL(tradelist.GetBatchStats().nCommits, 1U);
+    }
+
+    // committed records were written to disk
+    {
+        CMPTradeList tradelist(path, false);
+        std::vector<uint256> vTrades;
+        tradelist.getTradesForAddress(address, vTrades);
+        BOOST_CHECK_EQUAL(vTrades.size(), 2U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(batch_iterator)
+{
+    CTestDB db(GetDataDir() / "tl_batch_iterator_test");
+    db.Put("a", "1");
+    db.Put("c", "3");
+    db.Put("e", "5");
+    db.Put("g", "7");
+
+    db.BeginBatch();
+    db.Put("b", "2");
+    db.Delete("c");
+    db.Put("e", "50");
+    db.Put("h", "8");
+    BOOST_CHECK_EQUAL(db.Read("c"), "-");
+    BOOST_CHECK_EQUAL(db.Read("e"), "50");
+
+    const std::vector<std::string> expected = {"a=1", "b=2", "e=50", "g=7", "h=8"};
+    std::unique_ptr<leveldb::Iterator> it(db.NewIterator());
+    BOOST_CHECK(ReadForward(it.get()) == expected);
+    BOOST_CHECK(ReadBackward(it.get()) == expected);
+
+    // changing direction
+    it->Seek("e");
+    BOOST_CHECK_EQUAL(it->key().ToString(), "e");
+    it->Prev();
+    BOOST_CHECK_EQUAL(it->key().ToString(), "b");
+    it->Next();
+    it->Next();
+    BOOST_CHECK_EQUAL(it->key().ToString(), "g");
+    it->Prev();
+    BOOST_CHECK_EQUAL(it->value().ToString(), "50");
+    it->Seek("c");
+    BOOST_CHECK_EQUAL(it->key().ToString(), "e");
+
+    // writes made after the iterator was created are not seen by it
+    db.Put("d", "4");
+    db.Delete("e");
+    db.Put("b", "20");
+    db.Delete("g");
+    BOOST_CHECK(ReadForward(it.get()) == expected);
+    BOOST_CHECK(ReadBackward(it.get()) == expected);
+
+    const std::vector<std::string> expected2 = {"a=1", "b=20", "d=4", "h=8"};
+    std::unique_ptr<leveldb::Iterator> it2(db.NewIterator());
+    BOOST_CHECK(ReadForward(it2.get()) == expected2);
+    BOOST_CHECK(ReadBackward(it2.get()) == expected2);
+
+    // nor are the writes after a commit
+    BOOST_CHECK(db.CommitBatch().ok());
+    db.Put("f", "6");
+    BOOST_CHECK(ReadForward(it.get()) == expected);
+    BOOST_CHECK(ReadForward(it2.get()) == expected2);
+    it.reset();
+    it2.reset();
+
+    std::unique_ptr<leveldb::Iterator> it3(db.NewIterator());
+    const std::vector<std::string> expected3 = {"a=1", "b=20", "d=4", "f=6", "h=8"};
+    BOOST_CHECK(ReadForward(it3.get()) == expected3);
+}
+
+BOOST_AUTO_TEST_CASE(binary_records)
+{
+    using namespace mastercore;
+
+    const uint256 txid1 = uint256S("1111111111111111111111111111111111111111111111111111111111111111");
+    const uint256 txid2 = uint256S("2222222222222222222222222222222222222222222222222222222222222222");
+
+    CMPContractMatchRecord match;
+    match.addressMaker = "QPh9K4wVBrbJVJnbLd7q2eKNpK8Cv2SEwP";
+    match.addressTaker = "QTfGsmEbHYsgsDL1ZmUnFHbXCHAjXXGSQf";
+    match.effectivePrice = 123456789;
+    match.nBlockTaker = 250000;
+    match.livesMaker = -7;
+    match.contractId = 5;
+    match.txidMaker = txid1;
+    match.txidTaker = txid2;
+    match.amountTraded = -100;
+
+    CMPContractMatchRecord decoded;
+    BOOST_CHECK(DecodeRecord(EncodeRecord(match), decoded));
+    BOOST_CHECK_EQUAL(decoded.addressMaker, match.addressMaker);
+    BOOST_CHECK_EQUAL(decoded.addressTaker, match.addressTaker);
+    BOOST_CHECK_EQUAL(decoded.effectivePrice, match.effectivePrice);
+    BOOST_CHECK_EQUAL(decoded.nBlockTaker, match.nBlockTaker);
+    BOOST_CHECK_EQUAL(decoded.livesMaker, match.livesMaker);
+    BOOST_CHECK_EQUAL(decoded.contractId, match.contractId);
+    BOOST_CHECK(decoded.txidMaker == txid1);
+    BOOST_CHECK(decoded.txidTaker == txid2);
+    BOOST_CHECK_EQUAL(decoded.amountTraded, match.amountTraded);
+
+    // records of a newer version are not decoded
+    match.nVersion = DB_RECORD_VERSION + 1;
+    BOOST_CHECK(!DecodeRecord(EncodeRecord(match), decoded));
+
+    // keys are typed and never collide with text records
+    const std::string strKey = MakeRecordKey(TRADEDB_CONTRACT_MATCH, txid1, txid2);
+    BOOST_CHECK(IsBinaryRecordKey(strKey));
+    BOOST_CHECK(!IsBinaryRecordKey(txid1.ToString()));
+
+    uint256 key1, key2;
+    BOOST_CHECK(ParseRecordKey(strKey, TRADEDB_CONTRACT_MATCH, key1, key2));
+    BOOST_CHECK(key1 == txid1);
+    BOOST_CHECK(key2 == txid2);
+    BOOST_CHECK(!ParseRecordKey(strKey, TRADEDB_METADEX_MATCH, key1, key2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+#include <tradelayer/createpayload.h>
+#include <tradelayer/tx.h>
+
+#include <test/test_bitcoin.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_tx_payload_tests, BasicTestingSetup)
+
+static void SetPayload(CMPTransaction& mp_obj, std::vector<unsigned char>& vch)
+{
+    mp_obj.Set("sender", "reference", "", 0, uint256(), 100, 1, vch.data(), vch.size(), TL_CLASS_D, 0);
+}
+
+BOOST_AUTO_TEST_CASE(payload_strings)
+{
+    std::string name("Quantum Miner");
+    std::string url("builder.bitwatch.co");
+    std::string data;
+    std::vector<int> kycVec;
+    std::vector<unsigned char> vch = CreatePayload_IssuanceFixed(1, 0, name, url, data, 1000000, kycVec);
+
+    CMPTransaction mp_obj;
+    SetPayload(mp_obj, vch);
+    BOOST_CHECK_EQUAL(mp_obj.getPayloadSize(), (int) vch.size());
+    BOOST_CHECK_EQUAL(mp_obj.getPayload(), HexStr(vch));
+
+    BOOST_CHECK(mp_obj.interpret_Transaction());
+    BOOST_CHECK_EQUAL(mp_obj.getSPName(), name);
+    BOOST_CHECK_EQUAL(mp_obj.getSPUrl(), url);
+    BOOST_CHECK_EQUAL(mp_obj.getSPData(), data);
+    BOOST_CHECK_EQUAL(mp_obj.getAmount(), 1000000U);
+
+    // the strings are decoded from the copied payload
+    CMPTransaction mp_copy(mp_obj);
+    mp_obj.SetNull();
+    BOOST_CHECK_EQUAL(mp_obj.getSPName(), "");
+    BOOST_CHECK_EQUAL(mp_copy.getSPName(), name);
+}
+
+BOOST_AUTO_TEST_CASE(payload_strings_truncated)
+{
+    // version 0, type 50, property type 1, previous property 0
+    std::vector<unsigned char> vch = ParseHex("00320100");
+    vch.insert(vch.end(), 300, 'a');
+    vch.push_back('\0');
+    vch.push_back('u');
+    vch.push_back('\0');
+    vch.push_back('\0');
+    vch.push_back(0x05);
+
+    CMPTransaction mp_obj;
+    SetPayload(mp_obj, vch);
+    mp_obj.interpret_Transaction();
+    BOOST_CHECK_EQUAL(mp_obj.getSPName(), std::string(SP_STRING_FIELD_LEN - 1, 'a'));
+    BOOST_CHECK_EQUAL(mp_obj.getSPUrl(), "u");
+}
+
+BOOST_AUTO_TEST_CASE(payload_strings_unterminated)
+{
+    std::string name("Quantum Miner");
+    std::string url("builder.bitwatch.co");
+    std::string data("data");
+    std::vector<int> kycVec;
+    std::vector<unsigned char> vch = CreatePayload_IssuanceFixed(1, 0, name, url, data, 1000000, kycVec);
+
+    // cut within the name, so the strings run past the end of the payload
+    vch.resize(8);
+
+    CMPTransaction mp_obj;
+    SetPayload(mp_obj, vch);
+    BOOST_CHECK(!mp_obj.interpret_Transaction());
+    BOOST_CHECK_EQUAL(mp_obj.getSPName(), "");
+    BOOST_CHECK_EQUAL(mp_obj.getSPUrl(), "");
+}
+
+BOOST_AUTO_TEST_CASE(payload_large)
+{
+    // larger payloads are kept on the heap
+    std::string name(250, 'n');
+    std::string url(250, 'u');
+    std::string data(250, 'd');
+    std::vector<int> kycVec;
+    std::vector<unsigned char> vch = CreatePayload_IssuanceFixed(2, 0, name, url, data, 7, kycVec);
+    BOOST_CHECK(vch.size() > (size_t) MAX_CLASS_D_SEARCH_BYTES);
+
+    CMPTransaction mp_obj;
+    SetPayload(mp_obj, vch);
+    BOOST_CHECK(mp_obj.interpret_Transaction());
+    BOOST_CHECK_EQUAL(mp_obj.getSPName(), name);
+    BOOST_CHECK_EQUAL(mp_obj.getSPUrl(), url);
+    BOOST_CHECK_EQUAL(mp_obj.getSPData(), data);
+    BOOST_CHECK_EQUAL(mp_obj.getAmount(), 7U);
+    BOOST_CHECK_EQUAL(mp_obj.getPayload(), HexStr(vch));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+#include <tradelayer/volume.h>
+
+#include <test/test_bitcoin.h>
+
+#include <stdint.h>
+
+#include <limits>
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_volume_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(volume_ranges)
+{
+    CMPVolumeHistory volumes;
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 0, 1000), 0);
+
+    volumes.Add(100, 3, 10);
+    volumes.Add(105, 3, 20);
+    volumes.Add(105, 3, 5);
+    volumes.Add(110, 3, 40);
+    volumes.Add(105, 4, 7);
+
+    BOOST_CHECK_EQUAL(volumes.Get(105, 3), 25);
+    BOOST_CHECK_EQUAL(volumes.Get(106, 3), 0);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 0, 999999999), 75);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, -500, 105), 35);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 101, 110), 65);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 101, 109), 25);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 111, 200), 0);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 110, 100), 0);
+    BOOST_CHECK_EQUAL(volumes.Sum(4, 0, 200), 7);
+
+    // updating an older block shifts all later sums
+    volumes.Add(102, 3, 1);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 101, 110), 66);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 105, 110), 65);
+
+    volumes.Set(105, 3, 2);
+    BOOST_CHECK_EQUAL(volumes.Get(105, 3), 2);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 0, 110), 53);
+
+    // large volumes don't affect ranges, which fit into 64 bit
+    const int64_t nMax = std::numeric_limits<int64_t>::max();
+    volumes.Add(50, 3, nMax);
+    volumes.Add(60, 3, nMax);
+    BOOST_CHECK_EQUAL(volumes.Get(60, 3), nMax);
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 100, 110), 53);
+
+    std::map<int, std::map<uint32_t, int64_t> > blocks = volumes.GetBlocks();
+    BOOST_CHECK_EQUAL(blocks.size(), 6U);
+    BOOST_CHECK_EQUAL(blocks[50][3], nMax);
+    BOOST_CHECK_EQUAL(blocks[102][3], 1);
+    BOOST_CHECK_EQUAL(blocks[105][3], 2);
+    BOOST_CHECK_EQUAL(blocks[105][4], 7);
+
+    volumes.Clear();
+    BOOST_CHECK(volumes.Empty());
+    BOOST_CHECK_EQUAL(volumes.Sum(3, 0, 200), 0);
+}
+
+BOOST_AUTO_TEST_CASE(volume_compaction)
+{
+    CMPVolumeHistory volumes;
+    for (int block = 1; block <= 100; ++block) {
+        volumes.Add(block, 1, block);
+        if (block % 2 == 0) volumes.Add(block, 2, 1);
+    }
+    BOOST_CHECK_EQUAL(volumes.Size(), 150U);
+
+    const int64_t nLastDay = volumes.Sum(1, 81, 100);
+    volumes.Compact(80);
+    BOOST_CHECK_EQUAL(volumes.GetCheckpoint(), 80);
+    BOOST_CHECK_EQUAL(volumes.Size(), 32U);
+
+    // ranges after the checkpoint are unchanged
+    BOOST_CHECK_EQUAL(volumes.Sum(1, 81, 100), nLastDay);
+    BOOST_CHECK_EQUAL(volumes.Sum(1, 90, 90), 90);
+    BOOST_CHECK_EQUAL(volumes.Sum(2, 81, 100), 10);
+
+    // the checkpoint carries the whole history
+    BOOST_CHECK_EQUAL(volumes.Sum(1, 0, 100), 5050);
+    BOOST_CHECK_EQUAL(volumes.Sum(2, 0, 100), 50);
+
+    // loading the stored blocks restores the same sums
+    CMPVolumeHistory restored;
+    const std::map<int, std::map<uint32_t, int64_t> > blocks = volumes.GetBlocks();
+    for (const auto& block : blocks) {
+        for (const auto& entry : block.second) {
+            restored.Add(block.first, entry.first, entry.second);
+        }
+    }
+    BOOST_CHECK_EQUAL(restored.Sum(1, 0, 100), 5050);
+    BOOST_CHECK_EQUAL(restored.Sum(1, 81, 100), nLastDay);
+    BOOST_CHECK_EQUAL(restored.Sum(2, 95, 100), 3);
+
+    // the checkpoint is restored with them
+    BOOST_CHECK(!restored.IsCompacted(80));
+    restored.Compact(volumes.GetCheckpoint());
+    BOOST_CHECK(restored.IsCompacted(80));
+    BOOST_CHECK(!restored.IsCompacted(81));
+    BOOST_CHECK_EQUAL(restored.Size(), volumes.Size());
+
+    // compacting an older block doesn't do anything
+    volumes.Compact(50);
+    BOOST_CHECK_EQUAL(volumes.Size(), 32U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+#include <tradelayer/withdrawals.h>
+
+#include <test/test_bitcoin.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_withdrawals_tests, BasicTestingSetup)
+
+static withdrawalAccepted MakeWithdrawal(const std::string& address, int deadline, uint64_t amount, const std::string& txid)
+{
+    withdrawalAccepted w;
+    w.address = address;
+    w.deadline_block = deadline;
+    w.propertyId = 3;
+    w.amount = amount;
+    w.txid = uint256S(txid);
+    return w;
+}
+
+BOOST_AUTO_TEST_CASE(withdrawals_schedule)
+{
+    const std::string txidA = "1111111111111111111111111111111111111111111111111111111111111111";
+    const std::string txidB = "2222222222222222222222222222222222222222222222222222222222222222";
+    const std::string txidC = "3333333333333333333333333333333333333333333333333333333333333333";
+    const std::string txidD = "4444444444444444444444444444444444444444444444444444444444444444";
+
+    CMPWithdrawalSchedule schedule;
+    schedule.Add("chnB", MakeWithdrawal("bob", 107, 10, txidA));
+    schedule.Add("chnA", MakeWithdrawal("alice", 108, 20, txidB));
+    schedule.Add("chnB", MakeWithdrawal("carol", 105, 30, txidC));
+    schedule.Add("chnA", MakeWithdrawal("dave", 120, 40, txidD));
+    BOOST_CHECK_EQUAL(schedule.Size(), 4U);
+    BOOST_CHECK_EQUAL(schedule.GetStats().nDeadlines, 4U);
+
+    BOOST_CHECK(schedule.Contains(txidA, "chnB"));
+    BOOST_CHECK(!schedule.Contains(txidA, "chnA"));
+    BOOST_CHECK(schedule.HasPending("chnA"));
+
+    // nothing is due yet
+    BOOST_CHECK(schedule.PopDue(104).empty());
+    BOOST_CHECK_EQUAL(schedule.Size(), 4U);
+
+    // due withdrawals are ordered by channel, then in the order they were scheduled
+    std::vector<std::pair<std::string, withdrawalAccepted>> due = schedule.PopDue(110);
+    BOOST_CHECK_EQUAL(due.size(), 3U);
+    BOOST_CHECK_EQUAL(due[0].first, "chnA");
+    BOOST_CHECK_EQUAL(due[0].second.address, "alice");
+    BOOST_CHECK_EQUAL(due[1].first, "chnB");
+    BOOST_CHECK_EQUAL(due[1].second.address, "bob");
+    BOOST_CHECK_EQUAL(due[2].second.address, "carol");
+
+    BOOST_CHECK(!schedule.Contains(txidA, "chnB"));
+    BOOST_CHECK(!schedule.HasPending("chnB"));
+    BOOST_CHECK(schedule.Contains(txidD, "chnA"));
+
+    CWithdrawalStats stats = schedule.GetStats();
+    BOOST_CHECK_EQUAL(stats.nPending, 1U);
+    BOOST_CHECK_EQUAL(stats.nDeadlines, 1U);
+    BOOST_CHECK_EQUAL(stats.nScheduled, 4U);
+    BOOST_CHECK_EQUAL(stats.nMatured, 3U);
+    BOOST_CHECK_EQUAL(stats.nLastMatured, 3U);
+
+    schedule.EraseChannel("chnA");
+    BOOST_CHECK(schedule.Empty());
+    BOOST_CHECK(!schedule.Contains(txidD, "chnA"));
+    BOOST_CHECK_EQUAL(schedule.GetStats().nDeadlines, 0U);
+    BOOST_CHECK(schedule.PopDue(200).empty());
+    BOOST_CHECK_EQUAL(schedule.GetStats().nLastMatured, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(withdrawals_foreach)
+{
+    CMPWithdrawalSchedule schedule;
+    schedule.Add("chnB", MakeWithdrawal("bob", 100, 1, "01"));
+    schedule.Add("chnA", MakeWithdrawal("alice", 90, 2, "02"));
+    schedule.Add("chnB", MakeWithdrawal("carol", 80, 3, "03"));
+
+    std::vector<std::string> addresses;
+    schedule.ForEach([&addresses] (const std::string& chnAddr, const withdrawalAccepted& w) { addresses.push_back(chnAddr + ":" + w.address); });
+    BOOST_CHECK_EQUAL(addresses.size(), 3U);
+    BOOST_CHECK_EQUAL(addresses[0], "chnA:alice");
+    BOOST_CHECK_EQUAL(addresses[1], "chnB:bob");
+    BOOST_CHECK_EQUAL(addresses[2], "chnB:carol");
+
+    schedule.Clear();
+    BOOST_CHECK(schedule.Empty());
+    BOOST_CHECK(!schedule.HasPending("chnB"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
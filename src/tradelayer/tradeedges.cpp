@@ -0,0 +1,201 @@
+#include <tradelayer/tradeedges.h>
+
+#include <tradelayer/clearing.h>
+#include <tradelayer/log.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace mastercore;
+
+namespace
+{
+void AppendTrades(CClearingGraph& graph, const CClearingGraph& other)
+{
+    for (const CClearingTrade& trade : other.GetTrades()) {
+        graph.AddTrade(other.GetAddress(trade.address[0]), other.GetStatus(trade.status[0]), trade.lives[0],
+                other.GetAddress(trade.address[1]), other.GetStatus(trade.status[1]), trade.lives[1], trade.amount, trade.price);
+    }
+}
+
+/** An open position left by the settled trades. */
+struct CCarriedPosition
+{
+    uint32_t address;
+    bool fLong;
+    //! Contracts held after the last trade of the address
+    int64_t lives;
+    //! Contracts carried so far
+    int64_t carried;
+    //! Price of the last trade of the address
+    int64_t price;
+};
+
+/** Returns true, if the position is long after a trade with the given status. */
+bool IsLongAfter(const std::string& status)
+{
+    // "OpenLongPosByShortPosNetted" and "OpenShortPosByLongPosNetted" flip the position
+    if (status.compare(0, 4, "Open") == 0) return status.compare(0, 8, "OpenLong") == 0;
+    return status.find("Long") != std::string::npos;
+}
+} // anonymous namespace
+
+CMPTradeEdgeStore::CMPTradeEdgeStore(int nPeriodBlocksIn) : nPeriodBlocks(nPeriodBlocksIn), nSize(0)
+{
+}
+
+void CMPTradeEdgeStore::AddTrade(int block, const std::string& addressSrc, const std::string& statusSrc, int64_t livesSrc,
+        const std::string& addressTrk, const std::string& statusTrk, int64_t livesTrk, int64_t amount, int64_t price)
+{
+    segments[GetPeriod(block)].AddTrade(addressSrc, statusSrc, livesSrc, addressTrk, statusTrk, livesTrk, amount, price);
+    ++nSize;
+    ++stats.nRecorded;
+}
+
+bool CMPTradeEdgeStore::AddTrade(int block, const std::map<std::string, std::string>& edge)
+{
+    const int period = GetPeriod(block);
+    CClearingGraph& segment = segments[period];
+    if (!segment.AddTrade(edge)) {
+        if (segment.Size() == 0) segments.erase(period);
+        ++stats.nRejected;
+        return false;
+    }
+
+    ++nSize;
+    ++stats.nRecorded;
+    return true;
+}
+
+/**
+ * Carries the positions left open by the settled trades, as trades opening,
+ * or increasing, them.
+ *
+ * The lives of a trade are the contracts the address holds afterwards, so the
+ * last trade of each address has its open position, regardless of how the
+ * settlement paired the trades. The longs are paired with the shorts in the
+ * order of the addresses.
+ *
+ * The trades are priced at the settlement price, which the positions were
+ * marked to. If there is none, they are priced halfway between the last trade
+ * prices of both sides.
+ */
+void CMPTradeEdgeStore::Carry(const CClearingGraph& graph, const CClearingResult& result)
+{
+    carried.Clear();
+
+    int64_t exitPrice = 0;
+    const bool fExitPrice = ClearingPriceFromDouble(result.exitPrice, exitPrice);
+
+    // the later trades of an address replace the position of the earlier ones
+    std::map<uint32_t, CCarriedPosition> positions;
+    for (const CClearingTrade& trade : graph.GetTrades()) {
+        for (int side = 0; side < 2; ++side) {
+            CCarriedPosition& position = positions[trade.address[side]];
+            position.address = trade.address[side];
+            position.fLong = IsLongAfter(graph.GetStatus(trade.status[side]));
+            position.lives = trade.lives[side];
+            position.carried = 0;
+            position.price = trade.price;
+        }
+    }
+
+    std::vector<CCarriedPosition> longs;
+    std::vector<CCarriedPosition> shorts;
+    for (const auto& position : positions) {
+        if (position.second.lives <= 0) continue;
+        (position.second.fLong ? longs : shorts).push_back(position.second);
+    }
+
+    size_t posLong = 0;
+    size_t posShort = 0;
+    while (posLong < longs.size() && posShort < shorts.size()) {
+        CCarriedPosition& positionLong = longs[posLong];
+        CCarriedPosition& positionShort = shorts[posShort];
+        const int64_t amount = std::min(positionLong.lives - positionLong.carried, positionShort.lives - positionShort.carried);
+
+        const std::string statusLong = (positionLong.carried == 0) ? "OpenLongPosition" : "LongPosIncreased";
+        const std::string statusShort = (positionShort.carried == 0) ? "OpenShortPosition" : "ShortPosIncreased";
+        positionLong.carried += amount;
+        positionShort.carried += amount;
+
+        const int64_t price = fExitPrice ? exitPrice : positionLong.price / 2 + positionShort.price / 2;
+        carried.AddTrade(graph.GetAddress(positionShort.address), statusShort, positionShort.carried,
+                graph.GetAddress(positionLong.address), statusLong, positionLong.carried, amount, price);
+
+        if (positionLong.carried == positionLong.lives) ++posLong;
+        if (positionShort.carried == positionShort.lives) ++posShort;
+    }
+
+    // only one side can be left, when the lives of both sides don't add up
+    int64_t nDropped = 0;
+    for (; posLong < longs.size(); ++posLong) nDropped += longs[posLong].lives - longs[posLong].carried;
+    for (; posShort < shorts.size(); ++posShort) nDropped += shorts[posShort].lives - shorts[posShort].carried;
+
+    if (nDropped > 0) {
+        PrintToLog("%s(): WARNING: %d lives without counterparty dropped\n", __func__, nDropped);
+        stats.nDroppedLives += nDropped;
+    }
+}
+
+bool CMPTradeEdgeStore::Settle(int block, CClearingGraph& graph, CClearingResult& result)
+{
+    graph.Clear();
+    result.Clear();
+
+    const std::map<int, CClearingGraph>::iterator itEnd = segments.lower_bound(GetPeriod(block));
+    if (itEnd == segments.begin()) return false;
+
+    // the carried positions were opened before any of the trades
+    AppendTrades(graph, carried);
+    size_t nSettled = 0;
+    for (std::map<int, CClearingGraph>::const_iterator it = segments.begin(); it != itEnd; ++it) {
+        AppendTrades(graph, it->second);
+        nSettled += it->second.Size();
+    }
+
+    SettleFifo(graph, result);
+
+    nSize -= carried.Size() + nSettled;
+    segments.erase(segments.begin(), itEnd);
+    Carry(graph, result);
+    nSize += carried.Size();
+
+    ++stats.nSettlements;
+    stats.nSettled += nSettled;
+
+    return true;
+}
+
+void CMPTradeEdgeStore::Load(CClearingGraph& carriedIn, std::map<int, CClearingGraph>& segmentsIn)
+{
+    std::swap(carried, carriedIn);
+    segments.swap(segmentsIn);
+
+    nSize = carried.Size();
+    for (const auto& segment : segments) nSize += segment.second.Size();
+}
+
+void CMPTradeEdgeStore::Clear()
+{
+    carried.Clear();
+    segments.clear();
+    nSize = 0;
+}
+
+CTradeEdgeStats CMPTradeEdgeStore::GetStats() const
+{
+    CTradeEdgeStats result = stats;
+    result.nTrades = nSize;
+    result.nCarried = carried.Size();
+    result.nSegments = segments.size();
+    result.nMemoryUsage = carried.DynamicMemoryUsage();
+    for (const auto& segment : segments) result.nMemoryUsage += segment.second.DynamicMemoryUsage();
+    return result;
+}
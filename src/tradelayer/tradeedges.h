@@ -0,0 +1,93 @@
+#ifndef TRADELAYER_TRADEEDGES_H
+#define TRADELAYER_TRADEEDGES_H
+
+#include <tradelayer/clearing.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+namespace mastercore
+{
+/** Usage statistics of the trade edge store. */
+struct CTradeEdgeStats
+{
+    //! Trades held, including the carried ones
+    size_t nTrades;
+    //! Trades carrying the open positions of the settled periods
+    size_t nCarried;
+    //! Settlement periods with trades, which weren't settled yet
+    size_t nSegments;
+    //! Estimated memory used by the trades, in bytes
+    size_t nMemoryUsage;
+    //! Trades recorded since the state was loaded
+    uint64_t nRecorded;
+    //! Recorded trades, which were dropped as malformed
+    uint64_t nRejected;
+    //! Settlements run
+    uint64_t nSettlements;
+    //! Trades settled and compacted away
+    uint64_t nSettled;
+    //! Live contracts without counterparty, which couldn't be carried
+    uint64_t nDroppedLives;
+
+    CTradeEdgeStats() : nTrades(0), nCarried(0), nSegments(0), nMemoryUsage(0), nRecorded(0), nRejected(0), nSettlements(0), nSettled(0), nDroppedLives(0) {}
+};
+
+/** Matched contract trades, segmented by settlement period.
+ *
+ * Trades are kept per period until the period is settled. The settlement
+ * replaces the trades of the settled periods by the open positions they left,
+ * which are carried as trades opening them at the settlement price, so the
+ * memory used stays proportional to the open exposure.
+ */
+class CMPTradeEdgeStore
+{
+private:
+    //! Blocks of a settlement period
+    int nPeriodBlocks;
+    //! Open positions left by the settled periods
+    CClearingGraph carried;
+    //! Trades of the periods not settled yet, by period
+    std::map<int, CClearingGraph> segments;
+    size_t nSize;
+    CTradeEdgeStats stats;
+
+    void Carry(const CClearingGraph& graph, const CClearingResult& result);
+
+public:
+    explicit CMPTradeEdgeStore(int nPeriodBlocks);
+
+    /** Returns the settlement period of a block. */
+    int GetPeriod(int block) const { return block / nPeriodBlocks; }
+
+    /** Records a trade matched in the given block. */
+    void AddTrade(int block, const std::string& addressSrc, const std::string& statusSrc, int64_t livesSrc,
+            const std::string& addressTrk, const std::string& statusTrk, int64_t livesTrk, int64_t amount, int64_t price);
+    /** Records a trade built as edge by buildingEdge(), fails if the edge is malformed. */
+    bool AddTrade(int block, const std::map<std::string, std::string>& edge);
+
+    /** Settles the carried positions with the trades of the periods before the one of the given block.
+     *
+     * The settled trades are replaced by the positions left open. Returns
+     * false, if there are no trades to settle.
+     */
+    bool Settle(int block, CClearingGraph& graph, CClearingResult& result);
+
+    const CClearingGraph& GetCarried() const { return carried; }
+    const std::map<int, CClearingGraph>& GetSegments() const { return segments; }
+    /** Replaces all trades, as restored from a snapshot. */
+    void Load(CClearingGraph& carriedIn, std::map<int, CClearingGraph>& segmentsIn);
+
+    size_t Size() const { return nSize; }
+    bool Empty() const { return nSize == 0; }
+    void Clear();
+
+    CTradeEdgeStats GetStats() const;
+};
+
+} // namespace mastercore
+
+#endif // TRADELAYER_TRADEEDGES_H
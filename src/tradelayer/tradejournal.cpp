@@ -0,0 +1,323 @@
+#include <tradelayer/tradejournal.h>
+
+#include <tradelayer/log.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <fs.h>
+#include <hash.h>
+#include <serialize.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <uint256.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace mastercore;
+
+namespace
+{
+const char TRADE_JOURNAL_MAGIC[4] = {'T', 'L', 'T', 'J'};
+const uint32_t TRADE_JOURNAL_VERSION = 1;
+const size_t TRADE_JOURNAL_HEADER_SIZE = sizeof(TRADE_JOURNAL_MAGIC) + sizeof(uint32_t) + sizeof(int32_t);
+//! Largest record payload accepted, anything larger is considered corrupted
+const uint32_t MAX_TRADE_JOURNAL_RECORD = 64 * 1024 * 1024;
+
+//! Types of records
+const uint8_t RECORD_TRADES = 0;
+const uint8_t RECORD_ROLLBACK = 1;
+
+const std::string TRADE_JOURNAL_PREFIX = "trades-";
+const std::string TRADE_JOURNAL_SUFFIX = ".dat";
+
+uint32_t GetChecksum(const std::vector<char>& payload)
+{
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    return ReadLE32(hash.begin());
+}
+
+/** Reads and verifies the header of a journal file. */
+bool ReadHeader(FILE* file)
+{
+    unsigned char header[TRADE_JOURNAL_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) return false;
+
+    return memcmp(header, TRADE_JOURNAL_MAGIC, sizeof(TRADE_JOURNAL_MAGIC)) == 0 &&
+            ReadLE32(header + sizeof(TRADE_JOURNAL_MAGIC)) == TRADE_JOURNAL_VERSION;
+}
+
+/** Reads the payload of the next record, fails at the end of the file or an incomplete or corrupted record. */
+bool ReadRecord(FILE* file, std::vector<char>& payload)
+{
+    unsigned char buf[4];
+    if (fread(buf, 1, sizeof(buf), file) != sizeof(buf)) return false;
+    const uint32_t nLength = ReadLE32(buf);
+    if (nLength > MAX_TRADE_JOURNAL_RECORD) return false;
+
+    payload.resize(nLength);
+    if (fread(payload.data(), 1, payload.size(), file) != payload.size()) return false;
+    if (fread(buf, 1, sizeof(buf), file) != sizeof(buf)) return false;
+
+    return ReadLE32(buf) == GetChecksum(payload);
+}
+
+/** Lists the journal files of a directory by the first block they cover. */
+std::map<int, fs::path> ListFiles(const fs::path& dir)
+{
+    std::map<int, fs::path> files;
+    if (!fs::is_directory(dir)) return files;
+
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+        const std::string name = it->path().filename().string();
+        if (name.size() <= TRADE_JOURNAL_PREFIX.size() + TRADE_JOURNAL_SUFFIX.size()) continue;
+        if (name.compare(0, TRADE_JOURNAL_PREFIX.size(), TRADE_JOURNAL_PREFIX) != 0) continue;
+        if (name.compare(name.size() - TRADE_JOURNAL_SUFFIX.size(), TRADE_JOURNAL_SUFFIX.size(), TRADE_JOURNAL_SUFFIX) != 0) continue;
+
+        const std::string strStart = name.substr(TRADE_JOURNAL_PREFIX.size(), name.size() - TRADE_JOURNAL_PREFIX.size() - TRADE_JOURNAL_SUFFIX.size());
+        int32_t nStart = 0;
+        if (!ParseInt32(strStart, &nStart) || nStart < 0) continue;
+        files[nStart] = it->path();
+    }
+
+    return files;
+}
+} // anonymous namespace
+
+fs::path mastercore::GetTradeJournalFile(const fs::path& dir, int nFileStart)
+{
+    return dir / strprintf("%s%010d%s", TRADE_JOURNAL_PREFIX, nFileStart, TRADE_JOURNAL_SUFFIX);
+}
+
+CMPTradeJournal::CMPTradeJournal() : nFileBlocks(0), file(nullptr), nFileStart(-1), nBlock(0), fDirty(false)
+{
+}
+
+CMPTradeJournal::~CMPTradeJournal()
+{
+    Close();
+}
+
+bool CMPTradeJournal::Open(const fs::path& dirIn, int nFileBlocksIn)
+{
+    Close();
+    if (nFileBlocksIn <= 0) return false;
+
+    dir = dirIn;
+    TryCreateDirectory(dir);
+    if (!fs::is_directory(dir)) {
+        PrintToLog("%s(): ERROR: failed to create %s\n", __func__, dir.string());
+        return false;
+    }
+
+    // continue with the latest file
+    const std::map<int, fs::path> files = ListFiles(dir);
+    nFileStart = files.empty() ? -1 : files.rbegin()->first;
+    nFileBlocks = nFileBlocksIn;
+
+    return true;
+}
+
+void CMPTradeJournal::Close()
+{
+    if (!IsOpen()) return;
+
+    Commit();
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+    nFileBlocks = 0;
+    nFileStart = -1;
+}
+
+/**
+ * Opens the file for the trades of a block.
+ *
+ * Files are only rotated forward, so the trades of the blocks journaled
+ * again after a reorg follow the superseded ones in the open file. An
+ * incomplete record, left by an interrupted write, is cut off the end of
+ * a file before anything is appended.
+ */
+bool CMPTradeJournal::OpenFile(int block)
+{
+    const int nStart = std::max(block - block % nFileBlocks, nFileStart);
+    if (file != nullptr && nStart == nFileStart) return true;
+
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+
+    const fs::path path = GetTradeJournalFile(dir, nStart);
+    long nValidSize = 0;
+    FILE* fileIn = fsbridge::fopen(path, "rb");
+    if (fileIn != nullptr) {
+        std::vector<char> payload;
+        if (ReadHeader(fileIn)) {
+            while (ReadRecord(fileIn, payload)) nValidSize = ftell(fileIn);
+            if (nValidSize == 0) nValidSize = TRADE_JOURNAL_HEADER_SIZE;
+        }
+        fclose(fileIn);
+
+        try {
+            if (fs::file_size(path) != static_cast<uintmax_t>(nValidSize)) {
+                PrintToLog("%s(): truncating %s to %d bytes\n", __func__, path.string(), nValidSize);
+                fs::resize_file(path, nValidSize);
+            }
+        } catch (const fs::filesystem_error& e) {
+            PrintToLog("%s(): ERROR: %s\n", __func__, e.what());
+            return false;
+        }
+    }
+
+    file = fsbridge::fopen(path, "ab");
+    if (file == nullptr) {
+        PrintToLog("%s(): ERROR: failed to open %s\n", __func__, path.string());
+        return false;
+    }
+    nFileStart = nStart;
+
+    if (nValidSize == 0) {
+        unsigned char header[TRADE_JOURNAL_HEADER_SIZE];
+        memcpy(header, TRADE_JOURNAL_MAGIC, sizeof(TRADE_JOURNAL_MAGIC));
+        WriteLE32(header + sizeof(TRADE_JOURNAL_MAGIC), TRADE_JOURNAL_VERSION);
+        WriteLE32(header + sizeof(TRADE_JOURNAL_MAGIC) + sizeof(uint32_t), nStart);
+        if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+            PrintToLog("%s(): ERROR: failed to write %s\n", __func__, path.string());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CMPTradeJournal::WriteRecord(uint8_t type, int block, const std::vector<CTradeJournalEntry>& entries)
+{
+    if (!OpenFile(block)) return false;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << type;
+    ss << VARINT(block);
+    if (type == RECORD_TRADES) ss << entries;
+    const std::vector<char> payload(ss.begin(), ss.end());
+
+    unsigned char buf[4];
+    WriteLE32(buf, payload.size());
+    bool fSuccess = (fwrite(buf, 1, sizeof(buf), file) == sizeof(buf));
+    fSuccess &= (fwrite(payload.data(), 1, payload.size(), file) == payload.size());
+    WriteLE32(buf, GetChecksum(payload));
+    fSuccess &= (fwrite(buf, 1, sizeof(buf), file) == sizeof(buf));
+
+    if (!fSuccess) {
+        PrintToLog("%s(): ERROR: failed to write the trades of block %d\n", __func__, block);
+    }
+    fDirty = true;
+
+    return fSuccess;
+}
+
+void CMPTradeJournal::Append(int block, const CTradeJournalEntry& entry)
+{
+    if (!IsOpen()) return;
+
+    // the trades of a block are written together
+    if (!pending.empty() && block != nBlock) {
+        WriteRecord(RECORD_TRADES, nBlock, pending);
+        pending.clear();
+    }
+    nBlock = block;
+    pending.push_back(entry);
+}
+
+bool CMPTradeJournal::Commit()
+{
+    if (!IsOpen()) return true;
+
+    bool fSuccess = true;
+    if (!pending.empty()) {
+        fSuccess = WriteRecord(RECORD_TRADES, nBlock, pending);
+        pending.clear();
+    }
+
+    if (fDirty && file != nullptr) {
+        FileCommit(file);
+        fDirty = false;
+    }
+
+    return fSuccess;
+}
+
+bool CMPTradeJournal::Rollback(int block)
+{
+    if (!IsOpen()) return true;
+
+    // buffered trades of the dropped blocks are never written
+    if (!pending.empty() && nBlock >= block) pending.clear();
+
+    bool fSuccess = Commit();
+    fSuccess &= WriteRecord(RECORD_ROLLBACK, block, std::vector<CTradeJournalEntry>());
+    fSuccess &= Commit();
+
+    return fSuccess;
+}
+
+bool mastercore::ReadTradeJournal(const fs::path& dir, int nFirst, int nLast, std::map<int, std::vector<CTradeJournalEntry>>& blocks)
+{
+    blocks.clear();
+
+    for (const auto& item : ListFiles(dir)) {
+        const fs::path& path = item.second;
+        FILE* file = fsbridge::fopen(path, "rb");
+        if (file == nullptr) {
+            PrintToLog("%s(): ERROR: failed to open %s\n", __func__, path.string());
+            return false;
+        }
+
+        if (!ReadHeader(file)) {
+            PrintToLog("%s(): skipping %s, which isn't a trade journal\n", __func__, path.string());
+            fclose(file);
+            continue;
+        }
+
+        std::vector<char> payload;
+        while (ReadRecord(file, payload)) {
+            uint8_t type = 0;
+            int block = 0;
+            std::vector<CTradeJournalEntry> entries;
+            try {
+                CDataStream ss(payload.data(), payload.data() + payload.size(), SER_DISK, CLIENT_VERSION);
+                ss >> type;
+                ss >> VARINT(block);
+                if (type == RECORD_TRADES) ss >> entries;
+            } catch (const std::exception& e) {
+                PrintToLog("%s(%s): ERROR: %s\n", __func__, path.string(), e.what());
+                break;
+            }
+
+            if (type == RECORD_ROLLBACK) {
+                blocks.erase(blocks.lower_bound(block), blocks.end());
+            } else if (type == RECORD_TRADES) {
+                if (block < nFirst || block > nLast) continue;
+                std::vector<CTradeJournalEntry>& trades = blocks[block];
+                trades.insert(trades.end(), entries.begin(), entries.end());
+            } else {
+                PrintToLog("%s(%s): ERROR: unknown record type %d\n", __func__, path.string(), type);
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    return true;
+}
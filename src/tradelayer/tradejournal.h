@@ -0,0 +1,131 @@
+#ifndef TRADELAYER_TRADEJOURNAL_H
+#define TRADELAYER_TRADEJOURNAL_H
+
+#include <tradelayer/dbrecords.h>
+
+#include <fs.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** Append-only journal of the matched contract trades.
+ *
+ * The trades matched in a block are buffered in memory, and written as one
+ * record with a single fsync, once the block was processed. The journal is
+ * split into files covering a fixed number of blocks each, named after the
+ * first block they cover:
+ *
+ *  Header:
+ *      char[4]   "TLTJ"
+ *      uint32_t  format version
+ *      int32_t   first block covered
+ *
+ *  Records:
+ *      uint32_t  payload length
+ *      char[]    payload: record type, varint block, and for trades the
+ *                compactsize number of trades and the trades
+ *      uint32_t  first four bytes of the double SHA256 of the payload
+ *
+ * The trades of a block are usually written as one record, but may span
+ * several. A rollback record, written when blocks are disconnected or
+ * scanned again, drops the trades of its block and all higher blocks
+ * written before it.
+ */
+namespace mastercore
+{
+/** A matched contract trade, as one position change of maker and taker. */
+struct CTradeJournalEntry
+{
+    uint32_t contractId;
+    uint256 txidMaker;
+    uint256 txidTaker;
+    std::string addressMaker;
+    std::string addressTaker;
+    std::string statusMaker;
+    std::string statusTaker;
+    int64_t livesMaker;
+    int64_t livesTaker;
+    //! Number of contracts traded
+    int64_t amount;
+    uint64_t effectivePrice;
+
+    CTradeJournalEntry() : contractId(0), livesMaker(0), livesTaker(0), amount(0), effectivePrice(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(contractId));
+        READWRITE(txidMaker);
+        READWRITE(txidTaker);
+        READWRITE(addressMaker);
+        READWRITE(addressTaker);
+        READWRITE(statusMaker);
+        READWRITE(statusTaker);
+        READWRITE(SVARINT(livesMaker));
+        READWRITE(SVARINT(livesTaker));
+        READWRITE(SVARINT(amount));
+        READWRITE(VARINT(effectivePrice));
+    }
+};
+
+/** Writes the journal of the matched contract trades. */
+class CMPTradeJournal
+{
+private:
+    fs::path dir;
+    //! Blocks covered by a file
+    int nFileBlocks;
+    FILE* file;
+    //! First block covered by the open file
+    int nFileStart;
+    //! Block of the buffered trades
+    int nBlock;
+    std::vector<CTradeJournalEntry> pending;
+    //! Whether records were written since the last sync
+    bool fDirty;
+
+    bool OpenFile(int block);
+    bool WriteRecord(uint8_t type, int block, const std::vector<CTradeJournalEntry>& entries);
+
+public:
+    CMPTradeJournal();
+    ~CMPTradeJournal();
+
+    /** Writes the journal to the given directory, with a new file every nFileBlocks blocks. */
+    bool Open(const fs::path& dir, int nFileBlocks);
+    /** Flushes the buffered trades and closes the journal. */
+    void Close();
+    bool IsOpen() const { return nFileBlocks > 0; }
+    const fs::path& GetPath() const { return dir; }
+
+    /** Buffers a trade matched in the given block. */
+    void Append(int block, const CTradeJournalEntry& entry);
+    /** Writes the buffered trades to disk and syncs the file, fails if they were not written. */
+    bool Commit();
+    /** Drops the trades of a disconnected block and all later ones from the journal. */
+    bool Rollback(int block);
+};
+
+/** Returns the path of the journal file starting with the given block. */
+fs::path GetTradeJournalFile(const fs::path& dir, int nFileStart);
+
+/** Replays the journal in a directory, and collects the trades of the blocks from nFirst to nLast.
+ *
+ * Only complete records are read, so the trades of a block still being
+ * connected are not returned. Trades dropped by a rollback are skipped, and
+ * a file ends at the first incomplete or corrupted record. Fails if a file
+ * couldn't be read.
+ */
+bool ReadTradeJournal(const fs::path& dir, int nFirst, int nLast, std::map<int, std::vector<CTradeJournalEntry>>& blocks);
+
+} // namespace mastercore
+
+#endif // TRADELAYER_TRADEJOURNAL_H
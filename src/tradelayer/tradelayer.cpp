@@ -7,12 +7,14 @@
 #include <tradelayer/tradelayer.h>
 
 #include <tradelayer/activation.h>
+#include <tradelayer/clearing.h>
 #include <tradelayer/consensushash.h>
 #include <tradelayer/convert.h>
 #include <tradelayer/dex.h>
 #include <tradelayer/encoding.h>
 #include <tradelayer/errors.h>
 #include <tradelayer/externfns.h>
+#include <tradelayer/inputcache.h>
 #include <tradelayer/log.h>
 #include <tradelayer/mdex.h>
 #include <tradelayer/notifications.h>
@@ -23,7 +25,9 @@
 #include <tradelayer/rules.h>
 #include <tradelayer/script.h>
 #include <tradelayer/sp.h>
+#include <tradelayer/statewriter.h>
 #include <tradelayer/tally.h>
+#include <tradelayer/tradejournal.h>
 #include <tradelayer/tradelayer_matrices.h>
 #include <tradelayer/tx.h>
 #include <tradelayer/uint256_extensions.h>
@@ -35,6 +39,7 @@
 #include <arith_uint256.h>
 #include <base58.h>
 #include <chainparams.h>
+#include <clientversion.h>
 #include <coins.h>
 #include <consensus/params.h>
 #include <consensus/tx_verify.h>
@@ -42,6 +47,7 @@
 #include <core_io.h>
 #include <init.h>
 #include <net.h> // for g_connman.get()
+#include <prevector.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
@@ -63,17 +69,24 @@
 #endif
 
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <cmath>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <univalue.h>
 #include <unordered_map>
 #include <vector>
@@ -160,7 +173,8 @@ std::map<uint32_t, std::vector<int64_t>> mapContractAmountTimesPrice;
 std::map<uint32_t, std::vector<int64_t>> mapContractVolume;
 std::map<uint32_t, int64_t> VWAPMapContracts;
 std::vector<std::map<std::string, std::string>> path_ele;
-std::vector<std::map<std::string, std::string>> path_elef;
+mastercore::CMPTradeEdgeStore tradeEdges(BlockS);
+mastercore::CMPTradeJournal tradeJournal;
 
 std::map<uint32_t, std::vector<uint64_t>> cdextwap_ele;
 std::map<uint32_t, std::vector<uint64_t>> cdextwap_vec;
@@ -407,38 +421,127 @@ std::string mastercore::getTokenLabel(uint32_t propertyId)
   return tokenStr;
 }
 
+/**
+ * Running totals per property over all tallies.
+ *
+ * Built with one pass over the tally map when first needed, and kept up to
+ * date by update_tally_map() afterwards.
+ *
+ * Guarded by cs_tally.
+ */
+static std::unordered_map<uint32_t, CMPTallyTotals> tallyTotals;
+//! Whether the running totals reflect the tally map
+static bool fTallyTotalsValid = false;
+
+// sums up the totals of a single property with a full pass over the tally map
+static CMPTallyTotals ScanTallyTotals(uint32_t propertyId)
+{
+    CMPTallyTotals totals;
+    for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        const CMPTally& tally = it->second;
+        for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+            totals.total[ttype] += tally.getMoney(propertyId, static_cast<TallyType>(ttype));
+        }
+        const int64_t position = tally.getMoney(propertyId, CONTRACT_BALANCE);
+        (position > 0) ? totals.longs += position : totals.shorts += position;
+        if (tally.getMoneySupply(propertyId) != 0) ++totals.owners;
+    }
+    return totals;
+}
+
+// builds the totals of all properties with one pass over the tally map
+static void BuildTallyTotals()
+{
+    tallyTotals.clear();
+    for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        for (const CMPTally::BalanceRecord& record : it->second) {
+            CMPTallyTotals& totals = tallyTotals[record.propertyId];
+            for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+                totals.total[ttype] += record.balance[ttype];
+            }
+            const int64_t position = record.balance[CONTRACT_BALANCE];
+            (position > 0) ? totals.longs += position : totals.shorts += position;
+            if (it->second.getMoneySupply(record.propertyId) != 0) ++totals.owners;
+        }
+    }
+    fTallyTotalsValid = true;
+}
+
+// applies a successful update of a tally to the totals of the property
+static void UpdateTallyTotals(const CMPTally& tally, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
+    if (!fTallyTotalsValid) return;
+
+    CMPTallyTotals& totals = tallyTotals[propertyId];
+    totals.total[ttype] += amount;
+
+    if (isSupplyTallyType(ttype)) {
+        const int64_t after = tally.getMoneySupply(propertyId);
+        const int64_t before = after - amount;
+        if (before == 0 && after != 0) ++totals.owners;
+        if (before != 0 && after == 0) --totals.owners;
+    }
+
+    if (ttype == CONTRACT_BALANCE) {
+        const int64_t after = tally.getMoney(propertyId, CONTRACT_BALANCE);
+        const int64_t before = after - amount;
+        totals.longs += std::max(after, int64_t(0)) - std::max(before, int64_t(0));
+        totals.shorts += std::min(after, int64_t(0)) - std::min(before, int64_t(0));
+    }
+}
+
+void mastercore::InvalidateTallyTotals()
+{
+    LOCK(cs_tally);
+
+    tallyTotals.clear();
+    fTallyTotalsValid = false;
+}
+
+CMPTallyTotals mastercore::getTallyTotals(uint32_t propertyId)
+{
+    LOCK(cs_tally);
+
+    if (!fTallyTotalsValid) BuildTallyTotals();
+
+    CMPTallyTotals totals;
+    std::unordered_map<uint32_t, CMPTallyTotals>::const_iterator it = tallyTotals.find(propertyId);
+    if (it != tallyTotals.end()) totals = it->second;
+
+    if (msc_debug_tally_totals) {
+        const CMPTallyTotals scanned = ScanTallyTotals(propertyId);
+        if (scanned != totals) {
+            PrintToLog("%s(%d): ERROR: running totals differ from the tally map [supply: %d vs. %d, longs: %d vs. %d, shorts: %d vs. %d, owners: %d vs. %d]\n",
+                __func__, propertyId, totals.getSupply(), scanned.getSupply(), totals.longs, scanned.longs, totals.shorts, scanned.shorts, totals.owners, scanned.owners);
+        }
+    }
+
+    return totals;
+}
+
 // get total tokens for a property
 // optionally counts the number of addresses who own that property: n_owners_total
 int64_t mastercore::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
 {
-  int64_t prev = 0;
   int64_t owners = 0;
   int64_t totalTokens = 0;
 
   LOCK(cs_tally);
 
-  CMPSPInfo::Entry property;
-  if (! _my_sps->getSP(propertyId, property)) {
+  std::shared_ptr<const CMPSPInfo::Entry> property = _my_sps->getSPHandle(propertyId);
+  if (!property) {
     return 0; // property ID does not exist
   }
 
-  if (!property.fixed || n_owners_total) {
-    for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-      const CMPTally& tally = it->second;
-      totalTokens += tally.getMoney(propertyId, BALANCE);
-      totalTokens += tally.getMoney(propertyId, SELLOFFER_RESERVE);
-      totalTokens += tally.getMoney(propertyId, ACCEPT_RESERVE);
-      totalTokens += tally.getMoney(propertyId, METADEX_RESERVE);
-      totalTokens += tally.getMoney(propertyId, CONTRACTDEX_RESERVE); // amount in margin
-      if (prev != totalTokens) {
-	      prev = totalTokens;
-	      owners++;
-      }
-    }
+  if (!property->fixed || n_owners_total) {
+    // balance and reserves, including the amount in margin
+    const CMPTallyTotals totals = getTallyTotals(propertyId);
+    totalTokens = totals.getSupply();
+    owners = totals.owners;
   }
 
-  if (property.fixed) {
-    totalTokens = property.num_tokens; // only valid for TX50
+  if (property->fixed) {
+    totalTokens = property->num_tokens; // only valid for TX50
   }
 
   if (n_owners_total) *n_owners_total = owners;
@@ -474,6 +577,11 @@ bool mastercore::update_tally_map(const std::string& who, uint32_t propertyId, i
 
     CMPTally& tally = my_it->second;
     bRet = tally.updateMoney(propertyId, amount, ttype);
+    if (bRet) {
+        NotifyConsensusBalanceChanged(who, propertyId);
+        NotifyStateBalanceChanged(who, propertyId);
+        UpdateTallyTotals(tally, propertyId, amount, ttype);
+    }
 
     after = getMPbalance(who, propertyId, ttype);
     if (!bRet) {
@@ -516,7 +624,7 @@ void CMPTradeList::NotifyPeggedCurrency(const uint256& txid, string address, uin
     Status status;
     if (pdb)
     {
-        status = pdb->Put(writeoptions, key, value);
+        status = Put(key, value);
         ++ nWritten;
         // if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
     }
@@ -544,10 +652,9 @@ void CheckWalletUpdate(bool forceUpdate)
         std::string address = my_it->first;
         int addressIsMine = IsMyAddress(address);
         if (!addressIsMine) continue;
-        // iterate only those properties in the TokenMap for this address
-        my_it->second.init();
-        uint32_t propertyId;
-        while (0 != (propertyId = (my_it->second).next())) {
+        // iterate only those properties in the tally of this address
+        for (const CMPTally::BalanceRecord& record : my_it->second) {
+            const uint32_t propertyId = record.propertyId;
             // add to the global wallet property list
             global_wallet_property_list.insert(propertyId);
             // check if the address is spendable (only spendable balances are included in totals)
@@ -631,64 +738,22 @@ void creatingVestingTokens(int block)
  */
 int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
 {
-    bool hasOpReturn = false;
+    static const std::vector<unsigned char> vchMarker = GetTLMarker();
 
-    /* Fast Search
-     * Perform a string comparison on hex for each scriptPubKey & look directly for Trade Layer marker bytes
-     * This allows to drop non- Trade Layer transactions with less work
+    /* The scripts are checked directly for an OP_RETURN output, whose first
+     * pushed element equals, or starts with the "pp" marker, which allows to
+     * drop non- Trade Layer transactions without any allocation
      */
-    std::string strClassD = "7070"; /*the pp marker*/
-    bool examineClosely = false;
-    for (unsigned int n = 0; n < tx.vout.size(); ++n) {
-        const CTxOut& output = tx.vout[n];
-        std::string strSPB = HexStr(output.scriptPubKey.begin(), output.scriptPubKey.end());
-        if (strSPB.find(strClassD) != std::string::npos) {
-            examineClosely = true;
-            break;
-        }
-    }
-
-    // Examine everything when not on mainnet
-    if (isNonMainNet()) {
-        examineClosely = true;
-    }
-
-    if (!examineClosely) return NO_MARKER;
-
     for (unsigned int n = 0; n < tx.vout.size(); ++n) {
         const CTxOut& output = tx.vout[n];
 
-        txnouttype outType;
-        if (!GetOutputType(output.scriptPubKey, outType)) {
+        if (!HasDataMarker(output.scriptPubKey, vchMarker)) {
             continue;
         }
-        if (!IsAllowedOutputType(outType, nBlock)) {
+        if (!IsAllowedOutputType(TX_NULL_DATA, nBlock)) {
             continue;
         }
 
-        if (outType == TX_NULL_DATA) {
-            // Ensure there is a payload, and the first pushed element equals,
-            // or starts with the "tl" marker
-            std::vector<std::string> scriptPushes;
-            if (!GetScriptPushes(output.scriptPubKey, scriptPushes)) {
-                continue;
-            }
-
-            if (!scriptPushes.empty()) {
-                std::vector<unsigned char> vchMarker = GetTLMarker();
-                std::vector<unsigned char> vchPushed = ParseHex(scriptPushes[0]);
-                if (vchPushed.size() < vchMarker.size()) {
-                    continue;
-                }
-                if (std::equal(vchMarker.begin(), vchMarker.end(), vchPushed.begin())) {
-                    hasOpReturn = true;
-                }
-            }
-        }
-    }
-
-    if (hasOpReturn) {
-
         PrintToLog("%s(): HAS OP RETURN!\n",__func__);
         return TL_CLASS_D;
     }
@@ -696,74 +761,9 @@ int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
     return NO_MARKER;
 }
 
-// TODO: move
-CCoinsView mastercore::viewDummy;
-CCoinsViewCache mastercore::view(&viewDummy);
-
-//! Guards coins view cache
+//! Guards the input cache
 CCriticalSection mastercore::cs_tx_cache;
 
-static unsigned int nCacheHits = 0;
-static unsigned int nCacheMiss = 0;
-
-/**
- * Fetches transaction inputs and adds them to the coins view cache.
- *
- * @param tx[in]  The transaction to fetch inputs for
- * @return True, if all inputs were successfully added to the cache
- */
-static bool FillTxInputCache(const CTransaction& tx, const std::shared_ptr<std::map<COutPoint, Coin>> removedCoins)
-{
-    static unsigned int nCacheSize = gArgs.GetArg("-tltxcache", 500000);
-
-    if (view.GetCacheSize() > nCacheSize) {
-        if(msc_debug_fill_tx_input_cache) PrintToLog("%s(): clearing cache before insertion [size=%d, hit=%d, miss=%d]\n", __func__, view.GetCacheSize(), nCacheHits, nCacheMiss);
-        view.Flush();
-    }
-
-    for (std::vector<CTxIn>::const_iterator it = tx.vin.begin(); it != tx.vin.end(); ++it)
-    {
-        const CTxIn& txIn = *it;
-        unsigned int nOut = txIn.prevout.n;
-        const Coin& coin = view.AccessCoin(txIn.prevout);
-
-        if (!coin.IsSpent())
-        {
-            if(msc_debug_fill_tx_input_cache) PrintToLog("%s(): coin.IsSpent() == false, nCacheHits: %d \n",__func__, nCacheHits);
-            ++nCacheHits;
-            continue;
-        } else {
-            if(msc_debug_fill_tx_input_cache) PrintToLog("%s(): coin.IsSpent() == true, nCacheHits: %d \n",__func__, nCacheHits);
-            ++nCacheMiss;
-        }
-
-        CTransactionRef txPrev;
-        uint256 hashBlock;
-        Coin newcoin;
-        if (removedCoins && removedCoins->find(txIn.prevout) != removedCoins->end())
-        {
-            newcoin = removedCoins->find(txIn.prevout)->second;
-            if(msc_debug_fill_tx_input_cache) PrintToLog("%s(): newcoin = removedCoins->find(txIn.prevout)->second \n",__func__);
-        } else if (GetTransaction(txIn.prevout.hash, txPrev, Params().GetConsensus(), hashBlock, true)) {
-
-            newcoin.out.scriptPubKey = txPrev->vout[nOut].scriptPubKey;
-            newcoin.out.nValue = txPrev->vout[nOut].nValue;
-            if(msc_debug_fill_tx_input_cache) PrintToLog("%s():GetTransaction == true, nValue: %d\n",__func__, txPrev->vout[nOut].nValue);
-            BlockMap::iterator bit = mapBlockIndex.find(hashBlock);
-            newcoin.nHeight = bit != mapBlockIndex.end() ? bit->second->nHeight : 1;
-        } else {
-            if(msc_debug_fill_tx_input_cache) PrintToLog("%s():GetTransaction == false\n",__func__);
-            return false;
-        }
-
-        if(msc_debug_fill_tx_input_cache) PrintToLog("%s(): nCacheHits: %d, nCacheMiss: %d, nCacheSize: %d\n",__func__, nCacheHits, nCacheMiss, nCacheSize);
-
-        view.AddCoin(txIn.prevout, std::move(newcoin), true);
-    }
-
-    return true;
-}
-
 // idx is position within the block, 0-based
 // int msc_tx_push(const CTransaction &wtx, int nBlock, unsigned int idx)
 // INPUT: bRPConly -- set to true to avoid moving funds; to be called from various RPC calls like this
@@ -793,23 +793,20 @@ static int parseTransaction(bool bRPConly, const CTransaction& wtx, int nBlock,
     int64_t inAll = 0;
 
     { // needed to ensure the cache isn't cleared in the meantime when doing parallel queries
-        LOCK2(cs_main, cs_tx_cache); // cs_main should be locked first to avoid deadlocks with cs_tx_cache at FillTxInputCache(...)->GetTransaction(...)->LOCK(cs_main)
+        LOCK2(cs_main, cs_tx_cache); // cs_main should be locked first to avoid deadlocks with cs_tx_cache at ResolveInputs(...)->GetTransaction(...)->LOCK(cs_main)
 
-        // Add previous transaction inputs to the cache
-        if (!FillTxInputCache(wtx, removedCoins)) {
+        // Fetch the outputs spent by the transaction
+        std::vector<CTxOut> vPrevOuts;
+        if (!ResolveInputs(wtx, removedCoins, vPrevOuts)) {
             PrintToLog("%s() ERROR: failed to get inputs for %s\n", __func__, wtx.GetHash().GetHex());
             return -101;
         }
 
-        assert(view.HaveInputs(wtx));
-
         // determine the sender, but invalidate transaction, if the input is not accepted
         unsigned int vin_n = 0; // the first input
         if (msc_debug_parser_data) PrintToLog("vin=%d:%s\n", vin_n, ScriptToAsmStr(wtx.vin[vin_n].scriptSig));
 
-        const CTxIn& txIn = wtx.vin[vin_n];
-        const Coin& coin = view.AccessCoin(txIn.prevout);
-        const CTxOut& txOut = coin.out;
+        const CTxOut& txOut = vPrevOuts[vin_n];
 
         assert(!txOut.IsNull());
 
@@ -828,7 +825,9 @@ static int parseTransaction(bool bRPConly, const CTransaction& wtx, int nBlock,
             PrintToLog("%s(): strSender: %s \n",__func__, strSender);
         } else return -110;
 
-        inAll = view.GetValueIn(wtx);
+        for (const CTxOut& prevOut : vPrevOuts) {
+            inAll += prevOut.nValue;
+        }
 
     } // end of LOCK(cs_tx_cache)
 
@@ -844,8 +843,7 @@ static int parseTransaction(bool bRPConly, const CTransaction& wtx, int nBlock,
 
     // ### DATA POPULATION ### - save output addresses, values and scripts
     std::string strReference, spReference;
-    unsigned char single_pkt[65535];
-    unsigned int packet_size = 0;
+    prevector<MAX_CLASS_D_SEARCH_BYTES, unsigned char> single_pkt;
     std::vector<std::string> script_data;
     std::vector<std::string> address_data;
     std::vector<int64_t> value_data;
@@ -966,17 +964,16 @@ static int parseTransaction(bool bRPConly, const CTransaction& wtx, int nBlock,
                 assert(IsHex(op_return_script_data[n])); // via GetScriptPushes()
                 std::vector<unsigned char> vch = ParseHex(op_return_script_data[n]);
                 unsigned int payload_size = vch.size();
-                if (packet_size + payload_size > 65535) {
-                    payload_size = 65535 - packet_size;
-                    PrintToLog("limiting payload size to %d byte\n", packet_size + payload_size);
+                if (single_pkt.size() + payload_size > MAX_PAYLOAD_SIZE) {
+                    payload_size = MAX_PAYLOAD_SIZE - single_pkt.size();
+                    PrintToLog("limiting payload size to %d byte\n", single_pkt.size() + payload_size);
                 }
 
                 if (payload_size > 0) {
-                    memcpy(single_pkt+packet_size, &vch[0], payload_size);
-                    packet_size += payload_size;
+                    single_pkt.insert(single_pkt.end(), vch.begin(), vch.begin() + payload_size);
                 }
 
-                if (65535 == packet_size) {
+                if (MAX_PAYLOAD_SIZE == single_pkt.size()) {
                     break;
                 }
             }
@@ -984,10 +981,10 @@ static int parseTransaction(bool bRPConly, const CTransaction& wtx, int nBlock,
     }
 
     // ### SET MP TX INFO ###
-    if (msc_debug_verbose) PrintToLog("single_pkt: %s\n", HexStr(single_pkt, packet_size + single_pkt));
-    mp_tx.Set(strSender, strReference, spReference, 0, wtx.GetHash(), nBlock, idx, (unsigned char *)&single_pkt, packet_size, tlClass, txFee);
+    if (msc_debug_verbose) PrintToLog("single_pkt: %s\n", HexStr(single_pkt.begin(), single_pkt.end()));
+    mp_tx.Set(strSender, strReference, spReference, 0, wtx.GetHash(), nBlock, idx, single_pkt.data(), single_pkt.size(), tlClass, txFee);
 
-    PrintToLog("%s(): mp_tx object: strSender: %s, spReference: %s, strReference: %s, single_pkt: %s, tlClass: %d \n",__func__, strSender, spReference, strReference, HexStr(single_pkt, packet_size + single_pkt), tlClass);
+    PrintToLog("%s(): mp_tx object: strSender: %s, spReference: %s, strReference: %s, single_pkt: %s, tlClass: %d \n",__func__, strSender, spReference, strReference, HexStr(single_pkt.begin(), single_pkt.end()), tlClass);
 
     return 0;
 }
@@ -1038,6 +1035,7 @@ int ParseTransaction(const CTransaction& tx, int nBlock, unsigned int idx, CMPTr
      if (count > 0)
      {
          globalVolumeALL_LTC += nvalue;
+         NotifyStateSectionChanged(FILETYPE_GLOBAL_VARS);
          const int64_t globalVolumeALL_LTCh = globalVolumeALL_LTC;
 
          if (msc_debug_handle_dex_payment) PrintToLog("%s(): nvalue: %d, globalVolumeALL_LTC: %d \n",__func__, nvalue, globalVolumeALL_LTCh);
@@ -1079,6 +1077,7 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
     // adding buyer to channel if it wasn't added before
     if(!sChn.isPartOfChannel(buyer) && sChn.getSecond() == CHANNEL_PENDING){
         sChn.setSecond(buyer);
+        NotifyStateSectionChanged(FILETYPE_ACTIVE_CHANNELS);
     }
 
     const int64_t remaining = sChn.getRemaining(seller, property);
@@ -1104,7 +1103,8 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
     p_txlistdb->recordNewInstantLTCTrade(txid, sender, seller , buyer, property, amount_purchased, price, block, idx);
 
     // saving DEx token volume
-    MapTokenVolume[block][property] += amount_purchased;
+    MapTokenVolume.Add(block, property, amount_purchased);
+    NotifyStateSectionChanged(FILETYPE_DEX_VOLUME);
 
     const arith_uint256 unitPrice256 = (ConvertTo256(COIN) * amountLTC_Desired256) / amount_forsale256;
 
@@ -1112,12 +1112,15 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
 
     // adding last price
     lastPrice[property] = unitPrice;
+    NotifyStateSectionChanged(FILE_TYPE_TOKEN_LTC_PRICE);
 
     // adding numerator of vwap
     tokenvwap[property][block].push_back(std::make_pair(unitPrice, nvalue));
+    NotifyStateSectionChanged(FILE_TYPE_TOKEN_VWAP);
 
     // adding LTC volume to map
-    MapLTCVolume[block][property] += nvalue;
+    MapLTCVolume.Add(block, property, nvalue);
+    NotifyStateSectionChanged(FILE_TYPE_LTC_VOLUME);
 
     // updating last exchange block
     // assert(sChn.updateLastExBlock(block));
@@ -1169,6 +1172,7 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
 
          /** Adding LTC into volume **/
          globalVolumeALL_LTC += nvalue;
+         NotifyStateSectionChanged(FILETYPE_GLOBAL_VARS);
          const int64_t globalVolumeALL_LTCh = globalVolumeALL_LTC;
 
          if (msc_debug_handle_instant) PrintToLog("%s(): nvalue: %d, globalVolumeALL_LTC: %d \n",__func__, nvalue, globalVolumeALL_LTCh);
@@ -1253,6 +1257,218 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
      }
  };
 
+/**
+ * Clears pending amounts of a transaction, before it's parsed.
+ *
+ * @return False, if the transaction is prior to the waterline and not parsed at all
+ */
+static bool HandlePendingTx(const CTransaction& tx, int nBlock)
+{
+    LOCK(cs_tally);
+    // clear pending, if any
+    // NOTE1: Every incoming TX is checked, not just MP-ones because:
+    // if for some reason the incoming TX doesn't pass our parser validation steps successfuly, I'd still want to clear pending amounts for that TX.
+    // NOTE2: Plus I wanna clear the amount before that TX is parsed by our protocol, in case we ever consider pending amounts in internal calculations.
+    PendingDelete(tx.GetHash());
+
+    // we do not care about parsing blocks prior to our waterline (empty blockchain defense)
+    if (nBlock < nWaterlineBlock) return false;
+
+    return true;
+}
+
+/**
+ * Interprets and records a transaction, once it was parsed.
+ *
+ * @return True, if the transaction was a valid Trade Layer transaction
+ */
+static bool HandleParsedTx(const CTransaction& tx, int nBlock, unsigned int idx, CMPTransaction& mp_obj, int pop_ret)
+{
+    bool fFoundTx = false;
+
+    if (0 == pop_ret)
+    {
+        assert(mp_obj.getEncodingClass() != NO_MARKER);
+        assert(mp_obj.getSender().empty() == false);
+
+        int interp_ret = mp_obj.interpretPacket();
+
+        if(msc_debug_handler_tx) PrintToLog("%s(): interp_ret: %d\n",__func__, interp_ret);
+
+        // if interpretPacket returns 1, that means we have an instant trade between LTCs and tokens.
+        if (interp_ret == 1)
+        {
+            HandleLtcInstantTrade(tx, nBlock, mp_obj.getIndexInBlock(), mp_obj.getSender(), mp_obj.getSpecial(), mp_obj.getReceiver(), mp_obj.getProperty(), mp_obj.getAmountForSale(), mp_obj.getPrice());
+
+        } else if (interp_ret == 2) {
+            HandleDExPayments(tx, nBlock, mp_obj.getSender());
+
+        }
+
+        // Only structurally valid transactions get recorded in levelDB
+        // PKT_ERROR - 2 = interpret_Transaction failed, structurally invalid payload
+        if (interp_ret != PKT_ERROR - 2)
+        {
+            LOCK(cs_tally);
+            bool bValid = (0 <= interp_ret);
+            p_txlistdb->recordTX(tx.GetHash(), bValid, nBlock, mp_obj.getType(), mp_obj.getNewAmount(), interp_ret);
+            p_TradeTXDB->RecordTransaction(tx.GetHash(), idx);
+
+        }
+
+        fFoundTx |= (interp_ret == 0);
+    }
+
+    LOCK(cs_tally);
+    if (fFoundTx && msc_debug_consensus_hash_every_transaction) {
+        const uint256 consensusHash = GetConsensusHash();
+        if(msc_debug_handler_tx) PrintToLog("Consensus hash for transaction %s: %s\n", tx.GetHash().GetHex(), consensusHash.GetHex());
+    }
+
+    return fFoundTx;
+}
+
+//! Upper limit of threads to pre-parse blocks during the initial scan
+static const int MAX_SCAN_THREADS = 8;
+//! Blocks pre-parsed ahead of the scan, per thread
+static const int SCAN_BLOCKS_AHEAD_PER_THREAD = 16;
+
+/** A transaction with marker, pre-parsed ahead of the initial scan. */
+struct ScanTx
+{
+    //! Position within the block
+    unsigned int idx;
+    //! Whether the transaction was parsed, or only the marker was found
+    bool fParsed;
+    //! Result of parseTransaction()
+    int nParseResult;
+    std::unique_ptr<CMPTransaction> mp_obj;
+
+    explicit ScanTx(unsigned int idxIn) : idx(idxIn), fParsed(false), nParseResult(-1) {}
+};
+
+/** A block, read from the disk and pre-parsed ahead of the initial scan. */
+struct ScanBlock
+{
+    bool fRead;
+    CBlock block;
+    //! Transactions with marker, in the order of the block
+    std::vector<ScanTx> vTxs;
+
+    ScanBlock() : fRead(false) {}
+};
+
+/**
+ * Reads a block and pre-parses the transactions with marker.
+ *
+ * Identifying the sender and extracting the payload doesn't depend on the
+ * state, so it can be done ahead and in parallel. The inputs are only resolved
+ * when cs_main is available, given the scan may be run by a thread, which
+ * holds it. Otherwise the scan resolves them when the transaction is handled.
+ */
+static void PreParseBlock(int nBlock, const CBlockIndex* pblockindex, ScanBlock& scan)
+{
+    scan.fRead = ReadBlockFromDisk(scan.block, pblockindex, Params().GetConsensus());
+    if (!scan.fRead) return;
+
+    const int64_t nBlockTime = pblockindex->GetBlockTime();
+
+    for (unsigned int idx = 0; idx < scan.block.vtx.size(); ++idx) {
+        const CTransaction& tx = *scan.block.vtx[idx];
+        if (GetEncodingClass(tx, nBlock) == NO_MARKER) continue;
+
+        ScanTx scanTx(idx);
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain) {
+            scanTx.mp_obj.reset(new CMPTransaction());
+            scanTx.mp_obj->unlockLogic();
+            scanTx.nParseResult = parseTransaction(false, tx, nBlock, idx, *scanTx.mp_obj, nBlockTime);
+            scanTx.fParsed = true;
+        }
+        scan.vTxs.push_back(std::move(scanTx));
+    }
+}
+
+/**
+ * Pre-parses the blocks of the initial scan on worker threads.
+ *
+ * The workers pick the next block, while staying at most a window of blocks
+ * ahead of the scan, which takes the blocks in the order of the chain.
+ */
+class ScanPipeline
+{
+private:
+    const CBlockIndex* m_pblockLast;
+    const int m_nLastBlock;
+    const int m_nBlocksAhead;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Next block to pre-parse
+    int m_nNext;
+    //! Block the scan waits for
+    int m_nWanted;
+    bool m_fStop;
+    std::map<int, ScanBlock> m_blocks;
+    std::vector<std::thread> m_threads;
+
+    void Loop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_cond.wait(lock, [this] { return m_fStop || (m_nNext <= m_nLastBlock && m_nNext < m_nWanted + m_nBlocksAhead); });
+            if (m_fStop) break;
+
+            const int nBlock = m_nNext++;
+            lock.unlock();
+
+            ScanBlock scan;
+            PreParseBlock(nBlock, m_pblockLast->GetAncestor(nBlock), scan);
+
+            lock.lock();
+            m_blocks.insert(std::make_pair(nBlock, std::move(scan)));
+            m_cond.notify_all();
+        }
+    }
+
+public:
+    ScanPipeline(const CBlockIndex* pblockLast, int nFirstBlock, int nThreads)
+      : m_pblockLast(pblockLast), m_nLastBlock(pblockLast->nHeight), m_nBlocksAhead(nThreads * SCAN_BLOCKS_AHEAD_PER_THREAD),
+        m_nNext(nFirstBlock), m_nWanted(nFirstBlock), m_fStop(false)
+    {
+        for (int n = 0; n < nThreads; ++n) {
+            m_threads.push_back(std::thread(&TraceThread<std::function<void()>>, "tlscan", std::function<void()>(std::bind(&ScanPipeline::Loop, this))));
+        }
+    }
+
+    ~ScanPipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_fStop = true;
+        }
+        m_cond.notify_all();
+
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /** Waits until the block is pre-parsed, and takes it. */
+    void Get(int nBlock, ScanBlock& scan)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_nWanted = nBlock;
+        m_cond.notify_all();
+        m_cond.wait(lock, [this, nBlock] { return m_blocks.count(nBlock) > 0; });
+
+        std::map<int, ScanBlock>::iterator it = m_blocks.find(nBlock);
+        scan = std::move(it->second);
+        m_blocks.erase(it);
+    }
+};
+
 /**
  * Scans the blockchain for meta transactions.
  *
@@ -1261,6 +1477,10 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
  *
  * Every 30 seconds the progress of the scan is reported.
  *
+ * The blocks are read and pre-parsed ahead by "-tlscanthreads" worker threads
+ * (default: one less than the number of cores, 0 to read the blocks one by
+ * one), while the transactions are still interpreted in the order of the chain.
+ *
  * In case the current block being processed is not part of the active chain, or
  * if a block could not be retrieved from the disk, then the scan stops early.
  * Likewise, global shutdown requests are honored, and stop the scan progress.
@@ -1289,6 +1509,13 @@ static int msc_initial_scan(int nFirstBlock)
     // used to print the progress to the console and notifies the UI
     ProgressReporter progressReporter(chainActive[nFirstBlock], chainActive[nLastBlock]);
 
+    // blocks are read and pre-parsed ahead, but applied one by one in the order of the chain
+    const int nScanThreads = std::max(0, std::min<int>(gArgs.GetArg("-tlscanthreads", GetNumCores() - 1), MAX_SCAN_THREADS));
+    std::unique_ptr<ScanPipeline> pipeline;
+    if (nScanThreads > 0) {
+        pipeline.reset(new ScanPipeline(chainActive[nLastBlock], nFirstBlock, nScanThreads));
+    }
+
     for (nBlock = nFirstBlock; nBlock <= nLastBlock; ++nBlock)
     {
         if (ShutdownRequested()) {
@@ -1313,12 +1540,32 @@ static int msc_initial_scan(int nFirstBlock)
         unsigned int nTxsFoundInBlock = 0;
         mastercore_handler_block_begin(nBlock, pblockindex);
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) break;
-          for(const CTransactionRef& tx : block.vtx) {
-             if (mastercore_handler_tx(*tx, nBlock, nTxNum, pblockindex, nullptr)) ++nTxsFoundInBlock;
-             ++nTxNum;
-          }
+        ScanBlock scan;
+        if (pipeline) {
+            pipeline->Get(nBlock, scan);
+        } else {
+            PreParseBlock(nBlock, pblockindex, scan);
+        }
+        if (!scan.fRead) break;
+
+        std::vector<ScanTx>::iterator itTx = scan.vTxs.begin();
+        for (const CTransactionRef& tx : scan.block.vtx) {
+            ScanTx* pScanTx = nullptr;
+            if (itTx != scan.vTxs.end() && itTx->idx == nTxNum) pScanTx = &(*itTx++);
+
+            // transactions without marker are not parsed, but pending amounts are cleared
+            if (HandlePendingTx(*tx, nBlock) && pScanTx) {
+                if (!pScanTx->fParsed) {
+                    pScanTx->mp_obj.reset(new CMPTransaction());
+                    pScanTx->mp_obj->unlockLogic();
+
+                    LOCK2(cs_main, cs_tally);
+                    pScanTx->nParseResult = parseTransaction(false, *tx, nBlock, nTxNum, *pScanTx->mp_obj, pblockindex->GetBlockTime());
+                }
+                if (HandleParsedTx(*tx, nBlock, nTxNum, *pScanTx->mp_obj, pScanTx->nParseResult)) ++nTxsFoundInBlock;
+            }
+            ++nTxNum;
+        }
 
         nTxsFoundTotal += nTxsFoundInBlock;
         nTxsTotal += nTxNum;
@@ -1360,7 +1607,7 @@ int input_msc_balances_string(const std::string& s)
 
         std::vector<std::string> curBalance;
         boost::split(curBalance, curProperty[1], boost::is_any_of(","), boost::token_compress_on);
-        if (curBalance.size() != 10) return -1;
+        if (curBalance.size() != 11) return -1;
 
         const uint32_t propertyId = boost::lexical_cast<uint32_t>(curProperty[0]);
         const int64_t balance = boost::lexical_cast<int64_t>(curBalance[0]);
@@ -1564,20 +1811,7 @@ int input_withdrawals_string(const std::string& s)
     w.amount = boost::lexical_cast<int64_t>(vstr[4]);
     w.txid = uint256S(vstr[5]);
 
-    auto it = withdrawal_Map.find(chnAddr);
-
-    // channel found !
-    if(it != withdrawal_Map.end())
-    {
-        vector<withdrawalAccepted>& whAc = it->second;
-        whAc.push_back(w);
-        return 0;
-    }
-
-    // if there's no channel yet
-    vector<withdrawalAccepted> whAcc;
-    whAcc.push_back(w);
-    if(!withdrawal_Map.insert(std::make_pair(chnAddr,whAcc)).second) return -1;
+    withdrawalSchedule.Add(chnAddr, w);
 
     return 0;
 
@@ -1667,25 +1901,27 @@ int input_mp_mdexorder_string(const std::string& s)
     return 0;
 }
 
+/** Restores the checkpoint of compacted volumes, returns false if the line is no checkpoint. */
+static bool input_volume_checkpoint(const std::vector<std::string>& vstr, CMPVolumeHistory& volumes)
+{
+    if (vstr.size() != 2 || vstr[0] != "checkpoint") return false;
+
+    volumes.Compact(boost::lexical_cast<int>(vstr[1]));
+    return true;
+}
+
 int input_mp_dexvolume_string(const std::string& s)
 {
     std::vector<std::string> vstr;
     boost::split(vstr, s, boost::is_any_of(" ,="), boost::token_compress_on);
 
+    if (input_volume_checkpoint(vstr, MapTokenVolume)) return 0;
+
     const int block = boost::lexical_cast<int>(vstr[0]);
     const uint32_t propertyId = boost::lexical_cast<uint32_t>(vstr[1]);
     const int64_t amount = boost::lexical_cast<int64_t>(vstr[2]);
 
-    auto it = MapTokenVolume.find(block);
-    if (it != MapTokenVolume.end()){
-        auto pMap = it->second;
-        pMap[propertyId] = amount;
-        return 0;
-    }
-
-    std::map<uint32_t,int64_t> pMapp;
-    pMapp[propertyId] = amount;
-    if(!MapLTCVolume.insert(std::make_pair(block, pMapp)).second) return -1;
+    MapTokenVolume.Set(block, propertyId, amount);
 
     return 0;
 
@@ -1696,21 +1932,13 @@ int input_mp_mdexvolume_string(const std::string& s)
     std::vector<std::string> vstr;
     boost::split(vstr, s, boost::is_any_of(" ,="), boost::token_compress_on);
 
+    if (input_volume_checkpoint(vstr, metavolume)) return 0;
+
     const int block = boost::lexical_cast<int>(vstr[0]);
     const uint32_t property = boost::lexical_cast<uint32_t>(vstr[1]);
     const int64_t amount = boost::lexical_cast<int64_t>(vstr[2]);
 
-    auto it = metavolume.find(block);
-    if (it != metavolume.end()){
-        auto pMap = it->second;
-        pMap[property] = amount;
-        return 0;
-    }
-
-    std::map<uint32_t, int64_t> pMapp;
-    pMapp[property] = amount;
-
-    if(!metavolume.insert(std::make_pair(block, pMapp)).second) return -1;
+    metavolume.Set(block, property, amount);
 
     return 0;
 
@@ -1721,21 +1949,13 @@ int input_mp_ltcvolume_string(const std::string& s)
     std::vector<std::string> vstr;
     boost::split(vstr, s, boost::is_any_of(" ,="), boost::token_compress_on);
 
+    if (input_volume_checkpoint(vstr, MapLTCVolume)) return 0;
+
     const int block = boost::lexical_cast<int>(vstr[0]);
     const uint32_t property = boost::lexical_cast<uint32_t>(vstr[1]);
     const int64_t amount = boost::lexical_cast<int64_t>(vstr[2]);
 
-    auto it = MapLTCVolume.find(block);
-    if (it != MapLTCVolume.end()){
-        auto pMap = it->second;
-        pMap[property] = amount;
-        return 0;
-    }
-
-    std::map<uint32_t, int64_t> pMapp;
-    pMapp[property] = amount;
-
-    if(!MapLTCVolume.insert(std::make_pair(block, pMapp)).second) return -1;
+    MapLTCVolume.Set(block, property, amount);
 
     return 0;
 
@@ -1767,6 +1987,8 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
   {
     case FILETYPE_BALANCES:
         mp_tally_map.clear();
+        InvalidateConsensusHashCache();
+        InvalidateTallyTotals();
         inputLineFunc = input_msc_balances_string;
         break;
 
@@ -1776,11 +1998,13 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
 
     case FILETYPE_OFFERS:
         my_offers.clear();
+        InvalidateConsensusHashCache();
         inputLineFunc = input_mp_offers_string;
         break;
 
     case FILETYPE_ACCEPTS:
         my_accepts.clear();
+        InvalidateConsensusHashCache();
         inputLineFunc = input_mp_accepts_string;
         break;
 
@@ -1790,6 +2014,7 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         // TODO
         // ...
         metadex.clear();
+        metadex_index.Clear();
         inputLineFunc = input_mp_mdexorder_string;
         break;
 
@@ -1804,7 +2029,7 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         break;
 
     case FILETYPE_WITHDRAWALS:
-        withdrawal_Map.clear();
+        withdrawalSchedule.Clear();
         inputLineFunc = input_withdrawals_string;
         break;
 
@@ -1814,12 +2039,12 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         break;
 
     case FILETYPE_DEX_VOLUME:
-        MapTokenVolume.clear();
+        MapTokenVolume.Clear();
         inputLineFunc = input_mp_dexvolume_string;
         break;
 
     case FILETYPE_MDEX_VOLUME:
-        metavolume.clear();
+        metavolume.Clear();
         inputLineFunc = input_mp_mdexvolume_string;
         break;
 
@@ -1833,7 +2058,7 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         break;
 
     case FILE_TYPE_LTC_VOLUME:
-        MapLTCVolume.clear();
+        MapLTCVolume.Clear();
         inputLineFunc = input_mp_ltcvolume_string;
         break;
 
@@ -1938,6 +2163,8 @@ static char const * const statePrefix[NUM_FILETYPES] = {
     "tokenvwap"
 };
 
+static void flush_state_writer();
+
 // returns the height of the state loaded
 static int load_most_relevant_state()
 {
@@ -1947,6 +2174,9 @@ static int load_most_relevant_state()
   uint256 spWatermark;
   {
         LOCK(cs_tally);
+        // whatever is loaded, the next snapshot has to be a full one
+        flush_state_writer();
+        ResetStateDelta();
         if (!_my_sps->getWatermark(spWatermark)) {
             //trigger a full reparse, if the SP database has no watermark
             return -1;
@@ -2023,16 +2253,31 @@ static int load_most_relevant_state()
 
       while (nullptr != curTip && persistedBlocks.size() > 0 && curTip->nHeight > abortRollBackBlock)
       {
-          if (persistedBlocks.find(spBlockIndex->GetBlockHash()) != persistedBlocks.end())
+          if (persistedBlocks.find(curTip->GetBlockHash()) != persistedBlocks.end())
           {
-              int success = -1;
-              for (int i = 0; i < NUM_FILETYPES; ++i)
+              // prefer the binary snapshots, fall back to the text files
+              int success = LoadStateDeltas(MPPersistencePath, curTip);
+              if (success < 0)
               {
-                  fs::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], curTip->GetBlockHash().ToString());
-                  const std::string strFile = path.string();
-                  success = msc_file_load(strFile, i, true);
-                  if (success < 0) {
-                     break;
+                  // all files of the block must load, otherwise an older block is tried
+                  int textSuccess = 0;
+                  for (int i = 0; i < NUM_FILETYPES; ++i)
+                  {
+                      fs::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], curTip->GetBlockHash().ToString());
+                      const std::string strFile = path.string();
+                      textSuccess = msc_file_load(strFile, i, true);
+                      if (textSuccess < 0) {
+                         break;
+                      }
+                  }
+                  success = textSuccess;
+
+                  // the text files have no trade edges, whatever is held belongs to another block
+                  if (textSuccess >= 0) {
+                      const CTradeEdgeStats edgeStats = tradeEdges.GetStats();
+                      PrintToLog("%s(): WARNING: block %d loaded from text files, the positions carried from settled periods are lost (%d trades held, %d carried, dropped)\n",
+                          __func__, curTip->nHeight, edgeStats.nTrades, edgeStats.nCarried);
+                      tradeEdges.Clear();
                   }
               }
 
@@ -2042,7 +2287,7 @@ static int load_most_relevant_state()
               }
 
               // remove this from the persistedBlock Set
-              persistedBlocks.erase(spBlockIndex->GetBlockHash());
+              persistedBlocks.erase(curTip->GetBlockHash());
           }
 
           // go to the previous block
@@ -2076,10 +2321,9 @@ static int write_msc_balances(std::ofstream& file, CHash256& hasher)
         bool emptyWallet = true;
         std::string lineOut = (*iter).first;
         lineOut.append("=");
-        CMPTally& curAddr = (*iter).second;
-        curAddr.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = curAddr.next())) {
+        const CMPTally& curAddr = (*iter).second;
+        for (const CMPTally::BalanceRecord& record : curAddr) {
+            const uint32_t propertyId = record.propertyId;
             const int64_t balance = (*iter).second.getMoney(propertyId, BALANCE);
             const int64_t sellReserved = (*iter).second.getMoney(propertyId, SELLOFFER_RESERVE);
             const int64_t acceptReserved = (*iter).second.getMoney(propertyId, ACCEPT_RESERVE);
@@ -2290,14 +2534,7 @@ static void savingLine(const withdrawalAccepted&  w, const std::string chnAddr,
 /** Saving pending withdrawals **/
 static int write_mp_withdrawals(std::ofstream& file, CHash256& hasher)
 {
-    for (const auto w : withdrawal_Map)
-    {
-        const std::string& chnAddr = w.first;
-        const vector<withdrawalAccepted>& whd = w.second;
-
-        for_each(whd.begin(), whd.end(), [&file, &hasher, &chnAddr] (const withdrawalAccepted&  w) { savingLine(w, chnAddr, file, hasher);});
-
-    }
+    withdrawalSchedule.ForEach([&file, &hasher] (const std::string& chnAddr, const withdrawalAccepted& w) { savingLine(w, chnAddr, file, hasher);});
 
     return 0;
 }
@@ -2377,9 +2614,9 @@ static int write_mp_active_channels(std::ofstream& file, CHash256& hasher)
     return 0;
 }
 
-static void iterWrite(std::ofstream& file, CHash256& hasher, const std::map<int, std::map<uint32_t,int64_t>>& aMap)
+static void iterWrite(std::ofstream& file, CHash256& hasher, const CMPVolumeHistory& volumes)
 {
-    for(const auto &m : aMap)
+    for(const auto &m : volumes.GetBlocks())
     {
        // decompose the key for address
        const uint32_t& block = m.first;
@@ -2397,6 +2634,13 @@ static void iterWrite(std::ofstream& file, CHash256& hasher, const std::map<int,
        }
     }
 
+    // the checkpoint tells the compacted entries apart from the volume of a single block
+    if (volumes.GetCheckpoint() >= 0)
+    {
+        const std::string lineOut = strprintf("checkpoint=%d", volumes.GetCheckpoint());
+        hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
+        file << lineOut << std::endl;
+    }
 }
 
 /** Saving DexMap volume **/
@@ -2541,11 +2785,29 @@ static bool is_state_prefix(std::string const &str)
             return true;
     }
 
-    return false;
+    return boost::equals(str, "snapshot") || boost::equals(str, "delta");
 }
 
+/**
+ * Removes the state files of all blocks, which are neither among the last
+ * MAX_STATE_HISTORY ancestors of the given block, nor needed by their deltas.
+ *
+ * Only the parent links of the block index are followed, which never change
+ * once a block is indexed, so this works without holding cs_main.
+ */
 static void prune_state_files(CBlockIndex const *topIndex)
 {
+    // the blocks to keep
+    std::set<uint256> retainedBlockHashes;
+    for (CBlockIndex const *curIndex = topIndex; nullptr != curIndex; curIndex = curIndex->pprev)
+    {
+        if ((topIndex->nHeight - curIndex->nHeight) > MAX_STATE_HISTORY) break;
+        if (retainedBlockHashes.count(curIndex->GetBlockHash()) == 0) {
+            GetStateDeltaBases(MPPersistencePath, curIndex, retainedBlockHashes);
+        }
+        retainedBlockHashes.insert(curIndex->GetBlockHash());
+    }
+
     // build a set of blockHashes for which we have any state files
     std::set<uint256> statefulBlockHashes;
     fs::directory_iterator dIter(MPPersistencePath);
@@ -2572,62 +2834,86 @@ static void prune_state_files(CBlockIndex const *topIndex)
         }
     }
 
-    // for each blockHash in the set, determine the distance from the given block
     std::set<uint256>::const_iterator iter;
     for (iter = statefulBlockHashes.begin(); iter != statefulBlockHashes.end(); ++iter)
     {
-        // look up the CBlockIndex for height info
-        CBlockIndex const *curIndex = GetBlockIndex(*iter);
+        if (retainedBlockHashes.count(*iter)) continue;
 
-        // if we have nothing int the index, or this block is too old..
-        if (nullptr == curIndex || (topIndex->nHeight - curIndex->nHeight) > MAX_STATE_HISTORY )
-        {
-            if (msc_debug_persistence)
-            {
-                if (curIndex)
-                {
-                    PrintToLog("State from Block:%s is no longer need, removing files (age-from-tip: %d)\n", (*iter).ToString(), topIndex->nHeight - curIndex->nHeight);
-                } else {
-                    PrintToLog("State from Block:%s is no longer need, removing files (not in index)\n", (*iter).ToString());
-                }
-            }
+        if (msc_debug_persistence) {
+            PrintToLog("State from Block:%s is no longer need, removing files\n", (*iter).ToString());
+        }
 
-            // destroy the associated files!
-            std::string strBlockHash = iter->ToString();
-            for (int i = 0; i < NUM_FILETYPES; ++i)
-            {
-                fs::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], strBlockHash);
-                fs::remove(path);
-            }
+        // destroy the associated files!
+        std::string strBlockHash = iter->ToString();
+        for (int i = 0; i < NUM_FILETYPES; ++i)
+        {
+            fs::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], strBlockHash);
+            fs::remove(path);
         }
+        fs::remove(GetStateSnapshotPath(MPPersistencePath, *iter, false));
+        fs::remove(GetStateSnapshotPath(MPPersistencePath, *iter, true));
+        ForgetStateDeltaBase(*iter);
     }
 }
 
+//! Queued images, before mastercore_save_state waits for the writer
+static const size_t MAX_STATE_WRITE_QUEUE = 8;
+
+//! Writes the state images in the background
+static CMPStateWriter stateWriter(MAX_STATE_WRITE_QUEUE, WriteStateSnapshot);
+
+/**
+ * Waits until all queued state images are written.
+ */
+static void flush_state_writer()
+{
+    stateWriter.Flush();
+}
+
 int mastercore_save_state(CBlockIndex const *pBlockIndex)
 {
+    // a failed write breaks the chain of deltas
+    if (stateWriter.TakeFailed()) ResetStateDelta();
+
     // write the new state as of the given block
-    write_state_file(pBlockIndex, FILETYPE_BALANCES);
-    write_state_file(pBlockIndex, FILETYPE_GLOBALS);
-    write_state_file(pBlockIndex, FILETYPE_CDEXORDERS);
-    write_state_file(pBlockIndex, FILETYPE_OFFERS);
-    write_state_file(pBlockIndex, FILETYPE_MDEXORDERS);
-    write_state_file(pBlockIndex, FILETYPE_ACCEPTS);
-    write_state_file(pBlockIndex, FILETYPE_CACHEFEES);
-    write_state_file(pBlockIndex, FILETYPE_CACHEFEES_ORACLES);
-    write_state_file(pBlockIndex, FILETYPE_WITHDRAWALS);
-    write_state_file(pBlockIndex, FILETYPE_ACTIVE_CHANNELS);
-    write_state_file(pBlockIndex, FILETYPE_DEX_VOLUME);
-    write_state_file(pBlockIndex, FILETYPE_MDEX_VOLUME);
-    write_state_file(pBlockIndex, FILETYPE_GLOBAL_VARS);
-    write_state_file(pBlockIndex, FILE_TYPE_VESTING_ADDRESSES);
-    write_state_file(pBlockIndex, FILE_TYPE_LTC_VOLUME);
-    write_state_file(pBlockIndex, FILE_TYPE_TOKEN_LTC_PRICE);
-    write_state_file(pBlockIndex, FILE_TYPE_TOKEN_VWAP);
-
-    // clean-up the directory
-    prune_state_files(pBlockIndex);
-
-    _my_sps->setWatermark(pBlockIndex->GetBlockHash());
+    // only the changes since the last saved block, unless a full snapshot is due
+    // the image is serialized under the locks: a delta is usually done in about a millisecond,
+    // and a full snapshot is serialized faster than the containers could be copied
+    CDataStream ssSnapshot(SER_DISK, CLIENT_VERSION);
+    bool fDelta = SerializeStateDelta(ssSnapshot, pBlockIndex);
+    if (!fDelta) SerializeStateSnapshot(ssSnapshot, pBlockIndex);
+    fs::path path = GetStateSnapshotPath(MPPersistencePath, pBlockIndex->GetBlockHash(), fDelta);
+
+    // the text files are only written on request
+    if (gArgs.GetBoolArg("-tllegacystate", false)) {
+        write_state_file(pBlockIndex, FILETYPE_BALANCES);
+        write_state_file(pBlockIndex, FILETYPE_GLOBALS);
+        write_state_file(pBlockIndex, FILETYPE_CDEXORDERS);
+        write_state_file(pBlockIndex, FILETYPE_OFFERS);
+        write_state_file(pBlockIndex, FILETYPE_MDEXORDERS);
+        write_state_file(pBlockIndex, FILETYPE_ACCEPTS);
+        write_state_file(pBlockIndex, FILETYPE_CACHEFEES);
+        write_state_file(pBlockIndex, FILETYPE_CACHEFEES_ORACLES);
+        write_state_file(pBlockIndex, FILETYPE_WITHDRAWALS);
+        write_state_file(pBlockIndex, FILETYPE_ACTIVE_CHANNELS);
+        write_state_file(pBlockIndex, FILETYPE_DEX_VOLUME);
+        write_state_file(pBlockIndex, FILETYPE_MDEX_VOLUME);
+        write_state_file(pBlockIndex, FILETYPE_GLOBAL_VARS);
+        write_state_file(pBlockIndex, FILE_TYPE_VESTING_ADDRESSES);
+        write_state_file(pBlockIndex, FILE_TYPE_LTC_VOLUME);
+        write_state_file(pBlockIndex, FILE_TYPE_TOKEN_LTC_PRICE);
+        write_state_file(pBlockIndex, FILE_TYPE_TOKEN_VWAP);
+    }
+
+    // the files are pruned and the watermark moves on, once the image was written
+    const CMPStateWriter::Callback onWritten = [pBlockIndex] {
+        prune_state_files(pBlockIndex);
+        _my_sps->setWatermark(pBlockIndex->GetBlockHash());
+    };
+    if (!stateWriter.Write(path, ssSnapshot, onWritten)) {
+        ResetStateDelta();
+        return -1;
+    }
 
     return 0;
 }
@@ -2641,19 +2927,25 @@ void clear_all_state()
 
     // Memory based storage
     mp_tally_map.clear();
+    InvalidateConsensusHashCache();
+    InvalidateTallyTotals();
+    ResetStateDelta();
     my_pending.clear();
     my_offers.clear();
     my_accepts.clear();
     metadex.clear();
+    metadex_index.Clear();
     my_pending.clear();
     contractdex.clear();
+    contractdex_index.Clear();
     ResetConsensusParams();
     ClearActivations();
     channels_Map.clear();
-    withdrawal_Map.clear();
-    MapLTCVolume.clear();
-    MapTokenVolume.clear();
-    metavolume.clear();
+    withdrawalSchedule.Clear();
+    tradeEdges.Clear();
+    MapLTCVolume.Clear();
+    MapTokenVolume.Clear();
+    metavolume.Clear();
     vestingAddresses.clear();
 
     // LevelDB based storage
@@ -2665,6 +2957,9 @@ void clear_all_state()
      assert(p_txlistdb->setDBVersion() == DB_VERSION); // new set of databases, set DB version
 }
 
+//! Blocks covered by a file of the trade journal, if not set via -tltradejournalblocks
+static const int DEFAULT_TRADE_JOURNAL_BLOCKS = 30 * dayblocks;
+
 /**
  * Global handler to initialize Trade Layer.
  *
@@ -2686,6 +2981,11 @@ int mastercore_init()
   InitDebugLogLevels();
   ShrinkDebugLog();
 
+  {
+    LOCK(cs_tx_cache);
+    inputCache.SetMaxEntries(gArgs.GetArg("-tltxcache", DEFAULT_INPUT_CACHE_SIZE));
+  }
+
   // check for --autocommit option and set transaction commit flag accordingly
   if (!gArgs.GetBoolArg("-autocommit", true)) {
     PrintToLog("Process was started with --autocommit set to false. "
@@ -2702,10 +3002,12 @@ int mastercore_init()
       fs::path txlistPath = GetDataDir() / "OCL_txlist";
       fs::path spPath = GetDataDir() / "OCL_spinfo";
       fs::path tlTXDBPath = GetDataDir() / "OCL_TXDB";
+      fs::path journalPath = GetDataDir() / "OCL_tradejournal";
       if (fs::exists(persistPath)) fs::remove_all(persistPath);
       if (fs::exists(txlistPath)) fs::remove_all(txlistPath);
       if (fs::exists(spPath)) fs::remove_all(spPath);
       if (fs::exists(tlTXDBPath)) fs::remove_all(tlTXDBPath);
+      if (fs::exists(journalPath)) fs::remove_all(journalPath);
       PrintToLog("Success clearing persistence files in datadir %s\n", GetDataDir().string());
       startClean = true;
     } catch (const fs::filesystem_error& e) {
@@ -2719,6 +3021,11 @@ int mastercore_init()
   t_tradelistdb = new CMPTradeList(GetDataDir()/"OCL_tradelist", fReindex);
   MPPersistencePath = GetDataDir() / "OCL_persist";
   TryCreateDirectory(MPPersistencePath);
+  stateWriter.Start("tlstatewriter");
+
+  if (gArgs.GetBoolArg("-tltradejournal", true)) {
+      tradeJournal.Open(GetDataDir() / "OCL_tradejournal", gArgs.GetArg("-tltradejournalblocks", DEFAULT_TRADE_JOURNAL_BLOCKS));
+  }
 
   bool wrongDBVersion = (p_txlistdb->getDBVersion() != DB_VERSION);
 
@@ -2758,6 +3065,10 @@ int mastercore_init()
   // advance the waterline so that we start on the next unaccounted for block
   nWaterlineBlock += 1;
 
+  // the trades, registrations and attestations of the blocks scanned again replace the recorded ones
+  tradeJournal.Rollback(nWaterlineBlock);
+  t_tradelistdb->rollBackIdentities(nWaterlineBlock - 1);
+
   // load feature activation messages from txlistdb and process them accordingly
   p_txlistdb->LoadActivations(nWaterlineBlock);
 
@@ -2782,6 +3093,9 @@ int mastercore_init()
  */
 int mastercore_shutdown()
 {
+    // write out whatever is still queued, before the databases are closed
+    stateWriter.Stop();
+
     LOCK(cs_tally);
 
     if (p_txlistdb) {
@@ -2804,11 +3118,16 @@ int mastercore_shutdown()
         p_TradeTXDB = nullptr;
     }
 
+    tradeJournal.Close();
+
     mastercoreInitialized = 0;
 
     PrintToLog("\nTrade Layer shutdown completed\n");
     PrintToLog("Shutdown time: %s\n", FormatISO8601Date(GetTime()));
 
+    // write out whatever is still queued
+    StopLogWriter();
+
     return 0;
 }
 
@@ -2851,12 +3170,12 @@ bool CallingSettlement()
             int64_t twap_priceCDEx = mastercore::RationalToInt64(twap_priceRatCDEx);
             if(msc_debug_handler_tx) PrintToLog("\nTvwap Price CDEx = %s\n", FormatDivisibleMP(twap_priceCDEx));
 
-            CMPSPInfo::Entry sp;
-            if (!_my_sps->getSP(propertyId, sp))
+            std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
+            if (!sp)
                 return false;
 
-            uint64_t property_num = sp.numerator;
-            uint64_t property_den = sp.denominator;
+            uint64_t property_num = sp->numerator;
+            uint64_t property_den = sp->denominator;
 
             uint64_t num_mdex=accumulate(mdextwap_vec[property_num][property_den].begin(),mdextwap_vec[property_num][property_den].end(),0.0);
 
@@ -2878,7 +3197,7 @@ bool CallingSettlement()
 
             int64_t twap_price = 0;
 
-            switch(sp.prop_type){
+            switch(sp->prop_type){
                 case ALL_PROPERTY_TYPE_PERPETUAL_ORACLE:
                     twap_price = getOracleTwap(propertyId, oBlocks);
                     break;
@@ -2901,27 +3220,26 @@ bool CallingSettlement()
     /***********************************************************************/
 /** Calling The Settlement Algorithm **/
 
-if (nBlockNow%BlockS == 0 && nBlockNow != 0 && path_elef.size() != 0 && lastBlockg != nBlockNow)
+if (nBlockNow%BlockS == 0 && nBlockNow != 0 && !tradeEdges.Empty() && lastBlockg != nBlockNow)
 {
 
      PrintToLog("\nSETTLEMENT : every 8 hours here. nBlockNow = %d\n", nBlockNow);
-     pt_ndatabase = new MatrixTLS(path_elef.size(), n_cols); MatrixTLS &ndatabase = *pt_ndatabase;
-     MatrixTLS M_file(path_elef.size(), n_cols);
-     fillingMatrix(M_file, ndatabase, path_elef);
-     n_rows = size(M_file, 0);
-     PrintToLog("Matrix for Settlement: dim = (%d, %d)\n\n", n_rows, n_cols);
 
       /*****************************************************************************/
       cout << "\n\n";
       PrintToLog("\nCalling the Settlement Algorithm:\n\n");
-      int64_t twap_priceCDEx  = 0;
-      int64_t interest = 0;
-      settlement_algorithm_fifo(M_file, interest, twap_priceCDEx);
+      CClearingGraph graph;
+      CClearingResult result;
+      if (tradeEdges.Settle(nBlockNow, graph, result)) {
+          NotifyStateSectionChanged(STATE_SECTION_TRADE_EDGES);
+          const CTradeEdgeStats stats = tradeEdges.GetStats();
+          PrintToLog("Settlement: %d trades, %d paths, %d ghost edges, exit price = %f\n", graph.Size(), result.CountPaths(), result.ghosts.size(), result.exitPrice);
+          PrintToLog("Settlement: %d trades carried, %d trades left in %d periods (%d bytes)\n\n", stats.nCarried, stats.nTrades, stats.nSegments, stats.nMemoryUsage);
+      }
 
       /**********************************************************************/
       /** Unallocating Dynamic Memory **/
 
-      //path_elef.clear();
       market_priceMap.clear();
       VWAPMap.clear();
       VWAPMapSubVector.clear();
@@ -2952,15 +3270,15 @@ bool CallingExpiration(CBlockIndex const * pBlockIndex)
   // checking expiration block for each contract
   for (uint32_t propertyId = 1; propertyId < nextSPID; propertyId++)
   {
-      CMPSPInfo::Entry sp;
-      if (_my_sps->getSP(propertyId, sp) && sp.isContract() && !sp.expirated)
+      std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
+      if (sp && sp->isContract() && !sp->expirated)
       {
-	        expirationBlock = static_cast<int>(sp.blocks_until_expiration);
+	        expirationBlock = static_cast<int>(sp->blocks_until_expiration);
 	        tradeBlock = static_cast<int>(pBlockIndex->nHeight);
           lastBlockg = static_cast<int>(pBlockIndex->nHeight);
 
 
-          int deadline = sp.init_block + expirationBlock;
+          int deadline = sp->init_block + expirationBlock;
 
           // if(msc_debug_handler_tx) PrintToLog("%s(): deadline: %d, lastBlockg : %d\n",__func__,deadline,lastBlockg);
 
@@ -2968,7 +3286,7 @@ bool CallingExpiration(CBlockIndex const * pBlockIndex)
 
           if (checkExpiration)
           {
-              sp.expirated = true; // into entry register
+              // NOTE: the expiration isn't stored in the entry, which was only ever set on a copy here
               // if(msc_debug_handler_tx) PrintToLog("%s(): EXPIRATED!!!!!!!!!!!!!!!!!!!!!!!!!!!\n",__func__);
 
               idx_expiration += 1;
@@ -3111,25 +3429,13 @@ bool mastercore_handler_tx(const CTransaction& tx, int nBlock, unsigned int idx,
     }
 
 
-    {
-        LOCK(cs_tally);
-        // clear pending, if any
-        // NOTE1: Every incoming TX is checked, not just MP-ones because:
-        // if for some reason the incoming TX doesn't pass our parser validation steps successfuly, I'd still want to clear pending amounts for that TX.
-        // NOTE2: Plus I wanna clear the amount before that TX is parsed by our protocol, in case we ever consider pending amounts in internal calculations.
-        PendingDelete(tx.GetHash());
-
-        // we do not care about parsing blocks prior to our waterline (empty blockchain defense)
-        if (nBlock < nWaterlineBlock) return false;
-
-    }
+    if (!HandlePendingTx(tx, nBlock)) return false;
 
     int64_t nBlockTime = pBlockIndex->GetBlockTime();
 
     CMPTransaction mp_obj;
     mp_obj.unlockLogic();
 
-    bool fFoundTx = false;
     int pop_ret;
     {
        LOCK2(cs_main, cs_tally);
@@ -3137,46 +3443,7 @@ bool mastercore_handler_tx(const CTransaction& tx, int nBlock, unsigned int idx,
 
     }
 
-    if (0 == pop_ret)
-    {
-        assert(mp_obj.getEncodingClass() != NO_MARKER);
-        assert(mp_obj.getSender().empty() == false);
-
-        int interp_ret = mp_obj.interpretPacket();
-
-        if(msc_debug_handler_tx) PrintToLog("%s(): interp_ret: %d\n",__func__, interp_ret);
-
-        // if interpretPacket returns 1, that means we have an instant trade between LTCs and tokens.
-        if (interp_ret == 1)
-        {
-            HandleLtcInstantTrade(tx, nBlock, mp_obj.getIndexInBlock(), mp_obj.getSender(), mp_obj.getSpecial(), mp_obj.getReceiver(), mp_obj.getProperty(), mp_obj.getAmountForSale(), mp_obj.getPrice());
-
-        } else if (interp_ret == 2) {
-            HandleDExPayments(tx, nBlock, mp_obj.getSender());
-
-        }
-
-        // Only structurally valid transactions get recorded in levelDB
-        // PKT_ERROR - 2 = interpret_Transaction failed, structurally invalid payload
-        if (interp_ret != PKT_ERROR - 2)
-        {
-            LOCK(cs_tally);
-            bool bValid = (0 <= interp_ret);
-            p_txlistdb->recordTX(tx.GetHash(), bValid, nBlock, mp_obj.getType(), mp_obj.getNewAmount(), interp_ret);
-            p_TradeTXDB->RecordTransaction(tx.GetHash(), idx);
-
-        }
-
-        fFoundTx |= (interp_ret == 0);
-    }
-
-    LOCK(cs_tally);
-    if (fFoundTx && msc_debug_consensus_hash_every_transaction) {
-        const uint256 consensusHash = GetConsensusHash();
-        if(msc_debug_handler_tx) PrintToLog("Consensus hash for transaction %s: %s\n", tx.GetHash().GetHex(), consensusHash.GetHex());
-    }
-
-    return fFoundTx;
+    return HandleParsedTx(tx, nBlock, idx, mp_obj, pop_ret);
 }
 
 bool TxValidNodeReward(std::string ConsensusHash, std::string Tx)
@@ -3391,7 +3658,7 @@ void CtlTransactionDB::RecordTransaction(const uint256& txid, uint32_t posInBloc
 
      const std::string key = txid.ToString();
      const std::string value = strprintf("%d", posInBlock);
-     Status status = pdb->Put(writeoptions, key, value);
+     Status status = Put(key, value);
      ++nWritten;
 }
 
@@ -3403,7 +3670,7 @@ uint32_t CtlTransactionDB::FetchTransactionPosition(const uint256& txid)
     std::string strValue;
     uint32_t posInBlock = 999999; // setting an initial arbitrarily high value will ensure transaction is always "last" in event of bug/exploit
 
-    Status status = pdb->Get(readoptions, key, &strValue);
+    Status status = Get(key, &strValue);
     if (status.ok()) {
         posInBlock = boost::lexical_cast<uint32_t>(strValue);
     }
@@ -3427,7 +3694,7 @@ void CMPTxList::recordMetaDExCancelTX(const uint256& txidMaster, const uint256&
     // Step 2b - If does exist add +1 to existing ref and set this ref as new number of affected
     std::vector<std::string> vstr;
     std::string strValue;
-    leveldb::Status status = pdb->Get(readoptions, txidMasterStr, &strValue);
+    leveldb::Status status = Get(txidMasterStr, &strValue);
     if (status.ok()) {
         // parse the string returned
         boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
@@ -3443,14 +3710,14 @@ void CMPTxList::recordMetaDExCancelTX(const uint256& txidMaster, const uint256&
     const std::string key = txidMasterStr;
     const std::string value = strprintf("%u:%d:%u:%lu", fValid ? 1 : 0, nBlock, type, refNumber);
     PrintToLog("METADEXCANCELDEBUG : Writing master record %s(%s, valid=%s, block= %d, type= %d, number of affected transactions= %d)\n", __func__, txidMaster.ToString(), fValid ? "YES" : "NO", nBlock, type, refNumber);
-    status = pdb->Put(writeoptions, key, value);
+    status = Put(key, value);
 
     // Step 4 - Write sub-record with cancel details
     const std::string txidStr = txidMaster.ToString() + "-C";
     const std::string subKey = STR_REF_SUBKEY_TXID_REF_COMBO(txidStr, refNumber);
     const std::string subValue = strprintf("%s:%d:%lu", txidSub.ToString(), propertyId, nValue);
     PrintToLog("METADEXCANCELDEBUG : Writing sub-record %s with value %s\n", subKey, subValue);
-    status = pdb->Put(writeoptions, subKey, subValue);
+    status = Put(subKey, subValue);
     if (msc_debug_txdb) PrintToLog("%s(): store: %s=%s, status: %s\n", __func__, subKey, subValue, status.ToString());
 }
 
@@ -3458,21 +3725,19 @@ void CMPTxList::LoadActivations(int blockHeight)
 {
      if (!pdb) return;
 
-     Slice skey, svalue;
      Iterator* it = NewIterator();
+     const std::string prefix(1, TXDB_TX);
 
      PrintToLog("Loading feature activations from levelDB\n");
 
      std::vector<std::pair<int64_t, uint256> > loadOrder;
 
-     for (it->SeekToFirst(); it->Valid(); it->Next()) {
-         std::string itData = it->value().ToString();
-         std::vector<std::string> vstr;
-         boost::split(vstr, itData, boost::is_any_of(":"), token_compress_on);
-         if (4 != vstr.size()) continue; // unexpected number of tokens
-         if (atoi(vstr[2]) != TL_MESSAGE_TYPE_ACTIVATION || atoi(vstr[0]) != 1) continue; // we only care about valid activations
-         uint256 txid = uint256S(it->key().ToString());
-         loadOrder.push_back(std::make_pair(atoi(vstr[1]), txid));
+     for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+         uint256 txid;
+         CMPTxRecord record;
+         if (!ParseRecordKey(it->key().ToString(), TXDB_TX, txid) || !DecodeRecord(it->value().ToString(), record)) continue;
+         if (record.nType != TL_MESSAGE_TYPE_ACTIVATION || !record.fValid) continue; // we only care about valid activations
+         loadOrder.push_back(std::make_pair(record.nBlock, txid));
      }
 
      std::sort (loadOrder.begin(), loadOrder.end());
@@ -3530,19 +3795,17 @@ void CMPTxList::LoadActivations(int blockHeight)
 void CMPTxList::LoadAlerts(int blockHeight)
 {
     if (!pdb) return;
-    Slice skey, svalue;
     Iterator* it = NewIterator();
+    const std::string prefix(1, TXDB_TX);
 
     std::vector<std::pair<int64_t, uint256> > loadOrder;
 
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-         std::string itData = it->value().ToString();
-         std::vector<std::string> vstr;
-         boost::split(vstr, itData, boost::is_any_of(":"), token_compress_on);
-         if (4 != vstr.size()) continue; // unexpected number of tokens
-         if (atoi(vstr[2]) != TL_MESSAGE_TYPE_ALERT || atoi(vstr[0]) != 1) continue; // not a valid alert
-         uint256 txid = uint256S(it->key().ToString());
-         loadOrder.push_back(std::make_pair(atoi(vstr[1]), txid));
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+         uint256 txid;
+         CMPTxRecord record;
+         if (!ParseRecordKey(it->key().ToString(), TXDB_TX, txid) || !DecodeRecord(it->value().ToString(), record)) continue;
+         if (record.nType != TL_MESSAGE_TYPE_ALERT || !record.fValid) continue; // not a valid alert
+         loadOrder.push_back(std::make_pair(record.nBlock, txid));
      }
 
      std::sort (loadOrder.begin(), loadOrder.end());
@@ -3605,7 +3868,7 @@ int CMPTxList::getDBVersion()
     std::string strValue;
     int verDB = 0;
 
-    Status status = pdb->Get(readoptions, "dbversion", &strValue);
+    Status status = Get("dbversion", &strValue);
     if (status.ok()) {
         verDB = boost::lexical_cast<uint64_t>(strValue);
     }
@@ -3623,7 +3886,7 @@ int CMPTxList::getDBVersion()
 int CMPTxList::setDBVersion()
 {
     std::string verStr = boost::lexical_cast<std::string>(DB_VERSION);
-    Status status = pdb->Put(writeoptions, "dbversion", verStr);
+    Status status = Put("dbversion", verStr);
 
     if (msc_debug_txdb) PrintToLog("%s(): dbversion %s status %s, line %d, file: %s\n", __FUNCTION__, verStr, status.ToString(), __LINE__, __FILE__);
 
@@ -3637,14 +3900,9 @@ int CMPTxList::setDBVersion()
 {
      int numberOfSubRecords = 0;
 
-     std::string strValue;
-     Status status = pdb->Get(readoptions, txid.ToString(), &strValue);
-     if (status.ok()) {
-         std::vector<std::string> vstr;
-         boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
-         if (4 <= vstr.size()) {
-             numberOfSubRecords = boost::lexical_cast<int>(vstr[3]);
-         }
+     CMPTxRecord record;
+     if (getTX(txid, record)) {
+         numberOfSubRecords = static_cast<int>(record.nValue);
      }
 
      return numberOfSubRecords;
@@ -3653,12 +3911,11 @@ int CMPTxList::setDBVersion()
 int CMPTxList::getMPTransactionCountTotal()
 {
      int count = 0;
-     Slice skey, svalue;
      Iterator* it = NewIterator();
-     for(it->SeekToFirst(); it->Valid(); it->Next())
+     const std::string prefix(1, TXDB_TX);
+     for(it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
      {
-         skey = it->key();
-         if (skey.ToString().length() == 64) { ++count; } //extra entries for cancels and purchases are more than 64 chars long
+         ++count; // sub records for cancels and purchases are stored with other types
      }
      delete it;
      return count;
@@ -3667,22 +3924,12 @@ int CMPTxList::getMPTransactionCountTotal()
 int CMPTxList::getMPTransactionCountBlock(int block)
 {
      int count = 0;
-     Slice skey, svalue;
      Iterator* it = NewIterator();
-     for(it->SeekToFirst(); it->Valid(); it->Next())
+     const std::string prefix(1, TXDB_TX);
+     for(it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
      {
-         skey = it->key();
-         svalue = it->value();
-         if (skey.ToString().length() == 64)
-         {
-             string strValue = svalue.ToString();
-             std::vector<std::string> vstr;
-             boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-             if (4 == vstr.size())
-             {
-                 if (atoi(vstr[1]) == block) { ++count; }
-             }
-         }
+         CMPTxRecord record;
+         if (DecodeRecord(it->value().ToString(), record) && record.nBlock == block) { ++count; }
      }
      delete it;
      return count;
@@ -3692,7 +3939,7 @@ string CMPTxList::getKeyValue(string key)
 {
      if (!pdb) return "";
      string strValue;
-     Status status = pdb->Get(readoptions, key, &strValue);
+     Status status = Get(key, &strValue);
      if (status.ok()) { return strValue; } else { return ""; }
 }
 
@@ -3703,7 +3950,7 @@ bool CMPTxList::getSendAllDetails(const uint256& txid, int subSend, uint32_t& pr
 {
      std::string strKey = strprintf("%s-%d", txid.ToString(), subSend);
      std::string strValue;
-     leveldb::Status status = pdb->Get(readoptions, strKey, &strValue);
+     leveldb::Status status = Get(strKey, &strValue);
      if (status.ok()) {
          std::vector<std::string> vstr;
          boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
@@ -3725,7 +3972,7 @@ void CMPTxList::recordSendAllSubRecord(const uint256& txid, int subRecordNumber,
      const std::string strKey = strprintf("%s-%d", txid.ToString(), subRecordNumber);
      const std::string strValue = strprintf("%d:%d", propertyId, nValue);
 
-     leveldb::Status status = pdb->Put(writeoptions, strKey, strValue);
+     leveldb::Status status = Put(strKey, strValue);
      ++nWritten;
     if (msc_debug_txdb) PrintToLog("%s(): store: %s=%s, status: %s\n", __func__, strKey, strValue, status.ToString());
 }
@@ -3738,8 +3985,15 @@ void CMPTxList::recordTX(const uint256 &txid, bool fValid, int nBlock, unsigned
     // reorgs delete all txs from levelDB above reorg_chain_height
     if (p_txlistdb->exists(txid)) PrintToLog("LEVELDB TX OVERWRITE DETECTION - %s\n", txid.ToString());
 
-    const string key = txid.ToString();
-    const string value = strprintf("%d:%d:%d:%u:%d", fValid ? 1:0, fValid ? 0:interp_ret, nBlock, type, nValue);
+    CMPTxRecord record;
+    record.fValid = fValid;
+    record.nReason = fValid ? 0 : interp_ret;
+    record.nBlock = nBlock;
+    record.nType = type;
+    record.nValue = nValue;
+
+    const string key = MakeRecordKey(TXDB_TX, txid);
+    const string value = EncodeRecord(record);
     Status status;
 
     PrintToLog("%s(%s, valid=%s, reason=%d, block= %d, type= %d, value= %lu)\n",
@@ -3747,7 +4001,7 @@ void CMPTxList::recordTX(const uint256 &txid, bool fValid, int nBlock, unsigned
 
     if (pdb)
     {
-        status = pdb->Put(writeoptions, key, value);
+        status = Put(key, value);
         ++nWritten;
          if (msc_debug_txdb) PrintToLog("%s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
     }
@@ -3758,18 +4012,21 @@ bool CMPTxList::exists(const uint256 &txid)
     if (!pdb) return false;
 
     std::string strValue;
-    Status status = pdb->Get(readoptions, txid.ToString(), &strValue);
+    Status status = Get(MakeRecordKey(TXDB_TX, txid), &strValue);
 
     return ((!status.ok() && status.IsNotFound()) ? false : true);
  }
 
-bool CMPTxList::getTX(const uint256 &txid, string &value)
+bool CMPTxList::getTX(const uint256 &txid, CMPTxRecord &record)
 {
-    Status status = pdb->Get(readoptions, txid.ToString(), &value);
+    if (!pdb) return false;
+
+    std::string strValue;
+    Status status = Get(MakeRecordKey(TXDB_TX, txid), &strValue);
 
     ++nRead;
 
-    return ((status.ok()) ? true : false);
+    return status.ok() && DecodeRecord(strValue, record);
 }
 
 void CMPTxList::printStats()
@@ -3806,55 +4063,55 @@ void CMPTxList::recordPaymentTX(const uint256 &txid, bool fValid, int nBlock, un
     uint64_t existingNumberOfPayments = 0;
 
     // Step 1 - Check TXList to see if this payment TXID exists
-    bool paymentEntryExists = p_txlistdb->exists(txid);
-
     // Step 2a - If doesn't exist leave number of payments & paymentNumber set to 1
     // Step 2b - If does exist add +1 to existing number of payments and set this paymentNumber as new numberOfPayments
-    if (paymentEntryExists)
+    CMPTxRecord record;
+    if (getTX(txid, record))
     {
-        //retrieve old numberOfPayments
-        std::vector<std::string> vstr;
-        string strValue;
-        Status status = pdb->Get(readoptions, txid.ToString(), &strValue);
-        if (status.ok())
-        {
-            // parse the string returned
-            boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-
-            // obtain the existing number of payments
-            if (4 <= vstr.size())
-            {
-                existingNumberOfPayments = atoi(vstr[3]);
-                paymentNumber = existingNumberOfPayments + 1;
-                numberOfPayments = existingNumberOfPayments + 1;
-             }
-        }
+        // obtain the existing number of payments
+        existingNumberOfPayments = record.nValue;
+        paymentNumber = existingNumberOfPayments + 1;
+        numberOfPayments = existingNumberOfPayments + 1;
     }
 
     // Step 3 - Create new/update master record for payment tx in TXList
-    const string key = txid.ToString();
-    const string value = strprintf("%u:%d:%u:%lu", fValid ? 1:0, nBlock, type, numberOfPayments);
+    record = CMPTxRecord();
+    record.fValid = fValid;
+    record.nBlock = nBlock;
+    record.nType = type;
+    record.nValue = numberOfPayments;
+
+    const string key = MakeRecordKey(TXDB_TX, txid);
+    const string value = EncodeRecord(record);
     Status status;
 
     if(msc_debug_record_payment_tx) PrintToLog("DEXPAYDEBUG : Writing master record %s(%s, valid=%s, block= %d, type= %d, number of payments= %lu)\n", __func__, txid.ToString(), fValid ? "YES":"NO", nBlock, type, numberOfPayments);
 
     if (pdb)
     {
-        status = pdb->Put(writeoptions, key, value);
+        status = Put(key, value);
         if(msc_debug_record_payment_tx) PrintToLog("DEXPAYDEBUG : %s(): %s, line %d, file: %s\n", __func__, status.ToString(), __LINE__, __FILE__);
     }
 
     // Step 4 - Write sub-record with payment details
-    const string txidStr = txid.ToString();
-    const string subKey = STR_PAYMENT_SUBKEY_TXID_PAYMENT_COMBO(txidStr, paymentNumber);
-    const string subValue = strprintf("%d:%d:%s:%s:%d:%lu:%lu", nBlock, vout, buyer, seller, propertyId, nValue, amountPaid);
+    CMPPaymentRecord payment;
+    payment.nBlock = nBlock;
+    payment.nVout = vout;
+    payment.buyer = buyer;
+    payment.seller = seller;
+    payment.propertyId = propertyId;
+    payment.nValue = nValue;
+    payment.nAmountPaid = amountPaid;
+
+    const string subKey = MakeRecordKey(TXDB_PAYMENT, txid, paymentNumber);
+    const string subValue = EncodeRecord(payment);
     Status subStatus;
 
-    if(msc_debug_record_payment_tx) PrintToLog("DEXPAYDEBUG : Writing sub-record %s with value %s\n", subKey, subValue);
+    if(msc_debug_record_payment_tx) PrintToLog("DEXPAYDEBUG : Writing sub-record %s-%d\n", txid.ToString(), paymentNumber);
 
     if (pdb)
     {
-        subStatus = pdb->Put(writeoptions, subKey, subValue);
+        subStatus = Put(subKey, subValue);
         if(msc_debug_record_payment_tx) PrintToLog("DEXPAYDEBUG : %s(): %s, line %d, file: %s\n", __func__, subStatus.ToString(), __LINE__, __FILE__);
      }
 
@@ -3879,22 +4136,33 @@ void CMPTxList::recordPaymentTX(const uint256 &txid, bool fValid, int nBlock, un
         svalue = it->value();
         ++count;
 
+        string strkey = skey.ToString();
         string strvalue = it->value().ToString();
 
-        // parse the string returned, find the validity flag/bit & other parameters
-        boost::split(vstr, strvalue, boost::is_any_of(":"), token_compress_on);
-
         // only care about the block number/height here
-        if (2 <= vstr.size())
+        if (IsBinaryRecordKey(strkey))
         {
+            CMPTxRecord record;
+            CMPPaymentRecord payment;
+            if (strkey[0] == TXDB_TX && DecodeRecord(strvalue, record)) {
+                block = record.nBlock;
+            } else if (strkey[0] == TXDB_PAYMENT && DecodeRecord(strvalue, payment)) {
+                block = payment.nBlock;
+            } else {
+                continue;
+            }
+        } else {
+            // parse the string returned, find the validity flag/bit & other parameters
+            boost::split(vstr, strvalue, boost::is_any_of(":"), token_compress_on);
+            if (2 > vstr.size()) continue;
             block = atoi(vstr[1]);
+        }
 
-            if ((starting_block <= block) && (block <= ending_block))
-            {
-                ++n_found;
-                if(msc_debug_is_mpin_block_range) PrintToLog("%s() DELETING: %s=%s\n", __FUNCTION__, skey.ToString(), svalue.ToString());
-                if (bDeleteFound) pdb->Delete(writeoptions, skey);
-            }
+        if ((starting_block <= block) && (block <= ending_block))
+        {
+            ++n_found;
+            if(msc_debug_is_mpin_block_range) PrintToLog("%s() DELETING: %s\n", __FUNCTION__, HexStr(strkey));
+            if (bDeleteFound) Delete(strkey);
         }
     }
 
@@ -3909,7 +4177,7 @@ void CMPTxList::getMPTransactionAddresses(std::vector<std::string> &vaddrs)
     if (!pdb) return;
 
     Slice skey, svalue;
-    Iterator* it = NewIterator();
+    Iterator* it = NewTextIterator();
 
     for(it->SeekToFirst(); it->Valid(); it->Next())
     {
@@ -3950,58 +4218,52 @@ bool mastercore::isMPinBlockRange(int starting_block, int ending_block, bool bDe
 // if (getValidMPTX(txid, &block, &type, &nNew)) // if true -- the TX is a valid MP TX
 bool mastercore::getValidMPTX(const uint256 &txid, std::string *reason, int *block, unsigned int *type, uint64_t *nAmended)
 {
-    string result;
-    int validity = 0;
+    CMPTxRecord record;
 
     if (!p_txlistdb) return false;
 
-    if (!p_txlistdb->getTX(txid, result))
+    if (!p_txlistdb->getTX(txid, record))
     {
         return false;
     }
 
-    // parse the string returned, find the validity flag/bit & other parameters
-    std::vector<std::string> vstr;
-    boost::split(vstr, result, boost::is_any_of(":"), token_compress_on);
+    if (msc_debug_txdb) PrintToLog("%s() valid=%d, reason=%d, block=%d, type=%d, value=%d\n", __FUNCTION__, record.fValid, record.nReason, record.nBlock, record.nType, record.nValue);
 
-    if (msc_debug_txdb) PrintToLog("%s() size=%lu : %s\n", __FUNCTION__, vstr.size(), result);
+    if (reason) *reason = error_str(record.nReason);
+    if (block) *block = record.nBlock;
+    if (type) *type = record.nType;
+    if (nAmended) *nAmended = record.nValue;
 
-    if (1 <= vstr.size()) validity = atoi(vstr[0]);
+    if (msc_debug_txdb) p_txlistdb->printStats();
 
-    if (reason)
-    {
-        if (2 <= vstr.size())
-        {
-            const int error_code = atoi(vstr[1]);
-            *reason = error_str(error_code);
-        } else {
-            *reason = "-";
-        }
-    }
+    return record.fValid;
+}
 
-    if (block)
-    {
-        if (3 <= vstr.size()) *block = atoi(vstr[2]);
-        else *block = 0;
-    }
+/**
+ * Starts collecting the records written while processing a block.
+ */
+static void BeginDBBatches()
+{
+    if (p_txlistdb) p_txlistdb->BeginBatch();
+    if (t_tradelistdb) t_tradelistdb->BeginBatch();
+    if (p_TradeTXDB) p_TradeTXDB->BeginBatch();
+}
 
-    if (type)
-    {
-        if (4 <= vstr.size()) *type = atoi(vstr[3]);
-        else *type = 0;
-    }
+/**
+ * Writes the records of a block, each database in one atomic batch.
+ */
+static void CommitDBBatches(int nBlock, bool fSync)
+{
+    if (p_txlistdb) p_txlistdb->CommitBatch(fSync);
+    if (t_tradelistdb) t_tradelistdb->CommitBatch(fSync);
+    if (p_TradeTXDB) p_TradeTXDB->CommitBatch(fSync);
 
-    if (nAmended)
-    {
-        if (5 <= vstr.size()) *nAmended = boost::lexical_cast<boost::uint64_t>(vstr[4]);
-        else nAmended = 0;
+    if (msc_debug_persistence && t_tradelistdb && p_txlistdb) {
+        const CDBBatchStats txStats = p_txlistdb->GetBatchStats();
+        const CDBBatchStats tradeStats = t_tradelistdb->GetBatchStats();
+        PrintToLog("%s(): block %d, tx entries: %d [%.3f ms], trade entries: %d [%.3f ms]\n", __func__, nBlock,
+            txStats.nLastEntries, 0.001 * txStats.nLastCommitTime, tradeStats.nLastEntries, 0.001 * tradeStats.nLastCommitTime);
     }
-
-    if (msc_debug_txdb) p_txlistdb->printStats();
-
-    if (0 == validity) return false;
-
-    return true;
 }
 
 int mastercore_handler_block_begin(int nBlockPrev, CBlockIndex const * pBlockIndex)
@@ -4026,6 +4288,10 @@ int mastercore_handler_block_begin(int nBlockPrev, CBlockIndex const * pBlockInd
             nWaterlineBlock = best_state_block;
         }
 
+        // the trades, registrations and attestations of the blocks to reparse are recorded again
+        tradeJournal.Rollback(nWaterlineBlock + 1);
+        t_tradelistdb->rollBackIdentities(nWaterlineBlock);
+
         // clear the global wallet property list, perform a forced wallet update and tell the UI that state is no longer valid, and UI views need to be reinit
         global_wallet_property_list.clear();
         CheckWalletUpdate(true);
@@ -4038,6 +4304,9 @@ int mastercore_handler_block_begin(int nBlockPrev, CBlockIndex const * pBlockInd
         }
     }
 
+    // records of this block are committed together in mastercore_handler_block_end()
+    BeginDBBatches();
+
     // handle any features that go live with this block
     CheckLiveActivations(pBlockIndex->nHeight);
 
@@ -4078,6 +4347,57 @@ int mastercore_handler_block_begin(int nBlockPrev, CBlockIndex const * pBlockInd
 // called once per block, after the block has been processed
 // TODO: consolidate into *handler_block_begin() << need to adjust Accept expiry check.............
 // it performs cleanup and other functions
+//! Blocks of traded volume kept in detail, if not set via -tlvolumehistory
+static const int DEFAULT_VOLUME_HISTORY = 30 * dayblocks;
+//! Longest volume window used by consensus, which must never be compacted
+static const int MIN_VOLUME_HISTORY = 1000;
+
+/**
+ * Compacts the traded volume older than "-tlvolumehistory" blocks into
+ * checkpoints, once per day of blocks. With 0, the whole history is kept.
+ *
+ * Volume ranges starting within the kept history remain exact.
+ */
+static void CompactVolumes(int nBlockNow)
+{
+    if (nBlockNow % dayblocks != 0) return;
+
+    const int nHistory = gArgs.GetArg("-tlvolumehistory", DEFAULT_VOLUME_HISTORY);
+    if (nHistory <= 0) return;
+
+    const int nCheckpoint = nBlockNow - std::max(nHistory, MIN_VOLUME_HISTORY);
+    if (nCheckpoint < 0) return;
+
+    MapLTCVolume.Compact(nCheckpoint);
+    MapTokenVolume.Compact(nCheckpoint);
+    metavolume.Compact(nCheckpoint);
+    NotifyStateSectionChanged(FILE_TYPE_LTC_VOLUME);
+    NotifyStateSectionChanged(FILETYPE_DEX_VOLUME);
+    NotifyStateSectionChanged(FILETYPE_MDEX_VOLUME);
+
+    if (msc_debug_persistence) PrintToLog("%s(): volumes compacted up to block %d\n", __func__, nCheckpoint);
+}
+
+//! Whether the global PNL and volume totals changed in the current block
+static bool fGlobalTotalsChanged = false;
+
+/** Appends the global PNL and volume totals to their files, if they changed in the block. */
+static void SaveGlobalTotals()
+{
+    if (!fGlobalTotalsChanged) return;
+    fGlobalTotalsChanged = false;
+
+    std::fstream fileglobalPNLALL_DUSD;
+    fileglobalPNLALL_DUSD.open ("globalPNLALL_DUSD.txt", std::fstream::in | std::fstream::out | std::fstream::app);
+    saveDataGraphs(fileglobalPNLALL_DUSD, std::to_string(globalPNLALL_DUSD));
+    fileglobalPNLALL_DUSD.close();
+
+    std::fstream fileglobalVolumeALL_DUSD;
+    fileglobalVolumeALL_DUSD.open ("globalVolumeALL_DUSD.txt", std::fstream::in | std::fstream::out | std::fstream::app);
+    saveDataGraphs(fileglobalVolumeALL_DUSD, std::to_string(FormatShortIntegerMP(globalVolumeALL_DUSD)));
+    fileglobalVolumeALL_DUSD.close();
+}
+
 int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
         unsigned int countMP)
 {
@@ -4106,6 +4426,9 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
        // check the alert status, do we need to do anything else here?
        CheckExpiredAlerts(nBlockNow, pBlockIndex->GetBlockTime());
 
+       // merge old traded volume into checkpoints
+       CompactVolumes(nBlockNow);
+
        // transactions were found in the block, signal the UI accordingly
        if (countMP > 0) CheckWalletUpdate(true);
 
@@ -4137,12 +4460,17 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
      }
 
      LOCK2(cs_main, cs_tally);
-     if (checkpointValid){
+     const bool fSaveState = checkpointValid && writePersistence(nBlockNow) && nBlockNow >= ConsensusParams().GENESIS_BLOCK;
+
+     // the records of the block go to disk before the state, which refers to them
+     CommitDBBatches(nBlockNow, fSaveState);
+     tradeJournal.Commit();
+     SaveGlobalTotals();
+
+     if (fSaveState) {
          // save out the state after this block
-         if (writePersistence(nBlockNow) && nBlockNow >= ConsensusParams().GENESIS_BLOCK) {
-              mastercore_save_state(pBlockIndex);
-          }
-      }
+         mastercore_save_state(pBlockIndex);
+     }
 
       return 0;
 }
@@ -4153,6 +4481,7 @@ int mastercore_handler_disc_begin(int nBlockNow, CBlockIndex const * pBlockIndex
 
     reorgRecoveryMode = 1;
     reorgRecoveryMaxHeight = (pBlockIndex->nHeight > reorgRecoveryMaxHeight) ? pBlockIndex->nHeight: reorgRecoveryMaxHeight;
+    tradeJournal.Rollback(pBlockIndex->nHeight);
     return 0;
 }
 
@@ -4163,39 +4492,172 @@ int mastercore_handler_disc_end(int nBlockNow, CBlockIndex const * pBlockIndex)
     return 0;
 }
 
+//! Type bytes of the secondary index entries in the trade database
+static const char TRADEIDX_ADDRESS = '\x01';
+static const char TRADEIDX_PAIR = '\x02';
+static const char TRADEIDX_INSTANT = '\x03';
+static const char TRADEIDX_CONTRACT = '\x04';
+static const char TRADEIDX_META = '\x05';
+
+//! Version of the secondary indexes, bump to rebuild them
+static const int TRADEIDX_VERSION = 2;
+
+static std::string TradeIndexVersionKey()
+{
+    return strprintf("%cversion", TRADEIDX_META);
+}
+
+// address -> MetaDEx trade, ordered by block and position
+static std::string TradeIndexAddressPrefix(const std::string& address)
+{
+    return strprintf("%c%s:", TRADEIDX_ADDRESS, address);
+}
+
+// property pair -> matched MetaDEx trade, ordered by block
+static std::string TradeIndexPairPrefix(uint32_t propertyIdA, uint32_t propertyIdB)
+{
+    return strprintf("%c%010u%010u", TRADEIDX_PAIR, std::min(propertyIdA, propertyIdB), std::max(propertyIdA, propertyIdB));
+}
+
+// property -> instant trade in channels, ordered by block; property 0 lists all of them
+static std::string TradeIndexInstantPrefix(uint32_t propertyId)
+{
+    return strprintf("%c%010u", TRADEIDX_INSTANT, propertyId);
+}
+
+// contract -> match, ordered by block of the taker
+static std::string TradeIndexContractPrefix(uint32_t contractId)
+{
+    return strprintf("%c%010u", TRADEIDX_CONTRACT, contractId);
+}
+
+/**
+ * Returns the index entries of a trade database record, as pairs of index key
+ * and record key.
+ */
+static std::vector<std::pair<std::string, std::string>> GetTradeIndexEntries(const std::string& strKey, const std::string& strValue)
+{
+    std::vector<std::pair<std::string, std::string>> vEntries;
+    if (strKey.empty()) return vEntries;
+
+    uint256 txid1, txid2;
+    CMPMetaDExTradeRecord trade;
+    CMPMetaDExMatchRecord match;
+    CMPContractMatchRecord contractMatch;
+
+    if (ParseRecordKey(strKey, TRADEDB_METADEX_TRADE, txid1) && DecodeRecord(strValue, trade)) {
+        vEntries.push_back(std::make_pair(TradeIndexAddressPrefix(trade.address) + strprintf("%010d%010d%s", trade.nBlock, trade.nBlockIndex, txid1.GetHex()), strKey));
+    } else if (ParseRecordKey(strKey, TRADEDB_METADEX_MATCH, txid1, txid2) && DecodeRecord(strValue, match)) {
+        vEntries.push_back(std::make_pair(TradeIndexPairPrefix(match.prop1, match.prop2) + strprintf("%010d%s+%s", match.nBlock, txid1.GetHex(), txid2.GetHex()), strKey));
+    } else if (ParseRecordKey(strKey, TRADEDB_CONTRACT_MATCH, txid1, txid2) && DecodeRecord(strValue, contractMatch)) {
+        vEntries.push_back(std::make_pair(TradeIndexContractPrefix(contractMatch.contractId) + strprintf("%010d%s+%s", contractMatch.nBlockTaker, txid1.GetHex(), txid2.GetHex()), strKey));
+    } else if (!IsBinaryRecordKey(strKey)) {
+        std::vector<std::string> vstr;
+        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
+        if (vstr.size() != 10 || vstr[9] != TYPE_INSTANT_TRADE) return vEntries;
+
+        try {
+            // instant trade: channel:first:second:prop1:amount1:prop2:amount2:block:index:type
+            const uint32_t prop1 = boost::lexical_cast<uint32_t>(vstr[3]);
+            const uint32_t prop2 = boost::lexical_cast<uint32_t>(vstr[5]);
+            const std::string strBlock = strprintf("%010d", boost::lexical_cast<int>(vstr[7]));
+            vEntries.push_back(std::make_pair(TradeIndexInstantPrefix(0) + strBlock + strKey, strKey));
+            vEntries.push_back(std::make_pair(TradeIndexInstantPrefix(prop1) + strBlock + strKey, strKey));
+            if (prop2 != prop1) vEntries.push_back(std::make_pair(TradeIndexInstantPrefix(prop2) + strBlock + strKey, strKey));
+        } catch (const boost::bad_lexical_cast& e) {
+            PrintToLog("%s(): unable to index record %s: %s\n", __func__, strKey, e.what());
+        }
+    }
+
+    return vEntries;
+}
+
+leveldb::Status CMPTradeList::putIndexed(const std::string& key, const std::string& value)
+{
+    leveldb::WriteBatch batch;
+    batch.Put(key, value);
+    for (const auto& entry : GetTradeIndexEntries(key, value)) {
+        batch.Put(entry.first, entry.second);
+    }
+    ++nWritten;
+
+    return Write(&batch);
+}
+
+void CMPTradeList::buildIndexes()
+{
+    std::string strVersion;
+    Status status = Get(TradeIndexVersionKey(), &strVersion);
+    if (status.ok() && atoi(strVersion) == TRADEIDX_VERSION) return;
+
+    PrintToLog("Building trade database indexes...\n");
+
+    leveldb::WriteBatch batch;
+    unsigned int nEntries = 0;
+    leveldb::Iterator* it = NewIterator();
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        const std::string strKey = it->key().ToString();
+        if (!strKey.empty() && strKey[0] <= TRADEIDX_META) {
+            // stale entries of a previous index version
+            batch.Delete(strKey);
+            continue;
+        }
+        for (const auto& entry : GetTradeIndexEntries(strKey, it->value().ToString())) {
+            batch.Put(entry.first, entry.second);
+            ++nEntries;
+        }
+    }
+    delete it;
+
+    batch.Put(TradeIndexVersionKey(), strprintf("%d", TRADEIDX_VERSION));
+    status = pdb->Write(syncoptions, &batch);
+
+    PrintToLog("Trade database indexes built: %d entries, %s\n", nEntries, status.ToString());
+}
+
+void CMPTradeList::forEachIndexedReverse(const std::string& prefix, std::function<bool(const std::string& key, const std::string& value)> fn)
+{
+    leveldb::Iterator* it = NewIterator();
+
+    // position on the last entry with the prefix
+    it->Seek(prefix + '\xff');
+    if (it->Valid()) {
+        it->Prev();
+    } else {
+        it->SeekToLast();
+    }
+
+    for (; it->Valid() && it->key().starts_with(prefix); it->Prev()) {
+        const std::string strKey = it->value().ToString();
+        std::string strValue;
+        if (!Get(strKey, &strValue).ok()) continue;
+        if (!fn(strKey, strValue)) break;
+    }
+
+    delete it;
+}
+
 // obtains a vector of txids where the supplied address participated in a trade (needed for gettradehistory_MP)
 // optional property ID parameter will filter on propertyId transacted if supplied
 // sorted by block then index
 void CMPTradeList::getTradesForAddress(std::string address, std::vector<uint256>& vecTransactions, uint32_t propertyIdFilter)
 {
     if (!pdb) return;
-    std::map<std::string,uint256> mapTrades;
+    const std::string prefix = TradeIndexAddressPrefix(address);
     leveldb::Iterator* it = NewIterator();
-    for(it->SeekToFirst(); it->Valid(); it->Next()) {
-        const std::string strKey = it->key().ToString();
-        const std::string strValue = it->value().ToString();
-        std::vector<std::string> vecValues;
-        if (strKey.size() != 64) continue; // only interested in trades
-        const uint256 txid = uint256S(strKey);
-        const size_t addressMatch = strValue.find(address);
-        if (addressMatch == std::string::npos) continue;
-        boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vecValues.size() != 5) {
-            // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        const std::string strKey = it->value().ToString();
+        uint256 txid;
+        if (!ParseRecordKey(strKey, TRADEDB_METADEX_TRADE, txid)) continue;
+        if (propertyIdFilter != 0) {
+            std::string strValue;
+            CMPMetaDExTradeRecord record;
+            if (!Get(strKey, &strValue).ok() || !DecodeRecord(strValue, record)) continue;
+            if (propertyIdFilter != record.propertyIdForSale && propertyIdFilter != record.propertyIdDesired) continue;
         }
-        const uint32_t propertyIdForSale = boost::lexical_cast<uint32_t>(vecValues[1]);
-        const uint32_t propertyIdDesired = boost::lexical_cast<uint32_t>(vecValues[2]);
-        const int64_t blockNum = boost::lexical_cast<uint32_t>(vecValues[3]);
-        const int64_t txIndex = boost::lexical_cast<uint32_t>(vecValues[4]);
-        if (propertyIdFilter != 0 && propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) continue;
-        std::string sortKey = strprintf("%06d%010d", blockNum, txIndex);
-        mapTrades.insert(std::make_pair(sortKey, txid));
+        vecTransactions.push_back(txid);
     }
     delete it;
-    for (const auto &m : mapTrades) {
-        vecTransactions.push_back(m.second);
-    }
 }
 
 static bool CompareTradePair(const std::pair<int64_t, UniValue>& firstJSONObj, const std::pair<int64_t, UniValue>& secondJSONObj)
@@ -4207,45 +4669,39 @@ static bool CompareTradePair(const std::pair<int64_t, UniValue>& firstJSONObj, c
 void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyIdSideB, UniValue& responseArray, uint64_t count)
 {
     if (!pdb) return;
-    leveldb::Iterator* it = NewIterator();
-    std::vector<std::pair<int64_t, UniValue> > vecResponse;
+    std::vector<UniValue> vecResponse;
     bool propertyIdSideAIsDivisible = isPropertyDivisible(propertyIdSideA);
     bool propertyIdSideBIsDivisible = isPropertyDivisible(propertyIdSideB);
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        const std::string strKey = it->key().ToString();
-        const std::string strValue = it->value().ToString();
-        std::vector<std::string> vecKeys;
-        std::vector<std::string> vecValues;
+
+    // most recent first
+    forEachIndexedReverse(TradeIndexPairPrefix(propertyIdSideA, propertyIdSideB), [&](const std::string& strKey, const std::string& strValue) {
+        if (vecResponse.size() >= count) return false;
+        uint256 txid1, txid2;
+        CMPMetaDExMatchRecord record;
         uint256 sellerTxid, matchingTxid;
         std::string sellerAddress, matchingAddress;
         int64_t amountReceived = 0, amountSold = 0;
-        if (strKey.size() != 129) continue; // only interested in matches
-        boost::split(vecKeys, strKey, boost::is_any_of("+"), boost::token_compress_on);
-        boost::split(vecValues, strValue, boost::is_any_of(":"), boost::token_compress_on);
-        if (vecKeys.size() != 2 || vecValues.size() != 8) {
-            // PrintToLog("TRADEDB error - unexpected number of tokens (%s:%s)\n", strKey, strValue);
-            continue;
+        if (!ParseRecordKey(strKey, TRADEDB_METADEX_MATCH, txid1, txid2) || !DecodeRecord(strValue, record)) {
+            // PrintToLog("TRADEDB error - unexpected record (%s)\n", HexStr(strKey));
+            return true;
         }
 
-        const uint32_t tradePropertyIdSideA = boost::lexical_cast<uint32_t>(vecValues[2]);
-        const uint32_t tradePropertyIdSideB = boost::lexical_cast<uint32_t>(vecValues[3]);
-
-        if (tradePropertyIdSideA == propertyIdSideA && tradePropertyIdSideB == propertyIdSideB) {
-            sellerTxid.SetHex(vecKeys[1]);
-            sellerAddress = vecValues[1];
-            amountSold = boost::lexical_cast<int64_t>(vecValues[4]);
-            matchingTxid.SetHex(vecKeys[0]);
-            matchingAddress = vecValues[0];
-            amountReceived = boost::lexical_cast<int64_t>(vecValues[5]);
-        } else if (tradePropertyIdSideB == propertyIdSideA && tradePropertyIdSideA == propertyIdSideB) {
-            sellerTxid.SetHex(vecKeys[0]);
-            sellerAddress = vecValues[0];
-            amountSold = boost::lexical_cast<int64_t>(vecValues[5]);
-            matchingTxid.SetHex(vecKeys[1]);
-            matchingAddress = vecValues[1];
-            amountReceived = boost::lexical_cast<int64_t>(vecValues[4]);
+        if (record.prop1 == propertyIdSideA && record.prop2 == propertyIdSideB) {
+            sellerTxid = txid2;
+            sellerAddress = record.address2;
+            amountSold = record.amount1;
+            matchingTxid = txid1;
+            matchingAddress = record.address1;
+            amountReceived = record.amount2;
+        } else if (record.prop2 == propertyIdSideA && record.prop1 == propertyIdSideB) {
+            sellerTxid = txid1;
+            sellerAddress = record.address1;
+            amountSold = record.amount2;
+            matchingTxid = txid2;
+            matchingAddress = record.address2;
+            amountReceived = record.amount1;
         } else {
-            continue;
+            return true;
         }
 
         rational_t unitPrice(amountReceived, amountSold);
@@ -4255,7 +4711,7 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
         const std::string unitPriceStr = xToString(unitPrice); // TODO: not here!
         const std::string inversePriceStr = xToString(inversePrice);
 
-        const int64_t blockNum = boost::lexical_cast<int64_t>(vecValues[6]);
+        const int64_t blockNum = record.nBlock;
 
         UniValue trade(UniValue::VOBJ);
         trade.pushKV("block", blockNum);
@@ -4275,22 +4731,14 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
         }
         trade.pushKV("matchingtxid", matchingTxid.GetHex());
         trade.pushKV("matchingaddress", matchingAddress);
-        vecResponse.push_back(std::make_pair(blockNum, trade));
-    }
-
-    // sort the response most recent first before adding to the array
-    std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-
-    uint64_t elements = 0;
-    std::vector<std::pair<int64_t, UniValue>> aux;
-    for_each(vecResponse.begin(), vecResponse.end(), [&aux, &elements, &count] (const std::pair<int64_t, UniValue> p) { if(elements < count) aux.push_back(p); elements++; });
+        vecResponse.push_back(trade);
+        return true;
+    });
 
     //reversing vector and pushing back
-    for (std::vector<std::pair<int64_t, UniValue>>::reverse_iterator it = aux.rbegin(); it != aux.rend(); it++){
-        responseArray.push_back(it->second);
+    for (std::vector<UniValue>::reverse_iterator it = vecResponse.rbegin(); it != vecResponse.rend(); it++){
+        responseArray.push_back(*it);
     }
-
-    delete it;
 }
 
 // obtains an array of trades in DEx
@@ -4299,27 +4747,22 @@ void CMPTxList::getDExTrades(const std::string& address, uint32_t propertyId, Un
   if (!pdb) return;
   std::vector<std::pair<int64_t, UniValue> > vecResponse;
   leveldb::Iterator* it = NewIterator();
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      const std::string strKey = it->key().ToString();
-      const std::string strValue = it->value().ToString();
-      std::vector<std::string> vecValues;
-      if (strKey.size() != 66) continue;
-      std::string strtxid = strKey.substr (0,64);
-      const size_t addressMatch = strValue.find(address);
-      if (addressMatch == std::string::npos) continue;
-      boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
-      if (vecValues.size() != 7) {
-          // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-          continue;
-      }
-
-      const uint32_t prop = boost::lexical_cast<uint32_t>(vecValues[4]);
-      if (propertyId != 0 && propertyId != prop) continue;
-      const int blockNum = boost::lexical_cast<int>(vecValues[0]);
-      const std::string& buyer = vecValues[2];
-      const std::string& seller = vecValues[3];
-      uint64_t amount = boost::lexical_cast<uint64_t>(vecValues[5]);
-      uint64_t amountPaid = boost::lexical_cast<uint64_t>(vecValues[6]);
+  const std::string prefix(1, TXDB_PAYMENT);
+  for(it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+      uint256 txid;
+      unsigned int paymentNumber;
+      CMPPaymentRecord payment;
+      if (!ParseRecordKey(it->key().ToString(), TXDB_PAYMENT, txid, paymentNumber)) continue;
+      if (!DecodeRecord(it->value().ToString(), payment)) continue;
+      if (payment.buyer != address && payment.seller != address) continue;
+
+      if (propertyId != 0 && propertyId != payment.propertyId) continue;
+      const std::string strtxid = txid.ToString();
+      const int blockNum = payment.nBlock;
+      const std::string& buyer = payment.buyer;
+      const std::string& seller = payment.seller;
+      uint64_t amount = payment.nValue;
+      uint64_t amountPaid = payment.nAmountPaid;
 
       // calculate unit price and updated amount of litecoin desired
       arith_uint256 aUnitPrice = 0;
@@ -4362,7 +4805,7 @@ void CMPTxList::getDExTrades(const std::string& address, uint32_t propertyId, Un
 void CMPTxList::getChannelTrades(const std::string& address, const std::string& channel, uint32_t propertyId, UniValue& responseArray, uint64_t count)
 {
   if (!pdb) return;
-  leveldb::Iterator* it = NewIterator();
+  leveldb::Iterator* it = NewTextIterator();
   std::vector<std::pair<int64_t, UniValue> > vecResponse;
   for(it->SeekToFirst(); it->Valid(); it->Next()) {
       const std::string strKey = it->key().ToString();
@@ -4436,13 +4879,12 @@ void CMPTxList::getChannelTrades(const std::string& address, const std::string&
 void CMPTradeList::getTokenChannelTrades(const std::string& address, const std::string& channel, uint32_t propertyId, UniValue& responseArray, uint64_t count)
 {
   if (!pdb) return;
-  leveldb::Iterator* it = NewIterator();
-  std::vector<std::pair<int64_t, UniValue> > vecResponse;
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      const std::string strKey = it->key().ToString();
-      const std::string strValue = it->value().ToString();
+  std::vector<UniValue> vecResponse;
+
+  // most recent first, property 0 lists all instant trades
+  forEachIndexedReverse(TradeIndexInstantPrefix(propertyId), [&](const std::string& strKey, const std::string& strValue) {
+      if (vecResponse.size() >= count) return false;
       std::vector<std::string> vecValues;
-      if (strKey.size() < 64) continue;
 
       int pos = strKey.find("+");
       const std::string strtxid = strKey.substr(pos + 1);
@@ -4450,17 +4892,11 @@ void CMPTradeList::getTokenChannelTrades(const std::string& address, const std::
       boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
       if (vecValues.size() != 10) {
           // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-          continue;
+          return true;
       }
 
-      const std::string& type  = vecValues[9];
-
-      // NOTE: improve this type string here (better: int)
-      if(type != TYPE_INSTANT_TRADE) continue;
-
       const uint32_t prop1 = boost::lexical_cast<uint32_t>(vecValues[3]);
       const uint32_t prop2 = boost::lexical_cast<uint32_t>(vecValues[5]);
-      if (propertyId != 0 && propertyId != prop1 && propertyId != prop2) continue;
 
       const std::string& channel = vecValues[0];
       const std::string& buyer = vecValues[1];
@@ -4485,34 +4921,26 @@ void CMPTradeList::getTokenChannelTrades(const std::string& address, const std::
       trade.pushKV("amountdesired", FormatMP(prop2, amountDesired));
       trade.pushKV("unitprice", unitPriceStr);
 
-      vecResponse.push_back(std::make_pair(blockNum, trade));
-  }
-
-  // sort the response most recent first before adding to the array
-  std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-
-  uint64_t elements = 0;
-  std::vector<std::pair<int64_t, UniValue>> aux;
-  for_each(vecResponse.begin(), vecResponse.end(), [&aux, &elements, &count] (const std::pair<int64_t, UniValue> p) { if(elements < count) aux.push_back(p); elements++; });
+      vecResponse.push_back(trade);
+      return true;
+  });
 
   //reversing vector and pushing back
-  for (std::vector<std::pair<int64_t, UniValue>>::reverse_iterator it = aux.rbegin(); it != aux.rend(); it++){
-      responseArray.push_back(it->second);
+  for (std::vector<UniValue>::reverse_iterator it = vecResponse.rbegin(); it != vecResponse.rend(); it++){
+      responseArray.push_back(*it);
   }
-
-  delete it;
 }
 
 void CMPTradeList::getChannelTradesForPair(const std::string& channel, uint32_t propertyIdA, uint32_t propertyIdB, UniValue& responseArray, uint64_t count)
 {
   if (!pdb) return;
-  leveldb::Iterator* it = NewIterator();
-  std::vector<std::pair<int64_t, UniValue> > vecResponse;
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      const std::string strKey = it->key().ToString();
-      const std::string strValue = it->value().ToString();
+  std::vector<UniValue> vecResponse;
+
+  // most recent first, seeking by one side of the pair, and filtering by the other one
+  const uint32_t propertyIdSeek = (propertyIdA != 0) ? propertyIdA : propertyIdB;
+  forEachIndexedReverse(TradeIndexInstantPrefix(propertyIdSeek), [&](const std::string& strKey, const std::string& strValue) {
+      if (vecResponse.size() >= count) return false;
       std::vector<std::string> vecValues;
-      if (strKey.size() < 64) continue;
 
       int pos = strKey.find("+");
       const std::string strtxid = strKey.substr(pos + 1);
@@ -4520,21 +4948,16 @@ void CMPTradeList::getChannelTradesForPair(const std::string& channel, uint32_t
       boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
       if (vecValues.size() != 10) {
           // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-          continue;
+          return true;
       }
 
-      const std::string& type  = vecValues[9];
-
-      // NOTE: improve this type string here (better: int)
-      if(type != TYPE_INSTANT_TRADE) continue;
-
       const uint32_t prop1 = boost::lexical_cast<uint32_t>(vecValues[3]);
       const uint32_t prop2 = boost::lexical_cast<uint32_t>(vecValues[5]);
 
       //checking first property
-      if (propertyIdA != 0 && propertyIdA != prop1 && propertyIdA != prop2) continue;
+      if (propertyIdA != 0 && propertyIdA != prop1 && propertyIdA != prop2) return true;
       //checking second property
-      if (propertyIdB != 0 && propertyIdB != prop1 && propertyIdB != prop2) continue;
+      if (propertyIdB != 0 && propertyIdB != prop1 && propertyIdB != prop2) return true;
 
 
       const std::string& channel = vecValues[0];
@@ -4560,39 +4983,40 @@ void CMPTradeList::getChannelTradesForPair(const std::string& channel, uint32_t
       trade.pushKV("amountdesired", FormatMP(prop2, amountDesired));
       trade.pushKV("unitprice", unitPriceStr);
 
-      vecResponse.push_back(std::make_pair(blockNum, trade));
-  }
-
-  // sort the response most recent first before adding to the array
-  std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-
-  uint64_t elements = 0;
-  std::vector<std::pair<int64_t, UniValue>> aux;
-  for_each(vecResponse.begin(), vecResponse.end(), [&aux, &elements, &count] (const std::pair<int64_t, UniValue> p) { if(elements < count) aux.push_back(p); elements++; });
+      vecResponse.push_back(trade);
+      return true;
+  });
 
   //reversing vector and pushing back
-  for (std::vector<std::pair<int64_t, UniValue>>::reverse_iterator it = aux.rbegin(); it != aux.rend(); it++){
-      responseArray.push_back(it->second);
+  for (std::vector<UniValue>::reverse_iterator it = vecResponse.rbegin(); it != vecResponse.rend(); it++){
+      responseArray.push_back(*it);
   }
-
-  delete it;
 }
 
 void CMPTradeList::recordNewTrade(const uint256& txid, const std::string& address, uint32_t propertyIdForSale, uint32_t propertyIdDesired, int blockNum, int blockIndex)
 {
     if (!pdb) return;
-    const std::string strValue = strprintf("%s:%d:%d:%d:%d", address, propertyIdForSale, propertyIdDesired, blockNum, blockIndex);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
-    ++nWritten;
+    CMPMetaDExTradeRecord record;
+    record.address = address;
+    record.propertyIdForSale = propertyIdForSale;
+    record.propertyIdDesired = propertyIdDesired;
+    record.nBlock = blockNum;
+    record.nBlockIndex = blockIndex;
+    Status status = putIndexed(MakeRecordKey(TRADEDB_METADEX_TRADE, txid), EncodeRecord(record));
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
 
 void CMPTradeList::recordNewTrade(const uint256& txid, const std::string& address, uint32_t propertyIdForSale, uint32_t propertyIdDesired, int blockNum, int blockIndex, int64_t reserva)
 {
     if (!pdb) return;
-    const std::string strValue = strprintf("%s:%d:%d:%d:%d:%d", address, propertyIdForSale, propertyIdDesired, blockNum, blockIndex,reserva);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
-    ++nWritten;
+    CMPMetaDExTradeRecord record;
+    record.address = address;
+    record.propertyIdForSale = propertyIdForSale;
+    record.propertyIdDesired = propertyIdDesired;
+    record.nBlock = blockNum;
+    record.nBlockIndex = blockIndex;
+    record.nReserve = reserva;
+    Status status = putIndexed(MakeRecordKey(TRADEDB_METADEX_TRADE, txid), EncodeRecord(record));
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
 
@@ -4600,7 +5024,7 @@ void CMPTradeList::recordNewChannel(const std::string& channelAddress, const std
 {
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%s:%s", frAddr, secAddr, ACTIVE_CHANNEL, TYPE_CREATE_CHANNEL);
-    Status status = pdb->Put(writeoptions, channelAddress, strValue);
+    Status status = Put(channelAddress, strValue);
     ++nWritten;
 
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
@@ -4612,8 +5036,7 @@ void CMPTradeList::recordNewInstantTrade(const uint256& txid, const std::string&
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%s:%d:%d:%d:%d:%d:%d:%s", channelAddr, first, second, propertyIdForSale, amount_forsale, propertyIdDesired, amount_desired, blockNum, blockIndex, TYPE_INSTANT_TRADE);
     const string key = to_string(blockNum) + "+" + txid.ToString(); // order by blockNum
-    Status status = pdb->Put(writeoptions, key, strValue);
-    ++nWritten;
+    Status status = putIndexed(key, strValue);
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __func__, status.ToString());
 }
 
@@ -4622,7 +5045,7 @@ void CMPTxList::recordNewInstantLTCTrade(const uint256& txid, const std::string&
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%s:%d:%d:%d:%d:%d:%s", channelAddr, seller, buyer, propertyIdForSale, amount_purchased, price, blockNum, blockIndex, MSC_TYPE_INSTANT_LTC_TRADE);
     const string key = to_string(blockNum) + "+" + txid.ToString(); // order by blockNum
-    Status status = pdb->Put(writeoptions, key, strValue);
+    Status status = Put(key, strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __func__, status.ToString());
 }
@@ -4630,10 +5053,12 @@ void CMPTxList::recordNewInstantLTCTrade(const uint256& txid, const std::string&
 void CMPTradeList::recordNewIdRegister(const uint256& txid, const std::string& address, const std::string& name, const std::string& website, int blockNum, int blockIndex)
 {
     if (!pdb) return;
-    const int nextId = t_tradelistdb->getNextId();
+    LOCK(cs_identities);
+    const int nextId = getNextId();
     const std::string strValue = strprintf("%s:%s:%s:%d:%d:%d:%s:%s", address, name, website, blockNum, blockIndex, nextId, txid.ToString(), TYPE_NEW_ID_REGISTER);
     const string key = to_string(blockNum) + "+" + txid.ToString(); // order by blockNum
-    Status status = pdb->Put(writeoptions, key, strValue);
+    Status status = Put(key, strValue);
+    if (status.ok()) applyIdentityRecord(key, strValue);
 
     ++nWritten;
     PrintToLog("%s: %s\n", __FUNCTION__, status.ToString());
@@ -4645,7 +5070,9 @@ void CMPTradeList::recordNewAttestation(const uint256& txid, const std::string&
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%d:%d:%d:%s:%s", sender, receiver, blockNum, blockIndex, kyc_id, txid.ToString(), TYPE_ATTESTATION);
     const string key = to_string(blockNum) + "+" + txid.ToString(); // order by blockNum
-    Status status = pdb->Put(writeoptions, key, strValue);
+    LOCK(cs_identities);
+    Status status = Put(key, strValue);
+    if (status.ok()) applyIdentityRecord(key, strValue);
 
     ++nWritten;
     PrintToLog("%s: %s\n", __FUNCTION__, status.ToString());
@@ -4658,7 +5085,7 @@ bool CMPTradeList::updateIdRegister(const uint256& txid, const std::string& addr
     std::string strKey, newKey, newValue;
     std::vector<std::string> vstr;
 
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
     for(it->SeekToLast(); it->Valid(); it->Prev())
     {
@@ -4696,194 +5123,145 @@ bool CMPTradeList::updateIdRegister(const uint256& txid, const std::string& addr
 
         newValue = strprintf("%s:%s:%s:%s:%s:%s:%d:%d:%s:%s:%s", website, name, tokens, ltc, natives, oracles, blockNum, blockIndex, nextId,txid.ToString(), TYPE_NEW_ID_REGISTER);
 
-        update = true;
-        break;
-
-    }
-
-    // clean up
-    delete it;
-
-    if(update)
-    {
-        Status status1 = pdb->Delete(writeoptions, strKey);
-        Status status2 = pdb->Put(writeoptions, newAddr, newValue);
-        ++nWritten;
-
-        if(msc_debug_update_id_register)
-        {
-            PrintToLog("%s: %s\n", __FUNCTION__, status1.ToString());
-            PrintToLog("%s: %s\n", __FUNCTION__, status2.ToString());
-        }
-
-        return (status1.ok() && status2.ok());
-
-    }
-
-    return update;
-
-}
-
-bool CMPTradeList::checkKYCRegister(const std::string& address, int& kyc_id)
-{
-    bool status = false;
-    if (!pdb) return status;
-    std::string strKey, newKey, newValue;
-    std::vector<std::string> vstr;
-
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
-
-    for(it->SeekToLast(); it->Valid(); it->Prev())
-    {
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
-
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vstr.size() != 8)
-        {
-            // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
-        }
-
-        const std::string& type = vstr[7];
-
-        if(msc_debug_check_kyc_register) PrintToLog("%s: type: %s\n", __func__, type);
-
-        if(type != TYPE_NEW_ID_REGISTER)
-            continue;
-
-        const std::string& regAddr = vstr[0];
-
-        if(msc_debug_check_kyc_register) PrintToLog("%s: regAddr: %s, address: %s\n", __func__, regAddr, address);
-
-
-        if(address != regAddr) continue;
-
-        status = true;
-
-        if(msc_debug_check_kyc_register) PrintToLog("%s: Address Found! %s\n", __func__, address);
-
-        // returning the kyc_id
-        kyc_id = boost::lexical_cast<int>(vstr[5]);
-
-        if(msc_debug_check_kyc_register) PrintToLog("%s: kyc_id %s\n", __func__, kyc_id);
-
-        break;
-
-    }
-
-    // clean up
-    delete it;
-
-    return status;
-}
-
-bool CMPTradeList::checkAttestationReg(const std::string& address, int& kyc_id)
-{
-    bool status = false;
-    if (!pdb) return status;
-    std::string newKey, newValue;
-    std::vector<std::string> vstr;
-
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
-
-    for(it->SeekToLast(); it->Valid(); it->Prev())
-    {
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
-
-        if(msc_debug_check_attestation_reg) PrintToLog("%s(): strValue: %s\n", __func__, strValue);
-
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-
-        if (vstr.size() != 7)
-            continue;
-
-        const std::string& type = vstr[6];
-
-        if(msc_debug_check_attestation_reg) PrintToLog("%s(): type: %s\n", __func__, type);
+        update = true;
+        break;
 
-        if(type != TYPE_ATTESTATION)
-            continue;
+    }
 
-        const std::string& regAddr = vstr[1];
+    // clean up
+    delete it;
 
-        if(msc_debug_check_attestation_reg) PrintToLog("%s(): regAddr: %s, address: %s\n", __func__, regAddr, address);
+    if(update)
+    {
+        Status status1 = Delete(strKey);
+        Status status2 = Put(newAddr, newValue);
+        ++nWritten;
 
-        if(address != regAddr) continue;
+        if(msc_debug_update_id_register)
+        {
+            PrintToLog("%s: %s\n", __FUNCTION__, status1.ToString());
+            PrintToLog("%s: %s\n", __FUNCTION__, status2.ToString());
+        }
 
-        status = true;
+        return (status1.ok() && status2.ok());
 
-        if(msc_debug_check_attestation_reg) PrintToLog("%s(): Address Found! %s\n", __func__, address);
+    }
 
-        // returning the kyc_id
-        kyc_id = boost::lexical_cast<int>(vstr[4]);
+    return update;
 
-        if(msc_debug_check_attestation_reg) PrintToLog("%s(): kyc_id %d\n", __func__,kyc_id);
+}
 
-        break;
+/**
+ * Rebuilds the identity registry from the records of the database.
+ */
+void CMPTradeList::loadIdentities()
+{
+    LOCK(cs_identities);
+    identities.Clear();
+    if (!pdb) return;
 
+    leveldb::Iterator* it = NewTextIterator();
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        applyIdentityRecord(it->key().ToString(), it->value().ToString());
     }
-
-    // clean up
     delete it;
 
-    return status;
+    PrintToLog("Loaded identity registry: %d registrations, %d attestations\n", identities.CountRegistrations(), identities.CountAttestations());
 }
 
-bool CMPTradeList::deleteAttestationReg(const std::string& sender,  const std::string& receiver)
+/**
+ * Parses a record of the database, and adds it to the identity registry, if
+ * it is a registration or an attestation.
+ *
+ * Registrations:  address:name:website:block:idx:kyc_id:txid:type
+ * Attestations:   sender:receiver:block:idx:kyc_id:txid:type
+ */
+bool CMPTradeList::applyIdentityRecord(const std::string& key, const std::string& value)
 {
-    bool found = false;
-    if (!pdb) return found;
-    std::string strKey;
+    AssertLockHeld(cs_identities);
     std::vector<std::string> vstr;
+    boost::split(vstr, value, boost::is_any_of(":"), token_compress_on);
 
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    try {
+        if (vstr.size() == 8 && vstr[7] == TYPE_NEW_ID_REGISTER) {
+            identities.AddRegistration(key, vstr[0], boost::lexical_cast<int>(vstr[5]), atoi(vstr[3]));
+            return true;
+        }
+        if (vstr.size() == 7 && vstr[6] == TYPE_ATTESTATION) {
+            identities.AddAttestation(key, vstr[0], vstr[1], boost::lexical_cast<int>(vstr[4]), atoi(vstr[2]));
+            return true;
+        }
+    } catch (const boost::bad_lexical_cast&) {
+        PrintToLog("%s(): ERROR: invalid KYC identifier in record %s: %s\n", __func__, key, value);
+    }
 
-    for(it->SeekToLast(); it->Valid(); it->Prev())
-    {
-        // search key to see if this is a matching trade
-        strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
+    return false;
+}
 
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
+bool CMPTradeList::checkKYCRegister(const std::string& address, int& kyc_id)
+{
+    if (!pdb) return false;
+    LOCK(cs_identities);
+    const bool status = identities.GetRegistration(address, kyc_id);
 
-        const std::string& regAddr = vstr[0];
-        const std::string& type = vstr[6];
+    if (msc_debug_check_kyc_register) PrintToLog("%s: address: %s, found: %d, kyc_id: %d\n", __func__, address, status, status ? kyc_id : -1);
 
-        if (vstr.size() != 7 || type != TYPE_ATTESTATION || sender != regAddr)
-            continue;
+    return status;
+}
 
-        const std::string& regRec = vstr[1];
+bool CMPTradeList::checkAttestationReg(const std::string& address, int& kyc_id)
+{
+    if (!pdb) return false;
+    LOCK(cs_identities);
+    const bool status = identities.GetAttestation(address, kyc_id);
 
-        if(receiver != regRec)
-            continue;
+    if (msc_debug_check_attestation_reg) PrintToLog("%s(): address: %s, found: %d, kyc_id: %d\n", __func__, address, status, status ? kyc_id : -1);
 
-        found = true;
-        break;
+    return status;
+}
 
-    }
+bool CMPTradeList::deleteAttestationReg(const std::string& sender,  const std::string& receiver)
+{
+    if (!pdb) return false;
+    LOCK(cs_identities);
+    std::string strKey;
+    if (!identities.FindAttestation(sender, receiver, strKey)) return false;
 
-    // clean up
-    delete it;
+    Status status1 = Delete(strKey);
+    identities.Remove(strKey);
 
-    if (found) {
-        Status status1 = pdb->Delete(writeoptions, strKey);
+    if(msc_debug_delete_att_register)
+    {
+      PrintToLog("%s: %s\n", __FUNCTION__, status1.ToString());
+    }
 
-        if(msc_debug_delete_att_register)
-        {
-          PrintToLog("%s: %s\n", __FUNCTION__, status1.ToString());
-        }
+    ++nWritten;
+
+    return true;
+}
 
+int CMPTradeList::rollBackIdentities(int blockNum)
+{
+    if (!pdb) return 0;
+    LOCK(cs_identities);
+    const std::vector<std::string> keys = identities.GetKeysAbove(blockNum);
+    for (const std::string& key : keys) {
+        Delete(key);
+        identities.Remove(key);
         ++nWritten;
     }
 
-    return found;
+    if (!keys.empty()) PrintToLog("%s(): removed %d identity records after block %d\n", __func__, keys.size(), blockNum);
+
+    return keys.size();
+}
+
+void CMPTradeList::Clear()
+{
+    // wipe database via parent class
+    CDBBase::Clear();
+    LOCK(cs_identities);
+    identities.Clear();
 }
 
 bool CMPTradeList::kycLoop(UniValue& response)
@@ -4893,7 +5271,7 @@ bool CMPTradeList::kycLoop(UniValue& response)
     std::string newKey, newValue;
     std::vector<std::string> vstr;
 
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
     for(it->SeekToLast(); it->Valid(); it->Prev())
     {
@@ -4946,7 +5324,7 @@ bool CMPTradeList::kycConsensusHash(CSHA256& hasher)
        return false;
     }
 
-    leveldb::Iterator* it = NewIterator();
+    leveldb::Iterator* it = NewTextIterator();
     for(it->SeekToLast(); it->Valid(); it->Prev())
     {
         // search key to see if this is a matching trade
@@ -4981,7 +5359,7 @@ bool CMPTradeList::attLoop(UniValue& response)
     std::string newKey, newValue;
     std::vector<std::string> vstr;
 
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
     for(it->SeekToLast(); it->Valid(); it->Prev())
     {
@@ -5029,7 +5407,7 @@ bool CMPTradeList::attConsensusHash(CSHA256& hasher)
        return false;
     }
 
-    leveldb::Iterator* it = NewIterator();
+    leveldb::Iterator* it = NewTextIterator();
     for(it->SeekToLast(); it->Valid(); it->Prev())
     {
         // search key to see if this is a matching trade
@@ -5060,28 +5438,15 @@ bool CMPTradeList::attConsensusHash(CSHA256& hasher)
 
 bool CMPTradeList::kycPropertyMatch(uint32_t propertyId, int kyc_id)
 {
-    CMPSPInfo::Entry sp;
-    if (!_my_sps->getSP(propertyId, sp)) {
-       return false; // property ID does not exist
-    }
-
     // looking for the kyc id in sp register
-    const std::vector<int64_t>& vecKyc = sp.kyc;
-
-    if (vecKyc.empty()){
-        PrintToLog("%s(): empty vector\n",__func__);
-    }
-
-    auto it = find_if(vecKyc.begin(), vecKyc.end(), [&kyc_id] (const int64_t& k) {return (kyc_id == k);});
-
-    return (it != vecKyc.end());
+    return _my_sps->hasKYC(propertyId, kyc_id);
 }
 
 void CMPTradeList::recordNewInstContTrade(const uint256& txid, const std::string& firstAddr, const std::string& secondAddr, uint32_t property, uint64_t amount_forsale, uint64_t price ,int blockNum, int blockIndex)
 {
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%d:%d:%d:%d:%d:%s", firstAddr, secondAddr, property, amount_forsale, price, blockNum, blockIndex, TYPE_CONTRACT_INSTANT_TRADE);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+    Status status = Put(txid.ToString(), strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
@@ -5090,7 +5455,7 @@ void CMPTradeList::recordNewCommit(const uint256& txid, const std::string& chann
 {
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%d:%d:%d:%d:%s", channelAddress, sender, propertyId, amountCommited, blockNum, blockIndex, TYPE_COMMIT);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+    Status status = Put(txid.ToString(), strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __func__, status.ToString());
 }
@@ -5099,7 +5464,7 @@ void CMPTradeList::recordNewWithdrawal(const uint256& txid, const std::string& c
 {
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%d:%d:%d:%d:%s:%d", channelAddress, sender, propertyId, amountToWithdrawal, blockNum, blockIndex,TYPE_WITHDRAWAL, ACTIVE_WITHDRAWAL);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+    Status status = Put(txid.ToString(), strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
@@ -5108,7 +5473,7 @@ void CMPTradeList::recordNewTransfer(const uint256& txid, const std::string& sen
 {
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%d:%d:%s", sender, receiver, blockNum, blockIndex, TYPE_TRANSFER);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+    Status status = Put(txid.ToString(), strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
@@ -5116,8 +5481,17 @@ void CMPTradeList::recordNewTransfer(const uint256& txid, const std::string& sen
 void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2, string address1, string address2, unsigned int prop1, unsigned int prop2, uint64_t amount1, uint64_t amount2, int blockNum, int64_t fee)
 {
     if (!pdb) return;
-    const string key = txid1.ToString() + "+" + txid2.ToString();
-    const string value = strprintf("%s:%s:%u:%u:%lu:%lu:%d:%d", address1, address2, prop1, prop2, amount1, amount2, blockNum, fee);
+    CMPMetaDExMatchRecord record;
+    record.address1 = address1;
+    record.address2 = address2;
+    record.prop1 = prop1;
+    record.prop2 = prop2;
+    record.amount1 = amount1;
+    record.amount2 = amount2;
+    record.nBlock = blockNum;
+    record.nFee = fee;
+    const string key = MakeRecordKey(TRADEDB_METADEX_MATCH, txid1, txid2);
+    const string value = EncodeRecord(record);
 
     int64_t volumeALL64_t = 0;
     /********************************************************************/
@@ -5145,6 +5519,7 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
       }
 
       globalVolumeALL_LTC += volumeALL64_t;
+      NotifyStateSectionChanged(FILETYPE_GLOBAL_VARS);
       if (msc_debug_tradedb) PrintToLog("\nGlobal LTC Volume Updated: CMPMetaDEx = %s\n", FormatDivisibleMP(globalVolumeALL_LTC));
 
       /****************************************************/
@@ -5169,12 +5544,41 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
       Status status;
       if (pdb)
       {
-          status = pdb->Put(writeoptions, key, value);
-          ++nWritten;
+          status = putIndexed(key, value);
           if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
       }
 }
 
+/** Buffers a position change of a contract match in the trade journal. */
+static void JournalTrade(int block, uint32_t contractId, const uint256& txidMaker, const uint256& txidTaker,
+        const std::string& addressMaker, const std::string& statusMaker, int64_t livesMaker,
+        const std::string& addressTaker, const std::string& statusTaker, int64_t livesTaker, int64_t amount, uint64_t effectivePrice)
+{
+    CTradeJournalEntry entry;
+    entry.contractId = contractId;
+    entry.txidMaker = txidMaker;
+    entry.txidTaker = txidTaker;
+    entry.addressMaker = addressMaker;
+    entry.addressTaker = addressTaker;
+    entry.statusMaker = statusMaker;
+    entry.statusTaker = statusTaker;
+    entry.livesMaker = livesMaker;
+    entry.livesTaker = livesTaker;
+    entry.amount = amount;
+    entry.effectivePrice = effectivePrice;
+    tradeJournal.Append(block, entry);
+}
+
+/** Adds a matched trade to the trades of its settlement period. */
+static void RecordTradeEdge(int block, const std::map<std::string, std::string>& edgeEle)
+{
+    if (!tradeEdges.AddTrade(block, edgeEle)) {
+        PrintToLog("%s(): ERROR: malformed trade edge dropped, block %d\n", __func__, block);
+        return;
+    }
+    NotifyStateSectionChanged(STATE_SECTION_TRADE_EDGES);
+}
+
 void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2, string address1, string address2, uint64_t effective_price, uint64_t amount_maker, uint64_t amount_taker, int blockNum1, int blockNum2, uint32_t property_traded, string tradeStatus, int64_t lives_s0, int64_t lives_s1, int64_t lives_s2, int64_t lives_s3, int64_t lives_b0, int64_t lives_b1, int64_t lives_b2, int64_t lives_b3, string s_maker0, string s_taker0, string s_maker1, string s_taker1, string s_maker2, string s_taker2, string s_maker3, string s_taker3, int64_t nCouldBuy0, int64_t nCouldBuy1, int64_t nCouldBuy2, int64_t nCouldBuy3,uint64_t amountpnew, uint64_t amountpold)
 {
   if (!pdb) return;
@@ -5184,30 +5588,41 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
   std::vector<std::map<std::string, std::string>>::iterator it_path_ele;
   std::vector<std::map<std::string, std::string>>::reverse_iterator reit_path_ele;
   //std::vector<std::map<std::string, std::string>> path_eleh;
-  bool savedata_bool = false;
-  std::string sblockNum2 = std::to_string(blockNum2);
   double UPNL1 = 0, UPNL2 = 0;
   /********************************************************************/
-  const string key =  sblockNum2 + "+" + txid1.ToString() + "+" + txid2.ToString(); //order with block of taker.
-  const string value = strprintf("%s:%s:%lu:%lu:%lu:%d:%d:%s:%s:%d:%d:%d:%s:%s:%d:%d:%d", address1, address2, effective_price, amount_maker, amount_taker, blockNum1, blockNum2, s_maker0, s_taker0, lives_s0, lives_b0, property_traded, txid1.ToString(), txid2.ToString(), nCouldBuy0,amountpold, amountpnew);
-
-  const string line0 = gettingLineOut(address1, s_maker0, lives_s0, address2, s_taker0, lives_b0, nCouldBuy0, effective_price);
-  const string line1 = gettingLineOut(address1, s_maker1, lives_s1, address2, s_taker1, lives_b1, nCouldBuy1, effective_price);
-  const string line2 = gettingLineOut(address1, s_maker2, lives_s2, address2, s_taker2, lives_b2, nCouldBuy2, effective_price);
-  const string line3 = gettingLineOut(address1, s_maker3, lives_s3, address2, s_taker3, lives_b3, nCouldBuy3, effective_price);
+  CMPContractMatchRecord record;
+  record.addressMaker = address1;
+  record.addressTaker = address2;
+  record.effectivePrice = effective_price;
+  record.amountMaker = amount_maker;
+  record.amountTaker = amount_taker;
+  record.nBlockMaker = blockNum1;
+  record.nBlockTaker = blockNum2;
+  record.statusMaker = s_maker0;
+  record.statusTaker = s_taker0;
+  record.livesMaker = lives_s0;
+  record.livesTaker = lives_b0;
+  record.contractId = property_traded;
+  record.txidMaker = txid1;
+  record.txidTaker = txid2;
+  record.amountTraded = nCouldBuy0;
+  record.amountOld = amountpold;
+  record.amountNew = amountpnew;
+  const string key = MakeRecordKey(TRADEDB_CONTRACT_MATCH, txid1, txid2);
+  const string value = EncodeRecord(record);
 
   bool status_bool1 = s_maker0 == "OpenShortPosByLongPosNetted" || s_maker0 == "OpenLongPosByShortPosNetted";
   bool status_bool2 = s_taker0 == "OpenShortPosByLongPosNetted" || s_taker0 == "OpenLongPosByShortPosNetted";
 
-  std::fstream fileSixth;
-  fileSixth.open ("graphInfoSixth.txt", std::fstream::in | std::fstream::out | std::fstream::app);
+  // a flipped position is journaled as netting and opening, both written at the end of the block
   if ( status_bool1 || status_bool2 )
     {
-      if ( s_maker3 == "EmptyStr" && s_taker3 == "EmptyStr" ) savedata_bool = true;
-      saveDataGraphs(fileSixth, line1, line2, line3, savedata_bool);
+      JournalTrade(blockNum2, property_traded, txid1, txid2, address1, s_maker1, lives_s1, address2, s_taker1, lives_b1, nCouldBuy1, effective_price);
+      JournalTrade(blockNum2, property_traded, txid1, txid2, address1, s_maker2, lives_s2, address2, s_taker2, lives_b2, nCouldBuy2, effective_price);
+      if ( s_maker3 != "EmptyStr" || s_taker3 != "EmptyStr" )
+        JournalTrade(blockNum2, property_traded, txid1, txid2, address1, s_maker3, lives_s3, address2, s_taker3, lives_b3, nCouldBuy3, effective_price);
     }
-  else saveDataGraphs(fileSixth, line0);
-  fileSixth.close();
+  else JournalTrade(blockNum2, property_traded, txid1, txid2, address1, s_maker0, lives_s0, address2, s_taker0, lives_b0, nCouldBuy0, effective_price);
 
   /********************************************************************/
   int number_lines = 0;
@@ -5217,14 +5632,12 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
       //path_ele.push_back(edgeEle);
       //path_eleh.push_back(edgeEle);
 
-      path_elef.push_back(edgeEle);
+      RecordTradeEdge(blockNum2, edgeEle);
       buildingEdge(edgeEle, address1, address2, s_maker2, s_taker2, lives_s2, lives_b2, nCouldBuy2, effective_price, idx_q, 0);
       //path_ele.push_back(edgeEle);
       //path_eleh.push_back(edgeEle);
 
-      path_elef.push_back(edgeEle);
-      // PrintToLog("Line 1: %s\n", line1);
-      // PrintToLog("Line 2: %s\n", line2);
+      RecordTradeEdge(blockNum2, edgeEle);
       number_lines += 2;
       if ( s_maker3 != "EmptyStr" && s_taker3 != "EmptyStr" )
 	{
@@ -5232,8 +5645,7 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
 	  //path_ele.push_back(edgeEle);
 	  //path_eleh.push_back(edgeEle);
 
-	  path_elef.push_back(edgeEle);
-	  // PrintToLog("Line 3: %s\n", line3);
+	  RecordTradeEdge(blockNum2, edgeEle);
 	  number_lines += 1;
 	}
     }
@@ -5243,8 +5655,7 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
       //path_ele.push_back(edgeEle);
       //path_eleh.push_back(edgeEle);
 
-      path_elef.push_back(edgeEle);
-      // PrintToLog("Line 0: %s\n", line0);
+      RecordTradeEdge(blockNum2, edgeEle);
       number_lines += 1;
     }
 
@@ -5315,9 +5726,9 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
   // 	}
 
   unsigned int contractId = static_cast<unsigned int>(property_traded);
-  CMPSPInfo::Entry sp;
-  assert(_my_sps->getSP(property_traded, sp));
-  uint32_t NotionalSize = sp.notional_size;
+  std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(property_traded);
+  assert(sp);
+  uint32_t NotionalSize = sp->notional_size;
 
   globalPNLALL_DUSD += UPNL1 + UPNL2;
   globalVolumeALL_DUSD += nCouldBuy0;
@@ -5335,6 +5746,7 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
   // PrintToLog("LTCs involved in the traded 64 Bits ~ %d LTC\n", FormatDivisibleMP(volumeLTC64_t));
 
   globalVolumeALL_LTC += volumeLTC64_t;
+  NotifyStateSectionChanged(FILETYPE_GLOBAL_VARS);
   // PrintToLog("\nGlobal LTC Volume Updated: CMPContractDEx = %d \n", FormatDivisibleMP(globalVolumeALL_LTC));
 
   int64_t volumeToCompare = 0;
@@ -5343,23 +5755,14 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
 
   // PrintToLog("\nglobalPNLALL_DUSD = %d, globalVolumeALL_DUSD = %d, contractId = %d\n", globalPNLALL_DUSD, globalVolumeALL_DUSD, contractId);
 
-  std::fstream fileglobalPNLALL_DUSD;
-  fileglobalPNLALL_DUSD.open ("globalPNLALL_DUSD.txt", std::fstream::in | std::fstream::out | std::fstream::app);
+  // the totals are written once at the end of the block
   if ( contractId == 5 ) // just fot testing
-    saveDataGraphs(fileglobalPNLALL_DUSD, std::to_string(globalPNLALL_DUSD));
-  fileglobalPNLALL_DUSD.close();
-
-  std::fstream fileglobalVolumeALL_DUSD;
-  fileglobalVolumeALL_DUSD.open ("globalVolumeALL_DUSD.txt", std::fstream::in | std::fstream::out | std::fstream::app);
-  if ( contractId == 5 )
-    saveDataGraphs(fileglobalVolumeALL_DUSD, std::to_string(FormatShortIntegerMP(globalVolumeALL_DUSD)));
-  fileglobalVolumeALL_DUSD.close();
+    fGlobalTotalsChanged = true;
 
   Status status;
   if (pdb)
     {
-      status = pdb->Put(writeoptions, key, value);
-      ++nWritten;
+      status = putIndexed(key, value);
     }
 
   // PrintToLog("\n\nEnd of recordMatchedTrade <------------------------------\n");
@@ -5591,17 +5994,6 @@ void loopforEntryPrice(std::vector<std::map<std::string, std::string>> path_ele,
     }
 }
 
-const string gettingLineOut(std::string address1, std::string s_status1, int64_t lives_maker, std::string address2, std::string s_status2, int64_t lives_taker, int64_t nCouldBuy, uint64_t effective_price)
-{
-  const string lineOut = strprintf("%s\t %s\t %d\t %s\t %s\t %d\t %d\t %d",
-				   address1, s_status1, FormatContractShortMP(lives_maker * COIN),
-				   address2, s_status2, FormatContractShortMP(lives_taker * COIN),
-				   FormatContractShortMP(nCouldBuy * COIN), FormatContractShortMP(effective_price));
-
-  PrintToLog("%s() lineOut: %s\n",__func__, lineOut);
-  return lineOut;
-}
-
 void buildingEdge(std::map<std::string, std::string> &edgeEle, std::string addrs_src, std::string addrs_trk, std::string status_src, std::string status_trk, int64_t lives_src, int64_t lives_trk, int64_t amount_path, int64_t matched_price, int idx_q, int ghost_edge)
 {
   edgeEle["addrs_src"]     = addrs_src;
@@ -5625,57 +6017,43 @@ bool CMPTradeList::getMatchingTrades(uint32_t propertyId, UniValue& tradeArray)
 {
     if (!pdb) return false;
     int count = 0;
-    std::vector<std::string> vstr;
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
 
-    for(it->SeekToLast(); it->Valid(); it->Prev())
-    {
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
+    // most recent first
+    forEachIndexedReverse(TradeIndexContractPrefix(propertyId), [&](const std::string& strKey, const std::string& strValue) {
+        if (tradeArray.size() > 9) return false;
 
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vstr.size() != 17) {
-            //PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
+        // decode the details from the record
+        CMPContractMatchRecord record;
+        if (!DecodeRecord(strValue, record)) {
+            //PrintToLog("TRADEDB error - unexpected record (%s)\n", HexStr(strKey));
+            return true;
         }
 
-        // decode the details from the value string
-        const uint32_t prop1 = boost::lexical_cast<uint32_t>(vstr[11]);
-        const std::string& address1 = vstr[0];
-        const std::string& address2 = vstr[1];
-        int64_t amount1 = boost::lexical_cast<int64_t>(vstr[15]);
-        int64_t amount2 = boost::lexical_cast<int64_t>(vstr[16]);
-        const int block = boost::lexical_cast<int>(vstr[6]);
-        const int64_t price = boost::lexical_cast<int64_t>(vstr[2]);
-        const int64_t amount_traded = boost::lexical_cast<int64_t>(vstr[14]);
-        const std::string& txidmaker = vstr[12];
-        const std::string& txidtaker = vstr[13];
-
-        // populate trade object and add to the trade array, correcting for orientation of trade
-        if (prop1 != propertyId) {
-           continue;
-        }
+        const std::string& address1 = record.addressMaker;
+        const std::string& address2 = record.addressTaker;
+        const int64_t amount1 = record.amountOld;
+        const int64_t amount2 = record.amountNew;
+        const int block = record.nBlockTaker;
+        const int64_t price = record.effectivePrice;
+        const int64_t amount_traded = record.amountTraded;
+        const std::string txidmaker = record.txidMaker.ToString();
+        const std::string txidtaker = record.txidTaker.ToString();
 
         UniValue trade(UniValue::VOBJ);
-        if (tradeArray.size() <= 9)
-        {
-            trade.push_back(Pair("maker_address", address1));
-            trade.push_back(Pair("maker_txid", txidmaker));
-            trade.push_back(Pair("taker_address", address2));
-            trade.push_back(Pair("taker_txid", txidtaker));
-            trade.push_back(Pair("amount_maker", FormatByType(amount1,2)));
-            trade.push_back(Pair("amount_taker", FormatByType(amount2,2)));
-            trade.push_back(Pair("price", FormatByType(price,2)));
-            trade.push_back(Pair("taker_block",block));
-            trade.push_back(Pair("amount_traded",FormatByType(amount_traded,2)));
-            tradeArray.push_back(trade);
-            ++count;
-        }
-    }
-    // clean up
-    delete it; // Desallocation proccess
+        trade.push_back(Pair("maker_address", address1));
+        trade.push_back(Pair("maker_txid", txidmaker));
+        trade.push_back(Pair("taker_address", address2));
+        trade.push_back(Pair("taker_txid", txidtaker));
+        trade.push_back(Pair("amount_maker", FormatByType(amount1,2)));
+        trade.push_back(Pair("amount_taker", FormatByType(amount2,2)));
+        trade.push_back(Pair("price", FormatByType(price,2)));
+        trade.push_back(Pair("taker_block",block));
+        trade.push_back(Pair("amount_traded",FormatByType(amount_traded,2)));
+        tradeArray.push_back(trade);
+        ++count;
+        return true;
+    });
+
     if (count) { return true; } else { return false; }
 }
 
@@ -5684,58 +6062,43 @@ bool CMPTradeList::getMatchingTradesUnfiltered(uint32_t propertyId, UniValue& tr
 {
     if (!pdb) return false;
     int count = 0;
-    std::vector<std::string> vstr;
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
-
-    for(it->SeekToLast(); it->Valid(); it->Prev()) {
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
-
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vstr.size() != 17)
-            continue;
-
-        // decode the details from the value string
-        // const string value = strprintf("%s:%s:%lu:%lu:%lu:%d:%d:%s:%s:%d:%d:%d:%s:%s:%d", address1, address2, effective_price, amount_maker, amount_taker, blockNum1,
-        // blockNum2, s_maker0, s_taker0, lives_s0, lives_b0, property_traded, txid1.ToString(), txid2.ToString(), nCouldBuy0);
-        const uint32_t prop1 = boost::lexical_cast<uint32_t>(vstr[11]);
-        const std::string& address1 = vstr[0];
-        const std::string& address2 = vstr[1];
-        const int64_t amount1 = boost::lexical_cast<int64_t>(vstr[15]);
-        const int64_t amount2 = boost::lexical_cast<int64_t>(vstr[16]);
-        int block = boost::lexical_cast<int>(vstr[6]);
-        const int64_t price = boost::lexical_cast<int64_t>(vstr[2]);
-        const int64_t amount_traded = boost::lexical_cast<int64_t>(vstr[14]);
-        const std::string& txidmaker = vstr[12];
-        const std::string& txidtaker = vstr[13];
 
-        // populate trade object and add to the trade array, correcting for orientation of trade
+    // most recent first
+    forEachIndexedReverse(TradeIndexContractPrefix(propertyId), [&](const std::string& strKey, const std::string& strValue) {
+        if (tradeArray.size() > 10000) return false;
 
-        if (prop1 != propertyId) {
-            continue;
+        // decode the details from the record
+        CMPContractMatchRecord record;
+        if (!DecodeRecord(strValue, record)) {
+            //PrintToLog("TRADEDB error - unexpected record (%s)\n", HexStr(strKey));
+            return true;
         }
 
+        const std::string& address1 = record.addressMaker;
+        const std::string& address2 = record.addressTaker;
+        const int64_t amount1 = record.amountOld;
+        const int64_t amount2 = record.amountNew;
+        const int block = record.nBlockTaker;
+        const int64_t price = record.effectivePrice;
+        const int64_t amount_traded = record.amountTraded;
+        const std::string txidmaker = record.txidMaker.ToString();
+        const std::string txidtaker = record.txidTaker.ToString();
+
         UniValue trade(UniValue::VOBJ);
+        trade.push_back(Pair("maker_address", address1));
+        trade.push_back(Pair("maker_txid", txidmaker));
+        trade.push_back(Pair("taker_address", address2));
+        trade.push_back(Pair("taker_txid", txidtaker));
+        trade.push_back(Pair("amount_maker", FormatByType(amount1,2)));
+        trade.push_back(Pair("amount_taker", FormatByType(amount2,2)));
+        trade.push_back(Pair("price", FormatByType(price,2)));
+        trade.push_back(Pair("taker_block",block));
+        trade.push_back(Pair("amount_traded",FormatByType(amount_traded,2)));
+        tradeArray.push_back(trade);
+        ++count;
+        return true;
+    });
 
-        if (tradeArray.size() <= 10000)
-        {
-            trade.push_back(Pair("maker_address", address1));
-            trade.push_back(Pair("maker_txid", txidmaker));
-            trade.push_back(Pair("taker_address", address2));
-            trade.push_back(Pair("taker_txid", txidtaker));
-            trade.push_back(Pair("amount_maker", FormatByType(amount1,2)));
-            trade.push_back(Pair("amount_taker", FormatByType(amount2,2)));
-            trade.push_back(Pair("price", FormatByType(price,2)));
-            trade.push_back(Pair("taker_block",block));
-            trade.push_back(Pair("amount_traded",FormatByType(amount_traded,2)));
-            tradeArray.push_back(trade);
-            ++count;
-        }
-    }
-    // clean up
-    delete it; // Desallocation proccess
     if (count) { return true; } else { return false; }
 }
 
@@ -5745,7 +6108,7 @@ bool CMPTradeList::getCreatedPegged(uint32_t propertyId, UniValue& tradeArray)
 
     int count = 0;
     std::vector<std::string> vstr;
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
     for(it->SeekToFirst(); it->Valid(); it->Next()) {
         // search key to see if this is a matching trade
@@ -5796,18 +6159,18 @@ bool mastercore::marginMain(int Block)
     uint32_t nextSPID = _my_sps->peekNextSPID();
     for (uint32_t contractId = 1; contractId < nextSPID; contractId++)
     {
-        CMPSPInfo::Entry sp;
-        if (_my_sps->getSP(contractId, sp))
+        std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(contractId);
+        if (!sp)
+            continue;
+
+        if(msc_debug_margin_main) PrintToLog("%s: Property Id: %d\n", __func__, contractId);
+        if (!sp->isContract())
         {
-            if(msc_debug_margin_main) PrintToLog("%s: Property Id: %d\n", __func__, contractId);
-            if (!sp.isContract())
-            {
-                if(msc_debug_margin_main) PrintToLog("%s: Property is not future contract\n",__func__);
-                continue;
-            }
+            if(msc_debug_margin_main) PrintToLog("%s: Property is not future contract\n",__func__);
+            continue;
         }
 
-        uint32_t collateralCurrency = sp.collateral_currency;
+        uint32_t collateralCurrency = sp->collateral_currency;
         //int64_t notionalSize = static_cast<int64_t>(sp.notional_size);
 
         // checking the upnl map
@@ -5835,7 +6198,7 @@ bool mastercore::marginMain(int Block)
                 continue;
 
             // checking position margin
-            int64_t posMargin = pos_margin(contractId, address, sp.margin_requirement);
+            int64_t posMargin = pos_margin(contractId, address, sp->margin_requirement);
 
             // if there's no position, something is wrong!
             if (posMargin < 0)
@@ -5964,7 +6327,7 @@ bool mastercore::marginMain(int Block)
 
                          if(msc_debug_margin_main) PrintToLog("%s(): upnl: %d, posMargin: %d\n", __func__, upnl,posMargin);
 
-                         arith_uint256 contracts = DivideAndRoundUp(ConvertTo256(posMargin) + ConvertTo256(-upnl), ConvertTo256(sp.margin_requirement));
+                         arith_uint256 contracts = DivideAndRoundUp(ConvertTo256(posMargin) + ConvertTo256(-upnl), ConvertTo256(sp->margin_requirement));
                          int64_t icontracts = ConvertTo64(contracts);
 
                          if(msc_debug_margin_main)
@@ -6019,10 +6382,10 @@ void mastercore::update_sum_upnls()
 
     for (uint32_t contractId = 1; contractId < nextSPID; contractId++)
     {
-        CMPSPInfo::Entry sp;
-        if (_my_sps->getSP(contractId, sp))
+        std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(contractId);
+        if (sp)
         {
-            if (!sp.isContract())
+            if (!sp->isContract())
                 continue;
 
             std::map<uint32_t, std::map<std::string, double>>::iterator it = addrs_upnlc.find(contractId);
@@ -6047,12 +6410,12 @@ int64_t mastercore::pos_margin(uint32_t contractId, const std::string& address,
         arith_uint256 maintMargin;
 
         LOCK(cs_tally);
-        CMPSPInfo::Entry sp;
+        std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(contractId);
 
-        if(_my_sps->getSP(contractId, sp))
+        if (sp)
         {
 
-            if (!sp.isContract())
+            if (!sp->isContract())
             {
                 if(msc_debug_pos_margin) PrintToLog("%s: this is not a future contract\n", __func__);
                 return -1;
@@ -6086,48 +6449,40 @@ int64_t mastercore::pos_margin(uint32_t contractId, const std::string& address,
 
 bool mastercore::makeWithdrawals(int Block)
 {
-    for(auto it = withdrawal_Map.begin(); it != withdrawal_Map.end(); ++it)
-    {
-        const std::string& channelAddress = it->first;
-        vector<withdrawalAccepted> &accepted = it->second;
-
-        for (auto itt = accepted.begin() ; itt != accepted.end(); )
-        {
-            const withdrawalAccepted& wthd = *itt;
-            const int deadline = wthd.deadline_block;
-
-            if (Block < deadline){
-                ++itt;
-                continue;
-            }
+    // only the withdrawals with a deadline up to this block are visited
+    const std::vector<std::pair<std::string, withdrawalAccepted>> due = withdrawalSchedule.PopDue(Block);
+    if (!due.empty()) NotifyStateSectionChanged(FILETYPE_WITHDRAWALS);
 
-            const std::string& address = wthd.address;
-            const uint32_t propertyId = wthd.propertyId;
-            const int64_t amount = static_cast<int64_t>(wthd.amount);
-
-            //checking channel
-            auto it = channels_Map.find(channelAddress);
-            assert(it != channels_Map.end());
-            Channel &chn = it->second;
-
-            if(!chn.updateChannelBal(address, propertyId, -amount))
-            {
-                if(msc_debug_make_withdrawal) PrintToLog("%s(): withdrawal is not possible\n",__func__);
-                itt = accepted.erase(itt++);
-                continue;
-            }
+    for (const auto& entry : due)
+    {
+        const std::string& channelAddress = entry.first;
+        const withdrawalAccepted& wthd = entry.second;
+        const int deadline = wthd.deadline_block;
 
-            if(msc_debug_make_withdrawal) PrintToLog("%s(): withdrawal: actual block: %d, deadline: %d, address: %s, propertyId: %d, amount: %d, txid: %s \n", __func__, Block, deadline, address, propertyId, amount, wthd.txid.ToString());
+        const std::string& address = wthd.address;
+        const uint32_t propertyId = wthd.propertyId;
+        const int64_t amount = static_cast<int64_t>(wthd.amount);
 
-            // updating tally map
-            assert(update_tally_map(address, propertyId, amount, BALANCE));
+        //checking channel
+        auto it = channels_Map.find(channelAddress);
+        assert(it != channels_Map.end());
+        Channel &chn = it->second;
 
-            // deleting element from vector
-            itt = accepted.erase(itt++);
+        if(!chn.updateChannelBal(address, propertyId, -amount))
+        {
+            if(msc_debug_make_withdrawal) PrintToLog("%s(): withdrawal is not possible\n",__func__);
+            continue;
+        }
 
+        if(msc_debug_make_withdrawal) PrintToLog("%s(): withdrawal: actual block: %d, deadline: %d, address: %s, propertyId: %d, amount: %d, txid: %s \n", __func__, Block, deadline, address, propertyId, amount, wthd.txid.ToString());
 
-        }
+        // updating tally map
+        assert(update_tally_map(address, propertyId, amount, BALANCE));
+    }
 
+    if (msc_debug_make_withdrawal && !due.empty()) {
+        const CWithdrawalStats stats = withdrawalSchedule.GetStats();
+        PrintToLog("%s(): block %d, matured: %d, pending: %d, deadlines: %d\n", __func__, Block, stats.nLastMatured, stats.nPending, stats.nDeadlines);
     }
 
     return true;
@@ -6136,33 +6491,13 @@ bool mastercore::makeWithdrawals(int Block)
 
 bool mastercore::checkWithdrawal(const std::string& txid, const std::string& channelAddress)
 {
-    bool found = false;
-    auto it =  withdrawal_Map.find(channelAddress);
-    if(it != withdrawal_Map.end())
-    {
-        const auto &wVec = it->second;
-        auto itt = std::find_if (wVec.begin(), wVec.end(), [&txid](const withdrawalAccepted& w){ return (txid == w.txid.ToString());});
-        if (itt != wVec.end()){
-            found = true;
-        }
-    }
-
-    return found;
-
+    return withdrawalSchedule.Contains(txid, channelAddress);
 }
 
 /* True if channel contain some pending withdrawal*/
 bool isChannelWithdraw(const std::string& address)
 {
-    auto it =  withdrawal_Map.find(address);
-    if(it == withdrawal_Map.end()) {
-        return false;
-    }
-
-    vector<withdrawalAccepted> &accepted = it->second;
-
-    return ((accepted.empty()) ? false : true);
-
+    return withdrawalSchedule.HasPending(address);
 }
 
 bool mastercore::closeChannel(const std::string& sender, const std::string& channelAddr)
@@ -6191,8 +6526,8 @@ bool mastercore::closeChannel(const std::string& sender, const std::string& chan
         // retrieving funds from channel
         for (uint32_t propertyId = 1; propertyId < nextSPID; propertyId++)
         {
-            CMPSPInfo::Entry sp;
-            if (_my_sps->getSP(propertyId, sp) && sp.isContract()) continue;
+            std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(propertyId);
+            if (sp && sp->isContract()) continue;
 
             const int64_t first_rem = chn.getRemaining(false, propertyId);
             const int64_t second_rem = chn.getRemaining(true, propertyId);
@@ -6215,13 +6550,12 @@ bool mastercore::closeChannel(const std::string& sender, const std::string& chan
         t_tradelistdb->setChannelClosed(channelAddr);
 
         // deleting channel from withdrawals
-        auto itt = withdrawal_Map.find(channelAddr);
-        if (itt != withdrawal_Map.end()){
-            withdrawal_Map.erase(itt);
-        }
+        withdrawalSchedule.EraseChannel(channelAddr);
+        NotifyStateSectionChanged(FILETYPE_WITHDRAWALS);
 
         // deleting channel from Map
         channels_Map.erase(it);
+        NotifyStateSectionChanged(FILETYPE_ACTIVE_CHANNELS);
 
 
         return (!fClosed);
@@ -6266,7 +6600,7 @@ bool CMPTradeList::getAllCommits(const std::string& senderAddress, UniValue& tra
     if (!pdb) return count;
     std::vector<std::string> vstr;
 
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
     for(it->SeekToLast(); it->Valid(); it->Prev()) {
         // search key to see if this is a matching trade
@@ -6396,6 +6730,7 @@ bool Channel::updateChannelBal(const std::string& address, uint32_t propertyId,
 void Channel::setBalance(const std::string& sender, uint32_t propertyId, uint64_t amount)
 {
     balances[sender][propertyId] = amount;
+    NotifyStateSectionChanged(FILETYPE_ACTIVE_CHANNELS);
 }
 
 uint64_t CMPTradeList::addClosedWithrawals(const std::string& channelAddr, const std::string& receiver, uint32_t propertyId)
@@ -6405,7 +6740,7 @@ uint64_t CMPTradeList::addClosedWithrawals(const std::string& channelAddr, const
    uint64_t totalAmount = 0;
    std::vector<std::string> vstr;
 
-   leveldb::Iterator* it = NewIterator(); // Allocation proccess
+   leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
    for(it->SeekToLast(); it->Valid(); it->Prev()) {
        // search key to see if this is a matching trade
@@ -6495,7 +6830,7 @@ bool CMPTradeList::getChannelInfo(const std::string& channelAddress, UniValue& t
     if (!pdb) return status;
     std::vector<std::string> vstr;
     std::string strValue;
-    Status status1 = pdb->Get(readoptions, channelAddress, &strValue);
+    Status status1 = Get(channelAddress, &strValue);
 
     if(!status1.ok()){
         PrintToLog("%s(): db error - channel not found\n", __func__);
@@ -6529,7 +6864,7 @@ bool CMPTradeList::getAllWithdrawals(const std::string& senderAddress, UniValue&
     if (!pdb) return false;
     int count = 0;
     std::vector<std::string> vstr;
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
+    leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
     for(it->SeekToLast(); it->Valid(); it->Prev())
     {
@@ -6596,7 +6931,7 @@ bool CMPTradeList::updateWithdrawal(const std::string& senderAddress, const std:
    std::string newValue;
    std::vector<std::string> vstr;
    std::string strKey;
-   leveldb::Iterator* it = NewIterator(); // Allocation proccess
+   leveldb::Iterator* it = NewTextIterator(); // Allocation proccess
 
    for(it->SeekToLast(); it->Valid(); it->Prev())
    {
@@ -6641,7 +6976,7 @@ bool CMPTradeList::updateWithdrawal(const std::string& senderAddress, const std:
    delete it; // Desallocation proccess
 
    if (found) {
-      Status status = pdb->Put(writeoptions, strKey, newValue);
+      Status status = Put(strKey, newValue);
       ++nWritten;
 
       return status.ok();
@@ -6656,40 +6991,9 @@ bool CMPTradeList::updateWithdrawal(const std::string& senderAddress, const std:
 int CMPTradeList::getNextId()
 {
     if (!pdb) return -1;
+    LOCK(cs_identities);
 
-    int count = 0;
-    std::vector<std::string> vstr;
-
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
-
-    for(it->SeekToLast(); it->Valid(); it->Prev()) {
-
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
-
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vstr.size() != 8) {
-            PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
-        }
-
-        const std::string& type = vstr[7];
-
-        if(type != TYPE_NEW_ID_REGISTER)
-            continue;
-
-        count++;
-    }
-
-    // clean up
-    delete it;
-
-    count++;
-
-    return count;
-
+    return identities.CountRegistrations() + 1;
 }
 
 inline int64_t setPosition(int64_t positive, int64_t negative)
@@ -6776,9 +7080,11 @@ bool mastercore::ContInst_Fees(const std::string& firstAddr, const std::string&
 
     // % to native feecache
     cachefees[colateral] += uFee;
+    NotifyStateSectionChanged(FILETYPE_CACHEFEES);
 
     // % to oracle feecache
     cachefees_oracles[colateral] += uFee;
+    NotifyStateSectionChanged(FILETYPE_CACHEFEES_ORACLES);
 
     return true;
 }
@@ -6911,28 +7217,12 @@ bool mastercore::Instant_x_Trade(const uint256& txid, uint8_t tradingAction, con
     return true;
 }
 
-void mastercore::iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const std::map<int, std::map<uint32_t,int64_t>>& aMap)
+void mastercore::iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const CMPVolumeHistory& volumes)
 {
-    for(const auto &m : aMap)
-    {
-        const int& blk = m.first;
-        if(blk < fblock && fblock != 0){
-            continue;
-        } else if(sblock < blk){
-            break;
-        }
-
-        const auto &blockMap = m.second;
-        auto itt = blockMap.find(propertyId);
-        if (itt != blockMap.end()){
-            const int64_t& newAmount = itt->second;
-            // overflows?
-            assert(!isOverflow(amount, newAmount));
-            amount += newAmount;
-        }
-
-    }
-
+    const int64_t newAmount = volumes.Sum(propertyId, fblock, sblock);
+    // overflows?
+    assert(!isOverflow(amount, newAmount));
+    amount += newAmount;
 }
 
 
@@ -7075,6 +7365,7 @@ bool mastercore::feeCacheBuy()
         if(mastercore::MetaDEx_Search_ALL(amount, propertyId))
         {
             ca.second = amount;
+            NotifyStateSectionChanged(FILETYPE_CACHEFEES_ORACLES);
             if (msc_debug_fee_cache_buy) PrintToLog("%s(): amount after trading (in cache): %d\n",__func__, amount);
             return true;
 
@@ -7136,44 +7427,38 @@ void calculateUPNL(std::vector<double>& sum_upnl, uint64_t entry_price, uint64_t
 void CMPTradeList::getUpnInfo(const std::string& address, uint32_t contractId, UniValue& response, bool showVerbose)
 {
     if (!pdb) return;
-    CMPSPInfo::Entry sp;
-    assert(_my_sps->getSP(contractId, sp));
+    std::shared_ptr<const CMPSPInfo::Entry> sp = _my_sps->getSPHandle(contractId);
+    assert(sp);
 
     //twap of last 3 blocks
     const uint64_t exitPrice = getOracleTwap(contractId, oBlocks);
 
     int count = 0;
     std::vector<double> sumUpnl;
-    leveldb::Iterator* it = NewIterator();
-
-    for(it->SeekToFirst(); it->Valid(); it->Next())
-    {
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
-        std::vector<std::string> vecValues;
 
-        boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vecValues.size() != 17) {
-            // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
+    forEachIndexedReverse(TradeIndexContractPrefix(contractId), [&](const std::string& strKey, const std::string& strValue) -> bool {
+        CMPContractMatchRecord record;
+        if (!DecodeRecord(strValue, record)) {
+            // PrintToLog("TRADEDB error - unexpected record (%s)\n", HexStr(strKey));
+            return true;
         }
 
-        const std::string& address1 = vecValues[0];
-        const std::string& address2 = vecValues[1];
+        const std::string& address1 = record.addressMaker;
+        const std::string& address2 = record.addressTaker;
 
         bool first = (address1 != address);
         bool second = (address2 != address);
 
         if(first && second){
-            continue;
+            return true;
         }
 
         count++;
 
         if(msc_debug_get_upn_info) PrintToLog("%s(): searching for address: %s\n",__func__, address);
 
-        const std::string& status1  = vecValues[7];
-        const std::string& status2  = vecValues[8];
+        const std::string& status1  = record.statusMaker;
+        const std::string& status2  = record.statusTaker;
 
         PrintToLog("%s(): status1: %s, status2: %s\n",__func__, status1, status2);
 
@@ -7185,17 +7470,16 @@ void CMPTradeList::getUpnInfo(const std::string& address, uint32_t contractId, U
         if (msc_debug_get_upn_info)
         {
             PrintToLog("%s(): first: %d\n",__func__, (first) ? 1 : 0);
-            PrintToLog("%s(): strValue: %s\n",__func__, strValue);
             PrintToLog("%s(): position bool: %d\n",__func__, args.second);
             PrintToLog("%s(): address matched: %d\n",__func__, args.first);
         }
 
-        const uint64_t price = boost::lexical_cast<uint64_t>(vecValues[2]);
-        const uint64_t amount = boost::lexical_cast<uint64_t>(vecValues[14]);
-        const uint64_t blockNum = boost::lexical_cast<uint64_t>(vecValues[6]);
+        const uint64_t price = record.effectivePrice;
+        const uint64_t amount = record.amountTraded;
+        const uint64_t blockNum = record.nBlockTaker;
 
         // partial upnl
-        calculateUPNL(sumUpnl, price, amount, exitPrice, args.second, sp.inverse_quoted);
+        calculateUPNL(sumUpnl, price, amount, exitPrice, args.second, sp->inverse_quoted);
 
         if(showVerbose)
         {
@@ -7206,9 +7490,9 @@ void CMPTradeList::getUpnInfo(const std::string& address, uint32_t contractId, U
             registerObj.push_back(Pair("block", blockNum));
             response.push_back(registerObj);
         }
-    }
 
-    delete it;
+        return true;
+    });
 
     const int64_t totalUpnl = accumulate(sumUpnl.begin(), sumUpnl.end(), 0.0) * COIN;
     UniValue upnlObj(UniValue::VOBJ);
@@ -7222,6 +7506,7 @@ void mastercore::createChannel(const std::string& sender, const std::string& rec
     Channel chn(receiver, sender, CHANNEL_PENDING, block);
     chn.setBalance(sender, propertyId, amount_commited);
     channels_Map[receiver] = chn;
+    NotifyStateSectionChanged(FILETYPE_ACTIVE_CHANNELS);
     if(msc_create_channel) PrintToLog("%s(): checking channel elements : channel address: %s, first address: %d, second address: %d\n",__func__, chn.getMultisig(), chn.getFirst(), chn.getSecond());
 
     t_tradelistdb->recordNewChannel(chn.getMultisig(), chn.getFirst(), chn.getSecond(), tx_id);
@@ -7236,7 +7521,7 @@ bool CMPTradeList::setChannelClosed(const std::string& channelAddr)
     if (!pdb) return false;
     std::vector<std::string> vstr;
     std::string newValue, strValue;
-    Status status = pdb->Get(readoptions, channelAddr, &strValue);
+    Status status = Get(channelAddr, &strValue);
 
     if(!status.ok()){
         PrintToLog("%s(): db error - channel not found\n", __func__);
@@ -7256,7 +7541,7 @@ bool CMPTradeList::setChannelClosed(const std::string& channelAddr)
 
     newValue = strprintf("%s:%s:%s:%s",frAddr, secAddr, CLOSED_CHANNEL, TYPE_CREATE_CHANNEL);
 
-    Status status1 = pdb->Put(writeoptions, channelAddr, newValue);
+    Status status1 = Put(channelAddr, newValue);
     ++nWritten;
 
     return (status.ok() && status1.ok());
@@ -7276,12 +7561,13 @@ bool CMPTradeList::tryAddSecond(const std::string& candidate, const std::string&
     if(chn.getSecond() == CHANNEL_PENDING && chn.getFirst() != candidate)
     {
         chn.setSecond(candidate);
+        NotifyStateSectionChanged(FILETYPE_ACTIVE_CHANNELS);
 
         // updating db register
         if (!pdb) return false;
         std::vector<std::string> vstr;
         std::string strValue, newValue;
-        status = pdb->Get(readoptions, channelAddr, &strValue);
+        status = Get(channelAddr, &strValue);
 
         if(!status.ok()){
             if(msc_debug_try_add_second) PrintToLog("%s(): db error - channel not found\n", __func__);
@@ -7303,7 +7589,7 @@ bool CMPTradeList::tryAddSecond(const std::string& candidate, const std::string&
 
         newValue = strprintf("%s:%s:%s:%s",frAddr, candidate, ACTIVE_CHANNEL, TYPE_CREATE_CHANNEL);
 
-        status1 = pdb->Put(writeoptions, channelAddr, newValue);
+        status1 = Put(channelAddr, newValue);
         ++nWritten;
 
     }
@@ -7373,7 +7659,10 @@ int64_t mastercore::increaseLTCVolume(uint32_t propertyId, uint32_t propertyDesi
         total = ConvertTo64(aTotal);
 
         // increment cumulative LTC volume by tokens traded * the 12-block VWAP
-        if (total > 0) MapLTCVolume[aBlock][propertyDesired] += total;
+        if (total > 0) {
+            MapLTCVolume.Add(aBlock, propertyDesired, total);
+            NotifyStateSectionChanged(FILE_TYPE_LTC_VOLUME);
+        }
 
     }
 
@@ -7394,6 +7683,7 @@ bool mastercore::Token_LTC_Fees(int64_t& buyer_amountGot, uint32_t propertyId)
     if(cacheFee > 0)
     {
          cachefees[propertyId] += cacheFee;
+         NotifyStateSectionChanged(FILETYPE_CACHEFEES);
          return true;
     }
 
@@ -1,10 +1,15 @@
 #ifndef TRADELAYER_TL_H
 #define TRADELAYER_TL_H
 
+#include <tradelayer/dbrecords.h>
+#include <tradelayer/identity.h>
 #include <tradelayer/log.h>
 #include <tradelayer/persistence.h>
 #include <tradelayer/tally.h>
+#include <tradelayer/tradeedges.h>
+#include <tradelayer/tradejournal.h>
 #include <tradelayer/tradelayer_matrices.h>
+#include <tradelayer/volume.h>
 
 #include <arith_uint256.h>
 #include <chain.h>
@@ -18,6 +23,7 @@
 #include <leveldb/status.h>
 #include <openssl/sha.h>
 
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -38,7 +44,7 @@ const int MAX_STATE_HISTORY = 50;
 #define MAX_PROPERTY_N (0x80000003UL)
 
 // increment this value to force a refresh of the state (similar to --startclean)
-const int DB_VERSION = 1;
+const int DB_VERSION = 2;
 
 // could probably also use: int64_t maxInt64 = std::numeric_limits<int64_t>::max();
 // maximum numeric values from the spec:
@@ -58,6 +64,7 @@ const uint16_t  MP_TX_PKT_V1 = 1;
 // Alls
 const int ALL_PROPERTY_MSC         = 3;
 const int MIN_PAYLOAD_SIZE         = 5;
+const unsigned int MAX_PAYLOAD_SIZE = 65535;
 const int MAX_CLASS_D_SEARCH_BYTES = 200;
 
 #define COIN256   10000000000000000
@@ -181,6 +188,12 @@ enum FILETYPES {
   NUM_FILETYPES
 };
 
+//! Sections of the binary state without a text state file, numbered after the FILETYPES
+enum StateSections {
+  STATE_SECTION_TRADE_EDGES = NUM_FILETYPES,
+  NUM_STATE_SECTIONS
+};
+
 const int PKT_RETURNED_OBJECT    =  1000;
 const int PKT_ERROR              = -9000;
 // Smart Properties
@@ -426,7 +439,7 @@ public:
     int setDBVersion();
 
     bool exists(const uint256 &txid);
-    bool getTX(const uint256 &txid, string &value);
+    bool getTX(const uint256 &txid, mastercore::CMPTxRecord &record);
 
     std::set<int> GetSeedBlocks(int startHeight, int endHeight);
     void LoadAlerts(int blockHeight);
@@ -455,14 +468,39 @@ public:
 };
 
 /** LevelDB based storage for the trade history. Trades are listed with key "txid1+txid2".
+ *
+ * Trades, instant trades and contract matches are additionally indexed by
+ * address, property pair and contract. The index entries are written in the
+ * same batch as the trade itself, and are keyed with a leading type byte, so
+ * they never collide with the trade records.
  */
 class CMPTradeList : public CDBBase
 {
+ private:
+  /** Writes a record together with its secondary index entries. */
+  leveldb::Status putIndexed(const std::string& key, const std::string& value);
+  /** Builds the secondary indexes, if the database was created without them. */
+  void buildIndexes();
+  /** Visits the records referenced by index entries with the given prefix, newest first, until fn returns false. */
+  void forEachIndexedReverse(const std::string& prefix, std::function<bool(const std::string& key, const std::string& value)> fn);
+
+  /** Registrations and attestations of the database, kept in sync with every write of them. */
+  mutable CCriticalSection cs_identities;
+  mastercore::CMPIdentityRegistry identities;
+  /** Rebuilds the identity registry from the database. */
+  void loadIdentities();
+  /** Adds a record to the identity registry, if it is a registration or attestation. */
+  bool applyIdentityRecord(const std::string& key, const std::string& value);
+
  public:
   CMPTradeList(const fs::path& path, bool fWipe)
     {
       leveldb::Status status = Open(path, fWipe);
       if (msc_debug_persistence) PrintToLog("Loading trades database: %s\n", status.ToString());
+      if (status.ok()) {
+          buildIndexes();
+          loadIdentities();
+      }
     }
 
   virtual ~CMPTradeList()
@@ -505,6 +543,11 @@ class CMPTradeList : public CDBBase
   bool kycPropertyMatch(uint32_t propertyId, int kyc_id);
   bool kycLoop(UniValue& response);
   bool attLoop(UniValue& response);
+  /** Deletes the registrations and attestations of blocks after the given one. */
+  int rollBackIdentities(int blockNum);
+
+  /** Extends clearing of CDBBase. */
+  void Clear();
 
   int deleteAboveBlock(int blockNum);
   bool exists(const uint256 &txid);
@@ -581,7 +624,10 @@ extern std::map<uint32_t, std::map<uint32_t, std::vector<int64_t>>> numVWAPVecto
 extern std::map<uint32_t, std::map<uint32_t, std::vector<int64_t>>> denVWAPVector;
 
 extern std::vector<std::map<std::string, std::string>> path_ele;
-extern std::vector<std::map<std::string, std::string>> path_elef;
+//! Matched contract trades of the unsettled periods
+extern mastercore::CMPTradeEdgeStore tradeEdges;
+//! Journal of the matched contract trades
+extern mastercore::CMPTradeJournal tradeJournal;
 
 int64_t getMPbalance(const std::string& address, uint32_t propertyId, TallyType ttype);
 int64_t getUserAvailableMPbalance(const std::string& address, uint32_t propertyId);
@@ -592,7 +638,6 @@ void CheckWalletUpdate(bool forceUpdate = false);
 void NotifyTotalTokensChanged(uint32_t propertyId);
 void buildingEdge(std::map<std::string, std::string> &edgeEle, std::string addrs_src, std::string addrs_trk, std::string status_src, std::string status_trk, int64_t lives_src, int64_t lives_trk, int64_t amount_path, int64_t matched_price, int idx_q, int ghost_edge);
 void printing_edges_database(std::map<std::string, std::string> &path_ele);
-const string gettingLineOut(std::string address1, std::string s_status1, int64_t lives_maker, std::string address2, std::string s_status2, int64_t lives_taker, int64_t nCouldBuy, uint64_t effective_price);
 void loopForUPNL(std::vector<std::map<std::string, std::string>> path_ele, std::vector<std::map<std::string, std::string>> path_eleh, unsigned int path_length, std::string address1, std::string address2, std::string status1, std::string status2, double &UPNL1, double &UPNL2, uint64_t exit_price, int64_t nCouldBuy0);
 void loopforEntryPrice(std::vector<std::map<std::string, std::string>> path_ele, std::vector<std::map<std::string, std::string>> path_eleh, std::string addrs_upnl, std::string status_match, double &entry_price, int &idx_price, uint64_t entry_price_num, unsigned int limSup, double exit_priceh, uint64_t &amount, std::string &status);
 bool callingPerpetualSettlement(double globalPNLALL_DUSD, int64_t globalVolumeALL_DUSD, int64_t volumeToCompare);
@@ -624,11 +669,7 @@ namespace mastercore
   extern CtlTransactionDB *p_TradeTXDB;
   extern CMPTradeList *t_tradelistdb;
 
-  // TODO: move, rename
-  extern CCoinsView viewDummy;
-  extern CCoinsViewCache view;
-
-  //! Guards coins view cache
+  //! Guards the input cache
   extern CCriticalSection cs_tx_cache;
 
   std::string strMPProperty(uint32_t propertyId);
@@ -648,6 +689,12 @@ namespace mastercore
 
   int64_t getTotalTokens(uint32_t propertyId, int64_t* n_owners_total = nullptr);
 
+  /** Returns the running totals of a property over all tallies. */
+  CMPTallyTotals getTallyTotals(uint32_t propertyId);
+
+  /** Discards the running totals, e.g. after the tally map was cleared. */
+  void InvalidateTallyTotals();
+
   std::string strTransactionType(uint16_t txType);
 
   /** Returns the encoding class, used to embed a payload. */
@@ -718,7 +765,7 @@ namespace mastercore
 
   int64_t getVWap(uint32_t propertyId, int aBlock, const std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>>& aMap);
 
-  void iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const std::map<int, std::map<uint32_t,int64_t>>& aMap);
+  void iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const CMPVolumeHistory& volumes);
 
   bool Token_LTC_Fees(int64_t& buyer_amountGot, uint32_t propertyId);
 
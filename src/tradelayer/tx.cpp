@@ -50,7 +50,7 @@ std::map<std::string,uint32_t> peggedIssuers;
 std::map<uint32_t,std::map<int,oracledata>> oraclePrices;
 
 /** Pending withdrawals **/
-std::map<std::string,vector<withdrawalAccepted>> withdrawal_Map;
+mastercore::CMPWithdrawalSchedule withdrawalSchedule;
 mutex mReward;
 using mastercore::StrToInt64;
 
@@ -151,10 +151,21 @@ std::vector<uint8_t> CMPTransaction::GetNextVarIntBytes(int &i) {
 /** Checks whether a pointer to the payload is past it's last position. */
 bool CMPTransaction::isOverrun(const char* p)
 {
-    ptrdiff_t pos = (char*) p - (char*) &pkt;
+    ptrdiff_t pos = p - (const char*) pkt.data();
     return (pos > pkt_size);
 }
 
+/** Reads the null-terminated string at the position of the payload, and moves past it. */
+PayloadString CMPTransaction::GetNextString(const char*& p) const
+{
+    // the padding after the payload ends every string
+    const size_t nLength = strlen(p);
+    const PayloadString str(p - (const char*) pkt.data(), std::min<size_t>(nLength, SP_STRING_FIELD_LEN - 1));
+    p += nLength + 1;
+
+    return str;
+}
+
 // -------------------- PACKET PARSING -----------------------
 
 /** Parses the packet or payload. */
@@ -407,11 +418,10 @@ bool CMPTransaction::interpret_CreatePropertyFixed()
     std::vector<uint8_t> vecPropTypeBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecPrevPropIdBytes = GetNextVarIntBytes(i);
 
-    const char* p = i + (char*) &pkt;
-    std::vector<std::string> spstr;
+    const char* p = i + (const char*) pkt.data();
+    PayloadString spstr[3];
     for (int j = 0; j < 3; j++) {
-        spstr.push_back(std::string(p));
-        p += spstr.back().size() + 1;
+        spstr[j] = GetNextString(p);
     }
 
     if (isOverrun(p)) {
@@ -420,10 +430,10 @@ bool CMPTransaction::interpret_CreatePropertyFixed()
     }
 
     int j = 0;
-    memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
-    memcpy(url, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(url)-1)); j++;
-    memcpy(data, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(data)-1)); j++;
-    i = i + strlen(name) + strlen(url) + strlen(data) + 3; // data sizes + 3 null terminators
+    name = spstr[j]; j++;
+    url = spstr[j]; j++;
+    data = spstr[j]; j++;
+    i = i + name.length + url.length + data.length + 3; // data sizes + 3 null terminators
 
     std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
 
@@ -454,9 +464,9 @@ bool CMPTransaction::interpret_CreatePropertyFixed()
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
         PrintToLog("\t   property type: %d (%s)\n", prop_type, strPropertyType(prop_type));
         PrintToLog("\tprev property id: %d\n", prev_prop_id);
-        PrintToLog("\t            name: %s\n", name);
-        PrintToLog("\t             url: %s\n", url);
-        PrintToLog("\t            data: %s\n", data);
+        PrintToLog("\t            name: %s\n", getString(name));
+        PrintToLog("\t             url: %s\n", getString(url));
+        PrintToLog("\t            data: %s\n", getString(data));
         PrintToLog("\t           value: %s\n", FormatByType(nValue, prop_type));
     }
 
@@ -473,11 +483,10 @@ bool CMPTransaction::interpret_CreatePropertyManaged()
     std::vector<uint8_t> vecPropTypeBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecPrevPropIdBytes = GetNextVarIntBytes(i);
 
-    const char* p = i + (char*) &pkt;
-    std::vector<std::string> spstr;
+    const char* p = i + (const char*) pkt.data();
+    PayloadString spstr[3];
     for (int j = 0; j < 3; j++) {
-        spstr.push_back(std::string(p));
-        p += spstr.back().size() + 1;
+        spstr[j] = GetNextString(p);
     }
 
     if (isOverrun(p)) {
@@ -486,10 +495,10 @@ bool CMPTransaction::interpret_CreatePropertyManaged()
     }
 
     int j = 0;
-    memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
-    memcpy(url, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(url)-1)); j++;
-    memcpy(data, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(data)-1)); j++;
-    i = i + strlen(name) + strlen(url) + strlen(data) + 3; // data sizes + 3 null terminators
+    name = spstr[j]; j++;
+    url = spstr[j]; j++;
+    data = spstr[j]; j++;
+    i = i + name.length + url.length + data.length + 3; // data sizes + 3 null terminators
 
     do
     {
@@ -513,9 +522,9 @@ bool CMPTransaction::interpret_CreatePropertyManaged()
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
         PrintToLog("\t   property type: %d (%s)\n", prop_type, strPropertyType(prop_type));
         PrintToLog("\tprev property id: %d\n", prev_prop_id);
-        PrintToLog("\t            name: %s\n", name);
-        PrintToLog("\t             url: %s\n", url);
-        PrintToLog("\t            data: %s\n", data);
+        PrintToLog("\t            name: %s\n", getString(name));
+        PrintToLog("\t             url: %s\n", getString(url));
+        PrintToLog("\t            data: %s\n", getString(data));
     }
 
     return true;
@@ -657,9 +666,9 @@ bool CMPTransaction::interpret_Alert()
     std::vector<uint8_t> vecAlertTypeBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecAlertExpiryBytes = GetNextVarIntBytes(i);
 
-    const char* p = i + (char*) &pkt;
-    std::string spstr(p);
-    memcpy(alert_text, spstr.c_str(), std::min(spstr.length(), sizeof(alert_text)-1));
+    const char* p = i + (const char*) pkt.data();
+    const char* pText = p;
+    alert_text = GetNextString(pText);
 
     if (isOverrun(p)) {
         PrintToLog("%s(): rejected: malformed string value(s)\n", __func__);
@@ -677,7 +686,7 @@ bool CMPTransaction::interpret_Alert()
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
         PrintToLog("\t      alert type: %d\n", alert_type);
         PrintToLog("\t    expiry value: %d\n", alert_expiry);
-        PrintToLog("\t   alert message: %s\n", alert_text);
+        PrintToLog("\t   alert message: %s\n", getString(alert_text));
     }
 
     return true;
@@ -900,11 +909,10 @@ bool CMPTransaction::interpret_CreateContractDex()
   std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecNum = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecDen = GetNextVarIntBytes(i);
-  const char* p = i + (char*) &pkt;
-  std::vector<std::string> spstr;
+  const char* p = i + (const char*) pkt.data();
+  PayloadString spstr[1];
   for (int j = 0; j < 1; j++) {
-    spstr.push_back(std::string(p));
-    p += spstr.back().size() + 1;
+    spstr[j] = GetNextString(p);
   }
 
   if (isOverrun(p)) {
@@ -913,8 +921,8 @@ bool CMPTransaction::interpret_CreateContractDex()
   }
 
   int j = 0;
-  memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
-  i = i + strlen(name) + 1; // data sizes + 1 null terminators
+  name = spstr[j]; j++;
+  i = i + name.length + 1; // data sizes + 1 null terminators
 
   std::vector<uint8_t> vecBlocksUntilExpiration = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecNotionalSize = GetNextVarIntBytes(i);
@@ -983,7 +991,7 @@ bool CMPTransaction::interpret_CreateContractDex()
       PrintToLog("\t notional size : %d\n", notional_size);
       PrintToLog("\t collateral currency: %d\n", collateral_currency);
       PrintToLog("\t margin requirement: %d\n", margin_requirement);
-      PrintToLog("\t name: %s\n", name);
+      PrintToLog("\t name: %s\n", getString(name));
       PrintToLog("\t prop_type: %d\n", prop_type);
       PrintToLog("\t inverse quoted: %d\n", inverse_quoted);
   }
@@ -998,12 +1006,11 @@ bool CMPTransaction::interpret_ContractDexTrade()
     std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
 
-    const char* p = i + (char*) &pkt;
-    std::vector<std::string> spstr;
+    const char* p = i + (const char*) pkt.data();
+    PayloadString spstr[1];
     for (int j = 0; j < 1; j++)
     {
-        spstr.push_back(std::string(p));
-        p += spstr.back().size() + 1;
+        spstr[j] = GetNextString(p);
     }
 
     if (isOverrun(p))
@@ -1013,8 +1020,8 @@ bool CMPTransaction::interpret_ContractDexTrade()
     }
 
     int j = 0;
-    memcpy(name_traded, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name_traded)-1)); j++;
-    i = i + strlen(name_traded) + 1;
+    name_traded = spstr[j]; j++;
+    i = i + name_traded.length + 1;
 
     std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecEffectivePriceBytes = GetNextVarIntBytes(i);
@@ -1049,7 +1056,7 @@ bool CMPTransaction::interpret_ContractDexTrade()
     {
         PrintToLog("\t leverage: %d\n", leverage);
         PrintToLog("\t messageType: %d\n",type);
-        PrintToLog("\t contractName: %s\n", name_traded);
+        PrintToLog("\t contractName: %s\n", getString(name_traded));
         PrintToLog("\t amount of contracts : %d\n", amount);
         PrintToLog("\t effective price : %d\n", effective_price);
         PrintToLog("\t trading action : %d\n", trading_action);
@@ -1065,12 +1072,11 @@ bool CMPTransaction::interpret_ContractDExCancel()
     std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
 
-    const char* p = i + (char*) &pkt;
-    std::vector<std::string> spstr;
+    const char* p = i + (const char*) pkt.data();
+    PayloadString spstr[1];
     for (int j = 0; j < 1; j++)
     {
-        spstr.push_back(std::string(p));
-        p += spstr.back().size() + 1;
+        spstr[j] = GetNextString(p);
     }
 
     if (isOverrun(p))
@@ -1080,8 +1086,8 @@ bool CMPTransaction::interpret_ContractDExCancel()
     }
 
     int j = 0;
-    memcpy(hash, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(hash)-1)); j++;
-    i = i + strlen(hash) + 1;
+    hash = spstr[j]; j++;
+    i = i + hash.length + 1;
 
 
     if (!vecTypeBytes.empty()) {
@@ -1097,7 +1103,7 @@ bool CMPTransaction::interpret_ContractDExCancel()
     {
         PrintToLog("\t version: %d\n", version);
         PrintToLog("\t messageType: %d\n",type);
-        PrintToLog("\t hash: %s\n", hash);
+        PrintToLog("\t hash: %s\n", getString(hash));
     }
 
     return true;
@@ -1209,12 +1215,11 @@ bool CMPTransaction::interpret_MetaDExCancel()
     std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
 
-    const char* p = i + (char*) &pkt;
-    std::vector<std::string> spstr;
+    const char* p = i + (const char*) pkt.data();
+    PayloadString spstr[1];
     for (int j = 0; j < 1; j++)
     {
-        spstr.push_back(std::string(p));
-        p += spstr.back().size() + 1;
+        spstr[j] = GetNextString(p);
     }
 
     if (isOverrun(p))
@@ -1224,8 +1229,8 @@ bool CMPTransaction::interpret_MetaDExCancel()
     }
 
     int j = 0;
-    memcpy(hash, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(hash)-1)); j++;
-    i = i + strlen(hash) + 1;
+    hash = spstr[j]; j++;
+    i = i + hash.length + 1;
 
 
     if (!vecTypeBytes.empty()) {
@@ -1241,7 +1246,7 @@ bool CMPTransaction::interpret_MetaDExCancel()
     {
         PrintToLog("\t version: %d\n", version);
         PrintToLog("\t messageType: %d\n",type);
-        PrintToLog("\t hash: %s\n", hash);
+        PrintToLog("\t hash: %s\n", getString(hash));
     }
 
     return true;
@@ -1341,10 +1346,9 @@ bool CMPTransaction::interpret_CreatePeggedCurrency()
     std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecPropTypeBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecPrevPropIdBytes = GetNextVarIntBytes(i);
-    const char* p = i + (char*) &pkt;
-    std::vector<std::string> spstr;
-    spstr.push_back(std::string(p));
-    p += spstr.back().size() + 1;
+    const char* p = i + (const char*) pkt.data();
+    PayloadString spstr[1];
+    spstr[0] = GetNextString(p);
 
     if (isOverrun(p)) {
         PrintToLog("%s(): rejected: malformed string value(s)\n", __func__);
@@ -1353,8 +1357,8 @@ bool CMPTransaction::interpret_CreatePeggedCurrency()
 
     int j = 0;
 
-    memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
-    i = i + strlen(name) + 1; // data sizes + 3 null terminators
+    name = spstr[j]; j++;
+    i = i + name.length + 1; // data sizes + 3 null terminators
     std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecContractIdBytes = GetNextVarIntBytes(i);
     std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
@@ -1394,7 +1398,7 @@ bool CMPTransaction::interpret_CreatePeggedCurrency()
         PrintToLog("\t contractId: %d\n", contractId);
         PrintToLog("\t propertyId: %d\n", propertyId);
         PrintToLog("\t amount of pegged currency : %d\n", amount);
-        PrintToLog("\t name : %s\n", name);
+        PrintToLog("\t name : %s\n", getString(name));
     }
 
     return true;
@@ -1485,10 +1489,9 @@ bool CMPTransaction::interpret_CreateOracleContract()
 
   std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  const char* p = i + (char*) &pkt;
-  std::vector<std::string> spstr;
-  spstr.push_back(std::string(p));
-  p += spstr.back().size() + 1;
+  const char* p = i + (const char*) pkt.data();
+  PayloadString spstr[1];
+  spstr[0] = GetNextString(p);
 
   if (isOverrun(p)) {
     PrintToLog("%s(): rejected: malformed string value(s)\n", __func__);
@@ -1496,8 +1499,8 @@ bool CMPTransaction::interpret_CreateOracleContract()
   }
 
   int j = 0;
-  memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
-  i = i + strlen(name) + 1; // data sizes + 2 null terminators
+  name = spstr[j]; j++;
+  i = i + name.length + 1; // data sizes + 2 null terminators
 
   std::vector<uint8_t> vecBlocksUntilExpiration = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecNotionalSize = GetNextVarIntBytes(i);
@@ -1561,7 +1564,7 @@ bool CMPTransaction::interpret_CreateOracleContract()
       PrintToLog("\t notional size : %d\n", notional_size);
       PrintToLog("\t collateral currency: %d\n", collateral_currency);
       PrintToLog("\t margin requirement: %d\n", margin_requirement);
-      PrintToLog("\t name: %s\n", name);
+      PrintToLog("\t name: %s\n", getString(name));
       PrintToLog("\t oracleAddress: %s\n", sender);
       PrintToLog("\t backupAddress: %s\n", receiver);
       PrintToLog("\t prop_type: %d\n", prop_type);
@@ -2007,11 +2010,10 @@ bool CMPTransaction::interpret_New_Id_Registration()
   std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
 
-  const char* p = i + (char*) &pkt;
-  std::vector<std::string> spstr;
+  const char* p = i + (const char*) pkt.data();
+  PayloadString spstr[2];
   for (int j = 0; j < 2; j++) {
-    spstr.push_back(std::string(p));
-    p += spstr.back().size() + 1;
+    spstr[j] = GetNextString(p);
   }
 
   if (isOverrun(p)) {
@@ -2020,16 +2022,16 @@ bool CMPTransaction::interpret_New_Id_Registration()
   }
 
   int j = 0;
-  memcpy(website, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(website)-1)); j++;
-  memcpy(company_name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(company_name)-1)); j++;
-  i = i + strlen(website) + strlen(company_name) + 2;
+  website = spstr[j]; j++;
+  company_name = spstr[j]; j++;
+  i = i + website.length + company_name.length + 2;
 
 
   if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly)
   {
       PrintToLog("\t address: %s\n", sender);
-      PrintToLog("\t website: %s\n", website);
-      PrintToLog("\t company name: %s\n", company_name);
+      PrintToLog("\t website: %s\n", getString(website));
+      PrintToLog("\t company name: %s\n", getString(company_name));
 
   }
 
@@ -2075,10 +2077,9 @@ bool CMPTransaction::interpret_Attestation()
   std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
   std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
 
-  const char* p = i + (char*) &pkt;
-  std::vector<std::string> spstr;
-  spstr.push_back(std::string(p));
-  p += spstr.back().size() + 1;
+  const char* p = i + (const char*) pkt.data();
+  PayloadString spstr[1];
+  spstr[0] = GetNextString(p);
 
   if (isOverrun(p)) {
     PrintToLog("%s(): rejected: malformed string value(s)\n", __func__);
@@ -2086,12 +2087,12 @@ bool CMPTransaction::interpret_Attestation()
   }
 
   int j = 0;
-  memcpy(hash, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(hash)-1)); j++;
-  i = i + strlen(hash) + 1;
+  hash = spstr[j]; j++;
+  i = i + hash.length + 1;
 
   if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly)
   {
-      PrintToLog("%s(): hash: %s\n",__func__, hash);
+      PrintToLog("%s(): hash: %s\n",__func__, getString(hash));
       PrintToLog("\t sender: %s\n", sender);
       PrintToLog("\t receiver: %s\n", receiver);
   }
@@ -2109,7 +2110,7 @@ bool CMPTransaction::interpret_Revoke_Attestation()
 
   if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly)
   {
-      PrintToLog("%s(): hash: %s\n",__func__, hash);
+      PrintToLog("%s(): hash: %s\n",__func__, getString(hash));
       PrintToLog("\t sender: %s\n", sender);
       PrintToLog("\t receiver: %s\n", receiver);
   }
@@ -2449,6 +2450,7 @@ int CMPTransaction::logicMath_SendVestingTokens()
   assert(update_tally_map(receiver, ALL, nValue, UNVESTED));
 
   vestingAddresses.push_back(receiver);
+  NotifyStateSectionChanged(FILE_TYPE_VESTING_ADDRESSES);
 
   return 0;
 }
@@ -2483,10 +2485,15 @@ int CMPTransaction::logicMath_SendAll()
         return (PKT_ERROR_SEND_ALL -54);
     }
 
-    uint32_t propertyId = ptally->init();
     int numberOfPropertiesSent = 0;
 
-    while (0 != (propertyId = ptally->next())) {
+    // balances are moved while iterating, so the properties are collected first
+    std::vector<uint32_t> properties;
+    for (const CMPTally::BalanceRecord& record : *ptally) {
+        properties.push_back(record.propertyId);
+    }
+
+    for (uint32_t propertyId : properties) {
 
         int64_t moneyAvailable = ptally->getMoney(propertyId, BALANCE);
         if (moneyAvailable > 0 && !isPropertyContract(propertyId) && propertyId != TL_PROPERTY_VESTING) {
@@ -2569,7 +2576,7 @@ int CMPTransaction::logicMath_CreatePropertyFixed()
         return (PKT_ERROR_SP -36);
     }
 
-    if ('\0' == name[0]) {
+    if (name.empty()) {
         PrintToLog("%s(): rejected: property name must not be empty\n", __func__);
         return (PKT_ERROR_SP -37);
     }
@@ -2581,11 +2588,11 @@ int CMPTransaction::logicMath_CreatePropertyFixed()
     newSP.txid = txid;
     newSP.prop_type = prop_type;
     newSP.num_tokens = nValue;
-    newSP.category.assign(category);
-    newSP.subcategory.assign(subcategory);
-    newSP.name.assign(name);
-    newSP.url.assign(url);
-    newSP.data.assign(data);
+    newSP.category.assign(getString(category));
+    newSP.subcategory.assign(getString(subcategory));
+    newSP.name.assign(getString(name));
+    newSP.url.assign(getString(url));
+    newSP.data.assign(getString(data));
     newSP.fixed = true;
     newSP.creation_block = blockHash;
     newSP.update_block = newSP.creation_block;
@@ -2633,7 +2640,7 @@ int CMPTransaction::logicMath_CreatePropertyManaged()
         return (PKT_ERROR_SP -36);
     }
 
-    if ('\0' == name[0]) {
+    if (name.empty()) {
         PrintToLog("%s(): rejected: property name must not be empty\n", __func__);
         return (PKT_ERROR_SP -37);
     }
@@ -2644,11 +2651,11 @@ int CMPTransaction::logicMath_CreatePropertyManaged()
     newSP.issuer = sender;
     newSP.txid = txid;
     newSP.prop_type = prop_type;
-    newSP.category.assign(category);
-    newSP.subcategory.assign(subcategory);
-    newSP.name.assign(name);
-    newSP.url.assign(url);
-    newSP.data.assign(data);
+    newSP.category.assign(getString(category));
+    newSP.subcategory.assign(getString(subcategory));
+    newSP.name.assign(getString(name));
+    newSP.url.assign(getString(url));
+    newSP.data.assign(getString(data));
     newSP.fixed = false;
     newSP.manual = true;
     newSP.creation_block = blockHash;
@@ -3012,11 +3019,11 @@ int CMPTransaction::logicMath_Alert()
     if (alert_type == 65535) { // set alert type to FFFF to clear previously sent alerts
         DeleteAlerts(sender);
     } else {
-        AddAlert(sender, alert_type, alert_expiry, alert_text);
+        AddAlert(sender, alert_type, alert_expiry, getString(alert_text));
     }
 
     // we have a new alert, fire a notify event if needed
-    DoWarning(alert_text);
+    DoWarning(getString(alert_text));
 
     return 0;
 }
@@ -3146,7 +3153,7 @@ int CMPTransaction::logicMath_CreateContractDex()
       return (PKT_ERROR_SP -22);
   }
 
-  if ('\0' == name[0]) {
+  if (name.empty()) {
     PrintToLog("%s(): rejected: property name must not be empty\n", __func__);
     return (PKT_ERROR_SP -37);
   }
@@ -3157,8 +3164,8 @@ int CMPTransaction::logicMath_CreateContractDex()
   newSP.txid = txid;
   newSP.issuer = sender;
   newSP.prop_type = prop_type;
-  newSP.subcategory.assign(subcategory);
-  newSP.name.assign(name);
+  newSP.subcategory.assign(getString(subcategory));
+  newSP.name.assign(getString(name));
   newSP.fixed = false;
   newSP.manual = true;
   newSP.creation_block = blockHash;
@@ -3185,7 +3192,7 @@ int CMPTransaction::logicMath_CreateContractDex()
 
 int CMPTransaction::logicMath_ContractDexTrade()
 {
-  struct FutureContractObject *pfuture = getFutureContractObject(name_traded);
+  struct FutureContractObject *pfuture = getFutureContractObject(getString(name_traded));
   uint32_t contractId = (pfuture) ? pfuture->fco_propertyId : 0;
   uint32_t expiration = (pfuture) ? pfuture->fco_blocks_until_expiration : 0;
 
@@ -3273,7 +3280,7 @@ int CMPTransaction::logicMath_ContractDExCancel()
     return (PKT_ERROR_SP -22);
   }
 
-  return (ContractDex_CANCEL(sender,hash));
+  return (ContractDex_CANCEL(sender, getString(hash)));
 }
 
 /** Tx 32 */
@@ -3346,7 +3353,7 @@ int CMPTransaction::logicMath_MetaDExCancel()
      return (PKT_ERROR_SP -22);
     }
 
-    return (MetaDEx_CANCEL(txid, sender, block, hash));
+    return (MetaDEx_CANCEL(txid, sender, block, getString(hash)));
 }
 
 
@@ -3459,7 +3466,7 @@ int CMPTransaction::logicMath_CreatePeggedCurrency()
         return (PKT_ERROR_SP -36);
     }
 
-    if ('\0' == name[0]) {
+    if (name.empty()) {
         PrintToLog("%s(): rejected: property name must not be empty\n", __func__);
         return (PKT_ERROR_SP -37);
     }
@@ -3534,8 +3541,8 @@ int CMPTransaction::logicMath_CreatePeggedCurrency()
         newSP.issuer = sender;
         newSP.txid = txid;
         newSP.prop_type = prop_type;
-        newSP.subcategory.assign(subcategory);
-        newSP.name.assign(name);
+        newSP.subcategory.assign(getString(subcategory));
+        newSP.name.assign(getString(name));
         newSP.fixed = true;
         newSP.manual = true;
         newSP.creation_block = blockHash;
@@ -3948,7 +3955,7 @@ int CMPTransaction::logicMath_CreateOracleContract()
     }
 
 
-    if ('\0' == name[0])
+    if (name.empty())
     {
         PrintToLog("%s(): rejected: property name must not be empty\n", __func__);
         return (PKT_ERROR_SP -37);
@@ -3960,8 +3967,8 @@ int CMPTransaction::logicMath_CreateOracleContract()
     newSP.txid = txid;
     newSP.issuer = sender;
     newSP.prop_type = prop_type;
-    newSP.subcategory.assign(subcategory);
-    newSP.name.assign(name);
+    newSP.subcategory.assign(getString(subcategory));
+    newSP.name.assign(getString(name));
     newSP.fixed = false;
     newSP.manual = true;
     newSP.creation_block = blockHash;
@@ -4272,19 +4279,8 @@ int CMPTransaction::logicMath_Withdrawal_FromChannel()
 
     if (msc_debug_withdrawal_from_channel) PrintToLog("checking wthd element : address: %s, deadline: %d, propertyId: %d, amount: %d \n", wthd.address, wthd.deadline_block, wthd.propertyId, wthd.amount);
 
-    auto p = withdrawal_Map.find(receiver);
-
-    // channel found !
-    if(p != withdrawal_Map.end())
-    {
-        vector<withdrawalAccepted>& whAc = p->second;
-        whAc.push_back(wthd);
-
-    } else {
-        vector<withdrawalAccepted> whAcc;
-        whAcc.push_back(wthd);
-        withdrawal_Map.insert(std::make_pair(receiver,whAcc));
-    }
+    withdrawalSchedule.Add(receiver, wthd);
+    NotifyStateSectionChanged(FILETYPE_WITHDRAWALS);
 
 
     t_tradelistdb->recordNewWithdrawal(txid, receiver, sender, propertyId, amount_to_withdraw, block, tx_idx);
@@ -4689,7 +4685,7 @@ int CMPTransaction::logicMath_New_Id_Registration()
   // ---------------------------------------
   if (msc_debug_new_id_registration) PrintToLog("%s(): channelAddres in register: %s \n",__func__,receiver);
 
-  t_tradelistdb->recordNewIdRegister(txid, sender, company_name, website, block, tx_idx);
+  t_tradelistdb->recordNewIdRegister(txid, sender, getString(company_name), getString(website), block, tx_idx);
 
   return 0;
 }
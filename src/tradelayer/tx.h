@@ -7,15 +7,33 @@ class CTransaction;
 class CMPContractDex;
 
 #include <tradelayer/tradelayer.h>
+#include <tradelayer/withdrawals.h>
 
+#include <prevector.h>
 #include <uint256.h>
 #include <util/strencodings.h>
 
 #include <stdint.h>
+#include <string.h>
 #include <string>
 
 using mastercore::strTransactionType;
 
+//! Zero bytes kept after the payload, given parsing may read a few bytes past its end
+const unsigned int PAYLOAD_PADDING = 64;
+
+/** A string within the payload, which is only decoded when requested. */
+struct PayloadString
+{
+    uint32_t offset;
+    uint32_t length;
+
+    PayloadString() : offset(0), length(0) {}
+    PayloadString(uint32_t offsetIn, uint32_t lengthIn) : offset(offsetIn), length(lengthIn) {}
+
+    bool empty() const { return length == 0; }
+};
+
 /** The class is responsible for transaction interpreting/parsing.
  *
  * It invokes other classes and methods: offers, accepts, tallies (balances).
@@ -35,7 +53,8 @@ private:
     uint64_t tx_fee_paid;
 
     int pkt_size;
-    unsigned char pkt[65535];
+    //! Payload, followed by PAYLOAD_PADDING zero bytes; only large payloads are stored on the heap
+    prevector<MAX_CLASS_D_SEARCH_BYTES + PAYLOAD_PADDING, unsigned char> pkt;
     int encodingClass;  // No Marker = 0, Class A = 1, Class B = 2, Class C = 3
 
     std::string sender;
@@ -61,15 +80,15 @@ private:
     // CreatePropertyFixed, CreatePropertyMananged
     unsigned short prop_type;
     unsigned int prev_prop_id;
-    char category[SP_STRING_FIELD_LEN];
-    char subcategory[SP_STRING_FIELD_LEN];
+    PayloadString category;
+    PayloadString subcategory;
     /* New things for contracts */
-    char stxid[SP_STRING_FIELD_LEN];
-    char name_traded[SP_STRING_FIELD_LEN];
+    PayloadString stxid;
+    PayloadString name_traded;
     //////////////////////////////////
-    char name[SP_STRING_FIELD_LEN];
-    char url[SP_STRING_FIELD_LEN];
-    char data[SP_STRING_FIELD_LEN];
+    PayloadString name;
+    PayloadString url;
+    PayloadString data;
 
     uint64_t deadline;
     unsigned char early_bird;
@@ -113,7 +132,7 @@ private:
     // Alert
     uint16_t alert_type;
     uint32_t alert_expiry;
-    char alert_text[SP_STRING_FIELD_LEN];
+    PayloadString alert_text;
 
     // Activation
     uint16_t feature_id;
@@ -127,7 +146,7 @@ private:
     unsigned char subaction;
 
     //Multisig channels
-    char channel_address[SP_STRING_FIELD_LEN];
+    PayloadString channel_address;
     uint64_t amount_commited;
     uint64_t amount_to_withdraw;
     uint64_t pnl_amount;
@@ -141,9 +160,9 @@ private:
 
 
     //KYC
-    char company_name[SP_STRING_FIELD_LEN];
-    char website[SP_STRING_FIELD_LEN];
-    char hash[SP_STRING_FIELD_LEN];
+    PayloadString company_name;
+    PayloadString website;
+    PayloadString hash;
     int block_forexpiry;
     uint8_t tokens, ltc, natives, oracles;
     std::vector<int64_t> kyc_Ids; //kyc vector
@@ -155,6 +174,15 @@ private:
     /** Checks whether a pointer to the payload is past it's last position. */
     bool isOverrun(const char* p);
 
+    /** Reads the null-terminated string at the position of the payload, and moves past it. */
+    PayloadString GetNextString(const char*& p) const;
+
+    /** Decodes a string of the payload. */
+    std::string getString(const PayloadString& str) const
+    {
+        return std::string((const char*) pkt.data() + str.offset, str.length);
+    }
+
     /**
      * Variable Integers
      */
@@ -295,17 +323,17 @@ public:
     std::string getSender() const { return sender; }
     std::string getReceiver() const { return receiver; }
     std::string getSpecial() const { return special; }
-    std::string getPayload() const { return HexStr(pkt, pkt + pkt_size); }
+    std::string getPayload() const { return HexStr(pkt.begin(), pkt.begin() + pkt_size); }
     uint64_t getAmount() const { return nValue; }
     uint64_t getNewAmount() const { return nNewValue; }
     uint64_t getXAmount() const { return amount; }
     uint32_t getPreviousId() const { return prev_prop_id; }
-    std::string getSPCategory() const { return category; }
-    std::string getSPSubCategory() const { return subcategory; }
-    std::string getSPTxId() const { return stxid; }
-    std::string getSPName() const { return name; }
-    std::string getSPUrl() const { return url; }
-    std::string getSPData() const { return data; }
+    std::string getSPCategory() const { return getString(category); }
+    std::string getSPSubCategory() const { return getString(subcategory); }
+    std::string getSPTxId() const { return getString(stxid); }
+    std::string getSPName() const { return getString(name); }
+    std::string getSPUrl() const { return getString(url); }
+    std::string getSPData() const { return getString(data); }
     int64_t getDeadline() const { return deadline; }
     uint8_t getEarlyBirdBonus() const { return early_bird; }
     uint8_t getIssuerBonus() const { return percentage; }
@@ -313,7 +341,7 @@ public:
     int getEncodingClass() const { return encodingClass; }
     uint16_t getAlertType() const { return alert_type; }
     uint32_t getAlertExpiry() const { return alert_expiry; }
-    std::string getAlertMessage() const { return alert_text; }
+    std::string getAlertMessage() const { return getString(alert_text); }
     int getPayloadSize() const { return pkt_size; }
     uint16_t getFeatureId() const { return feature_id; }
     uint32_t getActivationBlock() const { return activation_block; }
@@ -372,7 +400,7 @@ public:
         tx_idx = 0;
         tx_fee_paid = 0;
         pkt_size = 0;
-        memset(&pkt, 0, sizeof(pkt));
+        pkt.assign(PAYLOAD_PADDING, 0);
         encodingClass = 0;
         sender.clear();
         receiver.clear();
@@ -384,23 +412,23 @@ public:
         property = 0;
         prop_type = 0;
         prev_prop_id = 0;
-        memset(&category, 0, sizeof(category));
-        memset(&subcategory, 0, sizeof(subcategory));
-        memset(&name, 0, sizeof(name));
-        memset(&url, 0, sizeof(url));
-        memset(&data, 0, sizeof(data));
-        memset(&stxid, 0, sizeof(stxid));
-	      memset(&name_traded, 0, sizeof(name_traded));
-        memset(&channel_address, 0, sizeof(channel_address));
-        memset(&website, 0, sizeof(website));
-        memset(&hash, 0, sizeof(hash));
-        memset(&company_name, 0, sizeof(company_name));
+        category = PayloadString();
+        subcategory = PayloadString();
+        name = PayloadString();
+        url = PayloadString();
+        data = PayloadString();
+        stxid = PayloadString();
+        name_traded = PayloadString();
+        channel_address = PayloadString();
+        website = PayloadString();
+        hash = PayloadString();
+        company_name = PayloadString();
         deadline = 0;
         early_bird = 0;
         percentage = 0;
         alert_type = 0;
         alert_expiry = 0;
-        memset(&alert_text, 0, sizeof(alert_text));
+        alert_text = PayloadString();
         rpcOnly = true;
         feature_id = 0;
         activation_block = 0;
@@ -465,12 +493,13 @@ public:
         txid = t;
         block = b;
         tx_idx = idx;
-        pkt_size = size < sizeof (pkt) ? size : sizeof (pkt);
+        pkt_size = size < MAX_PAYLOAD_SIZE ? size : MAX_PAYLOAD_SIZE;
         nValue = n;
         nNewValue = n;
         encodingClass = encodingClassIn;
         tx_fee_paid = txf;
-        memcpy(&pkt, p, pkt_size);
+        pkt.assign(pkt_size + PAYLOAD_PADDING, 0);
+        if (pkt_size > 0) memcpy(pkt.data(), p, pkt_size);
     }
 
     /** Parses the packet or payload. */
@@ -575,22 +604,11 @@ struct oracledata
 };
 
 
-struct withdrawalAccepted
-{
-  std::string address;
-  int deadline_block;
-  uint32_t propertyId;
-  uint64_t amount;
-  uint256 txid;
-
-  withdrawalAccepted() : address(""), deadline_block(0), propertyId(0), amount(0) {}
-};
-
 //! Prices for each oracle contract
 extern std::map<uint32_t,std::map<int,oracledata>> oraclePrices;
 
-//! Pending withdrawals
-extern std::map<std::string,vector<withdrawalAccepted>> withdrawal_Map;
+//! Pending withdrawals of channels
+extern mastercore::CMPWithdrawalSchedule withdrawalSchedule;
 
 struct FutureContractObject *getFutureContractObject(std::string identifier);
 struct TokenDataByName *getTokenDataByName(std::string identifier);
@@ -0,0 +1,116 @@
+#include <tradelayer/volume.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <utility>
+
+using namespace mastercore;
+
+CMPVolumeHistory::CMPVolumeHistory() : nCheckpoint(-1)
+{
+}
+
+uint64_t CMPVolumeHistory::SumUpTo(const Sums& propertySums, int block)
+{
+    Sums::const_iterator it = propertySums.upper_bound(block);
+    if (it == propertySums.begin()) return 0;
+
+    return (--it)->second;
+}
+
+void CMPVolumeHistory::Add(int block, uint32_t propertyId, int64_t amount)
+{
+    Sums& propertySums = sums[propertyId];
+
+    Sums::iterator it = propertySums.lower_bound(block);
+    if (it == propertySums.end() || it->first != block) {
+        it = propertySums.insert(it, std::make_pair(block, SumUpTo(propertySums, block - 1)));
+    }
+
+    // usually the last block, unless older blocks are updated
+    for (; it != propertySums.end(); ++it) {
+        it->second += static_cast<uint64_t>(amount);
+    }
+}
+
+void CMPVolumeHistory::Set(int block, uint32_t propertyId, int64_t amount)
+{
+    Add(block, propertyId, static_cast<int64_t>(static_cast<uint64_t>(amount) - static_cast<uint64_t>(Get(block, propertyId))));
+}
+
+int64_t CMPVolumeHistory::Get(int block, uint32_t propertyId) const
+{
+    return Sum(propertyId, block, block);
+}
+
+/**
+ * Returns the volume of a property from block fblock to sblock, inclusive.
+ *
+ * A range starting at block 0, or before, covers all blocks up to sblock.
+ */
+int64_t CMPVolumeHistory::Sum(uint32_t propertyId, int fblock, int sblock) const
+{
+    std::map<uint32_t, Sums>::const_iterator it = sums.find(propertyId);
+    if (it == sums.end() || sblock < fblock) return 0;
+
+    const uint64_t nUpper = SumUpTo(it->second, sblock);
+    const uint64_t nLower = (fblock > 0) ? SumUpTo(it->second, fblock - 1) : 0;
+
+    return static_cast<int64_t>(nUpper - nLower);
+}
+
+/**
+ * Merges the volume up to the block into one entry per property.
+ *
+ * The remaining entry is the one of the last block with trades up to the
+ * checkpoint, so ranges starting before the checkpoint may include volume,
+ * which was traded before the range.
+ */
+void CMPVolumeHistory::Compact(int block)
+{
+    if (block <= nCheckpoint) return;
+
+    for (std::map<uint32_t, Sums>::iterator it = sums.begin(); it != sums.end(); ++it) {
+        Sums& propertySums = it->second;
+        Sums::iterator itLast = propertySums.upper_bound(block);
+        if (itLast == propertySums.begin()) continue;
+
+        // keep the last entry up to the checkpoint, which holds the sum
+        --itLast;
+        propertySums.erase(propertySums.begin(), itLast);
+    }
+
+    nCheckpoint = block;
+}
+
+std::map<int, std::map<uint32_t, int64_t> > CMPVolumeHistory::GetBlocks() const
+{
+    std::map<int, std::map<uint32_t, int64_t> > blocks;
+
+    for (std::map<uint32_t, Sums>::const_iterator it = sums.begin(); it != sums.end(); ++it) {
+        uint64_t nPrevious = 0;
+        for (Sums::const_iterator itBlock = it->second.begin(); itBlock != it->second.end(); ++itBlock) {
+            blocks[itBlock->first][it->first] = static_cast<int64_t>(itBlock->second - nPrevious);
+            nPrevious = itBlock->second;
+        }
+    }
+
+    return blocks;
+}
+
+size_t CMPVolumeHistory::Size() const
+{
+    size_t nSize = 0;
+    for (std::map<uint32_t, Sums>::const_iterator it = sums.begin(); it != sums.end(); ++it) {
+        nSize += it->second.size();
+    }
+    return nSize;
+}
+
+void CMPVolumeHistory::Clear()
+{
+    sums.clear();
+    nCheckpoint = -1;
+}
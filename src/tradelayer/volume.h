@@ -0,0 +1,71 @@
+#ifndef TRADELAYER_VOLUME_H
+#define TRADELAYER_VOLUME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+
+namespace mastercore
+{
+/** Traded volume of properties by block.
+ *
+ * For each property the cumulative volume up to each block with trades is
+ * kept, so the volume of any range of blocks is the difference of two
+ * lookups. The sums are kept modulo 2^64, which still yields the exact volume
+ * of every range, whose volume fits into 64 bits.
+ *
+ * Older blocks can be compacted into a checkpoint: for each property only one
+ * entry remains, which carries the whole volume up to the checkpoint. Ranges
+ * starting after the checkpoint are not affected.
+ */
+class CMPVolumeHistory
+{
+private:
+    typedef std::map<int, uint64_t> Sums;
+
+    //! Cumulative volume by property and block
+    std::map<uint32_t, Sums> sums;
+    //! Last compacted block
+    int nCheckpoint;
+
+    /** Returns the cumulative volume up to and including the block. */
+    static uint64_t SumUpTo(const Sums& propertySums, int block);
+
+public:
+    CMPVolumeHistory();
+
+    /** Adds traded volume of a property in a block. */
+    void Add(int block, uint32_t propertyId, int64_t amount);
+
+    /** Sets the traded volume of a property in a block. */
+    void Set(int block, uint32_t propertyId, int64_t amount);
+
+    /** Returns the volume of a property in a block. */
+    int64_t Get(int block, uint32_t propertyId) const;
+
+    /** Returns the volume of a property from block fblock to sblock, inclusive. */
+    int64_t Sum(uint32_t propertyId, int fblock, int sblock) const;
+
+    /** Merges the volume up to the block into one entry per property. */
+    void Compact(int block);
+
+    /** Returns the last compacted block, or -1. */
+    int GetCheckpoint() const { return nCheckpoint; }
+
+    /** Returns whether the volume of the block was merged into the checkpoint. */
+    bool IsCompacted(int block) const { return block <= nCheckpoint; }
+
+    /** Returns the volume by block and property, as stored in the state files. */
+    std::map<int, std::map<uint32_t, int64_t> > GetBlocks() const;
+
+    /** Returns the number of entries. */
+    size_t Size() const;
+
+    bool Empty() const { return sums.empty(); }
+
+    void Clear();
+};
+}
+
+#endif // TRADELAYER_VOLUME_H
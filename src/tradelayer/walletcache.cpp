@@ -105,8 +105,7 @@ int WalletCacheUpdate()
         }
 
         // obtain & init the tally
-        CMPTally& tally = my_it->second;
-        tally.init();
+        const CMPTally& tally = my_it->second;
 
         // check cache for miss on address
         std::map<std::string, CMPTally>::iterator search_it = walletBalancesCache.find(address);
@@ -119,9 +118,9 @@ int WalletCacheUpdate()
         }
 
         // check cache for miss on balance - TODO TRY AND OPTIMIZE THIS
-        CMPTally &cacheTally = search_it->second;
-        uint32_t propertyId;
-        while (0 != (propertyId = (tally.next()))) {
+        const CMPTally& cacheTally = search_it->second;
+        for (const CMPTally::BalanceRecord& record : tally) {
+            const uint32_t propertyId = record.propertyId;
             if (tally.getMoney(propertyId, BALANCE) != cacheTally.getMoney(propertyId, BALANCE) ||
                     tally.getMoney(propertyId, PENDING) != cacheTally.getMoney(propertyId, PENDING)) {
                 ++numChanges;
@@ -0,0 +1,134 @@
+#include <tradelayer/withdrawals.h>
+
+#include <uint256.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace mastercore;
+
+CMPWithdrawalSchedule::CMPWithdrawalSchedule() : nNextSequence(0), nSize(0)
+{
+}
+
+void CMPWithdrawalSchedule::Add(const std::string& channelAddr, const withdrawalAccepted& w)
+{
+    const Key key(channelAddr, nNextSequence++);
+
+    channels[channelAddr].insert(std::make_pair(key.second, w));
+    deadlines[w.deadline_block].insert(key);
+    txids.insert(std::make_pair(w.txid, key));
+    ++nSize;
+    ++stats.nScheduled;
+}
+
+void CMPWithdrawalSchedule::Unlink(const Key& key, const withdrawalAccepted& w)
+{
+    std::pair<std::multimap<uint256, Key>::iterator, std::multimap<uint256, Key>::iterator> range = txids.equal_range(w.txid);
+    for (std::multimap<uint256, Key>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == key) {
+            txids.erase(it);
+            break;
+        }
+    }
+    --nSize;
+}
+
+std::vector<std::pair<std::string, withdrawalAccepted>> CMPWithdrawalSchedule::PopDue(int block)
+{
+    std::vector<std::pair<std::string, withdrawalAccepted>> due;
+
+    std::map<int, std::set<Key>>::iterator itEnd = deadlines.upper_bound(block);
+    if (itEnd == deadlines.begin()) {
+        stats.nLastMatured = 0;
+        return due;
+    }
+
+    // merge the buckets, which restores the order by channel and sequence
+    std::set<Key> keys;
+    for (std::map<int, std::set<Key>>::iterator it = deadlines.begin(); it != itEnd; ++it) {
+        keys.insert(it->second.begin(), it->second.end());
+    }
+    deadlines.erase(deadlines.begin(), itEnd);
+
+    due.reserve(keys.size());
+    for (const Key& key : keys) {
+        std::map<std::string, std::map<uint64_t, withdrawalAccepted>>::iterator itChannel = channels.find(key.first);
+        std::map<uint64_t, withdrawalAccepted>::iterator it = itChannel->second.find(key.second);
+        Unlink(key, it->second);
+        due.push_back(std::make_pair(key.first, it->second));
+        itChannel->second.erase(it);
+        if (itChannel->second.empty()) channels.erase(itChannel);
+    }
+
+    stats.nMatured += due.size();
+    stats.nLastMatured = due.size();
+
+    return due;
+}
+
+bool CMPWithdrawalSchedule::Contains(const std::string& txid, const std::string& channelAddr) const
+{
+    std::pair<std::multimap<uint256, Key>::const_iterator, std::multimap<uint256, Key>::const_iterator> range = txids.equal_range(uint256S(txid));
+    for (std::multimap<uint256, Key>::const_iterator it = range.first; it != range.second; ++it) {
+        if (it->second.first == channelAddr && it->first.ToString() == txid) return true;
+    }
+
+    return false;
+}
+
+bool CMPWithdrawalSchedule::HasPending(const std::string& channelAddr) const
+{
+    return channels.count(channelAddr) > 0;
+}
+
+void CMPWithdrawalSchedule::EraseChannel(const std::string& channelAddr)
+{
+    std::map<std::string, std::map<uint64_t, withdrawalAccepted>>::iterator itChannel = channels.find(channelAddr);
+    if (itChannel == channels.end()) return;
+
+    for (const auto& entry : itChannel->second) {
+        const Key key(channelAddr, entry.first);
+        std::map<int, std::set<Key>>::iterator itDeadline = deadlines.find(entry.second.deadline_block);
+        if (itDeadline != deadlines.end()) {
+            itDeadline->second.erase(key);
+            if (itDeadline->second.empty()) deadlines.erase(itDeadline);
+        }
+        Unlink(key, entry.second);
+    }
+
+    channels.erase(itChannel);
+}
+
+void CMPWithdrawalSchedule::ForEach(std::function<void(const std::string&, const withdrawalAccepted&)> fn) const
+{
+    for (const auto& channel : channels) {
+        for (const auto& entry : channel.second) {
+            fn(channel.first, entry.second);
+        }
+    }
+}
+
+void CMPWithdrawalSchedule::Clear()
+{
+    channels.clear();
+    deadlines.clear();
+    txids.clear();
+    nNextSequence = 0;
+    nSize = 0;
+}
+
+CWithdrawalStats CMPWithdrawalSchedule::GetStats() const
+{
+    CWithdrawalStats result = stats;
+    result.nPending = nSize;
+    result.nDeadlines = deadlines.size();
+    return result;
+}
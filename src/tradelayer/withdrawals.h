@@ -0,0 +1,100 @@
+#ifndef TRADELAYER_WITHDRAWALS_H
+#define TRADELAYER_WITHDRAWALS_H
+
+#include <uint256.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct withdrawalAccepted
+{
+  std::string address;
+  int deadline_block;
+  uint32_t propertyId;
+  uint64_t amount;
+  uint256 txid;
+
+  withdrawalAccepted() : address(""), deadline_block(0), propertyId(0), amount(0) {}
+};
+
+namespace mastercore
+{
+/** Usage statistics of the withdrawal schedule. */
+struct CWithdrawalStats
+{
+    //! Withdrawals waiting for their deadline
+    size_t nPending;
+    //! Distinct deadline blocks of the pending withdrawals
+    size_t nDeadlines;
+    //! Withdrawals scheduled in total
+    uint64_t nScheduled;
+    //! Withdrawals, which reached their deadline
+    uint64_t nMatured;
+    //! Withdrawals, which reached their deadline with the last block
+    uint64_t nLastMatured;
+
+    CWithdrawalStats() : nPending(0), nDeadlines(0), nScheduled(0), nMatured(0), nLastMatured(0) {}
+};
+
+/** Pending withdrawals of multisig channels, ordered by deadline.
+ *
+ * Withdrawals are bucketed by their deadline block, so the withdrawals due in
+ * a block are found without visiting the ones that are not. Withdrawals due
+ * at the same time are returned by channel, and in the order they were
+ * scheduled within a channel.
+ */
+class CMPWithdrawalSchedule
+{
+public:
+    //! Channel address and sequence number of a withdrawal
+    typedef std::pair<std::string, uint64_t> Key;
+
+private:
+    //! Withdrawals by channel, in the order they were scheduled
+    std::map<std::string, std::map<uint64_t, withdrawalAccepted>> channels;
+    //! Withdrawals by deadline block
+    std::map<int, std::set<Key>> deadlines;
+    //! Withdrawals by transaction
+    std::multimap<uint256, Key> txids;
+    uint64_t nNextSequence;
+    size_t nSize;
+    CWithdrawalStats stats;
+
+    void Unlink(const Key& key, const withdrawalAccepted& w);
+
+public:
+    CMPWithdrawalSchedule();
+
+    /** Schedules a withdrawal of a channel. */
+    void Add(const std::string& channelAddr, const withdrawalAccepted& w);
+
+    /** Removes and returns all withdrawals with a deadline up to the given block. */
+    std::vector<std::pair<std::string, withdrawalAccepted>> PopDue(int block);
+
+    /** Checks whether a withdrawal of a channel is still pending. */
+    bool Contains(const std::string& txid, const std::string& channelAddr) const;
+    /** Checks whether a channel has any pending withdrawals. */
+    bool HasPending(const std::string& channelAddr) const;
+    /** Removes all pending withdrawals of a channel. */
+    void EraseChannel(const std::string& channelAddr);
+
+    /** Visits all pending withdrawals by channel, in the order they were scheduled. */
+    void ForEach(std::function<void(const std::string&, const withdrawalAccepted&)> fn) const;
+
+    size_t Size() const { return nSize; }
+    bool Empty() const { return nSize == 0; }
+    void Clear();
+
+    CWithdrawalStats GetStats() const;
+};
+
+} // namespace mastercore
+
+#endif // TRADELAYER_WITHDRAWALS_H